@@ -0,0 +1,2433 @@
+#include <MailCore/MailCore.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <regex.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <libetpan/libetpan.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#ifndef MAILCORE_EVENT_LOOP
+#include <glib.h>
+#endif
+
+using namespace mailcore;
+
+// Declared in MCLibetpan.h, which is not a public header.
+namespace mailcore {
+    time_t mkgmtime(struct tm * tmp);
+    time_t timestampFromIMAPDate(struct mailimap_date_time * date_time);
+    void timestampsFromIMAPDates(struct mailimap_date_time * dates, unsigned int count, time_t * timestamps);
+}
+
+// Declared in MCIMAPIdleMultiplexer.h, which is not a public header.
+namespace mailcore {
+    unsigned int idleMultiplexerWatchesCount(void);
+}
+
+static double currentTime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.;
+}
+
+static void printResult(const char * name, unsigned int iterations, double duration)
+{
+    printf("%s: %u iterations in %.3fs, %.0f/s\n", name, iterations, duration, (double) iterations / duration);
+}
+
+#pragma mark retain/release
+
+// Reference counting as it was done before, with a lock per object.
+class LockedRefCount {
+public:
+    LockedRefCount()
+    {
+        pthread_mutex_init(&mLock, NULL);
+        mCounter = 1;
+    }
+
+    ~LockedRefCount()
+    {
+        pthread_mutex_destroy(&mLock);
+    }
+
+    void retain()
+    {
+        pthread_mutex_lock(&mLock);
+        mCounter ++;
+        pthread_mutex_unlock(&mLock);
+    }
+
+    void release()
+    {
+        pthread_mutex_lock(&mLock);
+        mCounter --;
+        pthread_mutex_unlock(&mLock);
+    }
+
+private:
+    pthread_mutex_t mLock;
+    int mCounter;
+};
+
+#define RETAIN_RELEASE_ITERATIONS 2000000
+
+struct retainReleaseContext {
+    Object * object;
+    LockedRefCount * lockedObject;
+};
+
+static void * retainReleaseThread(void * data)
+{
+    struct retainReleaseContext * context = (struct retainReleaseContext *) data;
+    if (context->lockedObject != NULL) {
+        for(unsigned int i = 0 ; i < RETAIN_RELEASE_ITERATIONS ; i ++) {
+            context->lockedObject->retain();
+            context->lockedObject->release();
+        }
+    }
+    else {
+        for(unsigned int i = 0 ; i < RETAIN_RELEASE_ITERATIONS ; i ++) {
+            context->object->retain();
+            context->object->release();
+        }
+    }
+    return NULL;
+}
+
+static void runRetainRelease(const char * name, Object * object, LockedRefCount * lockedObject, unsigned int threadsCount)
+{
+    pthread_t * threads = (pthread_t *) malloc(sizeof(* threads) * threadsCount);
+    struct retainReleaseContext context;
+    context.object = object;
+    context.lockedObject = lockedObject;
+
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < threadsCount ; i ++) {
+        pthread_create(&threads[i], NULL, retainReleaseThread, &context);
+    }
+    for(unsigned int i = 0 ; i < threadsCount ; i ++) {
+        pthread_join(threads[i], NULL);
+    }
+    double duration = currentTime() - startTime;
+    free(threads);
+
+    char title[256];
+    snprintf(title, sizeof(title), "%s (%u threads)", name, threadsCount);
+    printResult(title, RETAIN_RELEASE_ITERATIONS * threadsCount, duration);
+}
+
+static void benchmarkRetainRelease(void)
+{
+    printf("benchmarkRetainRelease\n");
+    String * str = MCSTR("Message-ID");
+    Data * data = Data::dataWithBytes("Message-ID", 10);
+    unsigned int threadsCounts[] = {1, 4, 16};
+    for(unsigned int i = 0 ; i < sizeof(threadsCounts) / sizeof(threadsCounts[0]) ; i ++) {
+        LockedRefCount * lockedObject = new LockedRefCount();
+        runRetainRelease("locked refcount", NULL, lockedObject, threadsCounts[i]);
+        delete lockedObject;
+        runRetainRelease("String retain/release", str, NULL, threadsCounts[i]);
+        runRetainRelease("Data retain/release", data, NULL, threadsCounts[i]);
+    }
+}
+
+#pragma mark UTF-8 conversion
+
+#define UTF8_ITERATIONS 1000000
+
+static void benchmarkUTF8Characters(void)
+{
+    printf("benchmarkUTF8Characters\n");
+    Array * headers = Array::array();
+    headers->addObject(String::stringWithUTF8Characters("Re: [mailcore2] Crash when fetching messages with a long subject"));
+    headers->addObject(String::stringWithUTF8Characters("Hoà Dinh <dinh.viet.hoa@gmail.com>"));
+    headers->addObject(String::stringWithUTF8Characters("<CAKpo8fE7wpsrD1t9NEz+QYqqvmPM7oe3qkXvtRcJzt3mQ@mail.gmail.com>"));
+    headers->addObject(String::stringWithUTF8Characters("[Gmail]/Tous les messages"));
+
+    mc_foreacharray(String, header, headers) {
+        // Appending an empty string invalidates the cached UTF-8 representation,
+        // which gives the cost of a conversion on each call.
+        UChar empty = 0;
+        AutoreleasePool * pool = new AutoreleasePool();
+        double startTime = currentTime();
+        for(unsigned int i = 0 ; i < UTF8_ITERATIONS ; i ++) {
+            header->appendCharactersLength(&empty, 0);
+            header->UTF8Characters();
+            if ((i % 1000) == 0) {
+                pool->release();
+                pool = new AutoreleasePool();
+            }
+        }
+        double duration = currentTime() - startTime;
+        pool->release();
+        char title[256];
+        snprintf(title, sizeof(title), "UTF8Characters() uncached, %u chars", header->length());
+        printResult(title, UTF8_ITERATIONS, duration);
+
+        pool = new AutoreleasePool();
+        startTime = currentTime();
+        for(unsigned int i = 0 ; i < UTF8_ITERATIONS ; i ++) {
+            header->UTF8Characters();
+        }
+        duration = currentTime() - startTime;
+        pool->release();
+        snprintf(title, sizeof(title), "UTF8Characters() cached, %u chars", header->length());
+        printResult(title, UTF8_ITERATIONS, duration);
+    }
+}
+
+#pragma mark local servers
+
+// Minimal servers on the loopback interface. They only know enough of the protocols
+// for the sessions to log in and run the commands used by the benchmarks.
+
+struct StandIn;
+
+typedef bool (* StandInHandler)(struct StandIn * standIn, char * line, Data * response);
+
+#define STAND_IN_MAXIMUM_CONNECTION_THREADS 16
+
+struct StandIn {
+    int listenFd;
+    int port;
+    pthread_t thread;
+    const char * greeting;
+    StandInHandler handler;
+    unsigned int commandsCount;
+    unsigned int connectionsCount;
+    // When set, the connections are served in parallel, each on a thread of its own. The counters
+    // are then approximate and the handler shouldn't keep a state.
+    bool concurrent;
+    pthread_t connectionThreads[STAND_IN_MAXIMUM_CONNECTION_THREADS];
+    int connectionFds[STAND_IN_MAXIMUM_CONNECTION_THREADS];
+    unsigned int connectionThreadsCount;
+    // Emulates a link with a long round trip time, where the throughput of a connection is limited
+    // by its window: the responses are sent windowSize bytes at a time, latency microseconds apart.
+    unsigned int latency;
+    unsigned int windowSize;
+    // IMAP
+    uint32_t messagesCount;
+    // Sent for all the BODY.PEEK[...] requests.
+    Data * body;
+    // Advertises CONDSTORE and QRESYNC.
+    bool qresync;
+    // Advertises BINARY when set. Sent, as a literal8, for all the BINARY.PEEK[...] requests.
+    Data * binaryBody;
+    // SMTP
+    bool receivingData;
+    unsigned int receivedMessagesCount;
+};
+
+static void standInWrite(int fd, Data * data)
+{
+    const char * bytes = data->bytes();
+    unsigned int remaining = data->length();
+    while (remaining > 0) {
+        ssize_t r = write(fd, bytes, remaining);
+        if (r <= 0)
+            return;
+        bytes += r;
+        remaining -= (unsigned int) r;
+    }
+}
+
+static void standInAppendFormat(Data * data, const char * format, ...)
+{
+    char buffer[512];
+    va_list argp;
+    va_start(argp, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, argp);
+    va_end(argp);
+    data->appendBytes(buffer, len);
+}
+
+static void standInSend(struct StandIn * standIn, int fd, Data * data)
+{
+    if (standIn->latency == 0) {
+        standInWrite(fd, data);
+        return;
+    }
+
+    unsigned int offset = 0;
+    do {
+        usleep(standIn->latency);
+        unsigned int length = data->length() - offset;
+        if (length > standIn->windowSize) {
+            length = standIn->windowSize;
+        }
+        standInWrite(fd, Data::dataWithBytes(data->bytes() + offset, length));
+        offset += length;
+    } while (offset < data->length());
+}
+
+static void standInServe(struct StandIn * standIn, int fd)
+{
+    size_t bufferSize = 65536;
+    size_t bufferLength = 0;
+    char * buffer = (char *) malloc(bufferSize);
+    bool running = true;
+
+    standIn->connectionsCount ++;
+    standIn->receivingData = false;
+    Data * greeting = Data::dataWithBytes(standIn->greeting, (unsigned int) strlen(standIn->greeting));
+    standInSend(standIn, fd, greeting);
+    while (running) {
+        if (bufferLength == bufferSize) {
+            bufferSize *= 2;
+            buffer = (char *) realloc(buffer, bufferSize);
+        }
+        ssize_t r = read(fd, buffer + bufferLength, bufferSize - bufferLength);
+        if (r <= 0)
+            break;
+        bufferLength += r;
+
+        char * eol;
+        char * current = buffer;
+        Data * response = new Data();
+        while (running && ((eol = (char *) memchr(current, '\n', bufferLength - (current - buffer))) != NULL)) {
+            * eol = '\0';
+            if ((eol > current) && (eol[-1] == '\r')) {
+                eol[-1] = '\0';
+            }
+            running = standIn->handler(standIn, current, response);
+            current = eol + 1;
+        }
+        // Responses to pipelined commands are sent together.
+        standInSend(standIn, fd, response);
+        response->release();
+        bufferLength -= current - buffer;
+        memmove(buffer, current, bufferLength);
+    }
+    free(buffer);
+}
+
+struct StandInConnection {
+    struct StandIn * standIn;
+    unsigned int index;
+};
+
+static void * standInConnectionThread(void * data)
+{
+    struct StandInConnection * connection = (struct StandInConnection *) data;
+    struct StandIn * standIn = connection->standIn;
+    AutoreleasePool * pool = new AutoreleasePool();
+    standInServe(standIn, standIn->connectionFds[connection->index]);
+    pool->release();
+    // Unless standInStop() took it.
+    int fd = __sync_lock_test_and_set(&standIn->connectionFds[connection->index], -1);
+    if (fd != -1) {
+        close(fd);
+    }
+    free(connection);
+    return NULL;
+}
+
+static void * standInThread(void * data)
+{
+    struct StandIn * standIn = (struct StandIn *) data;
+    while (1) {
+        int fd = accept(standIn->listenFd, NULL, NULL);
+        if (fd < 0)
+            break;
+        if (standIn->concurrent && (standIn->connectionThreadsCount < STAND_IN_MAXIMUM_CONNECTION_THREADS)) {
+            struct StandInConnection * connection = (struct StandInConnection *) malloc(sizeof(* connection));
+            connection->standIn = standIn;
+            connection->index = standIn->connectionThreadsCount;
+            standIn->connectionFds[standIn->connectionThreadsCount] = fd;
+            pthread_create(&standIn->connectionThreads[standIn->connectionThreadsCount], NULL,
+                           standInConnectionThread, connection);
+            standIn->connectionThreadsCount ++;
+            continue;
+        }
+        AutoreleasePool * pool = new AutoreleasePool();
+        standInServe(standIn, fd);
+        pool->release();
+        close(fd);
+    }
+    return NULL;
+}
+
+static void standInStart(struct StandIn * standIn, const char * greeting, StandInHandler handler)
+{
+    struct sockaddr_in addr;
+    socklen_t addrLength = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    standIn->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    bind(standIn->listenFd, (struct sockaddr *) &addr, sizeof(addr));
+    listen(standIn->listenFd, 16);
+    getsockname(standIn->listenFd, (struct sockaddr *) &addr, &addrLength);
+    standIn->port = ntohs(addr.sin_port);
+    standIn->greeting = greeting;
+    standIn->handler = handler;
+    standIn->commandsCount = 0;
+    standIn->connectionsCount = 0;
+    standIn->receivingData = false;
+    standIn->receivedMessagesCount = 0;
+    standIn->body = NULL;
+    standIn->qresync = false;
+    standIn->binaryBody = NULL;
+    standIn->concurrent = false;
+    standIn->connectionThreadsCount = 0;
+    standIn->latency = 0;
+    standIn->windowSize = 0;
+    pthread_create(&standIn->thread, NULL, standInThread, standIn);
+}
+
+static void standInStop(struct StandIn * standIn)
+{
+    shutdown(standIn->listenFd, SHUT_RDWR);
+    close(standIn->listenFd);
+    pthread_join(standIn->thread, NULL);
+    for(unsigned int i = 0 ; i < standIn->connectionThreadsCount ; i ++) {
+        int fd = __sync_lock_test_and_set(&standIn->connectionFds[i], -1);
+        if (fd != -1) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        pthread_join(standIn->connectionThreads[i], NULL);
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+#pragma mark IMAP stand-in
+
+// Parses the next range of a set, "1:5,7,9:*" for example. Returns NULL at the end of the set.
+static char * imapStandInNextRange(struct StandIn * standIn, char * p, uint32_t * pFirst, uint32_t * pLast)
+{
+    if ((* p < '0') || (* p > '9'))
+        return NULL;
+
+    uint32_t first = (uint32_t) strtoul(p, &p, 10);
+    uint32_t last = first;
+    if (* p == ':') {
+        p ++;
+        if (* p == '*') {
+            last = standIn->messagesCount;
+            p ++;
+        }
+        else {
+            last = (uint32_t) strtoul(p, &p, 10);
+        }
+    }
+    if (* p == ',') {
+        p ++;
+    }
+    * pFirst = first;
+    * pLast = last < standIn->messagesCount ? last : standIn->messagesCount;
+    return p;
+}
+
+// Appends a FETCH response for each message of the set.
+static void imapStandInFetch(struct StandIn * standIn, char * set, Data * response)
+{
+    uint32_t first;
+    uint32_t last;
+    char * p = set;
+    while ((p = imapStandInNextRange(standIn, p, &first, &last)) != NULL) {
+        for(uint32_t uid = first ; uid <= last ; uid ++) {
+            standInAppendFormat(response, "* %u FETCH (UID %u FLAGS (\\Seen) RFC822.SIZE 2048)\r\n", uid, uid);
+        }
+    }
+}
+
+#define IMAP_STAND_IN_MOD_SEQUENCE_VALUE 1000
+#define IMAP_STAND_IN_VANISHED_COUNT 50
+#define IMAP_STAND_IN_CHANGES_INTERVAL 100
+
+// Changes since any mod-sequence value: the first messages were expunged and the flags
+// of one message every IMAP_STAND_IN_CHANGES_INTERVAL were modified.
+static void imapStandInChanges(struct StandIn * standIn, Data * response)
+{
+    standInAppendFormat(response, "* VANISHED (EARLIER) 1:%u\r\n", IMAP_STAND_IN_VANISHED_COUNT);
+    for(uint32_t uid = IMAP_STAND_IN_CHANGES_INTERVAL ; uid <= standIn->messagesCount ; uid += IMAP_STAND_IN_CHANGES_INTERVAL) {
+        standInAppendFormat(response, "* %u FETCH (UID %u FLAGS (\\Seen \\Flagged) MODSEQ (%u))\r\n",
+                            uid - IMAP_STAND_IN_VANISHED_COUNT, uid, IMAP_STAND_IN_MOD_SEQUENCE_VALUE);
+    }
+}
+
+static const char * imapStandInCapabilities(struct StandIn * standIn)
+{
+    if (standIn->binaryBody != NULL)
+        return "IMAP4rev1 BINARY";
+    return standIn->qresync ? "IMAP4rev1 ENABLE CONDSTORE QRESYNC" : "IMAP4rev1";
+}
+
+static bool imapStandInHandleCommand(struct StandIn * standIn, char * line, Data * response)
+{
+    char * command = strchr(line, ' ');
+    if (command == NULL)
+        return false;
+    * command = '\0';
+    command ++;
+    const char * tag = line;
+
+    standIn->commandsCount ++;
+    if (strncasecmp(command, "CAPABILITY", 10) == 0) {
+        standInAppendFormat(response, "* CAPABILITY %s\r\n%s OK done\r\n", imapStandInCapabilities(standIn), tag);
+    }
+    else if (strncasecmp(command, "LOGIN", 5) == 0) {
+        standInAppendFormat(response, "%s OK [CAPABILITY %s] logged in\r\n", tag, imapStandInCapabilities(standIn));
+    }
+    else if ((strncasecmp(command, "ENABLE ", 7) == 0) && standIn->qresync) {
+        standInAppendFormat(response, "* ENABLED %s\r\n%s OK done\r\n", command + 7, tag);
+    }
+    else if (strncasecmp(command, "SELECT", 6) == 0) {
+        standInAppendFormat(response, "* FLAGS (\\Seen)\r\n* %u EXISTS\r\n* 0 RECENT\r\n"
+                            "* OK [UIDVALIDITY 1] ok\r\n* OK [UIDNEXT %u] ok\r\n",
+                            standIn->messagesCount, standIn->messagesCount + 1);
+        if (standIn->qresync) {
+            standInAppendFormat(response, "* OK [HIGHESTMODSEQ %u] ok\r\n", IMAP_STAND_IN_MOD_SEQUENCE_VALUE);
+            if (strstr(command, "(QRESYNC (1 ") != NULL) {
+                imapStandInChanges(standIn, response);
+            }
+        }
+        standInAppendFormat(response, "%s OK [READ-WRITE] done\r\n", tag);
+    }
+    else if ((strncasecmp(command, "UID FETCH ", 10) == 0) && standIn->qresync &&
+             (strstr(command, "CHANGEDSINCE") != NULL)) {
+        imapStandInChanges(standIn, response);
+        standInAppendFormat(response, "%s OK done\r\n", tag);
+    }
+    else if ((strncasecmp(command, "UID FETCH ", 10) == 0) && (standIn->binaryBody != NULL) &&
+             (strstr(command, "BINARY.PEEK[") != NULL)) {
+        char * section = strstr(command, "BINARY.PEEK[") + 12;
+        * strchr(section, ']') = '\0';
+        unsigned int uid = (unsigned int) strtoul(command + 10, NULL, 10);
+        standInAppendFormat(response, "* 1 FETCH (UID %u BINARY[%s] ~{%u}\r\n", uid, section, standIn->binaryBody->length());
+        response->appendData(standIn->binaryBody);
+        standInAppendFormat(response, ")\r\n%s OK done\r\n", tag);
+    }
+    else if ((strncasecmp(command, "UID FETCH ", 10) == 0) && (standIn->body != NULL) &&
+             (strstr(command, "BODY.PEEK[") != NULL)) {
+        char * section = strstr(command, "BODY.PEEK[") + 10;
+        char * sectionEnd = strchr(section, ']');
+        * sectionEnd = '\0';
+        if (sectionEnd[1] == '<') {
+            // Partial fetch: <offset.length>.
+            unsigned int uid = (unsigned int) strtoul(command + 10, NULL, 10);
+            char * p = sectionEnd + 2;
+            unsigned int offset = (unsigned int) strtoul(p, &p, 10);
+            unsigned int length = (unsigned int) strtoul(p + 1, NULL, 10);
+            if (offset > standIn->body->length()) {
+                offset = standIn->body->length();
+            }
+            if (length > standIn->body->length() - offset) {
+                length = standIn->body->length() - offset;
+            }
+            standInAppendFormat(response, "* 1 FETCH (UID %u BODY[%s]<%u> {%u}\r\n", uid, section, offset, length);
+            response->appendBytes(standIn->body->bytes() + offset, length);
+            standInAppendFormat(response, ")\r\n");
+        }
+        else {
+            // The same body for all the messages of the set.
+            uint32_t first;
+            uint32_t last;
+            char * p = command + 10;
+            while ((p = imapStandInNextRange(standIn, p, &first, &last)) != NULL) {
+                for(uint32_t uid = first ; uid <= last ; uid ++) {
+                    standInAppendFormat(response, "* %u FETCH (UID %u BODY[%s] {%u}\r\n", uid, uid, section, standIn->body->length());
+                    response->appendData(standIn->body);
+                    standInAppendFormat(response, ")\r\n");
+                }
+            }
+        }
+        standInAppendFormat(response, "%s OK done\r\n", tag);
+    }
+    else if (strncasecmp(command, "UID FETCH ", 10) == 0) {
+        imapStandInFetch(standIn, command + 10, response);
+        standInAppendFormat(response, "%s OK done\r\n", tag);
+    }
+    else if (strncasecmp(command, "LOGOUT", 6) == 0) {
+        standInAppendFormat(response, "* BYE\r\n%s OK done\r\n", tag);
+        return false;
+    }
+    else {
+        standInAppendFormat(response, "%s OK done\r\n", tag);
+    }
+    return true;
+}
+
+static void imapStandInStart(struct StandIn * standIn, uint32_t messagesCount)
+{
+    standIn->messagesCount = messagesCount;
+    standInStart(standIn, "* OK [CAPABILITY IMAP4rev1] ready\r\n", imapStandInHandleCommand);
+}
+
+static IMAPSession * imapStandInSession(struct StandIn * standIn)
+{
+    IMAPSession * session = new IMAPSession();
+    session->setHostname(MCSTR("127.0.0.1"));
+    session->setPort(standIn->port);
+    session->setUsername(MCSTR("user"));
+    session->setPassword(MCSTR("password"));
+    session->setConnectionType(ConnectionTypeClear);
+    session->setCheckCertificateEnabled(false);
+    return (IMAPSession *) session->autorelease();
+}
+
+#pragma mark SMTP sink
+
+// Accepts all the messages and drops them.
+static bool smtpSinkHandleCommand(struct StandIn * standIn, char * line, Data * response)
+{
+    if (standIn->receivingData) {
+        if (strcmp(line, ".") == 0) {
+            standIn->receivingData = false;
+            standIn->receivedMessagesCount ++;
+            standInAppendFormat(response, "250 2.0.0 queued\r\n");
+        }
+        return true;
+    }
+
+    standIn->commandsCount ++;
+    if ((strncasecmp(line, "EHLO", 4) == 0) || (strncasecmp(line, "HELO", 4) == 0)) {
+        standInAppendFormat(response, "250-localhost\r\n250-PIPELINING\r\n250-8BITMIME\r\n250 SIZE 10240000\r\n");
+    }
+    else if (strncasecmp(line, "DATA", 4) == 0) {
+        standIn->receivingData = true;
+        standInAppendFormat(response, "354 go ahead\r\n");
+    }
+    else if (strncasecmp(line, "QUIT", 4) == 0) {
+        standInAppendFormat(response, "221 2.0.0 bye\r\n");
+        return false;
+    }
+    else {
+        standInAppendFormat(response, "250 2.0.0 ok\r\n");
+    }
+    return true;
+}
+
+static void smtpSinkStart(struct StandIn * standIn)
+{
+    standInStart(standIn, "220 localhost ESMTP sink\r\n", smtpSinkHandleCommand);
+}
+
+static SMTPSession * smtpSinkSession(struct StandIn * standIn)
+{
+    SMTPSession * session = new SMTPSession();
+    session->setHostname(MCSTR("127.0.0.1"));
+    session->setPort(standIn->port);
+    session->setConnectionType(ConnectionTypeClear);
+    session->setCheckCertificateEnabled(false);
+    return (SMTPSession *) session->autorelease();
+}
+
+#pragma mark chunked UID FETCH
+
+#define CHUNKED_FETCH_MESSAGES_COUNT 200000
+
+static void benchmarkChunkedFetch(void)
+{
+    printf("benchmarkChunkedFetch\n");
+    struct StandIn standIn;
+    imapStandInStart(&standIn, CHUNKED_FETCH_MESSAGES_COUNT);
+
+    // Sparse set: every other message, which gives a very long command line.
+    IndexSet * uids = IndexSet::indexSet();
+    for(uint32_t uid = 1 ; uid <= CHUNKED_FETCH_MESSAGES_COUNT ; uid += 2) {
+        uids->addIndex(uid);
+    }
+
+    unsigned int chunkSizes[] = {0, 10000, 1000, 100, 1000, 100};
+    unsigned int pipelineDepths[] = {1, 1, 1, 1, 4, 4};
+    for(unsigned int i = 0 ; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]) ; i ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        ErrorCode error;
+        IMAPSession * session = imapStandInSession(&standIn);
+        session->setFetchChunkSize(chunkSizes[i]);
+        session->setFetchPipelineDepth(pipelineDepths[i]);
+        session->loginIfNeeded(&error);
+        session->select(MCSTR("INBOX"), &error);
+        unsigned int commandsCount = standIn.commandsCount;
+
+        double startTime = currentTime();
+        Array * messages = session->fetchMessagesByUID(MCSTR("INBOX"),
+                                                       (IMAPMessagesRequestKind) (IMAPMessagesRequestKindUid | IMAPMessagesRequestKindFlags | IMAPMessagesRequestKindSize),
+                                                       uids, NULL, &error);
+        double duration = currentTime() - startTime;
+        if (error != ErrorNone) {
+            printf("fetch failed with error %i\n", error);
+        }
+
+        char title[256];
+        snprintf(title, sizeof(title), "UID FETCH, chunk size %u, pipeline depth %u, %u commands", chunkSizes[i],
+                 pipelineDepths[i], standIn.commandsCount - commandsCount);
+        printResult(title, messages != NULL ? messages->count() : 0, duration);
+        session->disconnect();
+        pool->release();
+    }
+
+    standInStop(&standIn);
+}
+
+#pragma mark large bodies
+
+#define LARGE_BODY_SIZE (16 * 1024 * 1024)
+#define LARGE_BODY_FETCHES_COUNT 5
+
+static long maximumResidentSetSize(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static Data * randomAttachment(unsigned int size)
+{
+    Data * attachment = Data::dataWithCapacity(size);
+    srandom(0);
+    for(unsigned int i = 0 ; i < size ; i ++) {
+        char ch = (char) random();
+        attachment->appendBytes(&ch, 1);
+    }
+    return attachment;
+}
+
+// Base64 encoded attachment, with line breaks.
+static Data * base64Body(Data * attachment)
+{
+    const char * encoded = attachment->base64String()->UTF8Characters();
+    size_t encodedLength = strlen(encoded);
+    Data * body = Data::dataWithCapacity((unsigned int) (encodedLength + encodedLength / 76 * 2 + 2));
+    for(size_t i = 0 ; i < encodedLength ; i += 76) {
+        body->appendBytes(encoded + i, (unsigned int) (encodedLength - i < 76 ? encodedLength - i : 76));
+        body->appendBytes("\r\n", 2);
+    }
+    return body;
+}
+
+static void benchmarkLargeBodies(void)
+{
+    printf("benchmarkLargeBodies\n");
+    AutoreleasePool * pool = new AutoreleasePool();
+
+    Data * attachment = randomAttachment(LARGE_BODY_SIZE);
+    Data * body = base64Body(attachment);
+
+    struct StandIn standIn;
+    imapStandInStart(&standIn, 1);
+    standIn.body = body;
+
+    ErrorCode error;
+    IMAPSession * session = imapStandInSession(&standIn);
+    session->loginIfNeeded(&error);
+    session->select(MCSTR("INBOX"), &error);
+
+    // The growth of the peak memory usage is only meaningful if no earlier benchmark used more.
+    long maxRSS = maximumResidentSetSize();
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < LARGE_BODY_FETCHES_COUNT ; i ++) {
+        AutoreleasePool * fetchPool = new AutoreleasePool();
+        Data * data = session->fetchMessageByUID(MCSTR("INBOX"), 1, NULL, &error);
+        if ((data == NULL) || (data->length() != body->length())) {
+            printf("fetch failed with error %i\n", error);
+        }
+        fetchPool->release();
+    }
+    double duration = currentTime() - startTime;
+    printResult("fetch message", LARGE_BODY_FETCHES_COUNT, duration);
+    printf("%.1f MB/s, peak memory grew by %ld KB\n",
+           (double) body->length() * LARGE_BODY_FETCHES_COUNT / duration / (1024 * 1024), maximumResidentSetSize() - maxRSS);
+
+    maxRSS = maximumResidentSetSize();
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < LARGE_BODY_FETCHES_COUNT ; i ++) {
+        AutoreleasePool * fetchPool = new AutoreleasePool();
+        Data * data = session->fetchMessageAttachmentByUID(MCSTR("INBOX"), 1, MCSTR("2"), EncodingBase64, NULL, &error);
+        if ((data == NULL) || !data->isEqual(attachment)) {
+            printf("fetch failed with error %i\n", error);
+        }
+        fetchPool->release();
+    }
+    duration = currentTime() - startTime;
+    printResult("fetch and decode base64 attachment", LARGE_BODY_FETCHES_COUNT, duration);
+    printf("%.1f MB/s, peak memory grew by %ld KB\n",
+           (double) body->length() * LARGE_BODY_FETCHES_COUNT / duration / (1024 * 1024), maximumResidentSetSize() - maxRSS);
+
+    session->disconnect();
+    standInStop(&standIn);
+    pool->release();
+}
+
+#pragma mark SMTP keep-alive
+
+#define SMTP_MESSAGES_COUNT 2000
+
+static void benchmarkSMTPKeepAlive(void)
+{
+    printf("benchmarkSMTPKeepAlive\n");
+    struct StandIn standIn;
+    smtpSinkStart(&standIn);
+
+    Address * from = Address::addressWithMailbox(MCSTR("notifications@example.com"));
+    Array * recipients = Array::arrayWithObject(Address::addressWithMailbox(MCSTR("user@example.com")));
+    Data * messageData = MCSTR("From: notifications@example.com\r\nTo: user@example.com\r\n"
+                               "Subject: Notification\r\n\r\nSomething happened.\r\n")->dataUsingEncoding("utf-8");
+
+    for(unsigned int keepAlive = 0 ; keepAlive < 2 ; keepAlive ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        SMTPSession * session = smtpSinkSession(&standIn);
+        session->setKeepAliveEnabled(keepAlive);
+        unsigned int connectionsCount = standIn.connectionsCount;
+
+        double startTime = currentTime();
+        for(unsigned int i = 0 ; i < SMTP_MESSAGES_COUNT ; i ++) {
+            ErrorCode error;
+            AutoreleasePool * messagePool = new AutoreleasePool();
+            session->sendMessage(from, recipients, messageData, NULL, &error);
+            messagePool->release();
+            if (error != ErrorNone) {
+                printf("send failed with error %i\n", error);
+                break;
+            }
+        }
+        double duration = currentTime() - startTime;
+        session->disconnect();
+
+        char title[256];
+        snprintf(title, sizeof(title), "sendMessage(), keep-alive %s, %u connections",
+                 keepAlive ? "enabled" : "disabled", standIn.connectionsCount - connectionsCount);
+        printResult(title, SMTP_MESSAGES_COUNT, duration);
+        pool->release();
+    }
+
+    AutoreleasePool * pool = new AutoreleasePool();
+    Array * messages = Array::array();
+    for(unsigned int i = 0 ; i < SMTP_MESSAGES_COUNT ; i ++) {
+        messages->addObject(SMTPBatchMessage::messageWithData(from, recipients, messageData));
+    }
+    SMTPSession * session = smtpSinkSession(&standIn);
+    unsigned int connectionsCount = standIn.connectionsCount;
+    ErrorCode error;
+    double startTime = currentTime();
+    session->sendMessages(messages, NULL, &error);
+    double duration = currentTime() - startTime;
+    if (error != ErrorNone) {
+        printf("batch failed with error %i\n", error);
+    }
+    char title[256];
+    snprintf(title, sizeof(title), "sendMessages(), %u connections", standIn.connectionsCount - connectionsCount);
+    printResult(title, SMTP_MESSAGES_COUNT, duration);
+    pool->release();
+
+    standInStop(&standIn);
+}
+
+#pragma mark callback latency
+
+#define CALLBACK_LATENCY_OPERATIONS_COUNT 5000
+
+// The main loop runs on a thread of its own since the benchmarks wait for the operations.
+static void * mainLoopThread(void * context)
+{
+#ifdef MAILCORE_EVENT_LOOP
+    eventLoopRun();
+#else
+    g_main_loop_run(g_main_loop_new(NULL, FALSE));
+#endif
+    return NULL;
+}
+
+static void startMainLoop(void)
+{
+    pthread_t thread;
+    pthread_create(&thread, NULL, mainLoopThread, NULL);
+    pthread_detach(thread);
+}
+
+// Runs the calls on a thread of its own, like the main loop of an application.
+class LoopThreadExecutor : public CallbackExecutor {
+public:
+    LoopThreadExecutor()
+    {
+        pthread_mutex_init(&mLock, NULL);
+        pthread_cond_init(&mCallAdded, NULL);
+        pthread_cond_init(&mCallDone, NULL);
+        mFirstCall = NULL;
+        mLastCall = NULL;
+        mStopped = false;
+        pthread_create(&mThread, NULL, run, this);
+    }
+
+    virtual ~LoopThreadExecutor()
+    {
+        pthread_mutex_lock(&mLock);
+        mStopped = true;
+        pthread_cond_signal(&mCallAdded);
+        pthread_mutex_unlock(&mLock);
+        pthread_join(mThread, NULL);
+        pthread_cond_destroy(&mCallDone);
+        pthread_cond_destroy(&mCallAdded);
+        pthread_mutex_destroy(&mLock);
+    }
+
+    virtual void performMethod(Object * object, Object::Method method, void * context, bool waitUntilDone)
+    {
+        struct call * c = (struct call *) malloc(sizeof(* c));
+        c->object = object;
+        c->method = method;
+        c->context = context;
+        c->waiting = waitUntilDone;
+        c->done = false;
+        c->next = NULL;
+
+        pthread_mutex_lock(&mLock);
+        if (mLastCall != NULL) {
+            mLastCall->next = c;
+        }
+        else {
+            mFirstCall = c;
+        }
+        mLastCall = c;
+        pthread_cond_signal(&mCallAdded);
+        if (waitUntilDone) {
+            while (!c->done) {
+                pthread_cond_wait(&mCallDone, &mLock);
+            }
+            free(c);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+private:
+    struct call {
+        Object * object;
+        Object::Method method;
+        void * context;
+        bool waiting;
+        bool done;
+        struct call * next;
+    };
+
+    pthread_t mThread;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCallAdded;
+    pthread_cond_t mCallDone;
+    struct call * mFirstCall;
+    struct call * mLastCall;
+    bool mStopped;
+
+    static void * run(void * data)
+    {
+        LoopThreadExecutor * executor = (LoopThreadExecutor *) data;
+        pthread_mutex_lock(&executor->mLock);
+        while (true) {
+            while ((executor->mFirstCall == NULL) && !executor->mStopped) {
+                pthread_cond_wait(&executor->mCallAdded, &executor->mLock);
+            }
+            if (executor->mFirstCall == NULL) {
+                break;
+            }
+            struct call * c = executor->mFirstCall;
+            executor->mFirstCall = c->next;
+            if (executor->mFirstCall == NULL) {
+                executor->mLastCall = NULL;
+            }
+            pthread_mutex_unlock(&executor->mLock);
+
+            AutoreleasePool * pool = new AutoreleasePool();
+            (c->object->*(c->method))(c->context);
+            pool->release();
+
+            pthread_mutex_lock(&executor->mLock);
+            if (c->waiting) {
+                c->done = true;
+                pthread_cond_broadcast(&executor->mCallDone);
+            }
+            else {
+                free(c);
+            }
+        }
+        pthread_mutex_unlock(&executor->mLock);
+        return NULL;
+    }
+};
+
+class LatencyOperationCallback : public OperationCallback {
+public:
+    LatencyOperationCallback()
+    {
+        pthread_mutex_init(&mLock, NULL);
+        pthread_cond_init(&mCond, NULL);
+        mFinishedCount = 0;
+    }
+
+    virtual ~LatencyOperationCallback()
+    {
+        pthread_cond_destroy(&mCond);
+        pthread_mutex_destroy(&mLock);
+    }
+
+    virtual void operationFinished(Operation * op)
+    {
+        pthread_mutex_lock(&mLock);
+        mFinishedCount ++;
+        pthread_cond_signal(&mCond);
+        pthread_mutex_unlock(&mLock);
+    }
+
+    void waitForFinishedCount(unsigned int count)
+    {
+        pthread_mutex_lock(&mLock);
+        while (mFinishedCount < count) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+private:
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    unsigned int mFinishedCount;
+};
+
+static void benchmarkCallbackLatency(void)
+{
+    printf("benchmarkCallbackLatency\n");
+    struct StandIn standIn;
+    smtpSinkStart(&standIn);
+    startMainLoop();
+
+    // Round trips of NOOP operations, one at a time: without an executor, each operation waits
+    // twice for the main loop. The inline executor doesn't wait for it.
+    CallbackExecutor * executors[] = { NULL, CallbackExecutor::inlineExecutor() };
+    const char * names[] = { "main loop", "inline" };
+    for(unsigned int i = 0 ; i < sizeof(executors) / sizeof(executors[0]) ; i ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        LatencyOperationCallback callback;
+        SMTPAsyncSession * session = new SMTPAsyncSession();
+        session->setHostname(MCSTR("127.0.0.1"));
+        session->setPort(standIn.port);
+        session->setConnectionType(ConnectionTypeClear);
+        session->setCheckCertificateEnabled(false);
+        session->setCallbackExecutor(executors[i]);
+
+        // Connects.
+        SMTPOperation * op = session->noopOperation();
+        op->setCallback(&callback);
+        op->start();
+        callback.waitForFinishedCount(1);
+
+        double startTime = currentTime();
+        for(unsigned int k = 0 ; k < CALLBACK_LATENCY_OPERATIONS_COUNT ; k ++) {
+            AutoreleasePool * opPool = new AutoreleasePool();
+            op = session->noopOperation();
+            op->setCallback(&callback);
+            op->start();
+            callback.waitForFinishedCount(k + 2);
+            opPool->release();
+        }
+        double duration = currentTime() - startTime;
+        char title[256];
+        snprintf(title, sizeof(title), "SMTP NOOP round trip, %s callbacks", names[i]);
+        printResult(title, CALLBACK_LATENCY_OPERATIONS_COUNT, duration);
+
+        session->release();
+        pool->release();
+    }
+
+    standInStop(&standIn);
+}
+
+#pragma mark parallel attachment download
+
+#define PARALLEL_FETCH_SIZE (8 * 1024 * 1024)
+#define PARALLEL_FETCH_RANGE_SIZE (512 * 1024)
+// 20ms round trip time and 256KB window, about 12MB/s per connection.
+#define PARALLEL_FETCH_LATENCY 20000
+#define PARALLEL_FETCH_WINDOW_SIZE (256 * 1024)
+
+class OperationStarter : public Object {
+public:
+    void startOperation(void * context)
+    {
+        ((Operation *) context)->start();
+    }
+};
+
+// Runs the operation twice, the first time to open the connections, and returns the duration of
+// the second one.
+static double runAttachmentFetch(IMAPOperation * (* createOperation)(IMAPAsyncSession * session, void * context), void * context,
+                                 IMAPAsyncSession * session, LoopThreadExecutor * executor, Data * attachment)
+{
+    OperationStarter * starter = new OperationStarter();
+    double duration = 0;
+    for(unsigned int i = 0 ; i < 2 ; i ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        LatencyOperationCallback callback;
+        IMAPOperation * op = createOperation(session, context);
+        op->setCallback(&callback);
+        double startTime = currentTime();
+        // The operations are started on the thread of their callbacks.
+        executor->performMethod(starter, (Object::Method) &OperationStarter::startOperation, op, true);
+        callback.waitForFinishedCount(1);
+        duration = currentTime() - startTime;
+        Data * data = NULL;
+        if (MCISKINDOFCLASS(op, IMAPParallelFetchContentOperation)) {
+            data = ((IMAPParallelFetchContentOperation *) op)->data();
+        }
+        else {
+            data = ((IMAPFetchContentOperation *) op)->data();
+        }
+        if ((op->error() != ErrorNone) || (data == NULL) || !data->isEqual(attachment)) {
+            printf("fetch failed with error %i\n", op->error());
+        }
+        pool->release();
+    }
+    starter->release();
+    return duration;
+}
+
+static IMAPOperation * createFetchOperation(IMAPAsyncSession * session, void * context)
+{
+    return session->fetchMessageAttachmentByUIDOperation(MCSTR("INBOX"), 1, MCSTR("2"), EncodingBase64);
+}
+
+struct ParallelFetchParameters {
+    uint32_t size;
+    unsigned int concurrentRanges;
+    Data * resumeData;
+};
+
+static IMAPOperation * createParallelFetchOperation(IMAPAsyncSession * session, void * context)
+{
+    struct ParallelFetchParameters * parameters = (struct ParallelFetchParameters *) context;
+    IMAPParallelFetchContentOperation * op =
+        session->parallelFetchMessageAttachmentByUIDOperation(MCSTR("INBOX"), 1, MCSTR("2"), EncodingBase64, parameters->size);
+    op->setRangeSize(PARALLEL_FETCH_RANGE_SIZE);
+    op->setMaximumConcurrentRanges(parameters->concurrentRanges);
+    op->setResumeData(parameters->resumeData);
+    return op;
+}
+
+static void benchmarkParallelFetch(void)
+{
+    printf("benchmarkParallelFetch\n");
+    AutoreleasePool * pool = new AutoreleasePool();
+
+    Data * attachment = randomAttachment(PARALLEL_FETCH_SIZE);
+    Data * body = base64Body(attachment);
+
+    struct StandIn standIn;
+    imapStandInStart(&standIn, 1);
+    standIn.body = body;
+    standIn.concurrent = true;
+    standIn.latency = PARALLEL_FETCH_LATENCY;
+    standIn.windowSize = PARALLEL_FETCH_WINDOW_SIZE;
+
+    LoopThreadExecutor executor;
+    IMAPAsyncSession * session = new IMAPAsyncSession();
+    session->setHostname(MCSTR("127.0.0.1"));
+    session->setPort(standIn.port);
+    session->setUsername(MCSTR("user"));
+    session->setPassword(MCSTR("password"));
+    session->setConnectionType(ConnectionTypeClear);
+    session->setCheckCertificateEnabled(false);
+    session->setMaximumConnections(4);
+    session->setAllowsFolderConcurrentAccessEnabled(true);
+    session->setCallbackExecutor(&executor);
+
+    double duration = runAttachmentFetch(createFetchOperation, NULL, session, &executor, attachment);
+    printResult("fetch attachment, 1 connection", 1, duration);
+    printf("%.1f MB/s\n", (double) body->length() / duration / (1024 * 1024));
+
+    unsigned int concurrentRanges[] = {1, 2, 4};
+    for(unsigned int i = 0 ; i < sizeof(concurrentRanges) / sizeof(concurrentRanges[0]) ; i ++) {
+        struct ParallelFetchParameters parameters;
+        parameters.size = body->length();
+        parameters.concurrentRanges = concurrentRanges[i];
+        parameters.resumeData = NULL;
+        duration = runAttachmentFetch(createParallelFetchOperation, &parameters, session, &executor, attachment);
+        char title[256];
+        snprintf(title, sizeof(title), "fetch attachment in %u KB ranges, %u concurrent ranges",
+                 PARALLEL_FETCH_RANGE_SIZE / 1024, concurrentRanges[i]);
+        printResult(title, 1, duration);
+        printf("%.1f MB/s\n", (double) body->length() / duration / (1024 * 1024));
+    }
+
+    // Resumes after the first half, as if the download had been interrupted.
+    struct ParallelFetchParameters parameters;
+    parameters.size = body->length();
+    parameters.concurrentRanges = 4;
+    parameters.resumeData = Data::dataWithBytes(body->bytes(), body->length() / 2);
+    duration = runAttachmentFetch(createParallelFetchOperation, &parameters, session, &executor, attachment);
+    printResult("resume attachment download from the middle, 4 concurrent ranges", 1, duration);
+
+    LatencyOperationCallback callback;
+    IMAPOperation * op = session->disconnectOperation();
+    op->setCallback(&callback);
+    op->start();
+    callback.waitForFinishedCount(1);
+    session->release();
+    standInStop(&standIn);
+    pool->release();
+}
+
+#pragma mark BINARY
+
+#define BINARY_FETCH_SIZE (8 * 1024 * 1024)
+
+static double runBinaryFetch(Data * attachment, Data * body, bool binary)
+{
+    struct StandIn standIn;
+    imapStandInStart(&standIn, 1);
+    standIn.body = body;
+    standIn.binaryBody = binary ? attachment : NULL;
+    standIn.latency = PARALLEL_FETCH_LATENCY;
+    standIn.windowSize = PARALLEL_FETCH_WINDOW_SIZE;
+
+    ErrorCode error;
+    IMAPSession * session = imapStandInSession(&standIn);
+    session->loginIfNeeded(&error);
+    session->select(MCSTR("INBOX"), &error);
+
+    double startTime = currentTime();
+    Data * data = session->fetchMessageAttachmentByUID(MCSTR("INBOX"), 1, MCSTR("2"), EncodingBase64, NULL, &error);
+    double duration = currentTime() - startTime;
+    if ((data == NULL) || !data->isEqual(attachment)) {
+        printf("fetch failed with error %i\n", error);
+    }
+
+    session->disconnect();
+    standInStop(&standIn);
+    return duration;
+}
+
+static void benchmarkBinaryFetch(void)
+{
+    printf("benchmarkBinaryFetch\n");
+    AutoreleasePool * pool = new AutoreleasePool();
+
+    Data * attachment = randomAttachment(BINARY_FETCH_SIZE);
+    Data * body = base64Body(attachment);
+
+    double duration = runBinaryFetch(attachment, body, false);
+    printResult("fetch base64 attachment and decode it", 1, duration);
+    printf("%.1f MB/s, %u bytes received\n", (double) attachment->length() / duration / (1024 * 1024), body->length());
+
+    duration = runBinaryFetch(attachment, body, true);
+    printResult("fetch attachment decoded by the server, BINARY", 1, duration);
+    printf("%.1f MB/s, %u bytes received\n", (double) attachment->length() / duration / (1024 * 1024), attachment->length());
+
+    pool->release();
+}
+
+#pragma mark batched message bodies
+
+#define BATCHED_BODIES_COUNT 500
+#define BATCHED_BODY_SIZE (16 * 1024)
+// 5ms round trip time.
+#define BATCHED_BODIES_LATENCY 5000
+#define BATCHED_BODIES_WINDOW_SIZE (1024 * 1024)
+#define BATCHED_BODIES_IN_FLIGHT_BYTES (256 * 1024)
+
+class BodiesCounter : public IMAPFetchMessagesCallback, public IMAPOperationCallback {
+public:
+    BodiesCounter()
+    {
+        mCount = 0;
+        mLength = 0;
+    }
+
+    virtual void bodyFetched(IMAPSession * session, uint32_t uid, String * partID, Data * data)
+    {
+        mCount ++;
+        mLength += data->length();
+    }
+
+    virtual void bodyFetched(IMAPOperation * session, uint32_t uid, Data * data)
+    {
+        mCount ++;
+        mLength += data->length();
+    }
+
+    unsigned int mCount;
+    unsigned long long mLength;
+};
+
+static void benchmarkBatchedBodies(void)
+{
+    printf("benchmarkBatchedBodies\n");
+    AutoreleasePool * pool = new AutoreleasePool();
+
+    Data * body = base64Body(randomAttachment(BATCHED_BODY_SIZE));
+
+    struct StandIn standIn;
+    imapStandInStart(&standIn, BATCHED_BODIES_COUNT);
+    standIn.body = body;
+    standIn.latency = BATCHED_BODIES_LATENCY;
+    standIn.windowSize = BATCHED_BODIES_WINDOW_SIZE;
+
+    ErrorCode error;
+    IMAPSession * session = imapStandInSession(&standIn);
+    session->loginIfNeeded(&error);
+    session->select(MCSTR("INBOX"), &error);
+
+    double startTime = currentTime();
+    for(uint32_t uid = 1 ; uid <= BATCHED_BODIES_COUNT ; uid ++) {
+        AutoreleasePool * fetchPool = new AutoreleasePool();
+        Data * data = session->fetchMessageByUID(MCSTR("INBOX"), uid, NULL, &error);
+        if ((data == NULL) || (data->length() != body->length())) {
+            printf("fetch failed with error %i\n", error);
+        }
+        fetchPool->release();
+    }
+    double duration = currentTime() - startTime;
+    printResult("fetch message bodies one FETCH at a time", BATCHED_BODIES_COUNT, duration);
+
+    BodiesCounter counter;
+    startTime = currentTime();
+    session->streamMessageBodiesByUID(MCSTR("INBOX"), IndexSet::indexSetWithRange(RangeMake(1, BATCHED_BODIES_COUNT - 1)),
+                                      NULL, &counter, NULL, &error);
+    duration = currentTime() - startTime;
+    if ((error != ErrorNone) || (counter.mCount != BATCHED_BODIES_COUNT)) {
+        printf("fetch failed with error %i, %u bodies\n", error, counter.mCount);
+    }
+    printResult("fetch message bodies in batches", BATCHED_BODIES_COUNT, duration);
+    printf("%.1f MB/s\n", (double) counter.mLength / duration / (1024 * 1024));
+    session->disconnect();
+
+    // The callback thread is the loop thread: the bodies in flight are bounded while it's busy.
+    LoopThreadExecutor executor;
+    IMAPAsyncSession * asyncSession = new IMAPAsyncSession();
+    asyncSession->setHostname(MCSTR("127.0.0.1"));
+    asyncSession->setPort(standIn.port);
+    asyncSession->setUsername(MCSTR("user"));
+    asyncSession->setPassword(MCSTR("password"));
+    asyncSession->setConnectionType(ConnectionTypeClear);
+    asyncSession->setCheckCertificateEnabled(false);
+    asyncSession->setCallbackExecutor(&executor);
+
+    OperationStarter * starter = new OperationStarter();
+    for(unsigned int i = 0 ; i < 2 ; i ++) {
+        AutoreleasePool * fetchPool = new AutoreleasePool();
+        BodiesCounter asyncCounter;
+        LatencyOperationCallback callback;
+        IMAPFetchMessageBodiesOperation * op =
+            asyncSession->fetchMessageBodiesByUIDOperation(MCSTR("INBOX"), IndexSet::indexSetWithRange(RangeMake(1, BATCHED_BODIES_COUNT - 1)));
+        op->setMaximumInFlightBytes(BATCHED_BODIES_IN_FLIGHT_BYTES);
+        op->setImapCallback(&asyncCounter);
+        op->setCallback(&callback);
+        startTime = currentTime();
+        executor.performMethod(starter, (Object::Method) &OperationStarter::startOperation, op, true);
+        callback.waitForFinishedCount(1);
+        duration = currentTime() - startTime;
+        if ((op->error() != ErrorNone) || (asyncCounter.mCount != BATCHED_BODIES_COUNT)) {
+            printf("fetch failed with error %i, %u bodies\n", op->error(), asyncCounter.mCount);
+        }
+        fetchPool->release();
+    }
+    // Only the second run is measured, the first one opened the connection.
+    printResult("fetch message bodies in batches, 256 KB in flight", BATCHED_BODIES_COUNT, duration);
+    starter->release();
+
+    LatencyOperationCallback callback;
+    IMAPOperation * op = asyncSession->disconnectOperation();
+    op->setCallback(&callback);
+    op->start();
+    callback.waitForFinishedCount(1);
+    asyncSession->release();
+    standInStop(&standIn);
+    pool->release();
+}
+
+#pragma mark HashMap
+
+#define HASHMAP_SMALL_MAPS_COUNT 200000
+#define HASHMAP_LARGE_COUNT 200000
+#define HASHMAP_LOOKUPS_COUNT 2000000
+
+static void benchmarkHashMap(void)
+{
+    printf("benchmarkHashMap\n");
+
+    // Many small maps with constant keys, as built for template values or serialization.
+    AutoreleasePool * pool = new AutoreleasePool();
+    String * value = MCSTR("value");
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < HASHMAP_SMALL_MAPS_COUNT ; i ++) {
+        HashMap * map = new HashMap();
+        map->setObjectForKey(MCSTR("FROM"), value);
+        map->setObjectForKey(MCSTR("TO"), value);
+        map->setObjectForKey(MCSTR("CC"), value);
+        map->setObjectForKey(MCSTR("SUBJECT"), value);
+        map->setObjectForKey(MCSTR("DATE"), value);
+        map->setObjectForKey(MCSTR("HEADER"), value);
+        map->setObjectForKey(MCSTR("BODY"), value);
+        map->setObjectForKey(MCSTR("FILENAME"), value);
+        map->release();
+    }
+    double duration = currentTime() - startTime;
+    pool->release();
+    printResult("setObjectForKey(), small maps of 8 constant keys", HASHMAP_SMALL_MAPS_COUNT, duration);
+
+    // One large map with distinct keys.
+    pool = new AutoreleasePool();
+    Array * keys = Array::array();
+    for(unsigned int i = 0 ; i < HASHMAP_LARGE_COUNT ; i ++) {
+        keys->addObject(String::stringWithUTF8Format("X-Header-%u", i));
+    }
+    HashMap * map = new HashMap();
+    startTime = currentTime();
+    mc_foreacharray(String, key, keys) {
+        map->setObjectForKey(key, value);
+    }
+    duration = currentTime() - startTime;
+    printResult("setObjectForKey(), large map", HASHMAP_LARGE_COUNT, duration);
+
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < HASHMAP_LOOKUPS_COUNT ; i ++) {
+        map->objectForKey(keys->objectAtIndex(i % HASHMAP_LARGE_COUNT));
+    }
+    duration = currentTime() - startTime;
+    printResult("objectForKey(), large map", HASHMAP_LOOKUPS_COUNT, duration);
+
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < 100 ; i ++) {
+        map->copy()->release();
+    }
+    duration = currentTime() - startTime;
+    printResult("copy(), large map", 100, duration);
+    map->release();
+    pool->release();
+}
+
+#pragma mark hash
+
+#define HASH_ITERATIONS 2000000
+
+// Byte-at-a-time djb2 hash, as previously used by hashCompute().
+static unsigned int djb2HashCompute(const char * key, unsigned int len)
+{
+    unsigned int c = 5381;
+    for(unsigned int i = 0 ; i < len ; i ++) {
+        c = ((c << 5) + c) + (unsigned char) key[i];
+    }
+    return c;
+}
+
+static void benchmarkHashKeys(const char * name, const char ** keys, unsigned int count)
+{
+    unsigned int lengths[16];
+    for(unsigned int i = 0 ; i < count ; i ++) {
+        lengths[i] = (unsigned int) strlen(keys[i]);
+    }
+
+    // Accumulate the results so that the calls are not optimized away.
+    unsigned int sum = 0;
+    char title[256];
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < HASH_ITERATIONS ; i ++) {
+        sum += djb2HashCompute(keys[i % count], lengths[i % count]);
+    }
+    double duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "djb2, %s", name);
+    printResult(title, HASH_ITERATIONS, duration);
+
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < HASH_ITERATIONS ; i ++) {
+        sum += hashCompute(keys[i % count], lengths[i % count]);
+    }
+    duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "hashCompute(), %s", name);
+    printResult(title, HASH_ITERATIONS, duration);
+
+    AutoreleasePool * pool = new AutoreleasePool();
+    Array * strings = Array::array();
+    for(unsigned int i = 0 ; i < count ; i ++) {
+        strings->addObject(String::stringWithUTF8Characters(keys[i]));
+    }
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < HASH_ITERATIONS ; i ++) {
+        sum += strings->objectAtIndex(i % count)->hash();
+    }
+    duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "String::hash(), %s", name);
+    printResult(title, HASH_ITERATIONS, duration);
+    pool->release();
+
+    if (sum == 0) {
+        printf("(unlikely hash sum)\n");
+    }
+}
+
+static void benchmarkHash(void)
+{
+    printf("benchmarkHash\n");
+
+    const char * headerNames[] = {
+        "Content-Type", "Content-Transfer-Encoding", "Message-ID", "In-Reply-To", "References",
+        "X-Mailer", "Subject", "DKIM-Signature",
+    };
+    benchmarkHashKeys("header names", headerNames, sizeof(headerNames) / sizeof(headerNames[0]));
+
+    const char * messageIDs[] = {
+        "CAHx7u2TgKfz0Z9kq1XJ4b0yQ8Jm3Yk@mail.gmail.com",
+        "20150312093547.GA21547@example.org",
+        "5501A3F2.8040207@mozilla.com",
+        "DB6PR0802MB2533F5A0CE64E5B4A5AC9E88D0930@DB6PR0802MB2533.eurprd08.prod.outlook.com",
+        "etPan.55019ed3.2ae8944a.1b3@mbp.local",
+        "1426152947.3921.12.camel@localhost.localdomain",
+    };
+    benchmarkHashKeys("Message-IDs", messageIDs, sizeof(messageIDs) / sizeof(messageIDs[0]));
+
+    const char * folderPaths[] = {
+        "INBOX", "[Gmail]/All Mail", "[Gmail]/Sent Mail", "INBOX/Archives/2015",
+        "INBOX/Lists/mailcore", "Drafts", "Junk E-mail", "Archives/Projects/Clients/Acme",
+    };
+    benchmarkHashKeys("folder paths", folderPaths, sizeof(folderPaths) / sizeof(folderPaths[0]));
+}
+
+#pragma mark dates
+
+#define DATES_COUNT 100000
+
+static int tmcomp(struct tm * atmp, struct tm * btmp)
+{
+    int result;
+    
+    if ((result = (atmp->tm_year - btmp->tm_year)) == 0 &&
+        (result = (atmp->tm_mon - btmp->tm_mon)) == 0 &&
+        (result = (atmp->tm_mday - btmp->tm_mday)) == 0 &&
+        (result = (atmp->tm_hour - btmp->tm_hour)) == 0 &&
+        (result = (atmp->tm_min - btmp->tm_min)) == 0)
+        result = atmp->tm_sec - btmp->tm_sec;
+    return result;
+}
+
+// Former implementation of mkgmtime(), bisecting over time_t.
+static time_t referenceMkgmtime(struct tm * tmp)
+{
+    int dir;
+    int bits;
+    int saved_seconds;
+    time_t t;
+    struct tm yourtm, mytm;
+    
+    yourtm = *tmp;
+    saved_seconds = yourtm.tm_sec;
+    yourtm.tm_sec = 0;
+    for (bits = 0, t = 1; t > 0; ++bits, t <<= 1)
+        ;
+    if(bits > 40) bits = 40;
+    t = (t < 0) ? 0 : ((time_t) 1 << bits);
+    for ( ; ; ) {
+        gmtime_r(&t, &mytm);
+        dir = tmcomp(&mytm, &yourtm);
+        if (dir != 0) {
+            if (bits-- < 0) {
+                return -1;
+            }
+            if (bits < 0)
+                --t;
+            else if (dir > 0)
+                t -= (time_t) 1 << bits;
+            else    t += (time_t) 1 << bits;
+            continue;
+        }
+        break;
+    }
+    t += saved_seconds;
+    return t;
+}
+
+static void benchmarkDates(void)
+{
+    printf("benchmarkDates\n");
+
+    // INTERNALDATE of a mailbox receiving a message every few minutes.
+    struct mailimap_date_time * dates = (struct mailimap_date_time *) malloc(DATES_COUNT * sizeof(* dates));
+    struct tm * tms = (struct tm *) malloc(DATES_COUNT * sizeof(* tms));
+    time_t * timestamps = (time_t *) malloc(DATES_COUNT * sizeof(* timestamps));
+    time_t date = 1420070400;
+    for(unsigned int i = 0 ; i < DATES_COUNT ; i ++) {
+        gmtime_r(&date, &tms[i]);
+        dates[i].dt_year = tms[i].tm_year + 1900;
+        dates[i].dt_month = tms[i].tm_mon + 1;
+        dates[i].dt_day = tms[i].tm_mday;
+        dates[i].dt_hour = tms[i].tm_hour;
+        dates[i].dt_min = tms[i].tm_min;
+        dates[i].dt_sec = tms[i].tm_sec;
+        dates[i].dt_zone = 0;
+        date += 313;
+    }
+
+    time_t sum = 0;
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < DATES_COUNT ; i ++) {
+        sum += referenceMkgmtime(&tms[i]);
+    }
+    double duration = currentTime() - startTime;
+    printResult("mkgmtime(), bisection", DATES_COUNT, duration);
+
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < DATES_COUNT ; i ++) {
+        sum -= mkgmtime(&tms[i]);
+    }
+    duration = currentTime() - startTime;
+    printResult("mkgmtime()", DATES_COUNT, duration);
+
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < DATES_COUNT ; i ++) {
+        sum += timestampFromIMAPDate(&dates[i]);
+    }
+    duration = currentTime() - startTime;
+    printResult("timestampFromIMAPDate()", DATES_COUNT, duration);
+
+    startTime = currentTime();
+    timestampsFromIMAPDates(dates, DATES_COUNT, timestamps);
+    duration = currentTime() - startTime;
+    printResult("timestampsFromIMAPDates()", DATES_COUNT, duration);
+    for(unsigned int i = 0 ; i < DATES_COUNT ; i ++) {
+        sum -= timestamps[i];
+    }
+
+    if (sum != 0) {
+        printf("mismatch between the conversions\n");
+    }
+    free(timestamps);
+    free(tms);
+    free(dates);
+}
+
+#pragma mark delayed performs
+
+#define DELAYED_PERFORM_TIMERS_COUNT 100000
+#define DELAYED_PERFORM_ROUNDS 5
+#define DELAYED_PERFORM_THREADS_COUNT 8
+
+class DelayedPerformTarget : public Object {
+public:
+    void timerFired(void * context)
+    {
+    }
+};
+
+struct DelayedPerformThreadData {
+    DelayedPerformTarget ** targets;
+    unsigned int first;
+    unsigned int count;
+};
+
+// Pushes back the timers, as the async sessions do with tryAutomaticDisconnectAfterDelay().
+static void rescheduleDelayedPerforms(DelayedPerformTarget ** targets, unsigned int first, unsigned int count)
+{
+    for(unsigned int i = first ; i < first + count ; i ++) {
+        targets[i]->cancelDelayedPerformMethod((Object::Method) &DelayedPerformTarget::timerFired, NULL);
+        targets[i]->performMethodAfterDelay((Object::Method) &DelayedPerformTarget::timerFired, NULL, 30 + i % 60);
+    }
+}
+
+static void * delayedPerformThread(void * data)
+{
+    struct DelayedPerformThreadData * threadData = (struct DelayedPerformThreadData *) data;
+    for(unsigned int k = 0 ; k < DELAYED_PERFORM_ROUNDS ; k ++) {
+        rescheduleDelayedPerforms(threadData->targets, threadData->first, threadData->count);
+    }
+    return NULL;
+}
+
+static void benchmarkDelayedPerform(void)
+{
+    printf("benchmarkDelayedPerform\n");
+
+    // The timers are far enough in the future to stay pending during the whole benchmark.
+    DelayedPerformTarget ** targets = (DelayedPerformTarget **) malloc(DELAYED_PERFORM_TIMERS_COUNT * sizeof(* targets));
+    for(unsigned int i = 0 ; i < DELAYED_PERFORM_TIMERS_COUNT ; i ++) {
+        targets[i] = new DelayedPerformTarget();
+    }
+
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < DELAYED_PERFORM_TIMERS_COUNT ; i ++) {
+        targets[i]->performMethodAfterDelay((Object::Method) &DelayedPerformTarget::timerFired, NULL, 30 + i % 60);
+    }
+    double duration = currentTime() - startTime;
+    printResult("schedule", DELAYED_PERFORM_TIMERS_COUNT, duration);
+
+    startTime = currentTime();
+    for(unsigned int k = 0 ; k < DELAYED_PERFORM_ROUNDS ; k ++) {
+        rescheduleDelayedPerforms(targets, 0, DELAYED_PERFORM_TIMERS_COUNT);
+    }
+    duration = currentTime() - startTime;
+    printResult("cancel and reschedule, 1 thread", DELAYED_PERFORM_TIMERS_COUNT * DELAYED_PERFORM_ROUNDS, duration);
+
+    pthread_t threads[DELAYED_PERFORM_THREADS_COUNT];
+    struct DelayedPerformThreadData threadsData[DELAYED_PERFORM_THREADS_COUNT];
+    unsigned int slice = DELAYED_PERFORM_TIMERS_COUNT / DELAYED_PERFORM_THREADS_COUNT;
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < DELAYED_PERFORM_THREADS_COUNT ; i ++) {
+        threadsData[i].targets = targets;
+        threadsData[i].first = i * slice;
+        threadsData[i].count = slice;
+        pthread_create(&threads[i], NULL, delayedPerformThread, &threadsData[i]);
+    }
+    for(unsigned int i = 0 ; i < DELAYED_PERFORM_THREADS_COUNT ; i ++) {
+        pthread_join(threads[i], NULL);
+    }
+    duration = currentTime() - startTime;
+    char title[256];
+    snprintf(title, sizeof(title), "cancel and reschedule, %u threads", DELAYED_PERFORM_THREADS_COUNT);
+    printResult(title, slice * DELAYED_PERFORM_THREADS_COUNT * DELAYED_PERFORM_ROUNDS, duration);
+
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < DELAYED_PERFORM_TIMERS_COUNT ; i ++) {
+        targets[i]->cancelDelayedPerformMethod((Object::Method) &DelayedPerformTarget::timerFired, NULL);
+    }
+    duration = currentTime() - startTime;
+    printResult("cancel", DELAYED_PERFORM_TIMERS_COUNT, duration);
+
+    for(unsigned int i = 0 ; i < DELAYED_PERFORM_TIMERS_COUNT ; i ++) {
+        targets[i]->release();
+    }
+    free(targets);
+}
+
+#pragma mark IDLE multiplexing
+
+#define IDLE_MAXIMUM_SESSIONS_COUNT 2000
+
+// Unlike the stand-in, it serves all the connections at the same time on a single thread.
+struct IdleStandIn {
+    int listenFd;
+    int port;
+    int stopPipe[2];
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // NULL for clear connections.
+    SSL_CTX * sslContext;
+    SSL ** ssls;
+    struct pollfd * fds;
+    char ** buffers;
+    unsigned int * buffersLengths;
+    // Tag of the IDLE command of each connection.
+    char (* tags)[32];
+    unsigned int count;
+    unsigned int capacity;
+};
+
+#define IDLE_STAND_IN_BUFFER_SIZE 1024
+
+// Self-signed certificate of the TLS stand-in, the sessions don't check it.
+static SSL_CTX * idleStandInSSLContext(void)
+{
+    EVP_PKEY * key = NULL;
+    EVP_PKEY_CTX * keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    EVP_PKEY_keygen_init(keyContext);
+    EVP_PKEY_CTX_set_rsa_keygen_bits(keyContext, 2048);
+    EVP_PKEY_keygen(keyContext, &key);
+    EVP_PKEY_CTX_free(keyContext);
+
+    X509 * certificate = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_get_notBefore(certificate), 0);
+    X509_gmtime_adj(X509_get_notAfter(certificate), 24 * 3600);
+    X509_set_pubkey(certificate, key);
+    X509_NAME * name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "127.0.0.1", -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+    X509_sign(certificate, key, EVP_sha256());
+
+    SSL_CTX * context = SSL_CTX_new(SSLv23_server_method());
+    SSL_CTX_use_certificate(context, certificate);
+    SSL_CTX_use_PrivateKey(context, key);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return context;
+}
+
+static void idleStandInWrite(struct IdleStandIn * standIn, unsigned int idx, Data * data)
+{
+    if (standIn->ssls[idx] == NULL) {
+        standInWrite(standIn->fds[idx].fd, data);
+        return;
+    }
+    if (data->length() > 0) {
+        SSL_write(standIn->ssls[idx], data->bytes(), data->length());
+    }
+}
+
+static void idleStandInHandleCommand(struct IdleStandIn * standIn, unsigned int idx, char * line, char * idleTag)
+{
+    Data * response = new Data();
+    char * command = strchr(line, ' ');
+    if (command == NULL) {
+        // DONE
+        standInAppendFormat(response, "%s OK done\r\n", idleTag);
+    }
+    else {
+        * command = '\0';
+        command ++;
+        const char * tag = line;
+        if (strncasecmp(command, "CAPABILITY", 10) == 0) {
+            standInAppendFormat(response, "* CAPABILITY IMAP4rev1 IDLE\r\n%s OK done\r\n", tag);
+        }
+        else if (strncasecmp(command, "SELECT", 6) == 0) {
+            standInAppendFormat(response, "* FLAGS (\\Seen)\r\n* 10 EXISTS\r\n* 0 RECENT\r\n"
+                                "* OK [UIDVALIDITY 1] ok\r\n* OK [UIDNEXT 11] ok\r\n"
+                                "%s OK [READ-WRITE] done\r\n", tag);
+        }
+        else if (strncasecmp(command, "IDLE", 4) == 0) {
+            snprintf(idleTag, 32, "%s", tag);
+            standInAppendFormat(response, "+ idling\r\n");
+        }
+        else {
+            standInAppendFormat(response, "%s OK done\r\n", tag);
+        }
+    }
+    idleStandInWrite(standIn, idx, response);
+    response->release();
+}
+
+// Notifies all the idling connections of a new message.
+static void idleStandInWriteExists(struct IdleStandIn * standIn)
+{
+    const char * exists = "* 11 EXISTS\r\n";
+    Data * data = Data::dataWithBytes(exists, (unsigned int) strlen(exists));
+    for(unsigned int i = 2 ; i < standIn->count ; i ++) {
+        idleStandInWrite(standIn, i, data);
+    }
+}
+
+static void * idleStandInThread(void * data)
+{
+    struct IdleStandIn * standIn = (struct IdleStandIn *) data;
+    while (1) {
+        pthread_mutex_lock(&standIn->lock);
+        unsigned int count = standIn->count;
+        pthread_mutex_unlock(&standIn->lock);
+        if (poll(standIn->fds, count, -1) < 0)
+            continue;
+        if (standIn->fds[0].revents != 0) {
+            // The pipe also asks for the notification of the idling connections, from this thread.
+            char command = 0;
+            read(standIn->stopPipe[0], &command, 1);
+            if (command != 'e')
+                break;
+            AutoreleasePool * pool = new AutoreleasePool();
+            idleStandInWriteExists(standIn);
+            pool->release();
+        }
+        if (standIn->fds[1].revents != 0) {
+            int fd = accept(standIn->listenFd, NULL, NULL);
+            SSL * ssl = NULL;
+            if (fd >= 0) {
+                if (standIn->sslContext != NULL) {
+                    // The handshake blocks the stand-in, the sessions connect in parallel anyway.
+                    ssl = SSL_new(standIn->sslContext);
+                    SSL_set_fd(ssl, fd);
+                    if (SSL_accept(ssl) <= 0) {
+                        SSL_free(ssl);
+                        close(fd);
+                        fd = -1;
+                    }
+                }
+            }
+            if (fd >= 0) {
+                pthread_mutex_lock(&standIn->lock);
+                if (standIn->count == standIn->capacity) {
+                    if (ssl != NULL) {
+                        SSL_free(ssl);
+                    }
+                    close(fd);
+                }
+                else {
+                    standIn->fds[standIn->count].fd = fd;
+                    standIn->fds[standIn->count].events = POLLIN;
+                    standIn->fds[standIn->count].revents = 0;
+                    standIn->ssls[standIn->count] = ssl;
+                    standIn->buffersLengths[standIn->count] = 0;
+                    standIn->count ++;
+                    const char * greeting = "* OK [CAPABILITY IMAP4rev1 IDLE] ready\r\n";
+                    idleStandInWrite(standIn, standIn->count - 1, Data::dataWithBytes(greeting, (unsigned int) strlen(greeting)));
+                }
+                pthread_mutex_unlock(&standIn->lock);
+            }
+        }
+        for(unsigned int i = 2 ; i < count ; i ++) {
+            if (standIn->fds[i].revents == 0)
+                continue;
+            char * buffer = standIn->buffers[i];
+            unsigned int length = standIn->buffersLengths[i];
+            // The TLS layer might have decoded more than what fits in the buffer.
+            do {
+                ssize_t r;
+                if (standIn->ssls[i] != NULL) {
+                    r = SSL_read(standIn->ssls[i], buffer + length, IDLE_STAND_IN_BUFFER_SIZE - 1 - length);
+                }
+                else {
+                    r = read(standIn->fds[i].fd, buffer + length, IDLE_STAND_IN_BUFFER_SIZE - 1 - length);
+                }
+                if (r <= 0) {
+                    // The closed connection will be ignored from now on.
+                    standIn->fds[i].events = 0;
+                    break;
+                }
+                length += (unsigned int) r;
+                char * current = buffer;
+                char * eol;
+                while ((eol = (char *) memchr(current, '\n', length - (current - buffer))) != NULL) {
+                    * eol = '\0';
+                    if ((eol > current) && (eol[-1] == '\r')) {
+                        eol[-1] = '\0';
+                    }
+                    AutoreleasePool * pool = new AutoreleasePool();
+                    idleStandInHandleCommand(standIn, i, current, standIn->tags[i]);
+                    pool->release();
+                    current = eol + 1;
+                }
+                length -= (unsigned int) (current - buffer);
+                memmove(buffer, current, length);
+            } while ((standIn->ssls[i] != NULL) && (SSL_pending(standIn->ssls[i]) > 0));
+            standIn->buffersLengths[i] = length;
+        }
+    }
+    return NULL;
+}
+
+static void idleStandInStart(struct IdleStandIn * standIn, unsigned int connectionsCount, bool tls)
+{
+    struct sockaddr_in addr;
+    socklen_t addrLength = sizeof(addr);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    standIn->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    bind(standIn->listenFd, (struct sockaddr *) &addr, sizeof(addr));
+    listen(standIn->listenFd, 256);
+    getsockname(standIn->listenFd, (struct sockaddr *) &addr, &addrLength);
+    standIn->port = ntohs(addr.sin_port);
+    pipe(standIn->stopPipe);
+    pthread_mutex_init(&standIn->lock, NULL);
+
+    // The first two are the stop pipe and the listening socket.
+    standIn->capacity = connectionsCount + 2;
+    standIn->fds = (struct pollfd *) calloc(standIn->capacity, sizeof(* standIn->fds));
+    standIn->sslContext = tls ? idleStandInSSLContext() : NULL;
+    standIn->ssls = (SSL **) calloc(standIn->capacity, sizeof(* standIn->ssls));
+    standIn->buffers = (char **) calloc(standIn->capacity, sizeof(* standIn->buffers));
+    standIn->buffersLengths = (unsigned int *) calloc(standIn->capacity, sizeof(* standIn->buffersLengths));
+    standIn->tags = (char (*)[32]) calloc(standIn->capacity, sizeof(* standIn->tags));
+    for(unsigned int i = 0 ; i < standIn->capacity ; i ++) {
+        standIn->buffers[i] = (char *) malloc(IDLE_STAND_IN_BUFFER_SIZE);
+    }
+    standIn->fds[0].fd = standIn->stopPipe[0];
+    standIn->fds[0].events = POLLIN;
+    standIn->fds[1].fd = standIn->listenFd;
+    standIn->fds[1].events = POLLIN;
+    standIn->count = 2;
+    pthread_create(&standIn->thread, NULL, idleStandInThread, standIn);
+}
+
+static void idleStandInPushExists(struct IdleStandIn * standIn)
+{
+    write(standIn->stopPipe[1], "e", 1);
+}
+
+static void idleStandInStop(struct IdleStandIn * standIn)
+{
+    write(standIn->stopPipe[1], "", 1);
+    pthread_join(standIn->thread, NULL);
+    for(unsigned int i = 1 ; i < standIn->count ; i ++) {
+        if (standIn->ssls[i] != NULL) {
+            SSL_free(standIn->ssls[i]);
+        }
+        close(standIn->fds[i].fd);
+    }
+    if (standIn->sslContext != NULL) {
+        SSL_CTX_free(standIn->sslContext);
+    }
+    free(standIn->ssls);
+    for(unsigned int i = 0 ; i < standIn->capacity ; i ++) {
+        free(standIn->buffers[i]);
+    }
+    free(standIn->buffers);
+    free(standIn->buffersLengths);
+    free(standIn->tags);
+    free(standIn->fds);
+    close(standIn->stopPipe[0]);
+    close(standIn->stopPipe[1]);
+    pthread_mutex_destroy(&standIn->lock);
+}
+
+static void runIdleMultiplexing(const char * name, unsigned int sessionsCount, bool tls)
+{
+    struct IdleStandIn standIn;
+    idleStandInStart(&standIn, sessionsCount, tls);
+
+    // The idling operations are suspended instead of holding the threads of the pool.
+    bool sharedThreadPoolEnabled = OperationQueue::isSharedThreadPoolEnabledByDefault();
+    OperationQueue::setSharedThreadPoolEnabledByDefault(true);
+    unsigned int createdThreadsCount = OperationQueue::createdThreadsCount();
+
+    AutoreleasePool * pool = new AutoreleasePool();
+    LatencyOperationCallback callback;
+    IMAPAsyncSession ** sessions = (IMAPAsyncSession **) malloc(sessionsCount * sizeof(* sessions));
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < sessionsCount ; i ++) {
+        sessions[i] = new IMAPAsyncSession();
+        sessions[i]->setHostname(MCSTR("127.0.0.1"));
+        sessions[i]->setPort(standIn.port);
+        sessions[i]->setUsername(MCSTR("user"));
+        sessions[i]->setPassword(MCSTR("password"));
+        sessions[i]->setConnectionType(tls ? ConnectionTypeTLS : ConnectionTypeClear);
+        sessions[i]->setCheckCertificateEnabled(false);
+        sessions[i]->setCallbackExecutor(CallbackExecutor::inlineExecutor());
+        IMAPIdleOperation * op = sessions[i]->idleOperation(MCSTR("INBOX"), 0);
+        op->setCallback(&callback);
+        op->start();
+    }
+    while (idleMultiplexerWatchesCount() < sessionsCount) {
+        usleep(1000);
+    }
+    double duration = currentTime() - startTime;
+    char title[256];
+    snprintf(title, sizeof(title), "connect and start idling, %s", name);
+    printResult(title, sessionsCount, duration);
+
+    startTime = currentTime();
+    idleStandInPushExists(&standIn);
+    callback.waitForFinishedCount(sessionsCount);
+    duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "wake up idling sessions, %s", name);
+    printResult(title, sessionsCount, duration);
+    printf("%u threads created for %u idling sessions\n",
+           OperationQueue::createdThreadsCount() - createdThreadsCount, sessionsCount);
+
+    for(unsigned int i = 0 ; i < sessionsCount ; i ++) {
+        sessions[i]->release();
+    }
+    free(sessions);
+    pool->release();
+
+    OperationQueue::setSharedThreadPoolEnabledByDefault(sharedThreadPoolEnabled);
+    idleStandInStop(&standIn);
+}
+
+static void benchmarkIdleMultiplexing(void)
+{
+    printf("benchmarkIdleMultiplexing\n");
+
+    // Each session uses a socket on both ends.
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    unsigned int sessionsCount = IDLE_MAXIMUM_SESSIONS_COUNT;
+    if ((limit.rlim_cur != RLIM_INFINITY) && (limit.rlim_cur < 2 * sessionsCount + 64)) {
+        sessionsCount = (unsigned int) (limit.rlim_cur - 64) / 2;
+    }
+
+    runIdleMultiplexing("clear", sessionsCount, false);
+    // The TLS sessions are watched on the socket below the TLS layer.
+    runIdleMultiplexing("TLS", sessionsCount, true);
+}
+
+#pragma mark QRESYNC
+
+#define QRESYNC_MESSAGES_COUNT 20000
+#define QRESYNC_ITERATIONS 20
+
+enum {
+    ResyncFullFlags,
+    ResyncChangedSince,
+    ResyncQResyncSelect,
+};
+
+// Reconnects and gets the changes since the last known mod-sequence value.
+static void runResync(const char * name, int mode)
+{
+    struct StandIn standIn;
+    imapStandInStart(&standIn, QRESYNC_MESSAGES_COUNT);
+    standIn.qresync = (mode != ResyncFullFlags);
+
+    IndexSet * knownUIDs = IndexSet::indexSetWithRange(RangeMake(1, QRESYNC_MESSAGES_COUNT - 1));
+    unsigned int changesCount = 0;
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < QRESYNC_ITERATIONS ; i ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        ErrorCode error;
+        IMAPSession * session = imapStandInSession(&standIn);
+        IMAPSyncResult * result;
+        if (mode == ResyncChangedSince) {
+            session->loginIfNeeded(&error);
+            session->select(MCSTR("INBOX"), &error);
+            result = session->syncMessagesByUID(MCSTR("INBOX"),
+                                                (IMAPMessagesRequestKind) (IMAPMessagesRequestKindUid | IMAPMessagesRequestKindFlags),
+                                                knownUIDs, IMAP_STAND_IN_MOD_SEQUENCE_VALUE - 1, NULL, &error);
+        }
+        else {
+            result = session->selectWithQResync(MCSTR("INBOX"), 1, IMAP_STAND_IN_MOD_SEQUENCE_VALUE - 1, knownUIDs, &error);
+        }
+        if (error != ErrorNone) {
+            printf("resync failed with error %i\n", error);
+        }
+        else {
+            changesCount = result->modifiedOrAddedMessages()->count();
+        }
+        session->disconnect();
+        pool->release();
+    }
+    double duration = currentTime() - startTime;
+
+    char title[256];
+    snprintf(title, sizeof(title), "%s, %u commands, %u messages returned", name,
+             standIn.commandsCount / QRESYNC_ITERATIONS, changesCount);
+    printResult(title, QRESYNC_ITERATIONS, duration);
+    standInStop(&standIn);
+}
+
+static void benchmarkQResync(void)
+{
+    printf("benchmarkQResync\n");
+    runResync("SELECT then UID FETCH FLAGS (no CONDSTORE)", ResyncFullFlags);
+    runResync("SELECT then UID FETCH CHANGEDSINCE", ResyncChangedSince);
+    runResync("SELECT QRESYNC", ResyncQResyncSelect);
+}
+
+#pragma mark unit test data
+
+static Array * pathsInDirectory(String * directory)
+{
+    Array * result = Array::array();
+
+    DIR * dir = opendir(directory->fileSystemRepresentation());
+    if (dir == NULL) {
+        return result;
+    }
+
+    struct dirent * ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        String * subpath = directory->stringByAppendingPathComponent(String::stringWithFileSystemRepresentation(ent->d_name));
+        if (ent->d_type == DT_DIR) {
+            result->addObjectsFromArray(pathsInDirectory(subpath));
+        }
+        else {
+            result->addObject(subpath);
+        }
+    }
+    closedir(dir);
+
+    return result;
+}
+
+#pragma mark charset decoding
+
+#define DECODING_ROUNDS 200
+
+static void benchmarkCharsetDecoding(String * path)
+{
+    printf("benchmarkCharsetDecoding\n");
+    Array * filenames = pathsInDirectory(path->stringByAppendingPathComponent(MCSTR("input")));
+    Array * inputs = Array::array();
+    Array * charsets = Array::array();
+    unsigned int totalLength = 0;
+    mc_foreacharray(String, filename, filenames) {
+        Data * data = Data::dataWithContentsOfFile(filename);
+        if (data == NULL) {
+            continue;
+        }
+        inputs->addObject(data);
+        charsets->addObject(data->charsetWithFilteredHTML(false));
+        totalLength += data->length();
+    }
+    if (inputs->count() == 0) {
+        fprintf(stderr, "no inputs found in %s\n", MCUTF8(path));
+        return;
+    }
+
+    unsigned int count = 0;
+    double startTime = currentTime();
+    for(unsigned int round = 0 ; round < DECODING_ROUNDS ; round ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        for(unsigned int i = 0 ; i < inputs->count() ; i ++) {
+            Data * data = (Data *) inputs->objectAtIndex(i);
+            String * charset = (String *) charsets->objectAtIndex(i);
+            data->stringWithCharset(charset->UTF8Characters());
+            count ++;
+        }
+        pool->release();
+    }
+    double duration = currentTime() - startTime;
+    char title[256];
+    snprintf(title, sizeof(title), "stringWithCharset(), %u inputs, %u bytes", inputs->count(), totalLength);
+    printResult(title, count, duration);
+}
+
+#pragma mark rendering
+
+#define RENDERING_ROUNDS 20
+#define RENDERING_THREADS_COUNT 4
+
+static unsigned int renderMessages(Array * parsers, bool plainText)
+{
+    unsigned int count = 0;
+    for(unsigned int round = 0 ; round < RENDERING_ROUNDS ; round ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        mc_foreacharray(MessageParser, parser, parsers) {
+            if (plainText) {
+                parser->plainTextRendering();
+            }
+            else {
+                parser->htmlRendering(NULL);
+            }
+            count ++;
+        }
+        pool->release();
+    }
+    return count;
+}
+
+static void * renderingThread(void * data)
+{
+    AutoreleasePool * pool = new AutoreleasePool();
+    renderMessages((Array *) data, false);
+    pool->release();
+    return NULL;
+}
+
+static Array * parseMessages(Array * filenames)
+{
+    Array * parsers = Array::array();
+    mc_foreacharray(String, filename, filenames) {
+        MessageParser * parser = MessageParser::messageParserWithContentsOfFile(filename);
+        if (parser != NULL) {
+            parsers->addObject(parser);
+        }
+    }
+    return parsers;
+}
+
+static void benchmarkRendering(String * path)
+{
+    printf("benchmarkRendering\n");
+    Array * filenames = pathsInDirectory(path->stringByAppendingPathComponent(MCSTR("input")));
+    Array * parsers = parseMessages(filenames);
+    if (parsers->count() == 0) {
+        fprintf(stderr, "no messages found in %s\n", MCUTF8(path));
+        return;
+    }
+
+    char title[256];
+    double startTime = currentTime();
+    unsigned int count = renderMessages(parsers, false);
+    double duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "htmlRendering(), %u messages", parsers->count());
+    printResult(title, count, duration);
+
+    startTime = currentTime();
+    count = renderMessages(parsers, true);
+    duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "plainTextRendering(), %u messages", parsers->count());
+    printResult(title, count, duration);
+
+    // Each thread renders its own copy of the messages, the compiled templates are shared.
+    pthread_t threads[RENDERING_THREADS_COUNT];
+    Array * threadParsers[RENDERING_THREADS_COUNT];
+    for(unsigned int i = 0 ; i < RENDERING_THREADS_COUNT ; i ++) {
+        threadParsers[i] = parseMessages(filenames);
+    }
+    startTime = currentTime();
+    for(unsigned int i = 0 ; i < RENDERING_THREADS_COUNT ; i ++) {
+        pthread_create(&threads[i], NULL, renderingThread, threadParsers[i]);
+    }
+    for(unsigned int i = 0 ; i < RENDERING_THREADS_COUNT ; i ++) {
+        pthread_join(threads[i], NULL);
+    }
+    duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "htmlRendering(), %u messages, %u threads", parsers->count(), RENDERING_THREADS_COUNT);
+    printResult(title, count * RENDERING_THREADS_COUNT, duration);
+}
+
+#define PREVIEW_LENGTH 200
+
+static void benchmarkPreviews(String * path)
+{
+    printf("benchmarkPreviews\n");
+    Array * parsers = parseMessages(pathsInDirectory(path->stringByAppendingPathComponent(MCSTR("input"))));
+    if (parsers->count() == 0) {
+        fprintf(stderr, "no messages found in %s\n", MCUTF8(path));
+        return;
+    }
+
+    char title[256];
+    unsigned int count = 0;
+    double startTime = currentTime();
+    for(unsigned int round = 0 ; round < RENDERING_ROUNDS ; round ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        mc_foreacharray(MessageParser, parser, parsers) {
+            String * preview = parser->plainTextBodyRendering(true);
+            if ((preview != NULL) && (preview->length() > PREVIEW_LENGTH)) {
+                preview->substringToIndex(PREVIEW_LENGTH);
+            }
+            count ++;
+        }
+        pool->release();
+    }
+    double duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "plainTextBodyRendering() truncated to %u characters, %u messages", PREVIEW_LENGTH, parsers->count());
+    printResult(title, count, duration);
+
+    count = 0;
+    startTime = currentTime();
+    for(unsigned int round = 0 ; round < RENDERING_ROUNDS ; round ++) {
+        AutoreleasePool * pool = new AutoreleasePool();
+        mc_foreacharray(MessageParser, parser, parsers) {
+            parser->plainTextPreview(PREVIEW_LENGTH);
+            count ++;
+        }
+        pool->release();
+    }
+    duration = currentTime() - startTime;
+    snprintf(title, sizeof(title), "plainTextPreview(%u), %u messages", PREVIEW_LENGTH, parsers->count());
+    printResult(title, count, duration);
+}
+
+#pragma mark providers
+
+#define PROVIDERS_EMAILS_COUNT 100000
+#define PROVIDERS_UNCOMPILED_EMAILS_COUNT 2000
+
+// Lookup as it was done before, compiling each pattern for each lookup.
+static bool uncompiledMatchDomain(String * match, String * domain)
+{
+    regex_t r;
+    match = String::stringWithUTF8Format("^%s$", match->UTF8Characters());
+    if (regcomp(&r, match->UTF8Characters(), REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0) {
+        return false;
+    }
+    bool matched = (regexec(&r, domain->UTF8Characters(), 0, NULL, 0) == 0);
+    regfree(&r);
+    return matched;
+}
+
+static String * uncompiledProviderForEmail(HashMap * providersInfos, String * email)
+{
+    String * domain = (String *) email->componentsSeparatedByString(MCSTR("@"))->lastObject();
+    String * result = NULL;
+    mc_foreachhashmapKeyAndValue(String, identifier, HashMap, info, providersInfos) {
+        bool excluded = false;
+        mc_foreacharray(String, exclude, (Array *) info->objectForKey(MCSTR("domain-exclude"))) {
+            if (uncompiledMatchDomain(exclude, domain)) {
+                excluded = true;
+                break;
+            }
+        }
+        if (excluded) {
+            continue;
+        }
+        mc_foreacharray(String, match, (Array *) info->objectForKey(MCSTR("domain-match"))) {
+            if (uncompiledMatchDomain(match, domain)) {
+                result = identifier;
+                break;
+            }
+        }
+        if (result != NULL) {
+            break;
+        }
+    }
+    return result;
+}
+
+static void benchmarkProviders(String * filename)
+{
+    printf("benchmarkProviders\n");
+    HashMap * providersInfos = (HashMap *) JSON::objectFromJSONData(Data::dataWithContentsOfFile(filename));
+    if (providersInfos == NULL) {
+        fprintf(stderr, "could not load %s\n", MCUTF8(filename));
+        return;
+    }
+    MailProvidersManager::sharedManager()->registerProvidersWithFilename(filename);
+
+    const char * domains[] = {
+        "gmail.com", "googlemail.com", "yahoo.com", "yahoo.co.jp", "ymail.com", "hotmail.com", "outlook.com",
+        "live.fr", "aol.com", "icloud.com", "me.com", "gmx.de", "fastmail.fm", "mail.ru", "example.com",
+        "university.edu", "company.co.uk",
+    };
+    unsigned int domainsCount = sizeof(domains) / sizeof(domains[0]);
+    Array * emails = Array::array();
+    for(unsigned int i = 0 ; i < PROVIDERS_EMAILS_COUNT ; i ++) {
+        emails->addObject(String::stringWithUTF8Format("user%u@%s", i, domains[i % domainsCount]));
+    }
+
+    AutoreleasePool * pool = new AutoreleasePool();
+    double startTime = currentTime();
+    for(unsigned int i = 0 ; i < PROVIDERS_UNCOMPILED_EMAILS_COUNT ; i ++) {
+        uncompiledProviderForEmail(providersInfos, (String *) emails->objectAtIndex(i));
+    }
+    double duration = currentTime() - startTime;
+    pool->release();
+    printResult("providerForEmail(), regcomp for each lookup", PROVIDERS_UNCOMPILED_EMAILS_COUNT, duration);
+
+    pool = new AutoreleasePool();
+    startTime = currentTime();
+    mc_foreacharray(String, email, emails) {
+        MailProvidersManager::sharedManager()->providerForEmail(email);
+    }
+    duration = currentTime() - startTime;
+    pool->release();
+    printResult("providerForEmail()", emails->count(), duration);
+
+    pool = new AutoreleasePool();
+    startTime = currentTime();
+    MailProvidersManager::sharedManager()->providersForEmails(emails);
+    duration = currentTime() - startTime;
+    pool->release();
+    printResult("providersForEmails()", emails->count(), duration);
+}
+
+int main(int argc, char ** argv)
+{
+    AutoreleasePool * pool = new AutoreleasePool();
+
+    benchmarkRetainRelease();
+    benchmarkUTF8Characters();
+    benchmarkLargeBodies();
+    benchmarkChunkedFetch();
+    benchmarkSMTPKeepAlive();
+    benchmarkCallbackLatency();
+    benchmarkParallelFetch();
+    benchmarkBatchedBodies();
+    benchmarkBinaryFetch();
+    benchmarkHashMap();
+    benchmarkHash();
+    benchmarkDates();
+    benchmarkDelayedPerform();
+    benchmarkIdleMultiplexing();
+    benchmarkQResync();
+    if (argc >= 2) {
+        // Directory of the unit test data.
+        String * path = String::stringWithUTF8Characters(argv[1]);
+        benchmarkCharsetDecoding(path->stringByAppendingPathComponent(MCSTR("charset-detection")));
+        benchmarkRendering(path->stringByAppendingPathComponent(MCSTR("parser")));
+        benchmarkPreviews(path->stringByAppendingPathComponent(MCSTR("summary")));
+    }
+    if (argc >= 3) {
+        // providers.json
+        benchmarkProviders(String::stringWithUTF8Characters(argv[2]));
+    }
+
+    pool->release();
+
+    exit(EXIT_SUCCESS);
+}
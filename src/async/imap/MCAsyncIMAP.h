@@ -16,7 +16,9 @@
 #include <MailCore/MCIMAPAppendMessageOperation.h>
 #include <MailCore/MCIMAPCopyMessagesOperation.h>
 #include <MailCore/MCIMAPFetchMessagesOperation.h>
+#include <MailCore/MCIMAPFetchMessageBodiesOperation.h>
 #include <MailCore/MCIMAPFetchContentOperation.h>
+#include <MailCore/MCIMAPParallelFetchContentOperation.h>
 #include <MailCore/MCIMAPFetchParsedContentOperation.h>
 #include <MailCore/MCIMAPIdleOperation.h>
 #include <MailCore/MCIMAPFolderInfo.h>
@@ -6,8 +6,14 @@
 //  Copyright (c) 2013 MailCore. All rights reserved.
 //
 
+#include "MCWin32.h" // should be included first.
+
 #include "MCIMAPAsyncConnection.h"
 
+#ifndef _MSC_VER
+#include <sys/time.h>
+#endif
+
 #include "MCIMAP.h"
 #include "MCIMAPFolderInfoOperation.h"
 #include "MCIMAPFolderStatusOperation.h"
@@ -42,6 +48,13 @@
 
 using namespace mailcore;
 
+static double currentTime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.;
+}
+
 namespace mailcore {
 
     class IMAPOperationQueueCallback : public Object, public OperationQueueCallback {
@@ -54,14 +67,18 @@ namespace mailcore {
         }
 
         virtual void queueStartRunning() {
+            mConnection->owner()->lock();
             mConnection->setQueueRunning(true);
+            mConnection->owner()->unlock();
             mConnection->owner()->operationRunningStateChanged();
             mConnection->queueStartRunning();
         }
 
         virtual void queueStoppedRunning() {
+            mConnection->owner()->lock();
             mConnection->setQueueRunning(false);
             mConnection->tryAutomaticDisconnect();
+            mConnection->owner()->unlock();
             mConnection->owner()->operationRunningStateChanged();
             mConnection->queueStoppedRunning();
         }
@@ -106,6 +123,12 @@ IMAPAsyncConnection::IMAPAsyncConnection()
     mAutomaticConfigurationEnabled = true;
     mQueueRunning = false;
     mScheduledAutomaticDisconnect = false;
+    mCallbackExecutor = NULL;
+    mMaxQueueDepth = 0;
+    mStartedOperationsCount = 0;
+    mStolenOperationsCount = 0;
+    mTotalWaitTime = 0;
+    mMaxWaitTime = 0;
 }
 
 IMAPAsyncConnection::~IMAPAsyncConnection()
@@ -225,6 +248,26 @@ bool IMAPAsyncConnection::isVoIPEnabled()
     return mSession->isVoIPEnabled();
 }
 
+void IMAPAsyncConnection::setFetchChunkSize(unsigned int chunkSize)
+{
+    mSession->setFetchChunkSize(chunkSize);
+}
+
+unsigned int IMAPAsyncConnection::fetchChunkSize()
+{
+    return mSession->fetchChunkSize();
+}
+
+void IMAPAsyncConnection::setFetchPipelineDepth(unsigned int depth)
+{
+    mSession->setFetchPipelineDepth(depth);
+}
+
+unsigned int IMAPAsyncConnection::fetchPipelineDepth()
+{
+    return mSession->fetchPipelineDepth();
+}
+
 void IMAPAsyncConnection::setDefaultNamespace(IMAPNamespace * ns)
 {
     mSession->setDefaultNamespace(ns);
@@ -275,20 +318,72 @@ void IMAPAsyncConnection::cancelAllOperations()
     mQueue->cancelAllOperations();
 }
 
+Array * IMAPAsyncConnection::pendingOperations()
+{
+    return mQueue->pendingOperations();
+}
+
+bool IMAPAsyncConnection::removePendingOperation(IMAPOperation * operation)
+{
+    return mQueue->removePendingOperation(operation);
+}
+
+void IMAPAsyncConnection::operationStolen()
+{
+    mStolenOperationsCount ++;
+}
+
+void IMAPAsyncConnection::operationWillStart(IMAPOperation * operation)
+{
+    double waitTime = currentTime() - operation->queuedTime();
+    mStartedOperationsCount ++;
+    mTotalWaitTime += waitTime;
+    if (waitTime > mMaxWaitTime) {
+        mMaxWaitTime = waitTime;
+    }
+}
+
+HashMap * IMAPAsyncConnection::metrics()
+{
+    HashMap * result = HashMap::hashMap();
+    result->setObjectForKey(MCSTR("queueDepth"), Value::valueWithUnsignedIntValue(operationsCount()));
+    result->setObjectForKey(MCSTR("maxQueueDepth"), Value::valueWithUnsignedIntValue(mMaxQueueDepth));
+    result->setObjectForKey(MCSTR("startedOperationsCount"), Value::valueWithUnsignedIntValue(mStartedOperationsCount));
+    result->setObjectForKey(MCSTR("stolenOperationsCount"), Value::valueWithUnsignedIntValue(mStolenOperationsCount));
+    result->setObjectForKey(MCSTR("totalWaitTime"), Value::valueWithDoubleValue(mTotalWaitTime));
+    result->setObjectForKey(MCSTR("maxWaitTime"), Value::valueWithDoubleValue(mMaxWaitTime));
+    if (mLastFolder != NULL) {
+        result->setObjectForKey(MCSTR("lastFolder"), mLastFolder);
+    }
+    return result;
+}
+
+// Called with the lock of the owner taken.
 void IMAPAsyncConnection::runOperation(IMAPOperation * operation)
 {
-    if (mScheduledAutomaticDisconnect) {
+    bool scheduledAutomaticDisconnect = mScheduledAutomaticDisconnect;
+    if (scheduledAutomaticDisconnect) {
 #if __APPLE__
         cancelDelayedPerformMethodOnDispatchQueue((Object::Method) &IMAPAsyncConnection::tryAutomaticDisconnectAfterDelay, NULL, dispatchQueue());
 #else
         cancelDelayedPerformMethod((Object::Method) &IMAPAsyncConnection::tryAutomaticDisconnectAfterDelay, NULL);
 #endif
-        mOwner->release();
         mScheduledAutomaticDisconnect = false;
     }
+    if (operation->queuedTime() == 0) {
+        operation->setQueuedTime(currentTime());
+    }
     mQueue->addOperation(operation);
+    if (mQueue->count() > mMaxQueueDepth) {
+        mMaxQueueDepth = mQueue->count();
+    }
+    // The running queue retains the owner now, whose lock is still taken.
+    if (scheduledAutomaticDisconnect) {
+        mOwner->release();
+    }
 }
 
+// Called with the lock of the owner taken.
 void IMAPAsyncConnection::tryAutomaticDisconnect()
 {
     // It's safe since no thread is running when this function is called.
@@ -320,7 +415,14 @@ void IMAPAsyncConnection::tryAutomaticDisconnect()
 
 void IMAPAsyncConnection::tryAutomaticDisconnectAfterDelay(void * context)
 {
+    mOwner->lock();
+    bool scheduledAutomaticDisconnect = mScheduledAutomaticDisconnect;
     mScheduledAutomaticDisconnect = false;
+    mOwner->unlock();
+    // An operation started from another thread cancelled it while it was about to run.
+    if (!scheduledAutomaticDisconnect) {
+        return;
+    }
 
     IMAPOperation * op = disconnectOperation();
     op->start();
@@ -350,6 +452,11 @@ String * IMAPAsyncConnection::lastFolder()
     return mLastFolder;
 }
 
+String * IMAPAsyncConnection::selectedFolder()
+{
+    return mSession->selectedFolder();
+}
+
 void IMAPAsyncConnection::setOwner(IMAPAsyncSession * owner)
 {
     mOwner = owner;
@@ -425,3 +532,13 @@ dispatch_queue_t IMAPAsyncConnection::dispatchQueue()
     return mQueue->dispatchQueue();
 }
 #endif
+
+void IMAPAsyncConnection::setCallbackExecutor(CallbackExecutor * executor)
+{
+    mCallbackExecutor = executor;
+}
+
+CallbackExecutor * IMAPAsyncConnection::callbackExecutor()
+{
+    return mCallbackExecutor;
+}
@@ -69,6 +69,12 @@ namespace mailcore {
         virtual void setVoIPEnabled(bool enabled);
         virtual bool isVoIPEnabled();
         
+        virtual void setFetchChunkSize(unsigned int chunkSize);
+        virtual unsigned int fetchChunkSize();
+        
+        virtual void setFetchPipelineDepth(unsigned int depth);
+        virtual unsigned int fetchPipelineDepth();
+        
         virtual void setAutomaticConfigurationEnabled(bool enabled);
         virtual bool isAutomaticConfigurationEnabled();
         
@@ -86,6 +92,9 @@ namespace mailcore {
         virtual void setDispatchQueue(dispatch_queue_t dispatchQueue);
         virtual dispatch_queue_t dispatchQueue();
 #endif
+
+        virtual void setCallbackExecutor(CallbackExecutor * executor);
+        virtual CallbackExecutor * callbackExecutor();
         
         virtual IMAPOperation * disconnectOperation();
 
@@ -103,6 +112,12 @@ namespace mailcore {
         bool mAutomaticConfigurationEnabled;
         bool mQueueRunning;
         bool mScheduledAutomaticDisconnect;
+        CallbackExecutor * mCallbackExecutor;
+        unsigned int mMaxQueueDepth;
+        unsigned int mStartedOperationsCount;
+        unsigned int mStolenOperationsCount;
+        double mTotalWaitTime;
+        double mMaxWaitTime;
         
         virtual void tryAutomaticDisconnectAfterDelay(void * context);
 
@@ -113,8 +128,16 @@ namespace mailcore {
         virtual void cancelAllOperations();
         virtual unsigned int operationsCount();
         
+        virtual Array * pendingOperations();
+        virtual bool removePendingOperation(IMAPOperation * operation);
+        virtual void operationStolen();
+        virtual void operationWillStart(IMAPOperation * operation);
+        virtual HashMap * metrics();
+        
         virtual void setLastFolder(String * folder);
         virtual String * lastFolder();
+        // Folder actually selected on the connection. It must only be called when no operation is running.
+        virtual String * selectedFolder();
         
         virtual void tryAutomaticDisconnect();
         virtual void queueStartRunning();
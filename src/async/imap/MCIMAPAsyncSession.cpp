@@ -28,6 +28,8 @@
 #include "MCIMAPCopyMessagesOperation.h"
 #include "MCIMAPFetchMessagesOperation.h"
 #include "MCIMAPFetchContentOperation.h"
+#include "MCIMAPParallelFetchContentOperation.h"
+#include "MCIMAPFetchMessageBodiesOperation.h"
 #include "MCIMAPFetchParsedContentOperation.h"
 #include "MCIMAPStoreFlagsOperation.h"
 #include "MCIMAPStoreLabelsOperation.h"
@@ -49,9 +51,17 @@ using namespace mailcore;
 
 IMAPAsyncSession::IMAPAsyncSession()
 {
+    pthread_mutexattr_t attr;
+    
     mSessions = new Array();
+    // Operations started from a callback run on the connection thread with the lock already taken.
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mLock, &attr);
+    pthread_mutexattr_destroy(&attr);
     mMaximumConnections = DEFAULT_MAX_CONNECTIONS;
     mAllowsFolderConcurrentAccessEnabled = true;
+    mWorkStealingEnabled = false;
 
     mHostname = NULL;
     mPort = 0;
@@ -62,6 +72,8 @@ IMAPAsyncSession::IMAPAsyncSession()
     mConnectionType = ConnectionTypeClear;
     mCheckCertificateEnabled = true;
     mVoIPEnabled = true;
+    mFetchChunkSize = 0;
+    mFetchPipelineDepth = 1;
     mDefaultNamespace = NULL;
     mTimeout = 30.;
     mConnectionLogger = NULL;
@@ -69,6 +81,7 @@ IMAPAsyncSession::IMAPAsyncSession()
     mServerIdentity = new IMAPIdentity();
     mClientIdentity = new IMAPIdentity();
     mOperationQueueCallback = NULL;
+    mCallbackExecutor = NULL;
 #if __APPLE__
     mDispatchQueue = dispatch_get_main_queue();
 #endif
@@ -92,6 +105,17 @@ IMAPAsyncSession::~IMAPAsyncSession()
     MC_SAFE_RELEASE(mPassword);
     MC_SAFE_RELEASE(mOAuth2Token);
     MC_SAFE_RELEASE(mDefaultNamespace);
+    pthread_mutex_destroy(&mLock);
+}
+
+void IMAPAsyncSession::lock()
+{
+    pthread_mutex_lock(&mLock);
+}
+
+void IMAPAsyncSession::unlock()
+{
+    pthread_mutex_unlock(&mLock);
 }
 
 void IMAPAsyncSession::setHostname(String * hostname)
@@ -194,6 +218,26 @@ bool IMAPAsyncSession::isVoIPEnabled()
     return mVoIPEnabled;
 }
 
+void IMAPAsyncSession::setFetchChunkSize(unsigned int chunkSize)
+{
+    mFetchChunkSize = chunkSize;
+}
+
+unsigned int IMAPAsyncSession::fetchChunkSize()
+{
+    return mFetchChunkSize;
+}
+
+void IMAPAsyncSession::setFetchPipelineDepth(unsigned int depth)
+{
+    mFetchPipelineDepth = depth;
+}
+
+unsigned int IMAPAsyncSession::fetchPipelineDepth()
+{
+    return mFetchPipelineDepth;
+}
+
 IMAPNamespace * IMAPAsyncSession::defaultNamespace()
 {
     return mDefaultNamespace;
@@ -224,9 +268,37 @@ unsigned int IMAPAsyncSession::maximumConnections()
     return mMaximumConnections;
 }
 
+void IMAPAsyncSession::setWorkStealingEnabled(bool enabled)
+{
+    mWorkStealingEnabled = enabled;
+}
+
+bool IMAPAsyncSession::isWorkStealingEnabled()
+{
+    return mWorkStealingEnabled;
+}
+
+Array * IMAPAsyncSession::connectionsMetrics()
+{
+    Array * result = Array::array();
+    lock();
+    for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
+        IMAPAsyncConnection * s = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
+        result->addObject(s->metrics());
+    }
+    unlock();
+    return result;
+}
+
 IMAPIdentity * IMAPAsyncSession::serverIdentity()
 {
-    return mServerIdentity;
+    IMAPIdentity * identity;
+    
+    // afterMain() of an operation can replace it on the thread of a connection.
+    lock();
+    identity = (IMAPIdentity *) mServerIdentity->retain()->autorelease();
+    unlock();
+    return identity;
 }
 
 IMAPIdentity * IMAPAsyncSession::clientIdentity()
@@ -236,7 +308,15 @@ IMAPIdentity * IMAPAsyncSession::clientIdentity()
 
 String * IMAPAsyncSession::gmailUserDisplayName()
 {
-    return mGmailUserDisplayName;
+    String * name;
+    
+    lock();
+    name = mGmailUserDisplayName;
+    if (name != NULL) {
+        name->retain()->autorelease();
+    }
+    unlock();
+    return name;
 }
 
 IMAPAsyncConnection * IMAPAsyncSession::session()
@@ -256,11 +336,14 @@ IMAPAsyncConnection * IMAPAsyncSession::session()
     session->setTimeout(mTimeout);
     session->setCheckCertificateEnabled(mCheckCertificateEnabled);
     session->setVoIPEnabled(mVoIPEnabled);
+    session->setFetchChunkSize(mFetchChunkSize);
+    session->setFetchPipelineDepth(mFetchPipelineDepth);
     session->setDefaultNamespace(mDefaultNamespace);
     session->setClientIdentity(mClientIdentity);
 #if __APPLE__
     session->setDispatchQueue(mDispatchQueue);
 #endif
+    session->setCallbackExecutor(mCallbackExecutor);
 #if 0 // should be implemented properly
     if (mAutomaticConfigurationDone) {
         session->setAutomaticConfigurationEnabled(false);
@@ -347,6 +430,78 @@ IMAPAsyncConnection * IMAPAsyncSession::matchingSessionForFolder(String * folder
     return availableSession();
 }
 
+void IMAPAsyncSession::scheduleIdleConnections()
+{
+    if (!mWorkStealingEnabled || !mAllowsFolderConcurrentAccessEnabled) {
+        return;
+    }
+    
+    lock();
+    for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
+        IMAPAsyncConnection * s = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
+        if (s->operationsCount() == 0) {
+            stealOperation(s);
+        }
+    }
+    unlock();
+}
+
+bool IMAPAsyncSession::stealOperation(IMAPAsyncConnection * session)
+{
+    IMAPAsyncConnection * victim = NULL;
+    IMAPOperation * stolenOperation = NULL;
+    unsigned int maxOperationsCount = 0;
+    // lastFolder() is only the folder of the last operation scheduled on the connection, whose
+    // SELECT may have failed. The connection is idle: its selected folder can be read safely.
+    String * selectedFolder = session->selectedFolder();
+    
+    // Only the first waiting operation of a queue is considered so that the operations
+    // of a given connection still start in the order they were added.
+    for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
+        IMAPAsyncConnection * s = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
+        if (s == session) {
+            continue;
+        }
+        unsigned int operationsCount = s->operationsCount();
+        if (operationsCount < 2 || operationsCount <= maxOperationsCount) {
+            continue;
+        }
+        Array * pendingOperations = s->pendingOperations();
+        if (pendingOperations->count() == 0) {
+            continue;
+        }
+        IMAPOperation * op = (IMAPOperation *) pendingOperations->objectAtIndex(0);
+        if (!op->isReschedulable() || op->isCancelled()) {
+            continue;
+        }
+        if ((op->folder() != NULL) && (selectedFolder != NULL) &&
+            (selectedFolder->caseInsensitiveCompare(op->folder()) != 0)) {
+            continue;
+        }
+        victim = s;
+        stolenOperation = op;
+        maxOperationsCount = operationsCount;
+    }
+    
+    if (stolenOperation == NULL) {
+        return false;
+    }
+    
+    stolenOperation->retain();
+    bool removed = victim->removePendingOperation(stolenOperation);
+    if (removed) {
+        stolenOperation->setSession(session);
+        if (stolenOperation->folder() != NULL) {
+            session->setLastFolder(stolenOperation->folder());
+        }
+        session->operationStolen();
+        session->runOperation(stolenOperation);
+    }
+    stolenOperation->release();
+    
+    return removed;
+}
+
 IMAPFolderInfoOperation * IMAPAsyncSession::folderInfoOperation(String * folder)
 {
     IMAPFolderInfoOperation * op = new IMAPFolderInfoOperation();
@@ -356,6 +511,19 @@ IMAPFolderInfoOperation * IMAPAsyncSession::folderInfoOperation(String * folder)
     return op;
 }
 
+IMAPFolderInfoOperation * IMAPAsyncSession::resyncFolderOperation(String * folder, uint32_t uidValidity,
+                                                                  uint64_t modSequenceValue, IndexSet * knownUids)
+{
+    IMAPFolderInfoOperation * op = new IMAPFolderInfoOperation();
+    op->setMainSession(this);
+    op->setFolder(folder);
+    op->setLastKnownUidValidity(uidValidity);
+    op->setLastKnownModSequenceValue(modSequenceValue);
+    op->setKnownUids(knownUids);
+    op->autorelease();
+    return op;
+}
+
 IMAPFolderStatusOperation * IMAPAsyncSession::folderStatusOperation(String * folder)
 {
     IMAPFolderStatusOperation * op = new IMAPFolderStatusOperation();
@@ -525,6 +693,36 @@ IMAPFetchContentOperation * IMAPAsyncSession::fetchMessageAttachmentByUIDOperati
     return op;
 }
 
+IMAPFetchMessageBodiesOperation * IMAPAsyncSession::fetchMessageBodiesByUIDOperation(String * folder, IndexSet * uids,
+                                                                                     String * partID)
+{
+    IMAPFetchMessageBodiesOperation * op = new IMAPFetchMessageBodiesOperation();
+    op->setMainSession(this);
+    op->setFolder(folder);
+    op->setUids(uids);
+    op->setPartID(partID);
+    op->autorelease();
+    return op;
+}
+
+IMAPParallelFetchContentOperation * IMAPAsyncSession::parallelFetchMessageAttachmentByUIDOperation(String * folder, uint32_t uid, String * partID,
+                                                                                                  Encoding encoding, uint32_t size)
+{
+    IMAPParallelFetchContentOperation * op = new IMAPParallelFetchContentOperation();
+    op->setMainSession(this);
+    op->setFolder(folder);
+    op->setUid(uid);
+    op->setPartID(partID);
+    op->setEncoding(encoding);
+    op->setSize(size);
+#if __APPLE__
+    op->setCallbackDispatchQueue(mDispatchQueue);
+#endif
+    op->setCallbackExecutor(mCallbackExecutor);
+    op->autorelease();
+    return op;
+}
+
 IMAPFetchContentOperation * IMAPAsyncSession::fetchMessageByNumberOperation(String * folder, uint32_t number, bool urgent)
 {
     IMAPFetchContentOperation * op = new IMAPFetchContentOperation();
@@ -714,20 +912,24 @@ IMAPOperation * IMAPAsyncSession::disconnectOperation()
 {
     IMAPMultiDisconnectOperation * op = new IMAPMultiDisconnectOperation();
     op->autorelease();
+    lock();
     for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
         IMAPAsyncConnection * currentSession = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
         op->addOperation(currentSession->disconnectOperation());
     }
+    unlock();
     return op;
 }
 
 void IMAPAsyncSession::setConnectionLogger(ConnectionLogger * logger)
 {
+    lock();
     mConnectionLogger = logger;
     for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
         IMAPAsyncConnection * currentSession = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
         currentSession->setConnectionLogger(logger);
     }
+    unlock();
 }
 
 ConnectionLogger * IMAPAsyncSession::connectionLogger()
@@ -775,12 +977,23 @@ IMAPMessageRenderingOperation * IMAPAsyncSession::plainTextBodyRenderingOperatio
                               IMAPMessageRenderingTypePlainTextBody);
 }
 
+IMAPMessageRenderingOperation * IMAPAsyncSession::plainTextPreviewOperation(IMAPMessage * message,
+                                                                            String * folder,
+                                                                            unsigned int maximumLength)
+{
+    IMAPMessageRenderingOperation * op = renderingOperation(message, folder, IMAPMessageRenderingTypePlainTextPreview);
+    op->setMaximumLength(maximumLength);
+    return op;
+}
+
 void IMAPAsyncSession::automaticConfigurationDone(IMAPSession * session)
 {
+    lock();
     MC_SAFE_REPLACE_COPY(IMAPIdentity, mServerIdentity, session->serverIdentity());
     MC_SAFE_REPLACE_COPY(String, mGmailUserDisplayName, session->gmailUserDisplayName());
     setDefaultNamespace(session->defaultNamespace());
     mAutomaticConfigurationDone = true;
+    unlock();
 }
 
 void IMAPAsyncSession::setOperationQueueCallback(OperationQueueCallback * callback)
@@ -800,15 +1013,20 @@ bool IMAPAsyncSession::isOperationQueueRunning()
 
 void IMAPAsyncSession::cancelAllOperations()
 {
+    lock();
     for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
         IMAPAsyncConnection * currentSession = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
         currentSession->cancelAllOperations();
     }
+    unlock();
 }
 
 void IMAPAsyncSession::operationRunningStateChanged()
 {
     bool isRunning = false;
+    bool changed;
+    
+    lock();
     for(unsigned int i = 0 ; i < mSessions->count() ; i ++) {
         IMAPAsyncConnection * currentSession = (IMAPAsyncConnection *) mSessions->objectAtIndex(i);
         if (currentSession->isQueueRunning()){
@@ -816,10 +1034,12 @@ void IMAPAsyncSession::operationRunningStateChanged()
             break;
         }
     }
-    if (mQueueRunning == isRunning) {
+    changed = (mQueueRunning != isRunning);
+    mQueueRunning = isRunning;
+    unlock();
+    if (!changed) {
         return;
     }
-    mQueueRunning = isRunning;
     if (mOperationQueueCallback != NULL) {
         if (isRunning) {
             mOperationQueueCallback->queueStartRunning();
@@ -847,3 +1067,18 @@ dispatch_queue_t IMAPAsyncSession::dispatchQueue()
     return mDispatchQueue;
 }
 #endif
+
+void IMAPAsyncSession::setCallbackExecutor(CallbackExecutor * executor)
+{
+    lock();
+    mCallbackExecutor = executor;
+    mc_foreacharray(IMAPAsyncConnection, s, mSessions) {
+        s->setCallbackExecutor(executor);
+    }
+    unlock();
+}
+
+CallbackExecutor * IMAPAsyncSession::callbackExecutor()
+{
+    return mCallbackExecutor;
+}
@@ -23,6 +23,8 @@ namespace mailcore {
     class IMAPCopyMessagesOperation;
     class IMAPFetchMessagesOperation;
     class IMAPFetchContentOperation;
+    class IMAPParallelFetchContentOperation;
+    class IMAPFetchMessageBodiesOperation;
     class IMAPFetchParsedContentOperation;
     class IMAPIdleOperation;
     class IMAPFolderInfoOperation;
@@ -78,6 +80,14 @@ namespace mailcore {
         virtual void setVoIPEnabled(bool enabled);
         virtual bool isVoIPEnabled();
         
+        // See IMAPSession::setFetchChunkSize().
+        virtual void setFetchChunkSize(unsigned int chunkSize);
+        virtual unsigned int fetchChunkSize();
+        
+        // See IMAPSession::setFetchPipelineDepth().
+        virtual void setFetchPipelineDepth(unsigned int depth);
+        virtual unsigned int fetchPipelineDepth();
+        
         virtual void setDefaultNamespace(IMAPNamespace * ns);
         virtual IMAPNamespace * defaultNamespace();
         
@@ -87,6 +97,16 @@ namespace mailcore {
         virtual void setMaximumConnections(unsigned int maxConnections);
         virtual unsigned int maximumConnections();
         
+        // When enabled, an idle connection takes the next operation waiting on a busy connection
+        // if it has the same folder selected or if the operation doesn't need a folder.
+        // It requires allowsFolderConcurrentAccessEnabled. Default is false.
+        virtual void setWorkStealingEnabled(bool enabled);
+        virtual bool isWorkStealingEnabled();
+        
+        // One HashMap per connection with queueDepth, maxQueueDepth, startedOperationsCount,
+        // stolenOperationsCount, totalWaitTime, maxWaitTime (in seconds) and lastFolder.
+        virtual Array * connectionsMetrics();
+        
         virtual void setConnectionLogger(ConnectionLogger * logger);
         virtual ConnectionLogger * connectionLogger();
         
@@ -94,6 +114,14 @@ namespace mailcore {
         virtual void setDispatchQueue(dispatch_queue_t dispatchQueue);
         virtual dispatch_queue_t dispatchQueue();
 #endif
+
+        // Callbacks of the operations created afterwards, including beforeMain() and afterMain(),
+        // are run by the executor instead of the main thread. CallbackExecutor::inlineExecutor()
+        // runs them on the thread of the connection, without waiting for the main thread, and
+        // operations can be started from there. Since connections run in parallel, callbacks of
+        // different operations can then be called at the same time.
+        virtual void setCallbackExecutor(CallbackExecutor * executor);
+        virtual CallbackExecutor * callbackExecutor();
         
         virtual void setOperationQueueCallback(OperationQueueCallback * callback);
         virtual OperationQueueCallback * operationQueueCallback();
@@ -105,6 +133,10 @@ namespace mailcore {
         virtual String * gmailUserDisplayName() DEPRECATED_ATTRIBUTE;
         
         virtual IMAPFolderInfoOperation * folderInfoOperation(String * folder);
+        // Selects the folder and gets the changes since the last known mod-sequence value.
+        // knownUids can be NULL.
+        virtual IMAPFolderInfoOperation * resyncFolderOperation(String * folder, uint32_t uidValidity,
+                                                                uint64_t modSequenceValue, IndexSet * knownUids);
         virtual IMAPFolderStatusOperation * folderStatusOperation(String * folder);
         
         virtual IMAPFetchFoldersOperation * fetchSubscribedFoldersOperation();
@@ -134,6 +166,16 @@ namespace mailcore {
         virtual IMAPFetchContentOperation * fetchMessageAttachmentByUIDOperation(String * folder, uint32_t uid, String * partID,
                                                                                  Encoding encoding, bool urgent = false);
         
+        // Fetches the bodies of the messages, or the given part of each of them, with a single command.
+        // See IMAPFetchMessageBodiesOperation.
+        virtual IMAPFetchMessageBodiesOperation * fetchMessageBodiesByUIDOperation(String * folder, IndexSet * uids,
+                                                                                   String * partID = NULL);
+        
+        // Fetches the part in ranges over several connections. size is the size of the part as
+        // sent by the server, IMAPPart::size() for example.
+        virtual IMAPParallelFetchContentOperation * parallelFetchMessageAttachmentByUIDOperation(String * folder, uint32_t uid, String * partID,
+                                                                                                Encoding encoding, uint32_t size);
+        
         virtual IMAPFetchContentOperation * fetchMessageByNumberOperation(String * folder, uint32_t number, bool urgent = false);
         virtual IMAPFetchContentOperation * fetchMessageAttachmentByNumberOperation(String * folder, uint32_t number, String * partID,
                                                                                     Encoding encoding, bool urgent = false);
@@ -168,14 +210,20 @@ namespace mailcore {
         virtual IMAPMessageRenderingOperation * htmlBodyRenderingOperation(IMAPMessage * message, String * folder);
         virtual IMAPMessageRenderingOperation * plainTextRenderingOperation(IMAPMessage * message, String * folder);
         virtual IMAPMessageRenderingOperation * plainTextBodyRenderingOperation(IMAPMessage * message, String * folder, bool stripWhitespace);
+        virtual IMAPMessageRenderingOperation * plainTextPreviewOperation(IMAPMessage * message, String * folder, unsigned int maximumLength);
         
     public: // private
         virtual void automaticConfigurationDone(IMAPSession * session);
         virtual void operationRunningStateChanged();
         virtual IMAPAsyncConnection * sessionForFolder(String * folder, bool urgent = false);
+        virtual void scheduleIdleConnections();
+        // Guards the connections and the state they share. It can be taken recursively.
+        virtual void lock();
+        virtual void unlock();
         
     private:
         Array * mSessions;
+        pthread_mutex_t mLock;
         
         String * mHostname;
         unsigned int mPort;
@@ -186,10 +234,13 @@ namespace mailcore {
         ConnectionType mConnectionType;
         bool mCheckCertificateEnabled;
         bool mVoIPEnabled;
+        unsigned int mFetchChunkSize;
+        unsigned int mFetchPipelineDepth;
         IMAPNamespace * mDefaultNamespace;
         time_t mTimeout;
         bool mAllowsFolderConcurrentAccessEnabled;
         unsigned int mMaximumConnections;
+        bool mWorkStealingEnabled;
         ConnectionLogger * mConnectionLogger;
         bool mAutomaticConfigurationDone;
         IMAPIdentity * mServerIdentity;
@@ -199,11 +250,13 @@ namespace mailcore {
 #if __APPLE__
         dispatch_queue_t mDispatchQueue;
 #endif
+        CallbackExecutor * mCallbackExecutor;
         String * mGmailUserDisplayName;
         
         virtual IMAPAsyncConnection * session();
         virtual IMAPAsyncConnection * matchingSessionForFolder(String * folder);
         virtual IMAPAsyncConnection * availableSession();
+        virtual bool stealOperation(IMAPAsyncConnection * session);
         virtual IMAPMessageRenderingOperation * renderingOperation(IMAPMessage * message,
                                                                    String * folder,
                                                                    IMAPMessageRenderingType type);
@@ -19,6 +19,8 @@ IMAPFetchContentOperation::IMAPFetchContentOperation()
     mNumber = 0;
     mPartID = NULL;
     mEncoding = Encoding7Bit;
+    mOffset = 0;
+    mLength = 0;
     mData = NULL;
 }
 
@@ -68,6 +70,26 @@ Encoding IMAPFetchContentOperation::encoding()
     return mEncoding;
 }
 
+void IMAPFetchContentOperation::setOffset(uint32_t offset)
+{
+    mOffset = offset;
+}
+
+uint32_t IMAPFetchContentOperation::offset()
+{
+    return mOffset;
+}
+
+void IMAPFetchContentOperation::setLength(uint32_t length)
+{
+    mLength = length;
+}
+
+uint32_t IMAPFetchContentOperation::length()
+{
+    return mLength;
+}
+
 Data * IMAPFetchContentOperation::data()
 {
     return mData;
@@ -77,7 +99,10 @@ void IMAPFetchContentOperation::main()
 {
     ErrorCode error;
     if (mUid != 0) {
-        if (mPartID != NULL) {
+        if ((mPartID != NULL) && (mLength != 0)) {
+            mData = session()->session()->fetchMessageAttachmentRangeByUID(folder(), mUid, mPartID, mOffset, mLength, this, &error);
+        }
+        else if (mPartID != NULL) {
             mData = session()->session()->fetchMessageAttachmentByUID(folder(), mUid, mPartID, mEncoding, this, &error);
         }
         else {
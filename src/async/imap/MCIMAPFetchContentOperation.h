@@ -33,6 +33,14 @@ namespace mailcore {
         virtual void setEncoding(Encoding encoding);
         virtual Encoding encoding();
         
+        // When length is not zero, only that range of the part is fetched, by UID, and it's not
+        // decoded. See IMAPSession::fetchMessageAttachmentRangeByUID().
+        virtual void setOffset(uint32_t offset);
+        virtual uint32_t offset();
+        
+        virtual void setLength(uint32_t length);
+        virtual uint32_t length();
+        
         // Result.
         virtual Data * data();
         
@@ -44,6 +52,8 @@ namespace mailcore {
         uint32_t mNumber;
         String * mPartID;
         Encoding mEncoding;
+        uint32_t mOffset;
+        uint32_t mLength;
         Data * mData;
         
     };
@@ -0,0 +1,107 @@
+#include "MCIMAPFetchMessageBodiesOperation.h"
+
+#include <stdlib.h>
+
+#include "MCIMAPSession.h"
+#include "MCIMAPAsyncConnection.h"
+#include "MCIMAPOperationCallback.h"
+
+using namespace mailcore;
+
+#define DEFAULT_MAXIMUM_IN_FLIGHT_BYTES (16 * 1024 * 1024)
+
+struct fetchedBody {
+    uint32_t uid;
+    Data * data;
+};
+
+IMAPFetchMessageBodiesOperation::IMAPFetchMessageBodiesOperation()
+{
+    mUids = NULL;
+    mPartID = NULL;
+    mMaximumInFlightBytes = DEFAULT_MAXIMUM_IN_FLIGHT_BYTES;
+    mInFlightBytes = 0;
+    pthread_mutex_init(&mInFlightLock, NULL);
+    pthread_cond_init(&mInFlightCond, NULL);
+}
+
+IMAPFetchMessageBodiesOperation::~IMAPFetchMessageBodiesOperation()
+{
+    pthread_cond_destroy(&mInFlightCond);
+    pthread_mutex_destroy(&mInFlightLock);
+    MC_SAFE_RELEASE(mUids);
+    MC_SAFE_RELEASE(mPartID);
+}
+
+void IMAPFetchMessageBodiesOperation::setUids(IndexSet * uids)
+{
+    MC_SAFE_REPLACE_RETAIN(IndexSet, mUids, uids);
+}
+
+IndexSet * IMAPFetchMessageBodiesOperation::uids()
+{
+    return mUids;
+}
+
+void IMAPFetchMessageBodiesOperation::setPartID(String * partID)
+{
+    MC_SAFE_REPLACE_COPY(String, mPartID, partID);
+}
+
+String * IMAPFetchMessageBodiesOperation::partID()
+{
+    return mPartID;
+}
+
+void IMAPFetchMessageBodiesOperation::setMaximumInFlightBytes(unsigned int maximumInFlightBytes)
+{
+    mMaximumInFlightBytes = maximumInFlightBytes;
+}
+
+unsigned int IMAPFetchMessageBodiesOperation::maximumInFlightBytes()
+{
+    return mMaximumInFlightBytes;
+}
+
+void IMAPFetchMessageBodiesOperation::bodyFetched(IMAPSession * session, uint32_t uid, String * partID, Data * data)
+{
+    if (isCancelled())
+        return;
+    
+    pthread_mutex_lock(&mInFlightLock);
+    while ((mInFlightBytes > 0) && (mInFlightBytes + data->length() > mMaximumInFlightBytes)) {
+        pthread_cond_wait(&mInFlightCond, &mInFlightLock);
+    }
+    mInFlightBytes += data->length();
+    pthread_mutex_unlock(&mInFlightLock);
+    
+    struct fetchedBody * body = (struct fetchedBody *) malloc(sizeof(* body));
+    body->uid = uid;
+    body->data = (Data *) data->retain();
+    retain();
+    performMethodOnCallbackThread((Object::Method) &IMAPFetchMessageBodiesOperation::bodyFetchedOnMainThread, body, false);
+}
+
+void IMAPFetchMessageBodiesOperation::bodyFetchedOnMainThread(void * context)
+{
+    struct fetchedBody * body = (struct fetchedBody *) context;
+    if (!isCancelled() && (imapCallback() != NULL)) {
+        imapCallback()->bodyFetched(this, body->uid, body->data);
+    }
+    
+    pthread_mutex_lock(&mInFlightLock);
+    mInFlightBytes -= body->data->length();
+    pthread_cond_signal(&mInFlightCond);
+    pthread_mutex_unlock(&mInFlightLock);
+    
+    body->data->release();
+    free(body);
+    release();
+}
+
+void IMAPFetchMessageBodiesOperation::main()
+{
+    ErrorCode error;
+    session()->session()->streamMessageBodiesByUID(folder(), mUids, mPartID, this, this, &error);
+    setError(error);
+}
@@ -0,0 +1,53 @@
+#ifndef MAILCORE_MCIMAPFETCHMESSAGEBODIESOPERATION_H
+
+#define MAILCORE_MCIMAPFETCHMESSAGEBODIESOPERATION_H
+
+#include <pthread.h>
+#include <MailCore/MCIMAPOperation.h>
+#include <MailCore/MCIMAPFetchMessagesCallback.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+    
+    // Fetches the bodies of several messages with a single FETCH command and passes each of them to
+    // IMAPOperationCallback::bodyFetched() as soon as it has been received.
+    class MAILCORE_EXPORT IMAPFetchMessageBodiesOperation : public IMAPOperation, public IMAPFetchMessagesCallback {
+    public:
+        IMAPFetchMessageBodiesOperation();
+        virtual ~IMAPFetchMessageBodiesOperation();
+        
+        virtual void setUids(IndexSet * uids);
+        virtual IndexSet * uids();
+        
+        // The whole messages are fetched when it's NULL.
+        virtual void setPartID(String * partID);
+        virtual String * partID();
+        
+        // Bytes of the bodies passed to the callback thread that the callback didn't return from yet.
+        // The connection stops reading when it's reached, until the callback catches up.
+        // Default is 16MB. There's always at least one body in flight.
+        virtual void setMaximumInFlightBytes(unsigned int maximumInFlightBytes);
+        virtual unsigned int maximumInFlightBytes();
+        
+    public: // subclass behavior
+        virtual void main();
+        
+    private:
+        IndexSet * mUids;
+        String * mPartID;
+        unsigned int mMaximumInFlightBytes;
+        unsigned int mInFlightBytes;
+        pthread_mutex_t mInFlightLock;
+        pthread_cond_t mInFlightCond;
+        
+        virtual void bodyFetched(IMAPSession * session, uint32_t uid, String * partID, Data * data);
+        virtual void bodyFetchedOnMainThread(void * context);
+        
+    };
+    
+}
+
+#endif
+
+#endif
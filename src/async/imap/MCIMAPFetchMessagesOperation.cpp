@@ -11,6 +11,7 @@
 #include "MCIMAPSession.h"
 #include "MCIMAPAsyncConnection.h"
 #include "MCIMAPSyncResult.h"
+#include "MCIMAPOperationCallback.h"
 
 using namespace mailcore;
 
@@ -22,6 +23,7 @@ IMAPFetchMessagesOperation::IMAPFetchMessagesOperation()
     mVanishedMessages = NULL;
     mModSequenceValue = 0;
     mExtraHeaders = NULL;
+    mBatchSize = 0;
 }
 
 IMAPFetchMessagesOperation::~IMAPFetchMessagesOperation()
@@ -80,6 +82,16 @@ Array * IMAPFetchMessagesOperation::extraHeaders() {
     return mExtraHeaders;
 }
 
+void IMAPFetchMessagesOperation::setBatchSize(unsigned int batchSize)
+{
+    mBatchSize = batchSize;
+}
+
+unsigned int IMAPFetchMessagesOperation::batchSize()
+{
+    return mBatchSize;
+}
+
 Array * IMAPFetchMessagesOperation::messages()
 {
     return mMessages;
@@ -90,9 +102,44 @@ IndexSet * IMAPFetchMessagesOperation::vanishedMessages()
     return mVanishedMessages;
 }
 
+void IMAPFetchMessagesOperation::messagesFetched(IMAPSession * session, Array * messages)
+{
+    if (isCancelled())
+        return;
+    
+    // The array is reused by the session for the next batch.
+    Array * batch = (Array *) messages->copy();
+    retain();
+    performMethodOnCallbackThread((Object::Method) &IMAPFetchMessagesOperation::messagesFetchedOnMainThread, batch, true);
+}
+
+void IMAPFetchMessagesOperation::messagesFetchedOnMainThread(void * context)
+{
+    Array * batch = (Array *) context;
+    if (!isCancelled() && (imapCallback() != NULL)) {
+        imapCallback()->messagesFetched(this, batch);
+    }
+    batch->release();
+    release();
+}
+
 void IMAPFetchMessagesOperation::main()
 {
     ErrorCode error;
+    if (mBatchSize > 0) {
+        if (mFetchByUidEnabled) {
+            mVanishedMessages = session()->session()->streamMessagesByUID(folder(), mKind, mIndexes, mModSequenceValue,
+                                                                          mBatchSize, this, this, mExtraHeaders, &error);
+        }
+        else {
+            session()->session()->streamMessagesByNumber(folder(), mKind, mIndexes, mBatchSize, this, this,
+                                                         mExtraHeaders, &error);
+        }
+        MC_SAFE_RETAIN(mVanishedMessages);
+        setError(error);
+        return;
+    }
+    
     if (mFetchByUidEnabled) {
         if (mModSequenceValue != 0) {
             IMAPSyncResult * syncResult;
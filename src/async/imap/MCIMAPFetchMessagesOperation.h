@@ -11,12 +11,13 @@
 #define MAILCORE_MCIMAPFETCHMESSAGESOPERATION_H
 
 #include <MailCore/MCIMAPOperation.h>
+#include <MailCore/MCIMAPFetchMessagesCallback.h>
 
 #ifdef __cplusplus
 
 namespace mailcore {
     
-    class MAILCORE_EXPORT IMAPFetchMessagesOperation : public IMAPOperation {
+    class MAILCORE_EXPORT IMAPFetchMessagesOperation : public IMAPOperation, public IMAPFetchMessagesCallback {
     public:
         IMAPFetchMessagesOperation();
         virtual ~IMAPFetchMessagesOperation();
@@ -36,6 +37,11 @@ namespace mailcore {
         virtual void setExtraHeaders(Array * extraHeaders);
         virtual Array * extraHeaders();
         
+        // When set, messages are passed to IMAPOperationCallback::messagesFetched() in batches of at most
+        // batchSize messages while they are received, and messages() will return NULL.
+        virtual void setBatchSize(unsigned int batchSize);
+        virtual unsigned int batchSize();
+        
         // Result.
         virtual Array * /* IMAPMessage */ messages();
         virtual IndexSet * vanishedMessages();
@@ -51,6 +57,10 @@ namespace mailcore {
         Array * /* IMAPMessage */ mMessages;
         IndexSet * mVanishedMessages;
         uint64_t mModSequenceValue;
+        unsigned int mBatchSize;
+        
+        virtual void messagesFetched(IMAPSession * session, Array * messages);
+        virtual void messagesFetchedOnMainThread(void * context);
         
     };
     
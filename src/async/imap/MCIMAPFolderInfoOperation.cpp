@@ -11,17 +11,24 @@
 #include "MCIMAPSession.h"
 #include "MCIMAPAsyncConnection.h"
 #include "MCIMAPFolderInfo.h"
+#include "MCIMAPSyncResult.h"
 
 using namespace mailcore;
 
 IMAPFolderInfoOperation::IMAPFolderInfoOperation()
 {
     mInfo = NULL;
+    mLastKnownUidValidity = 0;
+    mLastKnownModSequenceValue = 0;
+    mKnownUids = NULL;
+    mSyncResult = NULL;
 }
 
 IMAPFolderInfoOperation::~IMAPFolderInfoOperation()
 {
     MC_SAFE_RELEASE(mInfo);
+    MC_SAFE_RELEASE(mKnownUids);
+    MC_SAFE_RELEASE(mSyncResult);
 }
 
 IMAPFolderInfo * IMAPFolderInfoOperation::info()
@@ -29,6 +36,41 @@ IMAPFolderInfo * IMAPFolderInfoOperation::info()
     return mInfo;
 }
 
+void IMAPFolderInfoOperation::setLastKnownUidValidity(uint32_t uidValidity)
+{
+    mLastKnownUidValidity = uidValidity;
+}
+
+uint32_t IMAPFolderInfoOperation::lastKnownUidValidity()
+{
+    return mLastKnownUidValidity;
+}
+
+void IMAPFolderInfoOperation::setLastKnownModSequenceValue(uint64_t modSequenceValue)
+{
+    mLastKnownModSequenceValue = modSequenceValue;
+}
+
+uint64_t IMAPFolderInfoOperation::lastKnownModSequenceValue()
+{
+    return mLastKnownModSequenceValue;
+}
+
+void IMAPFolderInfoOperation::setKnownUids(IndexSet * uids)
+{
+    MC_SAFE_REPLACE_RETAIN(IndexSet, mKnownUids, uids);
+}
+
+IndexSet * IMAPFolderInfoOperation::knownUids()
+{
+    return mKnownUids;
+}
+
+IMAPSyncResult * IMAPFolderInfoOperation::syncResult()
+{
+    return mSyncResult;
+}
+
 void IMAPFolderInfoOperation::main()
 {
     ErrorCode error;
@@ -39,7 +81,14 @@ void IMAPFolderInfoOperation::main()
         return;
     }
     
-    session()->session()->select(folder(), &error);
+    if (mLastKnownModSequenceValue != 0) {
+        IMAPSyncResult * syncResult = session()->session()->selectWithQResync(folder(), mLastKnownUidValidity,
+                                                                             mLastKnownModSequenceValue, mKnownUids, &error);
+        MC_SAFE_REPLACE_RETAIN(IMAPSyncResult, mSyncResult, syncResult);
+    }
+    else {
+        session()->session()->select(folder(), &error);
+    }
     if (error != ErrorNone) {
         setError(error);
         return;
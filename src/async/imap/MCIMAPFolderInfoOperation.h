@@ -17,6 +17,7 @@
 namespace mailcore {
 
     class IMAPFolderInfo;
+    class IMAPSyncResult;
     
     class MAILCORE_EXPORT IMAPFolderInfoOperation : public IMAPOperation {
     public:
@@ -24,6 +25,20 @@ namespace mailcore {
         virtual ~IMAPFolderInfoOperation();
 
         IMAPFolderInfo * info();
+        
+        // When a mod-sequence value is set, the changes since then are fetched while selecting
+        // the folder, using QRESYNC if available. See IMAPSession::selectWithQResync().
+        virtual void setLastKnownUidValidity(uint32_t uidValidity);
+        virtual uint32_t lastKnownUidValidity();
+        
+        virtual void setLastKnownModSequenceValue(uint64_t modSequenceValue);
+        virtual uint64_t lastKnownModSequenceValue();
+        
+        virtual void setKnownUids(IndexSet * uids);
+        virtual IndexSet * knownUids();
+        
+        // Result.
+        virtual IMAPSyncResult * syncResult();
 
     public: // subclass behavior
         virtual void main();
@@ -31,6 +46,10 @@ namespace mailcore {
     private:
 
         IMAPFolderInfo * mInfo;
+        uint32_t mLastKnownUidValidity;
+        uint64_t mLastKnownModSequenceValue;
+        IndexSet * mKnownUids;
+        IMAPSyncResult * mSyncResult;
 
     };
 
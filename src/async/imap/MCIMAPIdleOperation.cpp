@@ -10,6 +10,10 @@
 
 #include "MCIMAPSession.h"
 #include "MCIMAPAsyncConnection.h"
+#include "MCIMAPIdleMultiplexer.h"
+#include "MCIMAPIdleChanges.h"
+
+#include <libetpan/libetpan.h>
 
 using namespace mailcore;
 
@@ -19,10 +23,19 @@ IMAPIdleOperation::IMAPIdleOperation()
     mSetupSuccess = false;
     mInterrupted = false;
     pthread_mutex_init(&mLock, NULL);
+    mIdleWatch = NULL;
+    mIdleWatchStarted = false;
+    mWaitThreadStarted = false;
+    mWaitResult = MAILSTREAM_IDLE_ERROR;
+    mChanges = NULL;
 }
 
 IMAPIdleOperation::~IMAPIdleOperation()
 {
+    if (mIdleWatch != NULL) {
+        idleWatchFree(mIdleWatch);
+    }
+    MC_SAFE_RELEASE(mChanges);
     pthread_mutex_destroy(&mLock);
 }
 
@@ -36,6 +49,11 @@ uint32_t IMAPIdleOperation::lastKnownUID()
     return mLastKnownUid;
 }
 
+IMAPIdleChanges * IMAPIdleOperation::changes()
+{
+    return mChanges;
+}
+
 void IMAPIdleOperation::prepare(void * data)
 {
     if (isInterrupted()) {
@@ -63,6 +81,16 @@ bool IMAPIdleOperation::isInterrupted() {
 
 void IMAPIdleOperation::main()
 {
+    if (mIdleWatch != NULL) {
+        // Resumed by the multiplexer.
+        finishMultiplexedIdle();
+        return;
+    }
+    if (mWaitThreadStarted) {
+        finishWaitThread();
+        return;
+    }
+    
     if (isInterrupted()) {
         return;
     }
@@ -74,14 +102,153 @@ void IMAPIdleOperation::main()
         return;
     }
     
+    if (startMultiplexedIdle()) {
+        return;
+    }
+    
     performMethodOnCallbackThread((Object::Method) &IMAPIdleOperation::prepare, NULL, true);
     
     if (!mSetupSuccess) {
         return;
     }
     
+    // A thread of the shared pool is not held for the duration of IDLE.
+    if (canSuspend()) {
+        startWaitThread();
+        return;
+    }
+    
     session()->session()->idle(folder(), mLastKnownUid, &error);
     setError(error);
+    MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, session()->session()->idleChanges());
+    
+    performMethodOnCallbackThread((Object::Method) &IMAPIdleOperation::unprepare, NULL, true);
+}
+
+static void idleWatchFired(void * context)
+{
+    IMAPIdleOperation * op = (IMAPIdleOperation *) context;
+    op->resume();
+}
+
+// When the queue runs in the shared thread pool, the operation is suspended while idling and
+// the socket is watched by the multiplexer. Returns false if idle() should be used instead.
+bool IMAPIdleOperation::startMultiplexedIdle()
+{
+    IMAPSession * imapSession = session()->session();
+    
+    if (!canSuspend() || !idleMultiplexerIsAvailable()) {
+        return false;
+    }
+    int fd = imapSession->idleFileDescriptor();
+    if (fd == -1) {
+        return false;
+    }
+    
+    ErrorCode error;
+    if (!imapSession->enterIdle(folder(), mLastKnownUid, &error)) {
+        setError(error);
+        MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, imapSession->idleChanges());
+        return true;
+    }
+    if (imapSession->hasIdleData()) {
+        imapSession->leaveIdle(&error);
+        setError(error);
+        MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, imapSession->idleChanges());
+        return true;
+    }
+    
+    mIdleWatch = idleWatchNew(fd, imapSession->idleTimeout(), idleWatchFired, this);
+    suspend();
+    pthread_mutex_lock(&mLock);
+    if (mInterrupted) {
+        // main() will be called again right away.
+        resume();
+    }
+    else {
+        mIdleWatchStarted = true;
+        idleWatchStart(mIdleWatch);
+    }
+    pthread_mutex_unlock(&mLock);
+    return true;
+}
+
+void IMAPIdleOperation::finishMultiplexedIdle()
+{
+    IMAPSession * imapSession = session()->session();
+    
+    pthread_mutex_lock(&mLock);
+    int result = mIdleWatchStarted ? idleWatchResult(mIdleWatch) : MAILSTREAM_IDLE_INTERRUPTED;
+    mIdleWatchStarted = false;
+    pthread_mutex_unlock(&mLock);
+    idleWatchFree(mIdleWatch);
+    mIdleWatch = NULL;
+    
+    ErrorCode error;
+    imapSession->idleWaitFinished(result, &error);
+    if (error == ErrorNone) {
+        imapSession->leaveIdle(&error);
+    }
+    setError(error);
+    MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, imapSession->idleChanges());
+}
+
+// The multiplexer is not available: the operation is suspended while a thread of its own waits.
+void IMAPIdleOperation::startWaitThread()
+{
+    IMAPSession * imapSession = session()->session();
+    
+    ErrorCode error;
+    if (!imapSession->enterIdle(folder(), mLastKnownUid, &error)) {
+        setError(error);
+        MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, imapSession->idleChanges());
+        performMethodOnCallbackThread((Object::Method) &IMAPIdleOperation::unprepare, NULL, true);
+        return;
+    }
+    if (imapSession->hasIdleData()) {
+        imapSession->leaveIdle(&error);
+        setError(error);
+        MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, imapSession->idleChanges());
+        performMethodOnCallbackThread((Object::Method) &IMAPIdleOperation::unprepare, NULL, true);
+        return;
+    }
+    
+    suspend();
+    mWaitThreadStarted = true;
+    retain();
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int r = pthread_create(&thread, &attr, waitThreadMain, this);
+    pthread_attr_destroy(&attr);
+    if (r != 0) {
+        waitThreadMain(this);
+    }
+}
+
+void * IMAPIdleOperation::waitThreadMain(void * context)
+{
+    IMAPIdleOperation * op = (IMAPIdleOperation *) context;
+    // Interrupted by interruptIdle() through the session, as idle() would be.
+    op->mWaitResult = op->session()->session()->waitIdle();
+    op->resume();
+    op->release();
+    return NULL;
+}
+
+void IMAPIdleOperation::finishWaitThread()
+{
+    IMAPSession * imapSession = session()->session();
+    
+    mWaitThreadStarted = false;
+    ErrorCode error;
+    imapSession->idleWaitFinished(mWaitResult, &error);
+    if (error == ErrorNone) {
+        imapSession->leaveIdle(&error);
+    }
+    setError(error);
+    MC_SAFE_REPLACE_RETAIN(IMAPIdleChanges, mChanges, imapSession->idleChanges());
     
     performMethodOnCallbackThread((Object::Method) &IMAPIdleOperation::unprepare, NULL, true);
 }
@@ -90,9 +257,11 @@ void IMAPIdleOperation::interruptIdle()
 {
     pthread_mutex_lock(&mLock);
     mInterrupted = true;
+    if (mIdleWatchStarted) {
+        idleWatchInterrupt(mIdleWatch);
+    }
     pthread_mutex_unlock(&mLock);
     if (mSetupSuccess) {
         session()->session()->interruptIdle();
     }
 }
-
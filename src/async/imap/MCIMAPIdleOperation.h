@@ -16,6 +16,8 @@
 
 namespace mailcore {
     
+    class IMAPIdleChanges;
+    
     class MAILCORE_EXPORT IMAPIdleOperation : public IMAPOperation {
     public:
         IMAPIdleOperation();
@@ -26,6 +28,10 @@ namespace mailcore {
         
         virtual void interruptIdle();
         
+        // Changes of the folder received while idling, available once the operation finished.
+        // They can be applied without fetching the messages again.
+        virtual IMAPIdleChanges * changes();
+        
     public: // subclass behavior
         virtual void main();
         
@@ -34,9 +40,19 @@ namespace mailcore {
         bool mSetupSuccess;
         bool mInterrupted;
         pthread_mutex_t mLock;
+        struct IMAPIdleWatch * mIdleWatch;
+        bool mIdleWatchStarted;
+        bool mWaitThreadStarted;
+        int mWaitResult;
+        IMAPIdleChanges * mChanges;
         void prepare(void * data);
         void unprepare(void * data);
         bool isInterrupted();
+        bool startMultiplexedIdle();
+        void finishMultiplexedIdle();
+        void startWaitThread();
+        void finishWaitThread();
+        static void * waitThreadMain(void * context);
     };
     
 }
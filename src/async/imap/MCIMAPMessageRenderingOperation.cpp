@@ -18,6 +18,7 @@ IMAPMessageRenderingOperation::IMAPMessageRenderingOperation()
     mMessage = NULL;
     mRenderingType = IMAPMessageRenderingTypePlainTextBody;
     mResult = NULL;
+    mMaximumLength = 0;
 }
 
 IMAPMessageRenderingOperation::~IMAPMessageRenderingOperation()
@@ -46,6 +47,16 @@ IMAPMessage * IMAPMessageRenderingOperation::message()
     return mMessage;
 }
 
+void IMAPMessageRenderingOperation::setMaximumLength(unsigned int maximumLength)
+{
+    mMaximumLength = maximumLength;
+}
+
+unsigned int IMAPMessageRenderingOperation::maximumLength()
+{
+    return mMaximumLength;
+}
+
 String * IMAPMessageRenderingOperation::result()
 {
     return mResult;
@@ -70,6 +81,9 @@ void IMAPMessageRenderingOperation::main()
     else if (mRenderingType == IMAPMessageRenderingTypePlainTextBodyAndStripWhitespace) {
         mResult = session()->session()->plainTextBodyRendering(mMessage, folder(), true, &error);
     }
+    else if (mRenderingType == IMAPMessageRenderingTypePlainTextPreview) {
+        mResult = session()->session()->plainTextPreview(mMessage, folder(), mMaximumLength, &error);
+    }
     
     MC_SAFE_RETAIN(mResult);
     setError(error);
@@ -28,6 +28,10 @@ namespace mailcore {
         virtual void setMessage(IMAPMessage * message);
         virtual IMAPMessage * message();
         
+        // Only for IMAPMessageRenderingTypePlainTextPreview.
+        virtual void setMaximumLength(unsigned int maximumLength);
+        virtual unsigned int maximumLength();
+        
         // Result.
         virtual String * result();
         
@@ -38,6 +42,7 @@ namespace mailcore {
         IMAPMessageRenderingType mRenderingType;
         String * mResult;
         IMAPMessage * mMessage;
+        unsigned int mMaximumLength;
         
     };
     
@@ -40,6 +40,7 @@ void IMAPMultiDisconnectOperation::start()
 #if __APPLE__
         op->setCallbackDispatchQueue(this->callbackDispatchQueue());
 #endif
+        op->setCallbackExecutor(this->callbackExecutor());
         op->setCallback(this);
         op->start();
     }
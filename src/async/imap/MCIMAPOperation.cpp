@@ -25,6 +25,8 @@ IMAPOperation::IMAPOperation()
     mError = ErrorNone;
     mFolder = NULL;
     mUrgent = false;
+    mReschedulable = false;
+    mQueuedTime = 0;
 }
 
 IMAPOperation::~IMAPOperation()
@@ -47,6 +49,7 @@ void IMAPOperation::setSession(IMAPAsyncConnection * session)
     }
     setCallbackDispatchQueue(queue);
 #endif
+    setCallbackExecutor(session != NULL ? session->callbackExecutor() : NULL);
 }
 
 IMAPAsyncConnection * IMAPOperation::session()
@@ -104,13 +107,36 @@ ErrorCode IMAPOperation::error()
     return mError;
 }
 
+bool IMAPOperation::isReschedulable()
+{
+    return mReschedulable;
+}
+
+void IMAPOperation::setQueuedTime(double queuedTime)
+{
+    mQueuedTime = queuedTime;
+}
+
+double IMAPOperation::queuedTime()
+{
+    return mQueuedTime;
+}
+
 void IMAPOperation::start()
 {
+    // With the inline executor, operations can be started from the threads of the connections.
+    IMAPAsyncSession * owner = (session() == NULL) ? mMainSession : session()->owner();
+    owner->lock();
     if (session() == NULL) {
         IMAPAsyncConnection * connection = mMainSession->sessionForFolder(mFolder, mUrgent);
         setSession(connection);
+        mReschedulable = true;
     }
     mSession->runOperation(this);
+    if (mReschedulable) {
+        mMainSession->scheduleIdleConnections();
+    }
+    owner->unlock();
 }
 
 struct progressContext {
@@ -174,12 +200,19 @@ void IMAPOperation::itemsProgressOnMainThread(void * ctx)
 
 void IMAPOperation::beforeMain()
 {
+    mSession->owner()->lock();
+    mSession->operationWillStart(this);
+    mSession->owner()->unlock();
 }
 
 void IMAPOperation::afterMain()
 {
+    IMAPAsyncSession * owner = mSession->owner();
+    owner->lock();
     if (mSession->session()->isAutomaticConfigurationDone()) {
-        mSession->owner()->automaticConfigurationDone(mSession->session());
+        owner->automaticConfigurationDone(mSession->session());
         mSession->session()->resetAutomaticConfigurationDone();
     }
+    owner->scheduleIdleConnections();
+    owner->unlock();
 }
@@ -50,6 +50,13 @@ namespace mailcore {
         virtual void setError(ErrorCode error);
         virtual ErrorCode error();
         
+    public: // private
+        // True when the connection has been chosen by the IMAPAsyncSession, which can then move
+        // the operation to another connection before it starts.
+        virtual bool isReschedulable();
+        virtual void setQueuedTime(double queuedTime);
+        virtual double queuedTime();
+        
     private:
         IMAPAsyncSession * mMainSession;
         IMAPAsyncConnection * mSession;
@@ -57,6 +64,8 @@ namespace mailcore {
         IMAPOperationCallback * mImapCallback;
         ErrorCode mError;
         bool mUrgent;
+        bool mReschedulable;
+        double mQueuedTime;
         
     private:
         virtual void bodyProgress(IMAPSession * session, unsigned int current, unsigned int maximum);
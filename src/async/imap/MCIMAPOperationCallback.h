@@ -10,6 +10,7 @@
 
 #define MAILCORE_MCIMAPOPERATIONCALLBACK_H
 
+#include <inttypes.h>
 #include <MailCore/MCUtils.h>
 
 #ifdef __cplusplus
@@ -17,11 +18,15 @@
 namespace mailcore {
     
     class IMAPOperation;
+    class Array;
+    class Data;
     
     class MAILCORE_EXPORT IMAPOperationCallback {
     public:
         virtual void bodyProgress(IMAPOperation * session, unsigned int current, unsigned int maximum) {};
         virtual void itemProgress(IMAPOperation * session, unsigned int current, unsigned int maximum) {};
+        virtual void messagesFetched(IMAPOperation * session, Array * /* IMAPMessage */ messages) {};
+        virtual void bodyFetched(IMAPOperation * session, uint32_t uid, Data * data) {};
     };
     
 }
@@ -0,0 +1,277 @@
+#include "MCIMAPParallelFetchContentOperation.h"
+
+#include "MCIMAPAsyncSession.h"
+#include "MCIMAPFetchContentOperation.h"
+
+using namespace mailcore;
+
+#define DEFAULT_RANGE_SIZE (1024 * 1024)
+#define DEFAULT_CONCURRENT_RANGES 4
+
+IMAPParallelFetchContentOperation::IMAPParallelFetchContentOperation()
+{
+    mUid = 0;
+    mPartID = NULL;
+    mEncoding = Encoding7Bit;
+    mSize = 0;
+    mRangeSize = DEFAULT_RANGE_SIZE;
+    mMaximumConcurrentRanges = 0;
+    mResumeData = NULL;
+    mData = NULL;
+    mDownloadedData = NULL;
+    mRanges = new Array();
+    mNextOffset = 0;
+    mReceivedLength = 0;
+    mConcurrentRanges = 0;
+    mRunningCount = 0;
+    mEndReached = false;
+    mRunning = false;
+    mRangeError = ErrorNone;
+    // The callbacks can cancel the operation while a range is being handled.
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mLock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+IMAPParallelFetchContentOperation::~IMAPParallelFetchContentOperation()
+{
+    MC_SAFE_RELEASE(mPartID);
+    MC_SAFE_RELEASE(mResumeData);
+    MC_SAFE_RELEASE(mData);
+    MC_SAFE_RELEASE(mDownloadedData);
+    MC_SAFE_RELEASE(mRanges);
+    pthread_mutex_destroy(&mLock);
+}
+
+void IMAPParallelFetchContentOperation::setUid(uint32_t uid)
+{
+    mUid = uid;
+}
+
+uint32_t IMAPParallelFetchContentOperation::uid()
+{
+    return mUid;
+}
+
+void IMAPParallelFetchContentOperation::setPartID(String * partID)
+{
+    MC_SAFE_REPLACE_COPY(String, mPartID, partID);
+}
+
+String * IMAPParallelFetchContentOperation::partID()
+{
+    return mPartID;
+}
+
+void IMAPParallelFetchContentOperation::setEncoding(Encoding encoding)
+{
+    mEncoding = encoding;
+}
+
+Encoding IMAPParallelFetchContentOperation::encoding()
+{
+    return mEncoding;
+}
+
+void IMAPParallelFetchContentOperation::setSize(uint32_t size)
+{
+    mSize = size;
+}
+
+uint32_t IMAPParallelFetchContentOperation::size()
+{
+    return mSize;
+}
+
+void IMAPParallelFetchContentOperation::setRangeSize(uint32_t rangeSize)
+{
+    mRangeSize = rangeSize;
+}
+
+uint32_t IMAPParallelFetchContentOperation::rangeSize()
+{
+    return mRangeSize;
+}
+
+void IMAPParallelFetchContentOperation::setMaximumConcurrentRanges(unsigned int maximumConcurrentRanges)
+{
+    mMaximumConcurrentRanges = maximumConcurrentRanges;
+}
+
+unsigned int IMAPParallelFetchContentOperation::maximumConcurrentRanges()
+{
+    return mMaximumConcurrentRanges;
+}
+
+void IMAPParallelFetchContentOperation::setResumeData(Data * resumeData)
+{
+    MC_SAFE_REPLACE_RETAIN(Data, mResumeData, resumeData);
+}
+
+Data * IMAPParallelFetchContentOperation::resumeData()
+{
+    return mResumeData;
+}
+
+Data * IMAPParallelFetchContentOperation::data()
+{
+    return mData;
+}
+
+Data * IMAPParallelFetchContentOperation::downloadedData()
+{
+    return mDownloadedData;
+}
+
+void IMAPParallelFetchContentOperation::start()
+{
+    MC_SAFE_RELEASE(mDownloadedData);
+    mDownloadedData = new Data();
+    if (mResumeData != NULL) {
+        mDownloadedData->appendData(mResumeData);
+    }
+    mNextOffset = mDownloadedData->length();
+    mReceivedLength = mDownloadedData->length();
+
+    mConcurrentRanges = mMaximumConcurrentRanges;
+    if (mConcurrentRanges == 0) {
+        mConcurrentRanges = mainSession()->maximumConnections();
+    }
+    if (mConcurrentRanges == 0) {
+        mConcurrentRanges = DEFAULT_CONCURRENT_RANGES;
+    }
+    // The ranges would wait for each other on the connection that has the folder selected.
+    if (!mainSession()->allowsFolderConcurrentAccessEnabled()) {
+        mConcurrentRanges = 1;
+    }
+
+    retain();
+    pthread_mutex_lock(&mLock);
+    mRunning = true;
+    startRanges();
+    pthread_mutex_unlock(&mLock);
+}
+
+void IMAPParallelFetchContentOperation::startRanges()
+{
+    while ((mRunningCount < mConcurrentRanges) && !mEndReached && (mRangeError == ErrorNone)) {
+        // The size might be wrong: after the expected end, a range is fetched only when the
+        // previous one has been received entirely.
+        if ((mNextOffset >= mSize) && (mRunningCount > 0)) {
+            break;
+        }
+
+        IMAPFetchContentOperation * op = new IMAPFetchContentOperation();
+        op->setMainSession(mainSession());
+        op->setFolder(folder());
+        op->setUid(mUid);
+        op->setPartID(mPartID);
+        op->setOffset(mNextOffset);
+        op->setLength(mRangeSize);
+        // Picks a connection that is not busy, if any.
+        op->setUrgent(true);
+        op->setCallback(this);
+        mRanges->addObject(op);
+        mNextOffset += mRangeSize;
+        mRunningCount ++;
+        op->start();
+        op->release();
+    }
+}
+
+void IMAPParallelFetchContentOperation::operationFinished(Operation * op)
+{
+    // finish() and cancel() release the operation.
+    retain();
+    pthread_mutex_lock(&mLock);
+    rangeFinished((IMAPFetchContentOperation *) op);
+    pthread_mutex_unlock(&mLock);
+    release();
+}
+
+void IMAPParallelFetchContentOperation::rangeFinished(IMAPFetchContentOperation * rangeOp)
+{
+    int idx = mRanges->indexOfObject(rangeOp);
+    if (!mRunning || (idx == -1)) {
+        return;
+    }
+
+    // It's released when replaced in mRanges.
+    rangeOp->retain();
+    mRunningCount --;
+    if (rangeOp->error() != ErrorNone) {
+        if (mRangeError == ErrorNone) {
+            mRangeError = rangeOp->error();
+        }
+        // The ranges after the missing one can't be used to resume.
+        mRanges->replaceObject(idx, Null::null());
+        while ((unsigned int) idx + 1 < mRanges->count()) {
+            Object * obj = mRanges->lastObject();
+            if (MCISKINDOFCLASS(obj, IMAPFetchContentOperation)) {
+                ((IMAPFetchContentOperation *) obj)->setCallback(NULL);
+                ((IMAPFetchContentOperation *) obj)->cancel();
+                mRunningCount --;
+            }
+            mRanges->removeLastObject();
+        }
+    }
+    else {
+        Data * rangeData = rangeOp->data();
+        if (rangeData->length() < rangeOp->length()) {
+            mEndReached = true;
+        }
+        mReceivedLength += rangeData->length();
+        mRanges->replaceObject(idx, rangeData);
+        while ((mRanges->count() > 0) && MCISKINDOFCLASS(mRanges->objectAtIndex(0), Data)) {
+            mDownloadedData->appendData((Data *) mRanges->objectAtIndex(0));
+            mRanges->removeObjectAtIndex(0);
+        }
+        if (imapCallback() != NULL) {
+            imapCallback()->bodyProgress(this, mReceivedLength, mReceivedLength > mSize ? mReceivedLength : mSize);
+        }
+    }
+    rangeOp->release();
+
+    startRanges();
+    if (mRunningCount == 0) {
+        finish();
+    }
+}
+
+void IMAPParallelFetchContentOperation::finish()
+{
+    mRunning = false;
+    mRanges->removeAllObjects();
+    if (mRangeError == ErrorNone) {
+        mData = mDownloadedData->decodedDataUsingEncoding(mEncoding);
+        MC_SAFE_RETAIN(mData);
+    }
+    setError(mRangeError);
+    if (callback() != NULL) {
+        callback()->operationFinished(this);
+    }
+    release();
+}
+
+void IMAPParallelFetchContentOperation::cancel()
+{
+    IMAPOperation::cancel();
+    pthread_mutex_lock(&mLock);
+    bool running = mRunning;
+    if (running) {
+        mRunning = false;
+        mc_foreacharray(Object, obj, mRanges) {
+            if (MCISKINDOFCLASS(obj, IMAPFetchContentOperation)) {
+                ((IMAPFetchContentOperation *) obj)->setCallback(NULL);
+                ((IMAPFetchContentOperation *) obj)->cancel();
+            }
+        }
+        mRanges->removeAllObjects();
+    }
+    pthread_mutex_unlock(&mLock);
+    if (running) {
+        release();
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef MAILCORE_MCIMAPPARALLELFETCHCONTENTOPERATION_H
+
+#define MAILCORE_MCIMAPPARALLELFETCHCONTENTOPERATION_H
+
+#include <MailCore/MCIMAPOperation.h>
+#include <MailCore/MCIMAPOperationCallback.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+
+    class IMAPFetchContentOperation;
+
+    // Downloads a part of a message in ranges of bytes, fetched in parallel over several connections
+    // of the session, and puts them back together in order.
+    // The ranges are fetched on a single connection if allowsFolderConcurrentAccessEnabled is false.
+    class MAILCORE_EXPORT IMAPParallelFetchContentOperation : public IMAPOperation, public OperationCallback {
+    public:
+        IMAPParallelFetchContentOperation();
+        virtual ~IMAPParallelFetchContentOperation();
+
+        virtual void setUid(uint32_t uid);
+        virtual uint32_t uid();
+
+        virtual void setPartID(String * partID);
+        virtual String * partID();
+
+        virtual void setEncoding(Encoding encoding);
+        virtual Encoding encoding();
+
+        // Size of the part as sent by the server, IMAPPart::size() for example. The ranges after the
+        // expected end are fetched one at a time until the end of the part is found.
+        virtual void setSize(uint32_t size);
+        virtual uint32_t size();
+
+        // Default is 1MB.
+        virtual void setRangeSize(uint32_t rangeSize);
+        virtual uint32_t rangeSize();
+
+        // When zero, the default, it's the maximum number of connections of the session, or 4 if
+        // it's not limited.
+        virtual void setMaximumConcurrentRanges(unsigned int maximumConcurrentRanges);
+        virtual unsigned int maximumConcurrentRanges();
+
+        // downloadedData() of an operation that failed. Only the remaining ranges are fetched.
+        virtual void setResumeData(Data * resumeData);
+        virtual Data * resumeData();
+
+        // Result.
+        virtual Data * data();
+
+        // Bytes received from the start of the part, not decoded. When the operation fails, it
+        // contains all the ranges that completed before the first missing one.
+        virtual Data * downloadedData();
+
+    public: // subclass behavior
+        virtual void start();
+        virtual void cancel();
+
+    public: // OperationCallback
+        virtual void operationFinished(Operation * op);
+
+    private:
+        uint32_t mUid;
+        String * mPartID;
+        Encoding mEncoding;
+        uint32_t mSize;
+        uint32_t mRangeSize;
+        unsigned int mMaximumConcurrentRanges;
+        Data * mResumeData;
+        Data * mData;
+        Data * mDownloadedData;
+        // Operations of the running ranges and data of the ranges received out of order,
+        // indexed from the first missing range.
+        Array * mRanges;
+        uint32_t mNextOffset;
+        uint32_t mReceivedLength;
+        unsigned int mConcurrentRanges;
+        unsigned int mRunningCount;
+        bool mEndReached;
+        bool mRunning;
+        ErrorCode mRangeError;
+        // With the inline executor, the ranges finish on the threads of several connections.
+        pthread_mutex_t mLock;
+
+        void startRanges();
+        void rangeFinished(IMAPFetchContentOperation * rangeOp);
+        void finish();
+    };
+
+}
+
+#endif
+
+#endif
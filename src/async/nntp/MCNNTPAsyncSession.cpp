@@ -81,6 +81,7 @@ NNTPAsyncSession::NNTPAsyncSession()
     mInternalLogger = new NNTPConnectionLogger(this);
     mSession->setConnectionLogger(mInternalLogger);
     mOperationQueueCallback = NULL;
+    mCallbackExecutor = NULL;
 }
 
 NNTPAsyncSession::~NNTPAsyncSession()
@@ -308,6 +309,16 @@ dispatch_queue_t NNTPAsyncSession::dispatchQueue()
 }
 #endif
 
+void NNTPAsyncSession::setCallbackExecutor(CallbackExecutor * executor)
+{
+    mCallbackExecutor = executor;
+}
+
+CallbackExecutor * NNTPAsyncSession::callbackExecutor()
+{
+    return mCallbackExecutor;
+}
+
 void NNTPAsyncSession::setOperationQueueCallback(OperationQueueCallback * callback)
 {
     mOperationQueueCallback = callback;
@@ -53,6 +53,12 @@ namespace mailcore {
         virtual dispatch_queue_t dispatchQueue();
 #endif
 
+        // Callbacks of the operations created afterwards, including beforeMain() and afterMain(),
+        // are run by the executor instead of the main thread. CallbackExecutor::inlineExecutor()
+        // runs them on the thread of the session, without waiting for the main thread.
+        virtual void setCallbackExecutor(CallbackExecutor * executor);
+        virtual CallbackExecutor * callbackExecutor();
+
         virtual void setOperationQueueCallback(OperationQueueCallback * callback);
         virtual OperationQueueCallback * operationQueueCallback();
         virtual bool isOperationQueueRunning();
@@ -84,6 +90,7 @@ namespace mailcore {
         pthread_mutex_t mConnectionLoggerLock;
         NNTPConnectionLogger * mInternalLogger;
         OperationQueueCallback * mOperationQueueCallback;
+        CallbackExecutor * mCallbackExecutor;
         
     public: // private
         virtual void runOperation(NNTPOperation * operation);
@@ -41,6 +41,7 @@ void NNTPOperation::setSession(NNTPAsyncSession * session)
     }
     setCallbackDispatchQueue(queue);
 #endif
+    setCallbackExecutor(session != NULL ? session->callbackExecutor() : NULL);
 }
 
 NNTPAsyncSession * NNTPOperation::session()
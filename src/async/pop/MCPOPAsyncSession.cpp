@@ -79,6 +79,7 @@ POPAsyncSession::POPAsyncSession()
     mInternalLogger = new POPConnectionLogger(this);
     mSession->setConnectionLogger(mInternalLogger);
     mOperationQueueCallback = NULL;
+    mCallbackExecutor = NULL;
 }
 
 POPAsyncSession::~POPAsyncSession()
@@ -281,6 +282,16 @@ dispatch_queue_t POPAsyncSession::dispatchQueue()
 }
 #endif
 
+void POPAsyncSession::setCallbackExecutor(CallbackExecutor * executor)
+{
+    mCallbackExecutor = executor;
+}
+
+CallbackExecutor * POPAsyncSession::callbackExecutor()
+{
+    return mCallbackExecutor;
+}
+
 void POPAsyncSession::setOperationQueueCallback(OperationQueueCallback * callback)
 {
     mOperationQueueCallback = callback;
@@ -41,6 +41,7 @@ void POPOperation::setSession(POPAsyncSession * session)
     }
     setCallbackDispatchQueue(queue);
 #endif
+    setCallbackExecutor(session != NULL ? session->callbackExecutor() : NULL);
 }
 
 POPAsyncSession * POPOperation::session()
@@ -3,6 +3,7 @@
 #include "MCSMTPSession.h"
 #include "MCSMTPLoginOperation.h"
 #include "MCSMTPSendWithDataOperation.h"
+#include "MCSMTPSendMessagesOperation.h"
 #include "MCSMTPCheckAccountOperation.h"
 #include "MCSMTPDisconnectOperation.h"
 #include "MCSMTPNoopOperation.h"
@@ -72,6 +73,7 @@ SMTPAsyncSession::SMTPAsyncSession()
     mInternalLogger = new SMTPConnectionLogger(this);
     mSession->setConnectionLogger(mInternalLogger);
     mOperationQueueCallback = NULL;
+    mCallbackExecutor = NULL;
 }
 
 SMTPAsyncSession::~SMTPAsyncSession()
@@ -184,6 +186,16 @@ bool SMTPAsyncSession::useHeloIPEnabled()
     return mSession->useHeloIPEnabled();
 }
 
+void SMTPAsyncSession::setKeepAliveEnabled(bool enabled)
+{
+    mSession->setKeepAliveEnabled(enabled);
+}
+
+bool SMTPAsyncSession::isKeepAliveEnabled()
+{
+    return mSession->isKeepAliveEnabled();
+}
+
 void SMTPAsyncSession::runOperation(SMTPOperation * operation)
 {
     cancelDelayedPerformMethod((Object::Method) &SMTPAsyncSession::tryAutomaticDisconnectAfterDelay, NULL);
@@ -240,6 +252,14 @@ SMTPOperation * SMTPAsyncSession::sendMessageOperation(Address * from, Array * r
     return (SMTPOperation *) op->autorelease();
 }
 
+SMTPSendMessagesOperation * SMTPAsyncSession::sendMessagesOperation(Array * messages)
+{
+    SMTPSendMessagesOperation * op = new SMTPSendMessagesOperation();
+    op->setSession(this);
+    op->setMessages(messages);
+    return (SMTPSendMessagesOperation *) op->autorelease();
+}
+
 SMTPOperation * SMTPAsyncSession::checkAccountOperation(Address * from)
 {
     SMTPCheckAccountOperation * op = new SMTPCheckAccountOperation();
@@ -307,6 +327,16 @@ dispatch_queue_t SMTPAsyncSession::dispatchQueue()
 }
 #endif
 
+void SMTPAsyncSession::setCallbackExecutor(CallbackExecutor * executor)
+{
+    mCallbackExecutor = executor;
+}
+
+CallbackExecutor * SMTPAsyncSession::callbackExecutor()
+{
+    return mCallbackExecutor;
+}
+
 void SMTPAsyncSession::setOperationQueueCallback(OperationQueueCallback * callback)
 {
     mOperationQueueCallback = callback;
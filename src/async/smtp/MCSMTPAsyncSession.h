@@ -15,6 +15,7 @@ namespace mailcore {
     class Address;
     class SMTPOperationQueueCallback;
     class SMTPConnectionLogger;
+    class SMTPSendMessagesOperation;
     
     class MAILCORE_EXPORT SMTPAsyncSession : public Object {
     public:
@@ -51,6 +52,10 @@ namespace mailcore {
         virtual void setUseHeloIPEnabled(bool enabled);
         virtual bool useHeloIPEnabled();
         
+        // See SMTPSession::setKeepAliveEnabled().
+        virtual void setKeepAliveEnabled(bool enabled);
+        virtual bool isKeepAliveEnabled();
+        
         virtual void setConnectionLogger(ConnectionLogger * logger);
         virtual ConnectionLogger * connectionLogger();
         
@@ -59,6 +64,12 @@ namespace mailcore {
         virtual dispatch_queue_t dispatchQueue();
 #endif
 
+        // Callbacks of the operations created afterwards, including beforeMain() and afterMain(),
+        // are run by the executor instead of the main thread. CallbackExecutor::inlineExecutor()
+        // runs them on the thread of the session, without waiting for the main thread.
+        virtual void setCallbackExecutor(CallbackExecutor * executor);
+        virtual CallbackExecutor * callbackExecutor();
+
         virtual void setOperationQueueCallback(OperationQueueCallback * callback);
         virtual OperationQueueCallback * operationQueueCallback();
         virtual bool isOperationQueueRunning();
@@ -68,6 +79,7 @@ namespace mailcore {
         virtual SMTPOperation * sendMessageOperation(Data * messageData);
         virtual SMTPOperation * sendMessageOperation(Address * from, Array * recipients,
                                                      Data * messageData);
+        virtual SMTPSendMessagesOperation * sendMessagesOperation(Array * /* SMTPBatchMessage */ messages);
         virtual SMTPOperation * checkAccountOperation(Address * from);
         
         virtual SMTPOperation * noopOperation();
@@ -88,6 +100,7 @@ namespace mailcore {
         pthread_mutex_t mConnectionLoggerLock;
         SMTPConnectionLogger * mInternalLogger;
         OperationQueueCallback * mOperationQueueCallback;
+        CallbackExecutor * mCallbackExecutor;
         
         virtual void tryAutomaticDisconnectAfterDelay(void * context);
     };
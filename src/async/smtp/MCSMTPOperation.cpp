@@ -40,6 +40,7 @@ void SMTPOperation::setSession(SMTPAsyncSession * session)
     }
     setCallbackDispatchQueue(queue);
 #endif
+    setCallbackExecutor(session != NULL ? session->callbackExecutor() : NULL);
 }
 
 SMTPAsyncSession * SMTPOperation::session()
@@ -0,0 +1,46 @@
+//
+//  MCSMTPSendMessagesOperation.cpp
+//  mailcore2
+//
+
+#include "MCSMTPSendMessagesOperation.h"
+
+#include "MCSMTPAsyncSession.h"
+#include "MCSMTPSession.h"
+
+using namespace mailcore;
+
+SMTPSendMessagesOperation::SMTPSendMessagesOperation()
+{
+    mMessages = NULL;
+    mErrors = NULL;
+}
+
+SMTPSendMessagesOperation::~SMTPSendMessagesOperation()
+{
+    MC_SAFE_RELEASE(mMessages);
+    MC_SAFE_RELEASE(mErrors);
+}
+
+void SMTPSendMessagesOperation::setMessages(Array * messages)
+{
+    MC_SAFE_REPLACE_COPY(Array, mMessages, messages);
+}
+
+Array * SMTPSendMessagesOperation::messages()
+{
+    return mMessages;
+}
+
+Array * SMTPSendMessagesOperation::errors()
+{
+    return mErrors;
+}
+
+void SMTPSendMessagesOperation::main()
+{
+    ErrorCode error;
+    Array * errors = session()->session()->sendMessages(mMessages, this, &error);
+    MC_SAFE_REPLACE_RETAIN(Array, mErrors, errors);
+    setError(error);
+}
@@ -0,0 +1,42 @@
+//
+//  MCSMTPSendMessagesOperation.h
+//  mailcore2
+//
+
+#ifndef MAILCORE_MCSMTPSENDMESSAGESOPERATION_H
+
+#define MAILCORE_MCSMTPSENDMESSAGESOPERATION_H
+
+#include <MailCore/MCBaseTypes.h>
+#include <MailCore/MCSMTPOperation.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+    
+    class MAILCORE_EXPORT SMTPSendMessagesOperation : public SMTPOperation {
+    public:
+        SMTPSendMessagesOperation();
+        virtual ~SMTPSendMessagesOperation();
+        
+        virtual void setMessages(Array * /* SMTPBatchMessage */ messages);
+        virtual Array * /* SMTPBatchMessage */ messages();
+        
+        // Result.
+        // Error code of each message as a Value.
+        virtual Array * /* Value */ errors();
+        
+    public: // subclass behavior
+        virtual void main();
+        
+    private:
+        Array * mMessages;
+        Array * mErrors;
+        
+    };
+    
+}
+
+#endif
+
+#endif
@@ -15,6 +15,7 @@ set(async_imap_files
   async/imap/MCIMAPFetchContentOperation.cpp
   async/imap/MCIMAPFetchParsedContentOperation.cpp
   async/imap/MCIMAPFetchFoldersOperation.cpp
+  async/imap/MCIMAPFetchMessageBodiesOperation.cpp
   async/imap/MCIMAPFetchMessagesOperation.cpp
   async/imap/MCIMAPFetchNamespaceOperation.cpp
   async/imap/MCIMAPFolderInfo.cpp
@@ -25,6 +26,7 @@ set(async_imap_files
   async/imap/MCIMAPMessageRenderingOperation.cpp
   async/imap/MCIMAPMultiDisconnectOperation.cpp
   async/imap/MCIMAPOperation.cpp
+  async/imap/MCIMAPParallelFetchContentOperation.cpp
   async/imap/MCIMAPQuotaOperation.cpp
   async/imap/MCIMAPRenameFolderOperation.cpp
   async/imap/MCIMAPSearchOperation.cpp
@@ -52,6 +54,7 @@ set(async_smtp_files
   async/smtp/MCSMTPOperation.cpp
   async/smtp/MCSMTPLoginOperation.cpp
   async/smtp/MCSMTPSendWithDataOperation.cpp
+  async/smtp/MCSMTPSendMessagesOperation.cpp
   async/smtp/MCSMTPNoopOperation.cpp
 )
 
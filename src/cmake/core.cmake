@@ -30,9 +30,15 @@ IF(APPLE)
 ENDIF()
 
 IF(${CMAKE_SYSTEM_NAME} MATCHES "Linux")
-  set(basetypes_files_linux
-    core/basetypes/MCMainThreadGTK.cpp
-  )
+  IF(MAILCORE_EVENT_LOOP)
+    set(basetypes_files_linux
+      core/basetypes/MCMainThreadEventLoop.cpp
+    )
+  ELSE()
+    set(basetypes_files_linux
+      core/basetypes/MCMainThreadGTK.cpp
+    )
+  ENDIF()
 ENDIF()
 
 
@@ -41,6 +47,7 @@ set(basetypes_files
   core/basetypes/MCAssert.c
   core/basetypes/MCAutoreleasePool.cpp
   core/basetypes/MCBase64.c
+  core/basetypes/MCCallbackExecutor.cpp
   core/basetypes/MCConnectionLoggerUtils.cpp
   core/basetypes/MCData.cpp
   core/basetypes/MCHash.cpp
@@ -59,6 +66,7 @@ set(basetypes_files
   core/basetypes/MCRange.cpp
   core/basetypes/MCSet.cpp
   core/basetypes/MCString.cpp
+  core/basetypes/MCTimerWheel.cpp
   core/basetypes/MCValue.cpp
   core/basetypes/ConvertUTF.c
   ${basetypes_files_apple}
@@ -93,9 +101,12 @@ IF(APPLE)
 ENDIF()
 
 set(imap_files
+  core/imap/MCIMAPBinaryExtension.cpp
   core/imap/MCIMAPFolder.cpp
   core/imap/MCIMAPFolderStatus.cpp
   core/imap/MCIMAPIdentity.cpp
+  core/imap/MCIMAPIdleChanges.cpp
+  core/imap/MCIMAPIdleMultiplexer.cpp
   core/imap/MCIMAPMessage.cpp
   core/imap/MCIMAPMessagePart.cpp
   core/imap/MCIMAPMultipart.cpp
@@ -133,6 +144,7 @@ set(renderer_files
   core/renderer/MCHTMLRendererCallback.cpp
   core/renderer/MCHTMLRendererIMAPDataCallback.cpp
   core/renderer/MCSizeFormatter.cpp
+  core/renderer/MCTemplateCache.cpp
   
 )
 
@@ -145,6 +157,7 @@ set(rfc822_files
 )
 
 set(smtp_files
+  core/smtp/MCSMTPBatchMessage.cpp
   core/smtp/MCSMTPSession.cpp
 )
 
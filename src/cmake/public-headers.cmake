@@ -27,6 +27,8 @@ core/basetypes/MCOperation.h
 core/basetypes/MCOperationQueue.h
 core/basetypes/MCLibetpanTypes.h
 core/basetypes/MCOperationCallback.h
+core/basetypes/MCCallbackExecutor.h
+core/basetypes/MCMainThreadEventLoop.h
 core/basetypes/MCIterator.h
 core/basetypes/MCConnectionLogger.h
 core/basetypes/MCHTMLCleaner.h
@@ -44,11 +46,13 @@ core/imap/MCIMAPNamespace.h
 core/imap/MCIMAPNamespaceItem.h
 core/imap/MCIMAPPart.h
 core/imap/MCIMAPProgressCallback.h
+core/imap/MCIMAPFetchMessagesCallback.h
 core/imap/MCIMAPSearchExpression.h
 core/imap/MCIMAPSession.h
 core/imap/MCIMAPSyncResult.h
 core/imap/MCIMAPFolderStatus.h
 core/imap/MCIMAPIdentity.h
+core/imap/MCIMAPIdleChanges.h
 core/pop/MCPOP.h
 core/pop/MCPOPMessageInfo.h
 core/pop/MCPOPProgressCallback.h
@@ -66,6 +70,7 @@ core/rfc822/MCMultipart.h
 core/smtp/MCSMTP.h
 core/smtp/MCSMTPProgressCallback.h
 core/smtp/MCSMTPSession.h
+core/smtp/MCSMTPBatchMessage.h
 core/renderer/MCRenderer.h
 core/renderer/MCHTMLRendererCallback.h
 core/renderer/MCDateFormatter.h
@@ -80,6 +85,7 @@ async/smtp/MCAsyncSMTP.h
 async/smtp/MCSMTPAsyncSession.h
 async/smtp/MCSMTPOperation.h
 async/smtp/MCSMTPOperationCallback.h
+async/smtp/MCSMTPSendMessagesOperation.h
 async/imap/MCAsyncIMAP.h
 async/imap/MCIMAPAsyncSession.h
 async/imap/MCIMAPOperation.h
@@ -87,7 +93,9 @@ async/imap/MCIMAPFetchFoldersOperation.h
 async/imap/MCIMAPAppendMessageOperation.h
 async/imap/MCIMAPCopyMessagesOperation.h
 async/imap/MCIMAPFetchMessagesOperation.h
+async/imap/MCIMAPFetchMessageBodiesOperation.h
 async/imap/MCIMAPFetchContentOperation.h
+async/imap/MCIMAPParallelFetchContentOperation.h
 async/imap/MCIMAPFetchParsedContentOperation.h
 async/imap/MCIMAPIdleOperation.h
 async/imap/MCIMAPFolderInfo.h
@@ -270,6 +270,7 @@ namespace mailcore {
         IMAPMessageRenderingTypePlainText,
         IMAPMessageRenderingTypePlainTextBody,
         IMAPMessageRenderingTypePlainTextBodyAndStripWhitespace,
+        IMAPMessageRenderingTypePlainTextPreview,
     };
     
 }
@@ -112,3 +112,39 @@ char * MCDecodeBase64(const char * in, int len, int * p_outlen)
 
     return out;
 }
+
+size_t MCDecodeBase64Content(const char * in, size_t len, char * out)
+{
+    const unsigned char * uin = (const unsigned char *) in;
+    char * output = out;
+    unsigned int value = 0;
+    int count = 0;
+    size_t i;
+    
+    for (i = 0; i < len; i++) {
+        int c = uin[i];
+        if (c == '=')
+            break;
+        if (CHAR64(c) == -1)
+            continue;
+        value = (value << 6) | CHAR64(c);
+        count++;
+        if (count == 4) {
+            *output++ = (char) (value >> 16);
+            *output++ = (char) (value >> 8);
+            *output++ = (char) value;
+            value = 0;
+            count = 0;
+        }
+    }
+    
+    if (count == 2) {
+        *output++ = (char) (value >> 4);
+    }
+    else if (count == 3) {
+        *output++ = (char) (value >> 10);
+        *output++ = (char) (value >> 2);
+    }
+    
+    return (size_t) (output - out);
+}
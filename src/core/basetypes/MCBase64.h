@@ -10,6 +10,8 @@
 
 #define MAILCORE_MCBASE64_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -17,6 +19,11 @@ extern "C" {
 extern char * MCDecodeBase64(const char * in, int len, int * p_outlen);
 extern char * MCEncodeBase64(const char * in, int len);
 
+// Decodes MIME content into out, which should be at least len / 4 * 3 + 3 bytes long.
+// The characters outside of the alphabet, such as line breaks, are skipped.
+// Returns the length of the decoded data.
+extern size_t MCDecodeBase64Content(const char * in, size_t len, char * out);
+
 #ifdef __cplusplus
 }
 #endif
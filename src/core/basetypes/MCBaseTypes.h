@@ -22,6 +22,8 @@
 #include <MailCore/MCOperation.h>
 #include <MailCore/MCOperationQueue.h>
 #include <MailCore/MCOperationCallback.h>
+#include <MailCore/MCCallbackExecutor.h>
+#include <MailCore/MCMainThreadEventLoop.h>
 #include <MailCore/MCLibetpanTypes.h>
 #include <MailCore/MCICUTypes.h>
 #include <MailCore/MCIterator.h>
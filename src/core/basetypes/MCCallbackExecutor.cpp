@@ -0,0 +1,21 @@
+#include "MCCallbackExecutor.h"
+
+using namespace mailcore;
+
+namespace mailcore {
+    
+    class InlineCallbackExecutor : public CallbackExecutor {
+    public:
+        virtual void performMethod(Object * object, Object::Method method, void * context, bool waitUntilDone)
+        {
+            (object->*method)(context);
+        }
+    };
+    
+}
+
+CallbackExecutor * CallbackExecutor::inlineExecutor()
+{
+    static InlineCallbackExecutor executor;
+    return &executor;
+}
@@ -0,0 +1,29 @@
+#ifndef MAILCORE_MCCALLBACKEXECUTOR_H
+
+#define MAILCORE_MCCALLBACKEXECUTOR_H
+
+#include <MailCore/MCObject.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+    
+    // Runs the callbacks of operations (beforeMain(), afterMain(), completion and progress)
+    // instead of the main thread.
+    class MAILCORE_EXPORT CallbackExecutor {
+    public:
+        virtual ~CallbackExecutor() {}
+        
+        // Should call (object->*method)(context). When waitUntilDone is true, it should
+        // only return once the call is done.
+        virtual void performMethod(Object * object, Object::Method method, void * context, bool waitUntilDone) = 0;
+        
+        // Makes the calls right away on the calling thread, which is the thread running the operation.
+        static CallbackExecutor * inlineExecutor();
+    };
+    
+}
+
+#endif
+
+#endif
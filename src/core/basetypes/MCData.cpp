@@ -57,26 +57,50 @@ void Data::allocate(unsigned int length, bool force)
         }
     }
     
-    mBytes = (char *) realloc(mBytes, mAllocated);
+    reallocateBytes(mAllocated);
+}
+
+void Data::reallocateBytes(unsigned int capacity)
+{
+    if (mBytesDeallocator == NULL) {
+        mBytes = (char *) realloc(mBytes, capacity);
+        return;
+    }
+    
+    // The bytes can't be passed to realloc().
+    char * bytes = (char *) malloc(capacity);
+    memcpy(bytes, mBytes, mLength < capacity ? mLength : capacity);
+    mBytesDeallocator(mBytes);
+    mBytesDeallocator = NULL;
+    mBytes = bytes;
 }
 
 void Data::reset()
 {
-    free(mBytes);
+    if (mBytesDeallocator != NULL) {
+        mBytesDeallocator(mBytes);
+        mBytesDeallocator = NULL;
+    }
+    else {
+        free(mBytes);
+    }
     mAllocated = 0;
     mLength = 0;
     mBytes = NULL;
+    mHash = 0;
 }
 
 Data::Data()
 {
     mBytes = NULL;
+    mBytesDeallocator = NULL;
     reset();
 }
 
 Data::Data(Data * otherData) : Object()
 {
     mBytes = NULL;
+    mBytesDeallocator = NULL;
     reset();
     appendData(otherData);
 }
@@ -84,6 +108,7 @@ Data::Data(Data * otherData) : Object()
 Data::Data(const char * bytes, unsigned int length)
 {
     mBytes = NULL;
+    mBytesDeallocator = NULL;
     reset();
     allocate(length, true);
     appendBytes(bytes, length);
@@ -92,6 +117,7 @@ Data::Data(const char * bytes, unsigned int length)
 Data::Data(int capacity)
 {
     mBytes = NULL;
+    mBytesDeallocator = NULL;
     reset();
     allocate(capacity, true);
 }
@@ -127,6 +153,7 @@ void Data::appendBytes(const char * bytes, unsigned int length)
     allocate(mLength + length);
     memcpy(&mBytes[mLength], bytes, length);
     mLength += length;
+    mHash = 0;
 }
 
 void Data::setBytes(const char * bytes, unsigned int length)
@@ -163,7 +190,15 @@ bool Data::isEqual(Object * otherObject)
 
 unsigned int Data::hash()
 {
-    return hashCompute(mBytes, mLength);
+    unsigned int result = MC_ATOMIC_LOAD(&mHash);
+    if (result == 0) {
+        result = hashCompute(mBytes, mLength);
+        if (result == 0) {
+            result = 1;
+        }
+        MC_ATOMIC_STORE(&mHash, result);
+    }
+    return result;
 }
 
 String * Data::stringWithDetectedCharset()
@@ -484,11 +519,13 @@ String * Data::charsetWithFilteredHTML(bool filterHTML, String * hintCharset)
 #endif
 }
 
-void Data::takeBytesOwnership(char * bytes, unsigned int length)
+void Data::takeBytesOwnership(char * bytes, unsigned int length, BytesDeallocator deallocator)
 {
-    free(mBytes);
-    mBytes = (char *) bytes;
+    reset();
+    mBytes = bytes;
     mLength = length;
+    mAllocated = length;
+    mBytesDeallocator = deallocator;
 }
 
 Data * Data::dataWithContentsOfFile(String * filename)
@@ -567,6 +604,59 @@ static size_t uudecode(char * text, size_t size)
     return count;
 }
 
+static int hexValue(char ch)
+{
+    if ((ch >= '0') && (ch <= '9'))
+        return ch - '0';
+    if ((ch >= 'A') && (ch <= 'F'))
+        return ch - 'A' + 10;
+    if ((ch >= 'a') && (ch <= 'f'))
+        return ch - 'a' + 10;
+    return -1;
+}
+
+// Decodes into output, which should be at least text_length bytes long.
+// Returns the length of the decoded data.
+static size_t decodeQuotedPrintable(const char * text, size_t text_length, char * output)
+{
+    char * out = output;
+    size_t i = 0;
+    
+    while (i < text_length) {
+        const char * escape = (const char *) memchr(text + i, '=', text_length - i);
+        size_t plain_length = (escape == NULL) ? text_length - i : escape - (text + i);
+        memcpy(out, text + i, plain_length);
+        out += plain_length;
+        i += plain_length;
+        if (i == text_length)
+            break;
+        
+        // Soft line break.
+        if ((i + 1 < text_length) && (text[i + 1] == '\n')) {
+            i += 2;
+            continue;
+        }
+        if ((i + 2 < text_length) && (text[i + 1] == '\r') && (text[i + 2] == '\n')) {
+            i += 3;
+            continue;
+        }
+        if (i + 2 < text_length) {
+            int high = hexValue(text[i + 1]);
+            int low = hexValue(text[i + 2]);
+            if ((high != -1) && (low != -1)) {
+                * out ++ = (char) ((high << 4) | low);
+                i += 3;
+                continue;
+            }
+        }
+        // Invalid escape, kept as is.
+        * out ++ = '=';
+        i ++;
+    }
+    
+    return out - output;
+}
+
 Data * Data::decodedDataUsingEncoding(Encoding encoding)
 {
     const char * text;
@@ -585,29 +675,16 @@ Data * Data::decodedDataUsingEncoding(Encoding encoding)
             return this;
         }
         case EncodingBase64:
+        {
+            // Decoded in place in the result, which can't be larger.
+            Data * data = Data::dataWithCapacity((unsigned int) (text_length / 4 * 3 + 3));
+            data->mLength = (unsigned int) MCDecodeBase64Content(text, text_length, data->mBytes);
+            return data;
+        }
         case EncodingQuotedPrintable:
         {
-            char * decoded;
-            size_t decoded_length;
-            size_t cur_token;
-            int mime_encoding;
-            Data * data;
-            
-            switch (encoding) {
-                default: //disable warning
-                case EncodingBase64:
-                    mime_encoding = MAILMIME_MECHANISM_BASE64;
-                    break;
-                case EncodingQuotedPrintable:
-                    mime_encoding = MAILMIME_MECHANISM_QUOTED_PRINTABLE;
-                    break;
-            }
-            
-            cur_token = 0;
-            mailmime_part_parse(text, text_length, &cur_token,
-                                mime_encoding, &decoded, &decoded_length);
-            data = Data::dataWithBytes(decoded, (unsigned int) decoded_length);
-            mailmime_decoded_part_free(decoded);
+            Data * data = Data::dataWithCapacity((unsigned int) text_length);
+            data->mLength = (unsigned int) decodeQuotedPrintable(text, text_length, data->mBytes);
             return data;
         }
         case EncodingUUEncode:
@@ -808,6 +885,91 @@ static size_t lepIConvInternal(iconv_t cd,
     }
 }
 
+// Opened iconv handles are kept per thread since iconv_open() is costly for some charsets.
+#define ICONV_CACHE_SIZE 8
+
+struct iconvCacheEntry {
+    char * tocode;
+    char * fromcode;
+    iconv_t conv;
+};
+
+struct iconvCache {
+    unsigned int count;
+    // Least recently used first.
+    struct iconvCacheEntry entries[ICONV_CACHE_SIZE];
+};
+
+static pthread_key_t iconvCacheKey;
+static pthread_once_t iconvCacheOnce = PTHREAD_ONCE_INIT;
+
+static void iconvCacheEntryFree(struct iconvCacheEntry * entry)
+{
+    iconv_close(entry->conv);
+    free(entry->tocode);
+    free(entry->fromcode);
+}
+
+static void iconvCacheDestroy(void * value)
+{
+    struct iconvCache * cache = (struct iconvCache *) value;
+    for(unsigned int i = 0 ; i < cache->count ; i ++) {
+        iconvCacheEntryFree(&cache->entries[i]);
+    }
+    free(cache);
+}
+
+static void iconvCacheInitKey()
+{
+    pthread_key_create(&iconvCacheKey, iconvCacheDestroy);
+}
+
+static struct iconvCache * iconvCurrentCache()
+{
+    pthread_once(&iconvCacheOnce, iconvCacheInitKey);
+    struct iconvCache * cache = (struct iconvCache *) pthread_getspecific(iconvCacheKey);
+    if (cache == NULL) {
+        cache = (struct iconvCache *) calloc(1, sizeof(* cache));
+        pthread_setspecific(iconvCacheKey, cache);
+    }
+    return cache;
+}
+
+// Returns a handle for the conversion, taken out of the cache if available.
+static iconv_t iconvCacheTake(const char * tocode, const char * fromcode)
+{
+    struct iconvCache * cache = iconvCurrentCache();
+    for(unsigned int i = 0 ; i < cache->count ; i ++) {
+        struct iconvCacheEntry * entry = &cache->entries[i];
+        if ((strcasecmp(entry->tocode, tocode) == 0) && (strcasecmp(entry->fromcode, fromcode) == 0)) {
+            iconv_t conv = entry->conv;
+            free(entry->tocode);
+            free(entry->fromcode);
+            memmove(&cache->entries[i], &cache->entries[i + 1], (cache->count - i - 1) * sizeof(* entry));
+            cache->count --;
+            return conv;
+        }
+    }
+    return iconv_open(tocode, fromcode);
+}
+
+// Resets the handle and puts it back in the cache, closing the least recently used one if the cache is full.
+static void iconvCacheGiveBack(const char * tocode, const char * fromcode, iconv_t conv)
+{
+    struct iconvCache * cache = iconvCurrentCache();
+    iconv(conv, NULL, NULL, NULL, NULL);
+    if (cache->count == ICONV_CACHE_SIZE) {
+        iconvCacheEntryFree(&cache->entries[0]);
+        memmove(&cache->entries[0], &cache->entries[1], (cache->count - 1) * sizeof(cache->entries[0]));
+        cache->count --;
+    }
+    struct iconvCacheEntry * entry = &cache->entries[cache->count];
+    entry->tocode = strdup(tocode);
+    entry->fromcode = strdup(fromcode);
+    entry->conv = conv;
+    cache->count ++;
+}
+
 static int lepIConv(const char * tocode, const char * fromcode,
                     const char * str, size_t length,
                     char * result, size_t * result_len)
@@ -820,7 +982,7 @@ static int lepIConv(const char * tocode, const char * fromcode,
     int res;
     size_t r;
 
-    conv = iconv_open(tocode, fromcode);
+    conv = iconvCacheTake(tocode, fromcode);
     if (conv == (iconv_t) -1) {
         res = MAIL_CHARCONV_ERROR_UNKNOWN_CHARSET;
         goto err;
@@ -837,7 +999,7 @@ static int lepIConv(const char * tocode, const char * fromcode,
         goto close_iconv;
     }
     
-    iconv_close(conv);
+    iconvCacheGiveBack(tocode, fromcode, conv);
     
     * result_len = old_out_size - out_size;
     * p_result = '\0';
@@ -845,7 +1007,7 @@ static int lepIConv(const char * tocode, const char * fromcode,
     return MAIL_CHARCONV_NO_ERROR;
     
 close_iconv:
-    iconv_close(conv);
+    iconvCacheGiveBack(tocode, fromcode, conv);
 err:
     return res;
 }
@@ -19,6 +19,9 @@ namespace mailcore {
     
     class MAILCORE_EXPORT Data : public Object {
     public:
+        // Frees bytes that were not allocated with malloc().
+        typedef void (* BytesDeallocator)(char * bytes);
+        
         Data();
         Data(int capacity);
         Data(const char * bytes, unsigned int length);
@@ -29,6 +32,7 @@ namespace mailcore {
         static Data * dataWithContentsOfFile(String * filename);
         static Data * dataWithBytes(const char * bytes, unsigned int length);
         
+        // The hash value is cached: bytes should only be modified through the methods below.
         virtual char * bytes();
         virtual unsigned int length();
         
@@ -49,6 +53,9 @@ namespace mailcore {
         
     public: // private
         virtual String * charsetWithFilteredHTML(bool filterHTML, String * hintCharset = NULL);
+        // The data takes ownership of the bytes instead of copying them. They're freed with the deallocator,
+        // or with free() if it's NULL. Bytes owned by a deallocator are copied before being modified.
+        virtual void takeBytesOwnership(char * bytes, unsigned int length, BytesDeallocator deallocator = NULL);
 #ifdef __APPLE__
         virtual CFDataRef destructiveNSData();
 #endif
@@ -66,10 +73,13 @@ namespace mailcore {
         char * mBytes;
         unsigned int mLength;
         unsigned int mAllocated;
+        // Cached hash value, 0 when not computed yet.
+        unsigned int mHash;
+        BytesDeallocator mBytesDeallocator;
         void allocate(unsigned int length, bool force = false);
+        void reallocateBytes(unsigned int capacity);
         void reset();
         String * charsetWithFilteredHTMLWithoutHint(bool filterHTML);
-        void takeBytesOwnership(char * bytes, unsigned int length);
         
     };
 
@@ -14,6 +14,10 @@ using namespace mailcore;
 
 CFDataRef Data::destructiveNSData()
 {
+    if (mBytesDeallocator != NULL) {
+        // NSData will free() the bytes.
+        reallocateBytes(mLength);
+    }
     NSData * result = [NSData dataWithBytesNoCopy:(void *) mBytes length:mLength];
     mBytes = NULL;
     mAllocated = 0;
@@ -1,12 +1,42 @@
 #include "MCHash.h"
 
+#include <stdint.h>
+#include <string.h>
+
+// The key is read 8 bytes at a time and each word is mixed with a rotation and a multiplication.
+// A final avalanche step makes all the bits of the result depend on all the bits of the key.
+
+static inline uint64_t readWord(const char * p)
+{
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline uint64_t mixWord(uint64_t h, uint64_t word)
+{
+    h = (h << 5) | (h >> 59);
+    return (h ^ word) * 0x517cc1b727220a95ULL;
+}
+
 unsigned int mailcore::hashCompute(const char * key, unsigned int len) {
-  unsigned int c = 5381;
-  const char * k = key;
-  
-  while (len--) {
-    c = ((c << 5) + c) + *k++;
-  }
-  
-  return c;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    const char * k = key;
+    
+    while (len >= 8) {
+        h = mixWord(h, readWord(k));
+        k += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        uint64_t word = 0;
+        memcpy(&word, k, len);
+        h = mixWord(h, word);
+    }
+    
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    
+    return (unsigned int) (h ^ (h >> 32));
 }
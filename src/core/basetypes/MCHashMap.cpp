@@ -18,22 +18,38 @@ using namespace mailcore;
 namespace mailcore {
     struct HashMapCell {
         unsigned int func;
+        // NULL when the cell is empty.
         Object * key;
         Object * value;
-        HashMapCell * next;
     };
     
 }
 
-#define CHASH_DEFAULTSIZE 13
-#define CHASH_MAXDEPTH    3
+#define HASHMAP_DEFAULTSIZE 8
+// The table grows when more than 3/4 of the cells are used.
+#define HASHMAP_MAXCOUNT(size) ((size) - (size) / 4)
+
+// Fibonacci hashing: spreads the hash value over the bits used for the index.
+static inline unsigned int cellIndex(unsigned int func, unsigned int shift)
+{
+    return (unsigned int) ((func * 2654435769U) >> shift);
+}
+
+// Strings from MCSTR() are never modified, they can be shared instead of copied.
+static inline Object * keyForInsertion(Object * key)
+{
+    if (MCISKINDOFCLASS(key, String) && ((String *) key)->isUniqued()) {
+        return key->retain();
+    }
+    return key->copy();
+}
 
 void HashMap::init()
 {
     mCount = 0;
-    size_t hashMapCellSize = sizeof(HashMapCell *);
-    mCells = (void **) calloc(CHASH_DEFAULTSIZE, hashMapCellSize);
-    mAllocated = CHASH_DEFAULTSIZE;
+    mAllocated = 0;
+    mShift = 32;
+    mCells = NULL;
 }
 
 HashMap::HashMap()
@@ -44,25 +60,29 @@ HashMap::HashMap()
 HashMap::HashMap(HashMap * other)
 {
     init();
-    Array * keys = other->allKeys();
-    for(unsigned int i = 0 ; i < keys->count() ; i ++) {
-        Object * key = keys->objectAtIndex(i);
-        Object * value = other->objectForKey(key);
-        setObjectForKey(key, value);
+    if (other->mCount == 0) {
+        return;
+    }
+    // Keys stored in a hash map are never modified, they can be shared.
+    mCells = (HashMapCell *) malloc(other->mAllocated * sizeof(* mCells));
+    memcpy(mCells, other->mCells, other->mAllocated * sizeof(* mCells));
+    mAllocated = other->mAllocated;
+    mShift = other->mShift;
+    mCount = other->mCount;
+    for(unsigned int indx = 0 ; indx < mAllocated ; indx ++) {
+        if (mCells[indx].key != NULL) {
+            mCells[indx].key->retain();
+            mCells[indx].value->retain();
+        }
     }
 }
 
 HashMap::~HashMap()
 {
-    for(unsigned int indx = 0; indx < mAllocated; indx++) {
-        HashMapIter * iter, * next;
-        iter = (HashMapIter *) mCells[indx];
-        while (iter) {
-            next = iter->next;
-            iter->key->release();
-            iter->value->release();
-            free(iter);
-            iter = next;
+    for(unsigned int indx = 0 ; indx < mAllocated ; indx ++) {
+        if (mCells[indx].key != NULL) {
+            mCells[indx].key->release();
+            mCells[indx].value->release();
         }
     }
     free(mCells);
@@ -70,28 +90,32 @@ HashMap::~HashMap()
 
 void HashMap::allocate(unsigned int size)
 {
-    HashMapCell ** cells;
-    unsigned int indx, nindx;
-    HashMapIter * iter, * next;
-
+    HashMapCell * cells;
+    unsigned int shift;
+    
     if (mAllocated == size)
-      return;
-
-    cells = (HashMapCell **) calloc(size, sizeof(HashMapCell *));
-    /* iterate over initial hash and copy items in second hash */
-    for(indx = 0 ; indx < mAllocated ; indx ++) {
-      iter = (HashMapIter *) mCells[indx];
-      while (iter) {
-        next = iter->next;
-        nindx = iter->func % size;
-        iter->next = cells[nindx];
-        cells[nindx] = iter;
-        iter = next;
-      }
+        return;
+    
+    shift = 32;
+    for(unsigned int i = size ; i > 1 ; i >>= 1) {
+        shift --;
+    }
+    
+    cells = (HashMapCell *) calloc(size, sizeof(* cells));
+    /* move the entries of the previous table */
+    for(unsigned int indx = 0 ; indx < mAllocated ; indx ++) {
+        if (mCells[indx].key == NULL)
+            continue;
+        unsigned int nindx = cellIndex(mCells[indx].func, shift);
+        while (cells[nindx].key != NULL) {
+            nindx = (nindx + 1) & (size - 1);
+        }
+        cells[nindx] = mCells[indx];
     }
     free(mCells);
     mAllocated = size;
-    mCells = (void **) cells;
+    mShift = shift;
+    mCells = cells;
 }
 
 HashMap * HashMap::hashMap()
@@ -130,128 +154,108 @@ unsigned int HashMap::count()
     return mCount;
 }
 
-void HashMap::setObjectForKey(Object * key, Object * value)
+int HashMap::indexForKey(Object * key, unsigned int func)
 {
-    unsigned int func, indx;
-    HashMapIter * iter, * cell;
-
-    if (mCount > mAllocated * CHASH_MAXDEPTH) {
-        allocate((mCount / CHASH_MAXDEPTH) * 2 + 1);
-    }
-
-    func = key->hash();
-    indx = func % mAllocated;
-
-     /* look for the key in existing cells */
-    iter = (HashMapIter *) mCells[indx];
-    while (iter) {
-        if (iter->func == func && iter->key->isEqual(key)) {
-         /* found, replacing entry */
-            value->retain();
-            iter->value->release();
-            iter->value = value;
-            return;
+    if (mAllocated == 0)
+        return -1;
+    
+    unsigned int indx = cellIndex(func, mShift);
+    while (mCells[indx].key != NULL) {
+        HashMapCell * cell = &mCells[indx];
+        if (cell->func == func && ((cell->key == key) || key->isEqual(cell->key))) {
+            return (int) indx;
         }
-        iter = iter->next;
+        indx = (indx + 1) & (mAllocated - 1);
     }
-
-     /* not found, adding entry */
-    cell = (HashMapCell *) malloc(sizeof(HashMapCell));
-    cell->key = key->copy();
-    cell->value = value->retain();
-    cell->func = func;
-    cell->next = (HashMapCell *) mCells[indx];
-    mCells[indx] = cell;
-    mCount ++;
+    return -1;
 }
 
-void HashMap::removeObjectForKey(Object * key)
+void HashMap::setObjectForKey(Object * key, Object * value)
 {
     unsigned int func, indx;
-    HashMapIter * iter, * old;
+    int found;
     
-    func = key->hash();;
-    indx = func % mAllocated;
+    func = key->hash();
     
     /* look for the key in existing cells */
-    old = NULL;
-    iter = (HashMapIter *) mCells[indx];
-    while (iter) {
-        if (iter->func == func && iter->key->isEqual(key)) {
-            /* found, deleting */
-            if (old)
-                old->next = iter->next;
-            else
-                mCells[indx] = iter->next;
-            iter->key->release();
-            iter->value->release();
-            free(iter);
-            mCount --;
-            return;
-        }
-        old = iter;
-        iter = iter->next;
+    found = indexForKey(key, func);
+    if (found != -1) {
+        /* found, replacing entry */
+        value->retain();
+        mCells[found].value->release();
+        mCells[found].value = value;
+        return;
+    }
+    
+    /* not found, adding entry */
+    if (mCount + 1 > HASHMAP_MAXCOUNT(mAllocated)) {
+        allocate(mAllocated == 0 ? HASHMAP_DEFAULTSIZE : mAllocated * 2);
     }
-    // Not found.
+    indx = cellIndex(func, mShift);
+    while (mCells[indx].key != NULL) {
+        indx = (indx + 1) & (mAllocated - 1);
+    }
+    mCells[indx].key = keyForInsertion(key);
+    mCells[indx].value = value->retain();
+    mCells[indx].func = func;
+    mCount ++;
 }
 
-Object * HashMap::objectForKey(Object * key)
+void HashMap::removeCellAtIndex(unsigned int indx)
 {
-    unsigned int func;
-    HashMapIter * iter;
+    mCells[indx].key->release();
+    mCells[indx].value->release();
+    mCount --;
     
-    func = key->hash();
-    
-    /* look for the key in existing cells */
-    iter = (HashMapIter *) mCells[func % mAllocated];
-    while (iter) {
-        if (iter->func == func && key->isEqual(iter->key)) {
-            return iter->value; /* found */
+    /* move back the following entries of the probe sequence so that lookups don't stop at the hole */
+    unsigned int next = indx;
+    while (1) {
+        next = (next + 1) & (mAllocated - 1);
+        if (mCells[next].key == NULL)
+            break;
+        unsigned int ideal = cellIndex(mCells[next].func, mShift);
+        bool stays;
+        if (next > indx) {
+            stays = (ideal > indx) && (ideal <= next);
+        }
+        else {
+            stays = (ideal > indx) || (ideal <= next);
+        }
+        if (!stays) {
+            mCells[indx] = mCells[next];
+            indx = next;
         }
-        iter = iter->next;
     }
-    return NULL;
+    mCells[indx].key = NULL;
+    mCells[indx].value = NULL;
 }
 
-HashMapIter * HashMap::iteratorBegin()
+void HashMap::removeObjectForKey(Object * key)
 {
-  HashMapIter * iter;
-  unsigned int indx = 0;
-  
-  iter = (HashMapIter *) mCells[0];
-  while (!iter) {
-    indx ++;
-    if (indx >= mAllocated)
-      return NULL;
-    iter = (HashMapIter *) mCells[indx];
-  }
-  return iter;
+    int indx = indexForKey(key, key->hash());
+    if (indx == -1) {
+        // Not found.
+        return;
+    }
+    removeCellAtIndex((unsigned int) indx);
 }
 
-HashMapIter * HashMap::iteratorNext(HashMapIter * iter)
+Object * HashMap::objectForKey(Object * key)
 {
-  unsigned int indx;
-
-  if (!iter)
-    return NULL;
-
-  indx = iter->func % mAllocated;
-  iter = iter->next;
-
-  while(!iter) {
-    indx++;
-    if (indx >= mAllocated)
-      return NULL;
-    iter = (HashMapIter *) mCells[indx];
-  }
-  return iter;
+    int indx = indexForKey(key, key->hash());
+    if (indx == -1) {
+        return NULL;
+    }
+    return mCells[indx].value;
 }
 
 Array * HashMap::allKeys()
 {
     Array * keys = Array::array();
-    for(HashMapIter * iter = iteratorBegin() ; iter != NULL ; iter = iteratorNext(iter)) {
-        keys->addObject(iter->key);
+    for(unsigned int indx = 0 ; indx < mAllocated ; indx ++) {
+        if (mCells[indx].key != NULL) {
+            keys->addObject(mCells[indx].key);
+        }
     }
     return keys;
 }
@@ -259,26 +263,25 @@ Array * HashMap::allKeys()
 Array * HashMap::allValues()
 {
     Array * values = Array::array();
-    for(HashMapIter * iter = iteratorBegin() ; iter != NULL ; iter = iteratorNext(iter)) {
-        values->addObject(iter->value);
+    for(unsigned int indx = 0 ; indx < mAllocated ; indx ++) {
+        if (mCells[indx].key != NULL) {
+            values->addObject(mCells[indx].value);
+        }
     }
     return values;
 }
 
 void HashMap::removeAllObjects()
 {
-    for(unsigned int indx = 0 ; indx < mAllocated ; indx++) {
-        HashMapIter * iter, * next;
-        iter = (HashMapIter *) mCells[indx];
-        while (iter) {
-            next = iter->next;
-            iter->key->release();
-            iter->value->release();
-            free(iter);
-            iter = next;
+    for(unsigned int indx = 0 ; indx < mAllocated ; indx ++) {
+        if (mCells[indx].key != NULL) {
+            mCells[indx].key->release();
+            mCells[indx].value->release();
         }
     }
-    memset(mCells, 0, mAllocated * sizeof(* mCells));
+    if (mCells != NULL) {
+        memset(mCells, 0, mAllocated * sizeof(* mCells));
+    }
     mCount = 0;
 }
 
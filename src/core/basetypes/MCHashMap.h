@@ -11,7 +11,6 @@ namespace mailcore {
     class String;
     class Array;
     struct HashMapCell;
-    typedef HashMapCell HashMapIter;
     
     class MAILCORE_EXPORT HashMap : public Object {
     public:
@@ -37,11 +36,13 @@ namespace mailcore {
         virtual bool isEqual(Object * otherObject);
 
     private:
+        // Open addressing with linear probing. mAllocated is zero or a power of two.
         unsigned int mAllocated;
+        unsigned int mShift;
         unsigned int mCount;
-        void ** mCells;
-        HashMapIter * iteratorBegin();
-        HashMapIter * iteratorNext(HashMapIter * iter);
+        HashMapCell * mCells;
+        int indexForKey(Object * key, unsigned int func);
+        void removeCellAtIndex(unsigned int indx);
         void allocate(unsigned int size);
         void init();
     };
@@ -11,12 +11,13 @@
 #include "MCLibetpan.h"
 
 #include <libetpan/libetpan.h>
+#include <stdint.h>
 
 #include "MCDefines.h"
 
 using namespace mailcore;
 
-static int tmcomp(struct tm * atmp, struct tm * btmp);
+static int zoneOffset(int zone);
 
 INITIALIZE(Libetpan)
 {
@@ -28,8 +29,6 @@ time_t mailcore::timestampFromDate(struct mailimf_date_time * date_time)
 {
     struct tm tmval;
     time_t timeval;
-    int zone_min;
-    int zone_hour;
     
     tmval.tm_sec  = date_time->dt_sec;
     tmval.tm_min  = date_time->dt_min;
@@ -46,17 +45,26 @@ time_t mailcore::timestampFromDate(struct mailimf_date_time * date_time)
     
     timeval = mkgmtime(&tmval);
     
-    if (date_time->dt_zone >= 0) {
-        zone_hour = date_time->dt_zone / 100;
-        zone_min = date_time->dt_zone % 100;
+    timeval -= zoneOffset(date_time->dt_zone);
+    
+    return timeval;
+}
+
+// Offset in seconds of a zone given as +hhmm or -hhmm.
+static int zoneOffset(int zone)
+{
+    int zone_min;
+    int zone_hour;
+
+    if (zone >= 0) {
+        zone_hour = zone / 100;
+        zone_min = zone % 100;
     }
     else {
-        zone_hour = -((- date_time->dt_zone) / 100);
-        zone_min = -((- date_time->dt_zone) % 100);
+        zone_hour = -((- zone) / 100);
+        zone_min = -((- zone) % 100);
     }
-    timeval -= zone_hour * 3600 + zone_min * 60;
-    
-    return timeval;
+    return zone_hour * 3600 + zone_min * 60;
 }
 
 struct mailimf_date_time * mailcore::dateFromTimestamp(time_t timeval)
@@ -131,8 +139,6 @@ time_t mailcore::timestampFromIMAPDate(struct mailimap_date_time * date_time)
 {
     struct tm tmval;
     time_t timeval;
-    int zone_min;
-    int zone_hour;
     
     tmval.tm_sec  = date_time->dt_sec;
     tmval.tm_min  = date_time->dt_min;
@@ -149,74 +155,105 @@ time_t mailcore::timestampFromIMAPDate(struct mailimap_date_time * date_time)
     
     timeval = mkgmtime(&tmval);
     
-    if (date_time->dt_zone >= 0) {
-        zone_hour = date_time->dt_zone / 100;
-        zone_min = date_time->dt_zone % 100;
-    }
-    else {
-        zone_hour = -((- date_time->dt_zone) / 100);
-        zone_min = -((- date_time->dt_zone) % 100);
-    }
-    timeval -= zone_hour * 3600 + zone_min * 60;
+    timeval -= zoneOffset(date_time->dt_zone);
     
     return timeval;
 }
 
 #define INVALID_TIMESTAMP    (-1)
+// Range of the timestamps the former bisection over time_t could reach.
+#define MAX_TIMESTAMP (((int64_t) 1 << 40) - 1)
+
+static bool isLeapYear(int64_t year)
+{
+    return ((year % 4) == 0 && (year % 100) != 0) || ((year % 400) == 0);
+}
+
+static int daysInMonth(int64_t year, int month)
+{
+    static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if ((month == 1) && isLeapYear(year)) {
+        return 29;
+    }
+    return days[month];
+}
 
-static int tmcomp(struct tm * atmp, struct tm * btmp)
+// Number of days since 1970-01-01 of the given date of the proleptic Gregorian calendar.
+// month is in [0, 11] and day in [1, 31].
+static int64_t daysFromCivil(int64_t year, int month, int day)
 {
-    int    result;
-    
-    if ((result = (atmp->tm_year - btmp->tm_year)) == 0 &&
-        (result = (atmp->tm_mon - btmp->tm_mon)) == 0 &&
-        (result = (atmp->tm_mday - btmp->tm_mday)) == 0 &&
-        (result = (atmp->tm_hour - btmp->tm_hour)) == 0 &&
-        (result = (atmp->tm_min - btmp->tm_min)) == 0)
-        result = atmp->tm_sec - btmp->tm_sec;
-    return result;
+    // Years start in March so that the leap day is the last day of the year.
+    if (month < 2) {
+        year --;
+    }
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month < 2 ? month + 10 : month - 2) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static bool isValidDate(int64_t year, int month, int day, int hour, int min)
+{
+    if ((month < 0) || (month > 11)) {
+        return false;
+    }
+    if ((day < 1) || (day > daysInMonth(year, month))) {
+        return false;
+    }
+    if ((hour < 0) || (hour > 23) || (min < 0) || (min > 59)) {
+        return false;
+    }
+    return true;
+}
+
+static time_t timestampFromDays(int64_t days, int hour, int min, int sec)
+{
+    int64_t t = days * 86400 + hour * 3600 + min * 60;
+    if ((t > MAX_TIMESTAMP) || (t < -MAX_TIMESTAMP - 1) || ((time_t) t != t)) {
+        return INVALID_TIMESTAMP;
+    }
+    return (time_t) (t + sec);
 }
 
 time_t mailcore::mkgmtime(struct tm * tmp)
 {
-    int            dir;
-    int            bits;
-    int            saved_seconds;
-    time_t                t;
-    struct tm            yourtm, mytm;
-    
-    yourtm = *tmp;
-    saved_seconds = yourtm.tm_sec;
-    yourtm.tm_sec = 0;
-    /*
-     ** Calculate the number of magnitude bits in a time_t
-     ** (this works regardless of whether time_t is
-     ** signed or unsigned, though lint complains if unsigned).
-     */
-    for (bits = 0, t = 1; t > 0; ++bits, t <<= 1)
-        ;
-    /*
-     ** If time_t is signed, then 0 is the median value,
-     ** if time_t is unsigned, then 1 << bits is median.
-     */
-    if(bits > 40) bits = 40;
-    t = (t < 0) ? 0 : ((time_t) 1 << bits);
-    for ( ; ; ) {
-        gmtime_r(&t, &mytm);
-        dir = tmcomp(&mytm, &yourtm);
-        if (dir != 0) {
-            if (bits-- < 0) {
-                return INVALID_TIMESTAMP;
+    // Seconds are not validated, they're added to the result.
+    int64_t year = (int64_t) tmp->tm_year + 1900;
+    if (!isValidDate(year, tmp->tm_mon, tmp->tm_mday, tmp->tm_hour, tmp->tm_min)) {
+        return INVALID_TIMESTAMP;
+    }
+    return timestampFromDays(daysFromCivil(year, tmp->tm_mon, tmp->tm_mday), tmp->tm_hour, tmp->tm_min, tmp->tm_sec);
+}
+
+void mailcore::timestampsFromIMAPDates(struct mailimap_date_time * dates, unsigned int count, time_t * timestamps)
+{
+    // Dates fetched together are usually close to each other: the number of days
+    // of the first day of the month is reused while the month doesn't change.
+    int64_t lastYear = 0;
+    int lastMonth = -1;
+    int64_t monthDays = 0;
+    for(unsigned int i = 0 ; i < count ; i ++) {
+        struct mailimap_date_time * date_time = &dates[i];
+        int64_t year = date_time->dt_year;
+        int month = date_time->dt_month - 1;
+        time_t timeval;
+
+        if (year < 1000) {
+            // workaround when century is not given in year
+            year += 2000;
+        }
+        if (!isValidDate(year, month, date_time->dt_day, date_time->dt_hour, date_time->dt_min)) {
+            timeval = INVALID_TIMESTAMP;
+        }
+        else {
+            if ((year != lastYear) || (month != lastMonth)) {
+                monthDays = daysFromCivil(year, month, 1);
+                lastYear = year;
+                lastMonth = month;
             }
-            if (bits < 0)
-                --t;
-            else if (dir > 0)
-                t -= (time_t) 1 << bits;
-            else    t += (time_t) 1 << bits;
-            continue;
+            timeval = timestampFromDays(monthDays + date_time->dt_day - 1, date_time->dt_hour, date_time->dt_min, date_time->dt_sec);
         }
-        break;
+        timestamps[i] = timeval - zoneOffset(date_time->dt_zone);
     }
-    t += saved_seconds;
-    return t;
 }
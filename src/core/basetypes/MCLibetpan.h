@@ -20,6 +20,8 @@ namespace mailcore {
     struct mailimf_date_time * dateFromTimestamp(time_t timeval);
     struct mailimap_date_time * imapDateFromTimestamp(time_t timeval);
     time_t mkgmtime(struct tm * tmp);
+    // Same result as timestampFromIMAPDate() for each of the count dates.
+    void timestampsFromIMAPDates(struct mailimap_date_time * dates, unsigned int count, time_t * timestamps);
     
 }
 
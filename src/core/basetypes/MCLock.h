@@ -29,4 +29,33 @@
 
 #endif
 
+// Atomic operations on a 32-bits integer and on pointers.
+// MC_ATOMIC_DECREMENT() has release semantics and MC_ATOMIC_ACQUIRE_FENCE() should be issued
+// before tearing down an object once its counter reached zero.
+// MC_ATOMIC_CAS_PTR() is a full barrier and returns true if the value has been swapped.
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+#define MC_ATOMIC_INCREMENT(p) _InterlockedIncrement((volatile long *) (p))
+#define MC_ATOMIC_DECREMENT(p) _InterlockedDecrement((volatile long *) (p))
+#define MC_ATOMIC_LOAD(p) _InterlockedCompareExchange((volatile long *) (p), 0, 0)
+#define MC_ATOMIC_STORE(p, value) _InterlockedExchange((volatile long *) (p), (long) (value))
+#define MC_ATOMIC_ACQUIRE_FENCE() _ReadWriteBarrier()
+#define MC_ATOMIC_LOAD_PTR(p) _InterlockedCompareExchangePointer((void * volatile *) (p), NULL, NULL)
+#define MC_ATOMIC_CAS_PTR(p, oldValue, newValue) (_InterlockedCompareExchangePointer((void * volatile *) (p), (newValue), (oldValue)) == (oldValue))
+
+#else
+
+#define MC_ATOMIC_INCREMENT(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#define MC_ATOMIC_DECREMENT(p) __atomic_sub_fetch((p), 1, __ATOMIC_RELEASE)
+#define MC_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define MC_ATOMIC_STORE(p, value) __atomic_store_n((p), (value), __ATOMIC_RELAXED)
+#define MC_ATOMIC_ACQUIRE_FENCE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define MC_ATOMIC_LOAD_PTR(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MC_ATOMIC_CAS_PTR(p, oldValue, newValue) __sync_bool_compare_and_swap((p), (oldValue), (newValue))
+
+#endif
+
 #endif
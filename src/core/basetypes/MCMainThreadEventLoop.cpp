@@ -0,0 +1,384 @@
+//
+//  MCMainThreadEventLoop.cpp
+//  mailcore2
+//
+//  Copyright (c) 2014 MailCore. All rights reserved.
+//
+
+#include "MCMainThread.h"
+#include "MCMainThreadEventLoop.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <libetpan/libetpan.h>
+
+#include "MCAssert.h"
+#include "MCLock.h"
+
+using namespace mailcore;
+
+// Calls are pushed on a lock-free stack by any thread. The main thread takes the whole stack
+// at once and runs the calls in the order they were posted.
+struct event_loop_call {
+    struct event_loop_call * next;
+    void (* function)(void *);
+    void * context;
+    struct mailsem * sem;
+};
+
+// Delayed calls are kept in a binary heap ordered by fire time.
+struct event_loop_delayed_call {
+    void (* function)(void *);
+    void * context;
+    uint64_t fireTime;
+    uint64_t sequence;
+    unsigned int index;
+};
+
+static pthread_once_t eventLoopOnce = PTHREAD_ONCE_INIT;
+static int epollFd = -1;
+static int wakeUpFd = -1;
+static int timerFd = -1;
+static struct event_loop_call * volatile pendingCalls = NULL;
+static volatile long stopRequested = 0;
+static __thread bool isEventLoopThread = false;
+static pthread_key_t waitSemaphoreKey;
+
+static pthread_mutex_t delayedCallsLock = PTHREAD_MUTEX_INITIALIZER;
+static struct event_loop_delayed_call ** delayedCalls = NULL;
+static unsigned int delayedCallsCount = 0;
+static unsigned int delayedCallsCapacity = 0;
+static uint64_t delayedCallsSequence = 0;
+static uint64_t armedFireTime = 0;
+
+static void waitSemaphoreDestroy(void * sem)
+{
+    mailsem_free((struct mailsem *) sem);
+}
+
+static void initEventLoop(void)
+{
+    struct epoll_event event;
+    int r;
+
+    pthread_key_create(&waitSemaphoreKey, waitSemaphoreDestroy);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    MCAssert(epollFd != -1);
+    wakeUpFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    MCAssert(wakeUpFd != -1);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    MCAssert(timerFd != -1);
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = wakeUpFd;
+    r = epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeUpFd, &event);
+    MCAssert(r == 0);
+    event.data.fd = timerFd;
+    r = epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+    MCAssert(r == 0);
+}
+
+static void setupEventLoop(void)
+{
+    pthread_once(&eventLoopOnce, initEventLoop);
+}
+
+static uint64_t currentTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void wakeUp(void)
+{
+    uint64_t value = 1;
+    ssize_t r;
+    do {
+        r = write(wakeUpFd, &value, sizeof(value));
+    } while ((r < 0) && (errno == EINTR));
+}
+
+static void postCall(struct event_loop_call * call)
+{
+    struct event_loop_call * head;
+    do {
+        head = (struct event_loop_call *) MC_ATOMIC_LOAD_PTR(&pendingCalls);
+        call->next = head;
+    } while (!MC_ATOMIC_CAS_PTR(&pendingCalls, head, call));
+
+    // The loop only needs to be woken up by the first call posted since the last drain.
+    if (head == NULL) {
+        wakeUp();
+    }
+}
+
+static void runPendingCalls(void)
+{
+    struct event_loop_call * calls;
+    struct event_loop_call * orderedCalls;
+    uint64_t value;
+
+    // Reset the eventfd before taking the calls: a call posted afterwards will wake up the loop again.
+    read(wakeUpFd, &value, sizeof(value));
+    do {
+        calls = (struct event_loop_call *) MC_ATOMIC_LOAD_PTR(&pendingCalls);
+        if (calls == NULL) {
+            return;
+        }
+    } while (!MC_ATOMIC_CAS_PTR(&pendingCalls, calls, NULL));
+
+    orderedCalls = NULL;
+    while (calls != NULL) {
+        struct event_loop_call * next = calls->next;
+        calls->next = orderedCalls;
+        orderedCalls = calls;
+        calls = next;
+    }
+
+    while (orderedCalls != NULL) {
+        // A synchronous call lives on the stack of the waiting thread, which returns once signaled.
+        struct event_loop_call * next = orderedCalls->next;
+        orderedCalls->function(orderedCalls->context);
+        if (orderedCalls->sem != NULL) {
+            mailsem_up(orderedCalls->sem);
+        }
+        else {
+            free(orderedCalls);
+        }
+        orderedCalls = next;
+    }
+}
+
+static bool delayedCallIsBefore(struct event_loop_delayed_call * a, struct event_loop_delayed_call * b)
+{
+    if (a->fireTime != b->fireTime) {
+        return a->fireTime < b->fireTime;
+    }
+    return a->sequence < b->sequence;
+}
+
+static void setDelayedCallAtIndex(struct event_loop_delayed_call * call, unsigned int index)
+{
+    delayedCalls[index] = call;
+    call->index = index;
+}
+
+static void siftUp(unsigned int index)
+{
+    struct event_loop_delayed_call * call = delayedCalls[index];
+    while (index > 0) {
+        unsigned int parent = (index - 1) / 2;
+        if (!delayedCallIsBefore(call, delayedCalls[parent])) {
+            break;
+        }
+        setDelayedCallAtIndex(delayedCalls[parent], index);
+        index = parent;
+    }
+    setDelayedCallAtIndex(call, index);
+}
+
+static void siftDown(unsigned int index)
+{
+    struct event_loop_delayed_call * call = delayedCalls[index];
+    while (1) {
+        unsigned int child = index * 2 + 1;
+        if (child >= delayedCallsCount) {
+            break;
+        }
+        if ((child + 1 < delayedCallsCount) && delayedCallIsBefore(delayedCalls[child + 1], delayedCalls[child])) {
+            child ++;
+        }
+        if (!delayedCallIsBefore(delayedCalls[child], call)) {
+            break;
+        }
+        setDelayedCallAtIndex(delayedCalls[child], index);
+        index = child;
+    }
+    setDelayedCallAtIndex(call, index);
+}
+
+static void removeDelayedCallAtIndex(unsigned int index)
+{
+    delayedCallsCount --;
+    if (index == delayedCallsCount) {
+        return;
+    }
+    struct event_loop_delayed_call * moved = delayedCalls[delayedCallsCount];
+    setDelayedCallAtIndex(moved, index);
+    siftDown(index);
+    siftUp(moved->index);
+}
+
+// Should be called with delayedCallsLock held.
+static void armTimer(void)
+{
+    struct itimerspec spec;
+    uint64_t fireTime;
+
+    fireTime = 0;
+    if (delayedCallsCount > 0) {
+        fireTime = delayedCalls[0]->fireTime;
+    }
+    if (fireTime == armedFireTime) {
+        return;
+    }
+    armedFireTime = fireTime;
+
+    // A zero value disarms the timer.
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t) (fireTime / 1000000000ULL);
+    spec.it_value.tv_nsec = (long) (fireTime % 1000000000ULL);
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static void runDelayedCalls(void)
+{
+    uint64_t value;
+    uint64_t now;
+
+    read(timerFd, &value, sizeof(value));
+    now = currentTime();
+    while (1) {
+        struct event_loop_delayed_call * call;
+
+        pthread_mutex_lock(&delayedCallsLock);
+        if ((delayedCallsCount == 0) || (delayedCalls[0]->fireTime > now)) {
+            armTimer();
+            pthread_mutex_unlock(&delayedCallsLock);
+            break;
+        }
+        call = delayedCalls[0];
+        removeDelayedCallAtIndex(0);
+        pthread_mutex_unlock(&delayedCallsLock);
+
+        call->function(call->context);
+        free(call);
+    }
+}
+
+void mailcore::callOnMainThread(void (* function)(void *), void * context)
+{
+    setupEventLoop();
+
+    struct event_loop_call * call = (struct event_loop_call *) malloc(sizeof(* call));
+    call->function = function;
+    call->context = context;
+    call->sem = NULL;
+    postCall(call);
+}
+
+void mailcore::callOnMainThreadAndWait(void (* function)(void *), void * context)
+{
+    setupEventLoop();
+
+    // Waiting for itself would never return.
+    if (isEventLoopThread) {
+        function(context);
+        return;
+    }
+
+    struct mailsem * sem = (struct mailsem *) pthread_getspecific(waitSemaphoreKey);
+    if (sem == NULL) {
+        sem = mailsem_new();
+        pthread_setspecific(waitSemaphoreKey, sem);
+    }
+
+    struct event_loop_call call;
+    call.function = function;
+    call.context = context;
+    call.sem = sem;
+    postCall(&call);
+
+    // Wait.
+    mailsem_down(sem);
+}
+
+void * mailcore::callAfterDelay(void (* function)(void *), void * context, double time)
+{
+    setupEventLoop();
+
+    struct event_loop_delayed_call * call = (struct event_loop_delayed_call *) malloc(sizeof(* call));
+    call->function = function;
+    call->context = context;
+    if (time < 0) {
+        time = 0;
+    }
+    call->fireTime = currentTime() + (uint64_t) (time * 1000000000.);
+
+    pthread_mutex_lock(&delayedCallsLock);
+    call->sequence = delayedCallsSequence;
+    delayedCallsSequence ++;
+    if (delayedCallsCount == delayedCallsCapacity) {
+        delayedCallsCapacity = delayedCallsCapacity == 0 ? 64 : delayedCallsCapacity * 2;
+        delayedCalls = (struct event_loop_delayed_call **) realloc(delayedCalls, delayedCallsCapacity * sizeof(* delayedCalls));
+    }
+    delayedCalls[delayedCallsCount] = call;
+    delayedCallsCount ++;
+    siftUp(delayedCallsCount - 1);
+    armTimer();
+    pthread_mutex_unlock(&delayedCallsLock);
+
+    return call;
+}
+
+void mailcore::cancelDelayedCall(void * delayedCall)
+{
+    struct event_loop_delayed_call * call = (struct event_loop_delayed_call *) delayedCall;
+
+    // When the cancelled call was the next one to fire, the timer will fire early and will
+    // be rearmed for the following call.
+    pthread_mutex_lock(&delayedCallsLock);
+    removeDelayedCallAtIndex(call->index);
+    pthread_mutex_unlock(&delayedCallsLock);
+    free(call);
+}
+
+int mailcore::eventLoopFileDescriptor(void)
+{
+    setupEventLoop();
+    return epollFd;
+}
+
+void mailcore::eventLoopProcessEvents(void)
+{
+    setupEventLoop();
+    isEventLoopThread = true;
+    runPendingCalls();
+    runDelayedCalls();
+}
+
+void mailcore::eventLoopRun(void)
+{
+    setupEventLoop();
+    while (!MC_ATOMIC_LOAD(&stopRequested)) {
+        struct pollfd pfd;
+        pfd.fd = epollFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int r = poll(&pfd, 1, -1);
+        if ((r < 0) && (errno != EINTR)) {
+            break;
+        }
+        eventLoopProcessEvents();
+    }
+    MC_ATOMIC_STORE(&stopRequested, 0);
+}
+
+void mailcore::eventLoopStop(void)
+{
+    setupEventLoop();
+    MC_ATOMIC_STORE(&stopRequested, 1);
+    wakeUp();
+}
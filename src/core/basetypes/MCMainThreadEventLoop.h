@@ -0,0 +1,37 @@
+#ifndef MAILCORE_MCMAINTHREADEVENTLOOP_H
+
+#define MAILCORE_MCMAINTHREADEVENTLOOP_H
+
+#if defined(__linux__) && !defined(ANDROID) && !defined(__ANDROID__)
+
+#include <MailCore/MCUtils.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+
+    // Available when mailcore is built with MAILCORE_EVENT_LOOP: the calls made on the main thread
+    // (callbacks of operations, performMethodOnMainThread(), performMethodAfterDelay()) are
+    // dispatched by an eventfd/timerfd based loop instead of the GLib main loop.
+
+    // File descriptor to add to the poll/epoll set of the application. It becomes readable when
+    // there are calls to run.
+    MAILCORE_EXPORT int eventLoopFileDescriptor(void);
+
+    // Runs the pending calls and the delayed calls that are due, without blocking.
+    // The thread that calls it is considered the main thread. It should always be the same thread.
+    MAILCORE_EXPORT void eventLoopProcessEvents(void);
+
+    // Runs the loop on the calling thread until eventLoopStop() is called.
+    MAILCORE_EXPORT void eventLoopRun(void);
+
+    // Can be called from any thread.
+    MAILCORE_EXPORT void eventLoopStop(void);
+
+}
+
+#endif
+
+#endif
+
+#endif
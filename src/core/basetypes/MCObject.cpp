@@ -21,6 +21,7 @@
 #include "MCLog.h"
 #include "MCHashMap.h"
 #include "MCLock.h"
+#include "MCTimerWheel.h"
 
 using namespace mailcore;
 
@@ -37,47 +38,32 @@ Object::~Object()
 
 void Object::init()
 {
-#if __APPLE__
-    mLock = OS_SPINLOCK_INIT;
-#else
-    pthread_mutex_init(&mLock, NULL);
-#endif
     mCounter = 1;
 }
 
 int Object::retainCount()
 {
-    MC_LOCK(&mLock);
-    int value = mCounter;
-    MC_UNLOCK(&mLock);
-    
-    return value;
+    return MC_ATOMIC_LOAD(&mCounter);
 }
 
 Object * Object::retain()
 {
-    MC_LOCK(&mLock);
-    mCounter ++;
-    MC_UNLOCK(&mLock);
+    MC_ATOMIC_INCREMENT(&mCounter);
     return this;
 }
 
 void Object::release()
 {
-    bool shouldRelease = false;
-    
-    MC_LOCK(&mLock);
-    mCounter --;
-    if (mCounter == 0) {
-        shouldRelease = true;
-    }
-    if (mCounter < 0) {
+    int value = MC_ATOMIC_DECREMENT(&mCounter);
+    if (value < 0) {
         MCLog("release too much %p %s", this, MCUTF8(className()));
         MCAssert(0);
     }
-    MC_UNLOCK(&mLock);
-
-    if (shouldRelease && !zombieEnabled) {
+    
+    if (value == 0 && !zombieEnabled) {
+        // Make sure that all the changes done by other threads before releasing
+        // are visible before destroying the object.
+        MC_ATOMIC_ACQUIRE_FENCE();
         //int status;
         //char * unmangled = abi::__cxa_demangle(typeid(* this).name(), NULL, NULL, &status);
         //MCLog("dealloc %p %s", this, unmangled);
@@ -140,9 +126,9 @@ struct mainThreadCallData {
     Object * obj;
     void * context;
     Object::Method method;
-    void * caller;
 };
 
+#if __APPLE__
 static pthread_once_t delayedPerformOnce = PTHREAD_ONCE_INIT;
 static chash * delayedPerformHash = NULL;
 static pthread_mutex_t delayedPerformLock = PTHREAD_MUTEX_INITIALIZER;
@@ -257,6 +243,7 @@ static void * getFromPerformHash(Object * obj, Object::Method method, void * con
     
     return value.data;
 }
+#endif
 
 static void performOnMainThread(void * info)
 {
@@ -275,24 +262,6 @@ static void performOnMainThread(void * info)
     free(data);
 }
 
-static void performAfterDelay(void * info)
-{
-    struct mainThreadCallData * data;
-    void * context;
-    Object * obj;
-    Object::Method method;
-    
-    data = (struct mainThreadCallData *) info;
-    obj = data->obj;
-    context = data->context;
-    method = data->method;
-    
-    removeFromPerformHash(obj, method, context, NULL);
-    (obj->*method)(context);
-    
-    free(data);
-}
-
 void Object::performMethodOnMainThread(Method method, void * context, bool waitUntilDone)
 {
     struct mainThreadCallData * data;
@@ -301,7 +270,6 @@ void Object::performMethodOnMainThread(Method method, void * context, bool waitU
     data->obj = this;
     data->context = context;
     data->method = method;
-    data->caller = NULL;
     
     if (waitUntilDone) {
         callOnMainThreadAndWait(performOnMainThread, data);
@@ -381,16 +349,7 @@ void Object::performMethodAfterDelay(Method method, void * context, double delay
 #if __APPLE__
     performMethodOnDispatchQueueAfterDelay(method, context, dispatch_get_main_queue(), delay);
 #else
-    initDelayedPerform();
-    
-    struct mainThreadCallData * data;
-    
-    data = (struct mainThreadCallData *) calloc(sizeof(* data), 1);
-    data->obj = this;
-    data->context = context;
-    data->method = method;
-    data->caller = callAfterDelay(performAfterDelay, data, delay);
-    addToPerformHash(this, method, context, NULL, data);
+    timerWheelSchedule(this, method, context, delay);
 #endif
 }
 
@@ -399,15 +358,7 @@ void Object::cancelDelayedPerformMethod(Method method, void * context)
 #if __APPLE__
     cancelDelayedPerformMethodOnDispatchQueue(method, context, dispatch_get_main_queue());
 #else
-    initDelayedPerform();
-    
-    struct mainThreadCallData * data = (struct mainThreadCallData *) getFromPerformHash(this, method, context, NULL);
-    if (data == NULL)
-        return;
-    
-    removeFromPerformHash(this, method, context, NULL);
-    cancelDelayedCall(data->caller);
-    free(data);
+    timerWheelCancel(this, method, context);
 #endif
 }
 
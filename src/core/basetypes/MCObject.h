@@ -5,7 +5,6 @@
 #include <pthread.h>
 #if __APPLE__
 #include <dispatch/dispatch.h>
-#include <libkern/OSAtomic.h>
 #endif
 
 #include <MailCore/MCUtils.h>
@@ -57,11 +56,6 @@ namespace mailcore {
     public: // private
         
     private:
-#if __APPLE__
-        OSSpinLock mLock;
-#else
-        pthread_mutex_t mLock;
-#endif
         int mCounter;
         void init();
         static void initObjectConstructors();
@@ -1,5 +1,9 @@
 #include "MCOperation.h"
 
+#include "MCCallbackExecutor.h"
+#include "MCOperationQueue.h"
+#include "MCAssert.h"
+
 using namespace mailcore;
 
 Operation::Operation()
@@ -11,6 +15,9 @@ Operation::Operation()
 #if __APPLE__
     mCallbackDispatchQueue = dispatch_get_main_queue();
 #endif
+    mCallbackExecutor = NULL;
+    mOperationQueue = NULL;
+    mSuspended = false;
 }
 
 Operation::~Operation()
@@ -59,6 +66,37 @@ void Operation::setShouldRunWhenCancelled(bool shouldRunWhenCancelled)
     mShouldRunWhenCancelled = shouldRunWhenCancelled;
 }
 
+bool Operation::canSuspend()
+{
+    return (mOperationQueue != NULL) && mOperationQueue->usesSharedThreadPool();
+}
+
+void Operation::suspend()
+{
+    MCAssert(canSuspend());
+    mSuspended = true;
+}
+
+void Operation::resume()
+{
+    mOperationQueue->resumeOperation(this);
+}
+
+void Operation::setOperationQueue(OperationQueue * queue)
+{
+    mOperationQueue = queue;
+}
+
+bool Operation::isSuspended()
+{
+    return mSuspended;
+}
+
+void Operation::setSuspended(bool suspended)
+{
+    mSuspended = suspended;
+}
+
 void Operation::beforeMain()
 {
 }
@@ -93,8 +131,22 @@ dispatch_queue_t Operation::callbackDispatchQueue()
 }
 #endif
 
+void Operation::setCallbackExecutor(CallbackExecutor * executor)
+{
+    mCallbackExecutor = executor;
+}
+
+CallbackExecutor * Operation::callbackExecutor()
+{
+    return mCallbackExecutor;
+}
+
 void Operation::performMethodOnCallbackThread(Method method, void * context, bool waitUntilDone)
 {
+    if (mCallbackExecutor != NULL) {
+        mCallbackExecutor->performMethod(this, method, context, waitUntilDone);
+        return;
+    }
 #if __APPLE__
     dispatch_queue_t queue = mCallbackDispatchQueue;
     if (queue == NULL) {
@@ -10,6 +10,8 @@
 namespace mailcore {
     
     class OperationCallback;
+    class CallbackExecutor;
+    class OperationQueue;
     
     class MAILCORE_EXPORT Operation : public Object {
     public:
@@ -36,11 +38,30 @@ namespace mailcore {
         virtual void setCallbackDispatchQueue(dispatch_queue_t callbackDispatchQueue);
         virtual dispatch_queue_t callbackDispatchQueue();
 #endif
+        // When set, the callbacks are run by the executor instead of the main thread
+        // or the callback dispatch queue. The executor is not retained.
+        virtual void setCallbackExecutor(CallbackExecutor * executor);
+        virtual CallbackExecutor * callbackExecutor();
+        
         void performMethodOnCallbackThread(Method method, void * context, bool waitUntilDone = false);
         
         virtual bool shouldRunWhenCancelled();
         virtual void setShouldRunWhenCancelled(bool shouldRunWhenCancelled);
         
+        // main() can call suspend() and return to wait for an event without holding a thread.
+        // The operation stays at the head of its queue and main() is called again after resume(),
+        // even if it has been cancelled meanwhile.
+        // resume() can be called from any thread, even before main() returned.
+        // Only operations of queues running in the shared thread pool can be suspended.
+        virtual bool canSuspend();
+        virtual void suspend();
+        virtual void resume();
+        
+    public: // private
+        virtual void setOperationQueue(OperationQueue * queue);
+        virtual bool isSuspended();
+        virtual void setSuspended(bool suspended);
+        
     private:
         OperationCallback * mCallback;
         bool mCancelled;
@@ -49,6 +70,9 @@ namespace mailcore {
 #ifdef __APPLE__
         dispatch_queue_t mCallbackDispatchQueue;
 #endif
+        CallbackExecutor * mCallbackExecutor;
+        OperationQueue * mOperationQueue;
+        bool mSuspended;
         
     };
     
@@ -1,9 +1,17 @@
+#include "MCWin32.h" // should be included first.
+
 #include "MCOperationQueue.h"
 
 #include <libetpan/libetpan.h>
+#include <errno.h>
+#include <stdlib.h>
+#ifndef _MSC_VER
+#include <sys/time.h>
+#endif
 
 #include "MCOperation.h"
 #include "MCOperationCallback.h"
+#include "MCCallbackExecutor.h"
 #include "MCOperationQueueCallback.h"
 #include "MCMainThread.h"
 #include "MCUtils.h"
@@ -12,12 +20,152 @@
 #include "MCAutoreleasePool.h"
 #include "MCMainThreadAndroid.h"
 #include "MCAssert.h"
+#include "MCLock.h"
 
 using namespace mailcore;
 
+namespace mailcore {
+    struct OperationQueueEntry {
+        Operation * operation;
+        // Time when the operation was added to the queue.
+        double addedTime;
+    };
+}
+
+// Threads of the shared pool exit after waiting that long for an operation, in seconds.
+#define SHARED_THREAD_POOL_IDLE_DELAY 10
+#define SHARED_THREAD_POOL_DEFAULT_MAXIMUM_THREADS_COUNT 16
+
+static double currentTime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double) tv.tv_sec + (double) tv.tv_usec / 1000000.;
+}
+
+static int sCreatedThreadsCount = 0;
+static bool sSharedThreadPoolEnabledByDefault = false;
+
+// Queues waiting for a thread of the shared pool, in FIFO order. A queue is listed at most once,
+// and it's retained while it's listed.
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    OperationQueue ** queues;
+    unsigned int capacity;
+    unsigned int head;
+    unsigned int count;
+    unsigned int threadsCount;
+    unsigned int idleThreadsCount;
+    unsigned int maximumThreadsCount;
+} sSharedThreadPool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    NULL, 0, 0, 0,
+    0, 0,
+    SHARED_THREAD_POOL_DEFAULT_MAXIMUM_THREADS_COUNT,
+};
+
+static void * sharedThreadPoolMain(void * context)
+{
+#if defined(__ANDROID) || defined(ANDROID)
+    androidSetupThread();
+#endif
+    
+    pthread_mutex_lock(&sSharedThreadPool.lock);
+    while (true) {
+        if (sSharedThreadPool.count == 0) {
+            struct timeval tv;
+            struct timespec deadline;
+            int r = 0;
+            
+            gettimeofday(&tv, NULL);
+            deadline.tv_sec = tv.tv_sec + SHARED_THREAD_POOL_IDLE_DELAY;
+            deadline.tv_nsec = tv.tv_usec * 1000;
+            sSharedThreadPool.idleThreadsCount ++;
+            while ((sSharedThreadPool.count == 0) && (r != ETIMEDOUT)) {
+                r = pthread_cond_timedwait(&sSharedThreadPool.cond, &sSharedThreadPool.lock, &deadline);
+            }
+            sSharedThreadPool.idleThreadsCount --;
+            if (sSharedThreadPool.count == 0) {
+                break;
+            }
+        }
+        
+        OperationQueue * queue = sSharedThreadPool.queues[sSharedThreadPool.head];
+        sSharedThreadPool.head = (sSharedThreadPool.head + 1) % sSharedThreadPool.capacity;
+        sSharedThreadPool.count --;
+        pthread_mutex_unlock(&sSharedThreadPool.lock);
+        
+        AutoreleasePool * pool = new AutoreleasePool();
+        queue->runNextOperationInSharedThreadPool();
+        queue->release();
+        pool->release();
+        
+        pthread_mutex_lock(&sSharedThreadPool.lock);
+    }
+    sSharedThreadPool.threadsCount --;
+    pthread_mutex_unlock(&sSharedThreadPool.lock);
+    
+#if defined(__ANDROID) || defined(ANDROID)
+    androidUnsetupThread();
+#endif
+    return NULL;
+}
+
+// The queue should be retained by the caller, the reference is given to the pool.
+static void sharedThreadPoolAddQueue(OperationQueue * queue)
+{
+    bool needsThread = false;
+    
+    pthread_mutex_lock(&sSharedThreadPool.lock);
+    if (sSharedThreadPool.count == sSharedThreadPool.capacity) {
+        unsigned int capacity = sSharedThreadPool.capacity == 0 ? 16 : sSharedThreadPool.capacity * 2;
+        OperationQueue ** queues = (OperationQueue **) malloc(capacity * sizeof(* queues));
+        for(unsigned int i = 0 ; i < sSharedThreadPool.count ; i ++) {
+            queues[i] = sSharedThreadPool.queues[(sSharedThreadPool.head + i) % sSharedThreadPool.capacity];
+        }
+        free(sSharedThreadPool.queues);
+        sSharedThreadPool.queues = queues;
+        sSharedThreadPool.capacity = capacity;
+        sSharedThreadPool.head = 0;
+    }
+    sSharedThreadPool.queues[(sSharedThreadPool.head + sSharedThreadPool.count) % sSharedThreadPool.capacity] = queue;
+    sSharedThreadPool.count ++;
+    // Idle threads might not have picked up the queues added previously yet.
+    if ((sSharedThreadPool.count > sSharedThreadPool.idleThreadsCount) &&
+        (sSharedThreadPool.threadsCount < sSharedThreadPool.maximumThreadsCount)) {
+        sSharedThreadPool.threadsCount ++;
+        needsThread = true;
+    }
+    pthread_cond_signal(&sSharedThreadPool.cond);
+    pthread_mutex_unlock(&sSharedThreadPool.lock);
+    
+    if (needsThread) {
+        pthread_t threadID;
+        pthread_attr_t attr;
+        
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        MC_ATOMIC_INCREMENT(&sCreatedThreadsCount);
+        int r = pthread_create(&threadID, &attr, sharedThreadPoolMain, NULL);
+        pthread_attr_destroy(&attr);
+        if (r != 0) {
+            // The queue will be run by one of the existing threads.
+            pthread_mutex_lock(&sSharedThreadPool.lock);
+            sSharedThreadPool.threadsCount --;
+            MCAssert(sSharedThreadPool.threadsCount > 0);
+            pthread_mutex_unlock(&sSharedThreadPool.lock);
+        }
+    }
+}
+
 OperationQueue::OperationQueue()
 {
-    mOperations = new Array();
+    mEntries = NULL;
+    mEntriesCapacity = 0;
+    mEntriesHead = 0;
+    mEntriesCount = 0;
     mStarted = false;
     pthread_mutex_init(&mLock, NULL);
     mWaiting = false;
@@ -31,6 +179,13 @@ OperationQueue::OperationQueue()
     mDispatchQueue = dispatch_get_main_queue();
 #endif
     _pendingCheckRunning = false;
+    mUsesSharedThreadPool = sSharedThreadPoolEnabledByDefault;
+    mScheduled = false;
+    mFirstOperationStarted = false;
+    mSuspendedOperation = NULL;
+    mResumeRequested = false;
+    mStartedOperationsCount = 0;
+    mTotalWaitTime = 0;
 }
 
 OperationQueue::~OperationQueue()
@@ -40,7 +195,10 @@ OperationQueue::~OperationQueue()
         dispatch_release(mDispatchQueue);
     }
 #endif
-    MC_SAFE_RELEASE(mOperations);
+    while (mEntriesCount > 0) {
+        removeOperationAtIndex(0);
+    }
+    free(mEntries);
     pthread_mutex_destroy(&mLock);
     mailsem_free(mOperationSem);
     mailsem_free(mStartSem);
@@ -48,21 +206,64 @@ OperationQueue::~OperationQueue()
     mailsem_free(mWaitingFinishedSem);
 }
 
+Operation * OperationQueue::operationAtIndex(unsigned int idx)
+{
+    return mEntries[(mEntriesHead + idx) % mEntriesCapacity].operation;
+}
+
+void OperationQueue::appendOperation(Operation * op)
+{
+    if (mEntriesCount == mEntriesCapacity) {
+        unsigned int capacity = mEntriesCapacity == 0 ? 4 : mEntriesCapacity * 2;
+        OperationQueueEntry * entries = (OperationQueueEntry *) malloc(capacity * sizeof(* entries));
+        for(unsigned int i = 0 ; i < mEntriesCount ; i ++) {
+            entries[i] = mEntries[(mEntriesHead + i) % mEntriesCapacity];
+        }
+        free(mEntries);
+        mEntries = entries;
+        mEntriesCapacity = capacity;
+        mEntriesHead = 0;
+    }
+    OperationQueueEntry * entry = &mEntries[(mEntriesHead + mEntriesCount) % mEntriesCapacity];
+    entry->operation = (Operation *) op->retain();
+    entry->addedTime = currentTime();
+    mEntriesCount ++;
+}
+
+void OperationQueue::removeOperationAtIndex(unsigned int idx)
+{
+    operationAtIndex(idx)->release();
+    if (idx == 0) {
+        mEntriesHead = (mEntriesHead + 1) % mEntriesCapacity;
+    }
+    else {
+        for(unsigned int i = idx ; i < mEntriesCount - 1 ; i ++) {
+            mEntries[(mEntriesHead + i) % mEntriesCapacity] = mEntries[(mEntriesHead + i + 1) % mEntriesCapacity];
+        }
+    }
+    mEntriesCount --;
+}
+
 void OperationQueue::addOperation(Operation * op)
 {
     pthread_mutex_lock(&mLock);
-    mOperations->addObject(op);
+    appendOperation(op);
     pthread_mutex_unlock(&mLock);
-    mailsem_up(mOperationSem);
-    startThread();
+    if (mUsesSharedThreadPool) {
+        startThread();
+        scheduleInSharedThreadPool();
+    }
+    else {
+        mailsem_up(mOperationSem);
+        startThread();
+    }
 }
 
 void OperationQueue::cancelAllOperations()
 {
     pthread_mutex_lock(&mLock);
-    for (unsigned int i = 0 ; i < mOperations->count() ; i ++) {
-        Operation * op = (Operation *) mOperations->objectAtIndex(i);
-        op->cancel();
+    for (unsigned int i = 0 ; i < mEntriesCount ; i ++) {
+        operationAtIndex(i)->cancel();
     }
     pthread_mutex_unlock(&mLock);
 }
@@ -83,7 +284,6 @@ void OperationQueue::runOperations()
     
     while (true) {
         Operation * op = NULL;
-        bool needsCheckRunning = false;
         bool quitting;
         
         AutoreleasePool * pool = new AutoreleasePool();
@@ -91,8 +291,8 @@ void OperationQueue::runOperations()
         mailsem_down(mOperationSem);
         
         pthread_mutex_lock(&mLock);
-        if (mOperations->count() > 0) {
-            op = (Operation *) mOperations->objectAtIndex(0);
+        if (mEntriesCount > 0) {
+            op = operationAtIndex(0);
         }
         quitting = mQuitting;
         pthread_mutex_unlock(&mLock);
@@ -114,48 +314,174 @@ void OperationQueue::runOperations()
         }
 
         MCAssert(op != NULL);
-        performOnCallbackThread(op, (Object::Method) &OperationQueue::beforeMain, op, true);
+        if (runOperation(op)) {
+            scheduleCheckRunning();
+        }
         
-        if (!op->isCancelled() || op->shouldRunWhenCancelled()) {
+        pool->release();
+    }
+    MCLog("cleanup thread %p", this);
+#if defined(__ANDROID) || defined(ANDROID)
+    androidUnsetupThread();
+#endif
+}
+
+// Runs the first operation of the queue and removes it from the queue, unless it got suspended.
+// Returns true if the queue is empty afterwards.
+bool OperationQueue::runOperation(Operation * op)
+{
+    bool needsCheckRunning = false;
+    bool resumed;
+    
+    pthread_mutex_lock(&mLock);
+    resumed = mFirstOperationStarted;
+    if (!resumed) {
+        mFirstOperationStarted = true;
+        mStartedOperationsCount ++;
+        mTotalWaitTime += currentTime() - mEntries[mEntriesHead].addedTime;
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    if (!resumed) {
+        op->setOperationQueue(this);
+        performOnCallbackThread(op, (Object::Method) &OperationQueue::beforeMain, op, true);
+    }
+    
+    // A suspended operation always runs again to finish what it started.
+    bool runMain = resumed || !op->isCancelled() || op->shouldRunWhenCancelled();
+    while (true) {
+        if (runMain) {
             op->main();
         }
+        if (!op->isSuspended()) {
+            break;
+        }
+        runMain = true;
         
-        op->retain()->autorelease();
-        
+        // The operation stays first in the queue until resumeOperation(), unless it has already been called.
         pthread_mutex_lock(&mLock);
-        mOperations->removeObjectAtIndex(0);
-        if (mOperations->count() == 0) {
-            if (mWaiting) {
-                mailsem_up(mWaitingFinishedSem);
-            }
-            needsCheckRunning = true;
+        op->setSuspended(false);
+        bool resumeRequested = mResumeRequested;
+        mResumeRequested = false;
+        if (!resumeRequested) {
+            retain(); // (6)
+            mSuspendedOperation = op;
         }
         pthread_mutex_unlock(&mLock);
-        
-        if (!op->isCancelled()) {
-            performOnCallbackThread(op, (Object::Method) &OperationQueue::callbackOnMainThread, op, true);
+        if (!resumeRequested) {
+            return false;
         }
-        
-        if (needsCheckRunning) {
-            retain(); // (1)
-            //MCLog("check running %p", this);
+    }
+    
+    op->setOperationQueue(NULL);
+    op->retain()->autorelease();
+    
+    pthread_mutex_lock(&mLock);
+    removeOperationAtIndex(0);
+    mFirstOperationStarted = false;
+    mResumeRequested = false;
+    if (mEntriesCount == 0) {
+        if (mWaiting) {
+            mailsem_up(mWaitingFinishedSem);
+        }
+        needsCheckRunning = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    if (!op->isCancelled()) {
+        performOnCallbackThread(op, (Object::Method) &OperationQueue::callbackOnMainThread, op, true);
+    }
+    
+    return needsCheckRunning;
+}
+
+void OperationQueue::scheduleCheckRunning()
+{
+    retain(); // (1)
+    //MCLog("check running %p", this);
 #if __APPLE__
-            performMethodOnDispatchQueue((Object::Method) &OperationQueue::checkRunningOnMainThread, this, mDispatchQueue);
+    performMethodOnDispatchQueue((Object::Method) &OperationQueue::checkRunningOnMainThread, this, mDispatchQueue);
 #else
-            performMethodOnMainThread((Object::Method) &OperationQueue::checkRunningOnMainThread, this);
+    performMethodOnMainThread((Object::Method) &OperationQueue::checkRunningOnMainThread, this);
 #endif
-        }
-        
-        pool->release();
+}
+
+void OperationQueue::scheduleInSharedThreadPool()
+{
+    bool schedule = false;
+    
+    pthread_mutex_lock(&mLock);
+    if (!mScheduled && (mEntriesCount > 0) && (mSuspendedOperation == NULL)) {
+        mScheduled = true;
+        schedule = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    if (schedule) {
+        retain(); // (5)
+        sharedThreadPoolAddQueue(this);
+    }
+}
+
+void OperationQueue::runNextOperationInSharedThreadPool()
+{
+    Operation * op;
+    bool reschedule = false;
+    
+    // Only the thread running the queue removes the first operation.
+    pthread_mutex_lock(&mLock);
+    op = operationAtIndex(0);
+    pthread_mutex_unlock(&mLock);
+    
+    bool needsCheckRunning = runOperation(op);
+    
+    // The queue goes back at the end of the pool's list so that the other queues get a chance to run.
+    pthread_mutex_lock(&mLock);
+    if ((mEntriesCount > 0) && (mSuspendedOperation == NULL)) {
+        reschedule = true;
+    }
+    else {
+        mScheduled = false;
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    if (reschedule) {
+        retain(); // (5)
+        sharedThreadPoolAddQueue(this);
+    }
+    if (needsCheckRunning) {
+        scheduleCheckRunning();
+    }
+    // The pool releases the queue afterwards (5).
+}
+
+void OperationQueue::resumeOperation(Operation * op)
+{
+    bool wasSuspended = false;
+    
+    pthread_mutex_lock(&mLock);
+    if (mSuspendedOperation == op) {
+        mSuspendedOperation = NULL;
+        wasSuspended = true;
+    }
+    else if (mFirstOperationStarted && (mEntriesCount > 0) && (operationAtIndex(0) == op)) {
+        // main() has not returned yet.
+        mResumeRequested = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    if (wasSuspended) {
+        scheduleInSharedThreadPool();
+        release(); // (6)
     }
-    MCLog("cleanup thread %p", this);
-#if defined(__ANDROID) || defined(ANDROID)
-    androidUnsetupThread();
-#endif
 }
 
 void OperationQueue::performOnCallbackThread(Operation * op, Method method, void * context, bool waitUntilDone)
 {
+    if (op->callbackExecutor() != NULL) {
+        op->callbackExecutor()->performMethod(this, method, context, waitUntilDone);
+        return;
+    }
 #if __APPLE__
     dispatch_queue_t queue = op->callbackDispatchQueue();
     if (queue == NULL) {
@@ -209,9 +535,32 @@ void OperationQueue::checkRunningOnMainThread(void * context)
 void OperationQueue::checkRunningAfterDelay(void * context)
 {
     _pendingCheckRunning = false;
+    
+    if (mUsesSharedThreadPool) {
+        bool stopped = false;
+        
+        // No thread to stop: the queue stops running as soon as it's not waiting for a thread of the pool.
+        pthread_mutex_lock(&mLock);
+        if (mStarted && (mEntriesCount == 0) && !mScheduled) {
+            mStarted = false;
+            stopped = true;
+        }
+        pthread_mutex_unlock(&mLock);
+        
+        if (stopped) {
+            if (mCallback) {
+                mCallback->queueStoppedRunning();
+            }
+            release(); // (3)
+        }
+        
+        release(); // (4)
+        return;
+    }
+    
     pthread_mutex_lock(&mLock);
     if (!mQuitting) {
-        if (mOperations->count() == 0) {
+        if (mEntriesCount == 0) {
             MCLog("trying to quit %p", this);
             mailsem_up(mOperationSem);
             mQuitting = true;
@@ -229,13 +578,15 @@ void OperationQueue::stoppedOnMainThread(void * context)
 {
     MCLog("thread stopped %p", this);
     mailsem_down(mStopSem);
+    pthread_mutex_lock(&mLock);
     mStarted = false;
+    pthread_mutex_unlock(&mLock);
     
     if (mCallback) {
         mCallback->queueStoppedRunning();
     }
     
-    if (mOperations->count() > 0) {
+    if (count() > 0) {
         //Operations have been added while thread was quitting, so restart automatically
         startThread();
     }
@@ -247,7 +598,17 @@ void OperationQueue::stoppedOnMainThread(void * context)
 
 void OperationQueue::startThread()
 {
-    if (mStarted)
+    bool started;
+    
+    // Operations can also be added from the thread of a callback executor.
+    pthread_mutex_lock(&mLock);
+    started = mStarted;
+    if (!started) {
+        mQuitting = false;
+        mStarted = true;
+    }
+    pthread_mutex_unlock(&mLock);
+    if (started)
         return;
     
     if (mCallback) {
@@ -255,8 +616,10 @@ void OperationQueue::startThread()
     }
     
     retain(); // (3)
-    mQuitting = false;
-    mStarted = true;
+    if (mUsesSharedThreadPool) {
+        return;
+    }
+    MC_ATOMIC_INCREMENT(&sCreatedThreadsCount);
     pthread_create(&mThreadID, NULL, (void * (*)(void *)) OperationQueue::runOperationsOnThread, this);
     mailsem_down(mStartSem);
 }
@@ -266,12 +629,50 @@ unsigned int OperationQueue::count()
     unsigned int count;
     
     pthread_mutex_lock(&mLock);
-    count = mOperations->count();
+    count = mEntriesCount;
     pthread_mutex_unlock(&mLock);
     
     return count;
 }
 
+Array * OperationQueue::pendingOperations()
+{
+    Array * result = Array::array();
+    
+    pthread_mutex_lock(&mLock);
+    for (unsigned int i = 1 ; i < mEntriesCount ; i ++) {
+        result->addObject(operationAtIndex(i));
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    return result;
+}
+
+bool OperationQueue::removePendingOperation(Operation * op)
+{
+    bool removed = false;
+    
+    // The first operation is never removed since the thread might already be running it.
+    pthread_mutex_lock(&mLock);
+    for (unsigned int i = 1 ; i < mEntriesCount ; i ++) {
+        if (operationAtIndex(i) == op) {
+            op->retain()->autorelease();
+            removeOperationAtIndex(i);
+            removed = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    
+    if (removed && !mUsesSharedThreadPool) {
+        // Consumes the signal of the removed operation. It can't block since the thread
+        // hasn't consumed the signals of the operations waiting behind the first one.
+        mailsem_down(mOperationSem);
+    }
+    
+    return removed;
+}
+
 void OperationQueue::setCallback(OperationQueueCallback * callback)
 {
     mCallback = callback;
@@ -282,13 +683,71 @@ OperationQueueCallback * OperationQueue::callback()
     return mCallback;
 }
 
+void OperationQueue::setUsesSharedThreadPool(bool enabled)
+{
+    MCAssert(!mStarted);
+    mUsesSharedThreadPool = enabled;
+}
+
+bool OperationQueue::usesSharedThreadPool()
+{
+    return mUsesSharedThreadPool;
+}
+
+void OperationQueue::setSharedThreadPoolEnabledByDefault(bool enabled)
+{
+    sSharedThreadPoolEnabledByDefault = enabled;
+}
+
+bool OperationQueue::isSharedThreadPoolEnabledByDefault()
+{
+    return sSharedThreadPoolEnabledByDefault;
+}
+
+void OperationQueue::setSharedThreadPoolMaximumThreadsCount(unsigned int count)
+{
+    MCAssert(count > 0);
+    pthread_mutex_lock(&sSharedThreadPool.lock);
+    sSharedThreadPool.maximumThreadsCount = count;
+    pthread_mutex_unlock(&sSharedThreadPool.lock);
+}
+
+unsigned int OperationQueue::sharedThreadPoolMaximumThreadsCount()
+{
+    pthread_mutex_lock(&sSharedThreadPool.lock);
+    unsigned int count = sSharedThreadPool.maximumThreadsCount;
+    pthread_mutex_unlock(&sSharedThreadPool.lock);
+    return count;
+}
+
+unsigned int OperationQueue::createdThreadsCount()
+{
+    return (unsigned int) MC_ATOMIC_LOAD(&sCreatedThreadsCount);
+}
+
+unsigned int OperationQueue::startedOperationsCount()
+{
+    pthread_mutex_lock(&mLock);
+    unsigned int count = mStartedOperationsCount;
+    pthread_mutex_unlock(&mLock);
+    return count;
+}
+
+double OperationQueue::totalWaitTime()
+{
+    pthread_mutex_lock(&mLock);
+    double waitTime = mTotalWaitTime;
+    pthread_mutex_unlock(&mLock);
+    return waitTime;
+}
+
 #if 0
 void OperationQueue::waitUntilAllOperationsAreFinished()
 {
     bool waiting = false;
     
     pthread_mutex_lock(&mLock);
-    if (mOperations->count() > 0) {
+    if (mEntriesCount > 0) {
         mWaiting = true;
         waiting = true;
     }
@@ -14,6 +14,7 @@ namespace mailcore {
     class Operation;
     class OperationQueueCallback;
     class Array;
+    struct OperationQueueEntry;
     
     class MAILCORE_EXPORT OperationQueue : public Object {
     public:
@@ -25,16 +26,50 @@ namespace mailcore {
         
         virtual unsigned int count();
         
+        // Operations waiting behind the one that is currently running or about to run.
+        virtual Array * pendingOperations();
+        // Returns false if the operation has already started or is not in the queue.
+        virtual bool removePendingOperation(Operation * op);
+        
         virtual void setCallback(OperationQueueCallback * callback);
         virtual OperationQueueCallback * callback();
         
+        // When enabled, operations run on threads of a pool shared by all the queues
+        // instead of a thread owned by the queue. Operations of the queue still run one at a time,
+        // in order. It can only be changed while the queue is not running.
+        virtual void setUsesSharedThreadPool(bool enabled);
+        virtual bool usesSharedThreadPool();
+        
+        // Value of usesSharedThreadPool() for the queues created afterwards. Default is false.
+        static void setSharedThreadPoolEnabledByDefault(bool enabled);
+        static bool isSharedThreadPoolEnabledByDefault();
+        // Maximum number of threads of the shared pool. Default is 16.
+        static void setSharedThreadPoolMaximumThreadsCount(unsigned int count);
+        static unsigned int sharedThreadPoolMaximumThreadsCount();
+        
+        // Number of threads created by all the queues, including the shared pool.
+        static unsigned int createdThreadsCount();
+        // Number of operations that started running and total time they waited in the queue, in seconds.
+        virtual unsigned int startedOperationsCount();
+        virtual double totalWaitTime();
+        
 #ifdef __APPLE__
         virtual void setDispatchQueue(dispatch_queue_t dispatchQueue);
         virtual dispatch_queue_t dispatchQueue();
 #endif
         
+    public: // private
+        // Runs the first operation of the queue on a thread of the shared pool.
+        virtual void runNextOperationInSharedThreadPool();
+        // Runs the suspended operation again. See Operation::suspend().
+        virtual void resumeOperation(Operation * op);
+        
     private:
-        Array * mOperations;
+        // Circular buffer of the operations, the first one is running or about to run.
+        OperationQueueEntry * mEntries;
+        unsigned int mEntriesCapacity;
+        unsigned int mEntriesHead;
+        unsigned int mEntriesCount;
         pthread_t mThreadID;
         bool mStarted;
         struct mailsem * mOperationSem;
@@ -49,8 +84,21 @@ namespace mailcore {
         dispatch_queue_t mDispatchQueue;
 #endif
         bool _pendingCheckRunning;
+        bool mUsesSharedThreadPool;
+        bool mScheduled;
+        bool mFirstOperationStarted;
+        Operation * mSuspendedOperation;
+        bool mResumeRequested;
+        unsigned int mStartedOperationsCount;
+        double mTotalWaitTime;
         
+        Operation * operationAtIndex(unsigned int idx);
+        void appendOperation(Operation * op);
+        void removeOperationAtIndex(unsigned int idx);
         void startThread();
+        void scheduleInSharedThreadPool();
+        bool runOperation(Operation * op);
+        void scheduleCheckRunning();
         static void runOperationsOnThread(OperationQueue * queue);
         void runOperations();
         void beforeMain(Operation * op);
@@ -804,6 +804,9 @@ static char * extract_subject(char * str, int keep_bracket)
 String::String(const UChar * unicodeChars)
 {
     mUnicodeChars = NULL;
+    mUTF8Data = NULL;
+    mHash = 0;
+    mUniqued = false;
     reset();
     if (unicodeChars != NULL) {
         allocate(u_strlen(unicodeChars), true);
@@ -814,6 +817,9 @@ String::String(const UChar * unicodeChars)
 String::String(const UChar * unicodeChars, unsigned int length)
 {
     mUnicodeChars = NULL;
+    mUTF8Data = NULL;
+    mHash = 0;
+    mUniqued = false;
     reset();
     allocate(length, true);
     appendCharactersLength(unicodeChars, length);
@@ -822,6 +828,9 @@ String::String(const UChar * unicodeChars, unsigned int length)
 String::String(const char * UTF8Characters)
 {
     mUnicodeChars = NULL;
+    mUTF8Data = NULL;
+    mHash = 0;
+    mUniqued = false;
     reset();
     allocate((unsigned int) strlen(UTF8Characters), true);
     appendUTF8Characters(UTF8Characters);
@@ -830,6 +839,9 @@ String::String(const char * UTF8Characters)
 String::String(String * otherString)
 {
     mUnicodeChars = NULL;
+    mUTF8Data = NULL;
+    mHash = 0;
+    mUniqued = false;
     reset();
     appendString(otherString);
 }
@@ -837,6 +849,9 @@ String::String(String * otherString)
 String::String(Data * data, const char * charset)
 {
     mUnicodeChars = NULL;
+    mUTF8Data = NULL;
+    mHash = 0;
+    mUniqued = false;
     reset();
     appendBytes(data->bytes(), data->length(), charset);
 }
@@ -844,6 +859,9 @@ String::String(Data * data, const char * charset)
 String::String(const char * bytes, unsigned int length, const char * charset)
 {
     mUnicodeChars = NULL;
+    mUTF8Data = NULL;
+    mHash = 0;
+    mUniqued = false;
     reset();
     allocate(length, true);
     if (charset == NULL) {
@@ -947,6 +965,7 @@ void String::appendCharactersLength(const UChar * unicodeCharacters, unsigned in
     if (unicodeCharacters == NULL) {
         return;
     }
+    resetCaches();
     allocate(mLength + length);
     MCAssert(mUnicodeChars != NULL);
     memcpy(&mUnicodeChars[mLength], unicodeCharacters, length * sizeof(* mUnicodeChars));
@@ -1006,19 +1025,56 @@ const UChar * String::unicodeCharacters()
     return mUnicodeChars;
 }
 
-const char * String::UTF8Characters()
+Data * String::UTF8Data()
 {
+    // The returned data is retained and autoreleased on every call so that the characters
+    // stay valid until the autorelease pool is drained, even if the string is modified
+    // or released in the meantime.
+    Data * data = (Data *) MC_ATOMIC_LOAD_PTR(&mUTF8Data);
+    if (data != NULL) {
+        return (Data *) data->retain()->autorelease();
+    }
+    
+    // A UTF-16 code unit is encoded in at most 3 bytes in UTF-8.
+    UTF8 buffer[256];
+    unsigned int maxLength = mLength * 3 + 1;
+    UTF8 * target = buffer;
+    if (maxLength > sizeof(buffer)) {
+        target = (UTF8 *) malloc(maxLength);
+    }
     const UTF16 * source = (const UTF16 *) mUnicodeChars;
-    UTF8 * target = (UTF8 *) malloc(mLength * 6 + 1);
     UTF8 * targetStart = target;
     ConvertUTF16toUTF8(&source, source + mLength,
-                       &targetStart, targetStart + mLength * 6 + 1, lenientConversion);
+                       &targetStart, targetStart + maxLength, lenientConversion);
     unsigned int utf8length = (unsigned int) (targetStart - target);
     target[utf8length] = 0;
-    Data * data = Data::dataWithBytes((const char *) target, utf8length + 1);
-    free(target);
+    data = new Data((const char *) target, utf8length + 1);
+    if (target != buffer) {
+        free(target);
+    }
     
-    return data->bytes();
+    // The string might be shared by several threads.
+    if (!MC_ATOMIC_CAS_PTR(&mUTF8Data, (Data *) NULL, data)) {
+        data->release();
+        data = (Data *) MC_ATOMIC_LOAD_PTR(&mUTF8Data);
+    }
+    return (Data *) data->retain()->autorelease();
+}
+
+void String::resetCaches()
+{
+    MC_SAFE_RELEASE(mUTF8Data);
+    mHash = 0;
+}
+
+const char * String::UTF8Characters()
+{
+    return UTF8Data()->bytes();
+}
+
+unsigned int String::UTF8Length()
+{
+    return UTF8Data()->length() - 1;
 }
 
 unsigned int String::length()
@@ -1058,6 +1114,7 @@ String * String::stringByAppendingCharacters(const UChar * unicodeCharacters)
 
 void String::reset()
 {
+    resetCaches();
     free(mUnicodeChars);
     mUnicodeChars = NULL;
     mLength = 0;
@@ -1105,7 +1162,17 @@ bool String::isEqual(Object * otherObject)
 
 unsigned int String::hash()
 {
-    return hashCompute((const char *) mUnicodeChars, mLength * sizeof(* mUnicodeChars));
+    // Computed on first use and kept until the string is modified.
+    // Concurrent callers compute and store the same value.
+    unsigned int result = MC_ATOMIC_LOAD(&mHash);
+    if (result == 0) {
+        result = hashCompute((const char *) mUnicodeChars, mLength * sizeof(* mUnicodeChars));
+        if (result == 0) {
+            result = 1;
+        }
+        MC_ATOMIC_STORE(&mHash, result);
+    }
+    return result;
 }
 
 #define DEFAULT_INCOMING_CHARSET "iso-8859-1"
@@ -1286,6 +1353,85 @@ String * String::uppercaseString()
 #endif
 }
 
+#if !DISABLE_ICU
+// Opened converters are kept per thread since ucnv_open() is costly for some charsets.
+#define CONVERTER_CACHE_SIZE 8
+
+struct converterCacheEntry {
+    char * charset;
+    UConverter * converter;
+};
+
+struct converterCache {
+    unsigned int count;
+    // Least recently used first.
+    struct converterCacheEntry entries[CONVERTER_CACHE_SIZE];
+};
+
+static pthread_key_t converterCacheKey;
+static pthread_once_t converterCacheOnce = PTHREAD_ONCE_INIT;
+
+static void converterCacheDestroy(void * value)
+{
+    struct converterCache * cache = (struct converterCache *) value;
+    for(unsigned int i = 0 ; i < cache->count ; i ++) {
+        ucnv_close(cache->entries[i].converter);
+        free(cache->entries[i].charset);
+    }
+    free(cache);
+}
+
+static void converterCacheInitKey()
+{
+    pthread_key_create(&converterCacheKey, converterCacheDestroy);
+}
+
+static struct converterCache * converterCurrentCache()
+{
+    pthread_once(&converterCacheOnce, converterCacheInitKey);
+    struct converterCache * cache = (struct converterCache *) pthread_getspecific(converterCacheKey);
+    if (cache == NULL) {
+        cache = (struct converterCache *) calloc(1, sizeof(* cache));
+        pthread_setspecific(converterCacheKey, cache);
+    }
+    return cache;
+}
+
+// Returns a converter for the charset, taken out of the cache if available.
+static UConverter * converterCacheTake(const char * charset, UErrorCode * pErr)
+{
+    struct converterCache * cache = converterCurrentCache();
+    for(unsigned int i = 0 ; i < cache->count ; i ++) {
+        struct converterCacheEntry * entry = &cache->entries[i];
+        if (strcasecmp(entry->charset, charset) == 0) {
+            UConverter * converter = entry->converter;
+            free(entry->charset);
+            memmove(&cache->entries[i], &cache->entries[i + 1], (cache->count - i - 1) * sizeof(* entry));
+            cache->count --;
+            return converter;
+        }
+    }
+    return ucnv_open(charset, pErr);
+}
+
+// Resets the converter and puts it back in the cache, closing the least recently used one if the cache is full.
+static void converterCacheGiveBack(const char * charset, UConverter * converter)
+{
+    struct converterCache * cache = converterCurrentCache();
+    ucnv_reset(converter);
+    if (cache->count == CONVERTER_CACHE_SIZE) {
+        ucnv_close(cache->entries[0].converter);
+        free(cache->entries[0].charset);
+        memmove(&cache->entries[0], &cache->entries[1], (cache->count - 1) * sizeof(cache->entries[0]));
+        cache->count --;
+    }
+    struct converterCacheEntry * entry = &cache->entries[cache->count];
+    entry->charset = strdup(charset);
+    entry->converter = converter;
+    cache->count ++;
+}
+#endif
+
 void String::appendBytes(const char * bytes, unsigned int length, const char * charset)
 {
     if (bytes == NULL) {
@@ -1356,7 +1502,7 @@ void String::appendBytes(const char * bytes, unsigned int length, const char * c
     }
 
     err = U_ZERO_ERROR;
-    UConverter * converter = ucnv_open(charset, &err); 
+    UConverter * converter = converterCacheTake(charset, &err);
     if (converter == NULL) {
         MCLog("invalid charset %s %i", charset, err);
         return;
@@ -1381,7 +1527,7 @@ void String::appendBytes(const char * bytes, unsigned int length, const char * c
     appendCharactersLength(dest, destLength);
     free(dest);
     
-    ucnv_close(converter);
+    converterCacheGiveBack(charset, converter);
 #endif
 }
 
@@ -1488,6 +1634,7 @@ unsigned int String::replaceOccurrencesOfString(String * occurrence, String * re
         * dest_p = 0;
     }
     
+    resetCaches();
     free(mUnicodeChars);
     mUnicodeChars = unicodeChars;
     mLength = modifiedLength - 1;
@@ -1512,6 +1659,7 @@ void String::deleteCharactersInRange(Range range)
         range.length = mLength - range.location;
     }
     
+    resetCaches();
     int32_t count = mLength - (int32_t) (range.location + range.length);
     memmove(&mUnicodeChars[range.location], &mUnicodeChars[range.location + range.length], count * sizeof(* mUnicodeChars));
     mLength -= range.length;
@@ -1975,6 +2123,38 @@ void initializeLibXML()
     MC_UNLOCK(&lock);
 }
 
+static void initParserState(struct parserState * state, xmlSAXHandler * handler, String * result,
+                            bool showBlockquote, bool showLink)
+{
+    memset(handler, 0, sizeof(xmlSAXHandler));
+    handler->characters = charactersParsed;
+    handler->startElement = elementStarted;
+    handler->endElement = elementEnded;
+    handler->comment = commentParsed;
+    state->result = result;
+    state->level = 0;
+    state->enabled = 1;
+    state->logEnabled = 0;
+    state->disabledLevel = 0;
+    state->quoteLevel = 0;
+    state->hasText = false;
+    state->hasQuote = false;
+    state->hasReturnToLine = false;
+    state->showBlockQuote = showBlockquote;
+    state->showLink = showLink;
+    state->lastCharIsWhitespace = true;
+    state->linkStack = new Array();
+    state->paragraphSpacingStack = new Array();
+}
+
+static void replaceNonBreakingSpaces(String * result)
+{
+    UChar ch[2];
+    ch[0] = 160;
+    ch[1] = 0;
+    result->replaceOccurrencesOfString(String::stringWithCharacters(ch), MCSTR(" "));
+}
+
 String * String::flattenHTMLAndShowBlockquoteAndLink(bool showBlockquote, bool showLink)
 /*" Interpretes the receiver als HTML, removes all tags
  and returns the plain text. "*/
@@ -1984,26 +2164,8 @@ String * String::flattenHTMLAndShowBlockquoteAndLink(bool showBlockquote, bool s
     int mem_base = xmlMemBlocks();
     String * result = String::string();
     xmlSAXHandler handler;
-    memset(&handler, 0, sizeof(xmlSAXHandler));
-    handler.characters = charactersParsed;
-    handler.startElement = elementStarted;
-    handler.endElement = elementEnded;
-    handler.comment = commentParsed;
     struct parserState state;
-    state.result = result;
-    state.level = 0;
-    state.enabled = 1;
-    state.logEnabled = 0;
-    state.disabledLevel = 0;
-    state.quoteLevel = 0;
-    state.hasText = false;
-    state.hasQuote = false;
-    state.hasReturnToLine = false;
-    state.showBlockQuote = showBlockquote;
-    state.showLink = showLink;
-    state.lastCharIsWhitespace = true;
-    state.linkStack = new Array();
-    state.paragraphSpacingStack = new Array();
+    initParserState(&state, &handler, result, showBlockquote, showLink);
     
     const char * characters = cleanedHTMLString()->UTF8Characters();
     
@@ -2017,10 +2179,44 @@ String * String::flattenHTMLAndShowBlockquoteAndLink(bool showBlockquote, bool s
     state.paragraphSpacingStack->release();
     state.linkStack->release();
     
-    UChar ch[2];
-    ch[0] = 160;
-    ch[1] = 0;
-    result->replaceOccurrencesOfString(String::stringWithCharacters(ch), MCSTR(" "));
+    replaceNonBreakingSpaces(result);
+    
+    return result;
+}
+
+// Size of the chunks of HTML given to the parser between two checks of the length of the text.
+#define FLATTEN_HTML_CHUNK_SIZE 4096
+
+String * String::flattenHTMLWithMaximumLength(unsigned int maximumLength)
+{
+    initializeLibXML();
+    
+    String * result = String::string();
+    xmlSAXHandler handler;
+    struct parserState state;
+    initParserState(&state, &handler, result, true, false);
+    
+    Data * data = dataUsingEncoding("utf-8");
+    const char * characters = data->bytes();
+    unsigned int remaining = data->length();
+    htmlParserCtxtPtr ctxt = htmlCreatePushParserCtxt(&handler, &state, NULL, 0, NULL, XML_CHAR_ENCODING_UTF8);
+    if (ctxt != NULL) {
+        while ((remaining > 0) && (result->length() < maximumLength)) {
+            unsigned int chunkSize = remaining < FLATTEN_HTML_CHUNK_SIZE ? remaining : FLATTEN_HTML_CHUNK_SIZE;
+            htmlParseChunk(ctxt, characters, chunkSize, 0);
+            characters += chunkSize;
+            remaining -= chunkSize;
+        }
+        if (remaining == 0) {
+            htmlParseChunk(ctxt, NULL, 0, 1);
+        }
+        htmlFreeParserCtxt(ctxt);
+    }
+    
+    state.paragraphSpacingStack->release();
+    state.linkStack->release();
+    
+    replaceNonBreakingSpaces(result);
     
     return result;
 }
@@ -2145,7 +2341,7 @@ Data * String::dataUsingEncoding(const char * charset)
     }
 
     err = U_ZERO_ERROR;
-    UConverter * converter = ucnv_open(charset, &err); 
+    UConverter * converter = converterCacheTake(charset, &err);
     if (converter == NULL) {
         MCLog("invalid charset %s %i", charset, err);
         return NULL;
@@ -2170,7 +2366,7 @@ Data * String::dataUsingEncoding(const char * charset)
     
     free(dest);
     
-    ucnv_close(converter);
+    converterCacheGiveBack(charset, converter);
     
     return data;
 #endif
@@ -2389,7 +2585,9 @@ String * String::uniquedStringWithUTF8Characters(const char * UTF8Characters)
         return (String *) value.data;
     }
     else {
-        value.data = new String(UTF8Characters);
+        String * str = new String(UTF8Characters);
+        str->mUniqued = true;
+        value.data = str;
         value.len = 0;
         chash_set(uniquedStringHash, &key, &value, NULL);
         MC_UNLOCK(&lock);
@@ -2397,6 +2595,11 @@ String * String::uniquedStringWithUTF8Characters(const char * UTF8Characters)
     }
 }
 
+bool String::isUniqued()
+{
+    return mUniqued;
+}
+
 String * String::htmlEncodedString()
 {
     String * htmlStr = String::string();
@@ -34,7 +34,9 @@ namespace mailcore {
         static String * stringWithData(Data * data, const char * charset = NULL);
         
         virtual const UChar * unicodeCharacters();
+        // The UTF-8 representation is cached until the string is modified.
         virtual const char * UTF8Characters();
+        virtual unsigned int UTF8Length();
         virtual unsigned int length();
         
         virtual void appendString(String * otherString);
@@ -88,6 +90,9 @@ namespace mailcore {
         virtual String * flattenHTML();
         virtual String * flattenHTMLAndShowBlockquote(bool showBlockquote);
         virtual String * flattenHTMLAndShowBlockquoteAndLink(bool showBlockquote, bool showLink);
+        // Stops parsing the HTML once the text reaches maximumLength characters. The text might be
+        // a bit longer. The HTML is not cleaned up first and links are not shown.
+        virtual String * flattenHTMLWithMaximumLength(unsigned int maximumLength);
         
         virtual String * stripWhitespace();
         
@@ -122,6 +127,8 @@ namespace mailcore {
 
     public: // private
         static String * uniquedStringWithUTF8Characters(const char * UTF8Characters);
+        // Uniqued strings are shared and never modified.
+        virtual bool isUniqued();
         
     public: // subclass behavior
         String(String * otherString);
@@ -136,8 +143,14 @@ namespace mailcore {
         UChar * mUnicodeChars;
         unsigned int mLength;
         unsigned int mAllocated;
+        Data * mUTF8Data;
+        // Cached hash value, 0 when not computed yet.
+        unsigned int mHash;
+        bool mUniqued;
         void allocate(unsigned int length, bool force = false);
         void reset();
+        Data * UTF8Data();
+        void resetCaches();
         int compareWithCaseSensitive(String * otherString, bool caseSensitive);
         void appendBytes(const char * bytes, unsigned int length, const char * charset);
         void appendUTF8CharactersLength(const char * UTF8Characters, unsigned int length);
@@ -0,0 +1,523 @@
+#include "MCWin32.h" // should be included first.
+
+#include "MCTimerWheel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#if __APPLE__
+#include <mach/mach_time.h>
+#elif !defined(_MSC_VER)
+#include <time.h>
+#endif
+
+#include "MCMainThread.h"
+#include "MCHash.h"
+
+using namespace mailcore;
+
+// The delayed calls are spread across shards, each with its own lock, its own hierarchical timer
+// wheel (4 levels of 64 slots, 10 ms ticks, about 46 hours) and its own table to find the calls
+// to cancel. Scheduling and cancelling a call are O(1).
+// A single delayed call on the main thread wakes up when the next slot of any shard is due.
+
+#define TICK_DURATION 0.01
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((uint64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+#define SHARDS_COUNT 16
+#define MAX_FREE_TIMERS 256
+#define NO_TICK ((uint64_t) -1)
+
+struct timer {
+    struct timer * next;
+    struct timer ** pprev;
+    struct timer * hashNext;
+    Object * obj;
+    Object::Method method;
+    void * context;
+    uint64_t expires;
+    unsigned int hashValue;
+    unsigned char level;
+    unsigned char slot;
+    // Due, out of the wheel but still in the table until it's called.
+    bool expired;
+    bool cancelled;
+};
+
+struct shard {
+    pthread_mutex_t lock;
+    uint64_t currentTick;
+    struct timer * slots[WHEEL_LEVELS][WHEEL_SIZE];
+    uint64_t occupied[WHEEL_LEVELS];
+    struct timer ** buckets;
+    unsigned int bucketsCount;
+    unsigned int count;
+    struct timer * freeTimers;
+    unsigned int freeTimersCount;
+};
+
+struct timerKey {
+    Object * obj;
+    Object::Method method;
+    void * context;
+};
+
+static pthread_once_t timerWheelOnce = PTHREAD_ONCE_INIT;
+static struct shard * shards = NULL;
+static double startTime = 0;
+
+static pthread_mutex_t driverLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t driverTick = NO_TICK;
+static void * driverCall = NULL;
+static bool driverUpdateScheduled = false;
+
+// Monotonic time, in seconds. The delays don't change when the clock of the system is set.
+static double currentTime(void)
+{
+#if defined(_MSC_VER)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart / (double) frequency.QuadPart;
+#elif __APPLE__
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    return (double) mach_absolute_time() * timebase.numer / timebase.denom / 1000000000.;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.;
+#endif
+}
+
+static uint64_t currentTick(void)
+{
+    double elapsed = currentTime() - startTime;
+    if (elapsed < 0) {
+        return 0;
+    }
+    return (uint64_t) (elapsed / TICK_DURATION);
+}
+
+static void initTimerWheel(void)
+{
+    startTime = currentTime();
+    shards = (struct shard *) calloc(SHARDS_COUNT, sizeof(* shards));
+    for(unsigned int i = 0 ; i < SHARDS_COUNT ; i ++) {
+        pthread_mutex_init(&shards[i].lock, NULL);
+        shards[i].bucketsCount = 64;
+        shards[i].buckets = (struct timer **) calloc(shards[i].bucketsCount, sizeof(* shards[i].buckets));
+    }
+}
+
+static unsigned int keyHash(Object * obj, Object::Method method, void * context)
+{
+    struct timerKey key;
+    // Clear the padding so that equal keys hash the same.
+    memset(&key, 0, sizeof(key));
+    key.obj = obj;
+    key.method = method;
+    key.context = context;
+    return hashCompute((const char *) &key, sizeof(key));
+}
+
+static struct shard * shardForHash(unsigned int hashValue)
+{
+    return &shards[(hashValue >> 24) % SHARDS_COUNT];
+}
+
+static int firstOccupiedSlot(uint64_t occupied)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(occupied);
+#else
+    int slot = 0;
+    while ((occupied & 1) == 0) {
+        occupied >>= 1;
+        slot ++;
+    }
+    return slot;
+#endif
+}
+
+// Returns the first occupied slot at or after the given one, wrapping around. -1 if there's none.
+static int nextOccupiedSlot(uint64_t occupied, unsigned int from)
+{
+    if (occupied == 0) {
+        return -1;
+    }
+    uint64_t after = occupied & ~(((uint64_t) 1 << from) - 1);
+    if (after != 0) {
+        return firstOccupiedSlot(after);
+    }
+    return firstOccupiedSlot(occupied);
+}
+
+static void addToWheel(struct shard * shard, struct timer * timer)
+{
+    uint64_t expires = timer->expires;
+    if (expires < shard->currentTick) {
+        expires = shard->currentTick;
+    }
+    uint64_t delta = expires - shard->currentTick;
+    if (delta >= WHEEL_SPAN) {
+        // Parked in the last level until it gets closer.
+        expires = shard->currentTick + WHEEL_SPAN - 1;
+        delta = WHEEL_SPAN - 1;
+    }
+    unsigned int level = 0;
+    while ((level < WHEEL_LEVELS - 1) && (delta >= ((uint64_t) 1 << (WHEEL_BITS * (level + 1))))) {
+        level ++;
+    }
+    unsigned int slot = (unsigned int) ((expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+
+    timer->level = level;
+    timer->slot = slot;
+    timer->next = shard->slots[level][slot];
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = &shard->slots[level][slot];
+    shard->slots[level][slot] = timer;
+    shard->occupied[level] |= (uint64_t) 1 << slot;
+}
+
+static void removeFromWheel(struct shard * shard, struct timer * timer)
+{
+    * timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    if (shard->slots[timer->level][timer->slot] == NULL) {
+        shard->occupied[timer->level] &= ~((uint64_t) 1 << timer->slot);
+    }
+}
+
+static void addToTable(struct shard * shard, struct timer * timer)
+{
+    if (shard->count >= shard->bucketsCount) {
+        unsigned int bucketsCount = shard->bucketsCount * 2;
+        struct timer ** buckets = (struct timer **) calloc(bucketsCount, sizeof(* buckets));
+        for(unsigned int i = 0 ; i < shard->bucketsCount ; i ++) {
+            struct timer * current = shard->buckets[i];
+            while (current != NULL) {
+                struct timer * next = current->hashNext;
+                unsigned int index = current->hashValue & (bucketsCount - 1);
+                current->hashNext = buckets[index];
+                buckets[index] = current;
+                current = next;
+            }
+        }
+        free(shard->buckets);
+        shard->buckets = buckets;
+        shard->bucketsCount = bucketsCount;
+    }
+    unsigned int index = timer->hashValue & (shard->bucketsCount - 1);
+    timer->hashNext = shard->buckets[index];
+    shard->buckets[index] = timer;
+    shard->count ++;
+}
+
+static void removeFromTable(struct shard * shard, struct timer * timer)
+{
+    struct timer ** pcurrent = &shard->buckets[timer->hashValue & (shard->bucketsCount - 1)];
+    while (* pcurrent != timer) {
+        pcurrent = &(* pcurrent)->hashNext;
+    }
+    * pcurrent = timer->hashNext;
+    shard->count --;
+}
+
+static struct timer * newTimer(struct shard * shard)
+{
+    struct timer * timer = shard->freeTimers;
+    if (timer == NULL) {
+        return (struct timer *) malloc(sizeof(* timer));
+    }
+    shard->freeTimers = timer->next;
+    shard->freeTimersCount --;
+    return timer;
+}
+
+static void recycleTimer(struct shard * shard, struct timer * timer)
+{
+    if (shard->freeTimersCount >= MAX_FREE_TIMERS) {
+        free(timer);
+        return;
+    }
+    timer->next = shard->freeTimers;
+    shard->freeTimers = timer;
+    shard->freeTimersCount ++;
+}
+
+static void cascade(struct shard * shard, uint64_t tick)
+{
+    for(unsigned int level = 1 ; level < WHEEL_LEVELS ; level ++) {
+        unsigned int slot = (unsigned int) ((tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+        struct timer * timer = shard->slots[level][slot];
+        shard->slots[level][slot] = NULL;
+        shard->occupied[level] &= ~((uint64_t) 1 << slot);
+        while (timer != NULL) {
+            struct timer * next = timer->next;
+            addToWheel(shard, timer);
+            timer = next;
+        }
+        // The next level only moves when this one wraps around.
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+// Moves the timers due at nowTick to the expired list. They stay in the table so that they can
+// still be cancelled until they're called.
+static void advance(struct shard * shard, uint64_t nowTick, struct timer ** expired)
+{
+    if (shard->count == 0) {
+        if (shard->currentTick <= nowTick) {
+            shard->currentTick = nowTick + 1;
+        }
+        return;
+    }
+
+    while (shard->currentTick <= nowTick) {
+        uint64_t tick = shard->currentTick;
+        if ((tick & WHEEL_MASK) == 0) {
+            cascade(shard, tick);
+        }
+
+        unsigned int slot = (unsigned int) (tick & WHEEL_MASK);
+        struct timer * timer = shard->slots[0][slot];
+        shard->slots[0][slot] = NULL;
+        shard->occupied[0] &= ~((uint64_t) 1 << slot);
+        while (timer != NULL) {
+            struct timer * next = timer->next;
+            timer->expired = true;
+            timer->next = * expired;
+            * expired = timer;
+            timer = next;
+        }
+
+        // Skip the empty slots, but stop at the end of the level to cascade.
+        uint64_t nextTick = (tick | WHEEL_MASK) + 1;
+        if (slot < WHEEL_MASK) {
+            uint64_t later = shard->occupied[0] & ~(((uint64_t) 1 << (slot + 1)) - 1);
+            if (later != 0) {
+                nextTick = tick - slot + firstOccupiedSlot(later);
+            }
+        }
+        if (nextTick > nowTick + 1) {
+            nextTick = nowTick + 1;
+        }
+        shard->currentTick = nextTick;
+    }
+}
+
+// Returns a tick at which the shard needs to be advanced: either a timer is due or a slot
+// needs to be cascaded.
+static uint64_t nextWakeUpTick(struct shard * shard)
+{
+    if (shard->count == 0) {
+        return NO_TICK;
+    }
+
+    uint64_t tick = shard->currentTick;
+    if ((tick & WHEEL_MASK) == 0) {
+        return tick;
+    }
+
+    uint64_t result = NO_TICK;
+    for(unsigned int level = 0 ; level < WHEEL_LEVELS ; level ++) {
+        unsigned int shift = WHEEL_BITS * level;
+        unsigned int current = (unsigned int) ((tick >> shift) & WHEEL_MASK);
+        // The current slot of the upper levels has already been cascaded.
+        unsigned int from = level == 0 ? current : (current + 1) & WHEEL_MASK;
+        int slot = nextOccupiedSlot(shard->occupied[level], from);
+        if (slot == -1) {
+            continue;
+        }
+        uint64_t base = (tick >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+        uint64_t candidate = base + ((uint64_t) slot << shift);
+        if ((level == 0) ? ((unsigned int) slot < current) : ((unsigned int) slot <= current)) {
+            candidate += (uint64_t) WHEEL_SIZE << shift;
+        }
+        if (candidate < result) {
+            result = candidate;
+        }
+    }
+    return result;
+}
+
+static void updateDriver(void);
+
+static void driverFired(void * context)
+{
+    pthread_mutex_lock(&driverLock);
+    driverCall = NULL;
+    driverTick = NO_TICK;
+    pthread_mutex_unlock(&driverLock);
+
+    uint64_t nowTick = currentTick();
+    for(unsigned int i = 0 ; i < SHARDS_COUNT ; i ++) {
+        struct shard * shard = &shards[i];
+        struct timer * expired = NULL;
+
+        pthread_mutex_lock(&shard->lock);
+        advance(shard, nowTick, &expired);
+        pthread_mutex_unlock(&shard->lock);
+
+        if (expired == NULL) {
+            continue;
+        }
+
+        // Run them in the order they were due.
+        struct timer * ordered = NULL;
+        while (expired != NULL) {
+            struct timer * next = expired->next;
+            expired->next = ordered;
+            ordered = expired;
+            expired = next;
+        }
+        for(struct timer * timer = ordered ; timer != NULL ; timer = timer->next) {
+            // A previous call might have cancelled it.
+            pthread_mutex_lock(&shard->lock);
+            bool cancelled = timer->cancelled;
+            if (!cancelled) {
+                removeFromTable(shard, timer);
+            }
+            pthread_mutex_unlock(&shard->lock);
+            if (!cancelled) {
+                (timer->obj->*timer->method)(timer->context);
+            }
+        }
+
+        pthread_mutex_lock(&shard->lock);
+        while (ordered != NULL) {
+            struct timer * next = ordered->next;
+            recycleTimer(shard, ordered);
+            ordered = next;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    updateDriver();
+}
+
+// Runs on the main thread, which is the only one that arms and fires the driver call.
+static void updateDriver(void)
+{
+    pthread_mutex_lock(&driverLock);
+    driverUpdateScheduled = false;
+    pthread_mutex_unlock(&driverLock);
+
+    uint64_t nextTick = NO_TICK;
+    for(unsigned int i = 0 ; i < SHARDS_COUNT ; i ++) {
+        pthread_mutex_lock(&shards[i].lock);
+        uint64_t tick = nextWakeUpTick(&shards[i]);
+        pthread_mutex_unlock(&shards[i].lock);
+        if (tick < nextTick) {
+            nextTick = tick;
+        }
+    }
+
+    pthread_mutex_lock(&driverLock);
+    if (nextTick < driverTick) {
+        if (driverCall != NULL) {
+            cancelDelayedCall(driverCall);
+        }
+        // A millisecond of slack so that the driver doesn't wake up right before the tick.
+        double delay = startTime + (double) nextTick * TICK_DURATION - currentTime() + 0.001;
+        if (delay < 0) {
+            delay = 0;
+        }
+        driverTick = nextTick;
+        driverCall = callAfterDelay(driverFired, NULL, delay);
+    }
+    pthread_mutex_unlock(&driverLock);
+}
+
+static void updateDriverOnMainThread(void * context)
+{
+    updateDriver();
+}
+
+void mailcore::timerWheelSchedule(Object * obj, Object::Method method, void * context, double delay)
+{
+    pthread_once(&timerWheelOnce, initTimerWheel);
+
+    if (delay < 0) {
+        delay = 0;
+    }
+    double elapsed = currentTime() + delay - startTime;
+    uint64_t expires = elapsed <= 0 ? 0 : (uint64_t) (elapsed / TICK_DURATION) + 1;
+    unsigned int hashValue = keyHash(obj, method, context);
+    struct shard * shard = shardForHash(hashValue);
+
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count == 0) {
+        // Catch up with the time spent without any timer.
+        uint64_t nowTick = currentTick();
+        if (shard->currentTick < nowTick) {
+            shard->currentTick = nowTick;
+        }
+    }
+    struct timer * timer = newTimer(shard);
+    timer->obj = obj;
+    timer->method = method;
+    timer->context = context;
+    timer->hashValue = hashValue;
+    timer->expires = expires;
+    timer->expired = false;
+    timer->cancelled = false;
+    addToTable(shard, timer);
+    addToWheel(shard, timer);
+    pthread_mutex_unlock(&shard->lock);
+
+    bool needsUpdate = false;
+    pthread_mutex_lock(&driverLock);
+    if ((expires < driverTick) && !driverUpdateScheduled) {
+        driverUpdateScheduled = true;
+        needsUpdate = true;
+    }
+    pthread_mutex_unlock(&driverLock);
+    if (needsUpdate) {
+        callOnMainThread(updateDriverOnMainThread, NULL);
+    }
+}
+
+void mailcore::timerWheelCancel(Object * obj, Object::Method method, void * context)
+{
+    pthread_once(&timerWheelOnce, initTimerWheel);
+
+    unsigned int hashValue = keyHash(obj, method, context);
+    struct shard * shard = shardForHash(hashValue);
+
+    pthread_mutex_lock(&shard->lock);
+    struct timer ** pcurrent = &shard->buckets[hashValue & (shard->bucketsCount - 1)];
+    while (* pcurrent != NULL) {
+        struct timer * timer = * pcurrent;
+        if ((timer->obj == obj) && (timer->method == method) && (timer->context == context)) {
+            * pcurrent = timer->hashNext;
+            shard->count --;
+            if (timer->expired) {
+                // It's recycled by driverFired(), which skips it.
+                timer->cancelled = true;
+            }
+            else {
+                removeFromWheel(shard, timer);
+                recycleTimer(shard, timer);
+            }
+        }
+        else {
+            pcurrent = &timer->hashNext;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
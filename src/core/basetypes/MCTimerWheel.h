@@ -0,0 +1,22 @@
+#ifndef MAILCORE_MCTIMERWHEEL_H
+
+#define MAILCORE_MCTIMERWHEEL_H
+
+#include "MCObject.h"
+
+#ifdef __cplusplus
+
+namespace mailcore {
+
+    // Engine behind Object::performMethodAfterDelay() on platforms without dispatch queues.
+    // The method is called on the main thread once the delay has elapsed.
+    void timerWheelSchedule(Object * obj, Object::Method method, void * context, double delay);
+
+    // Cancels all the pending calls of the method with the given context on the object.
+    void timerWheelCancel(Object * obj, Object::Method method, void * context);
+
+}
+
+#endif
+
+#endif
@@ -89,7 +89,7 @@ bool Value::isEqual(Object * otherObject)
     if (mType == VALUE_TYPE_DATA_VALUE) {
         if (mValue.dataValue.length != otherValue->mValue.dataValue.length)
             return false;
-        if (memcmp(&otherValue->mValue.dataValue.data, &mValue.dataValue.data, mValue.dataValue.length) != 0)
+        if (memcmp(otherValue->mValue.dataValue.data, mValue.dataValue.data, mValue.dataValue.length) != 0)
             return false;
     }
     else {
@@ -101,6 +101,9 @@ bool Value::isEqual(Object * otherObject)
 
 unsigned int Value::hash()
 {
+    if (mType == VALUE_TYPE_DATA_VALUE) {
+        return hashCompute(mValue.dataValue.data, mValue.dataValue.length);
+    }
     return hashCompute((const char *) &mValue, sizeof(mValue));
 }
 
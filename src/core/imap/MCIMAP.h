@@ -10,10 +10,12 @@
 #include <MailCore/MCIMAPNamespaceItem.h>
 #include <MailCore/MCIMAPPart.h>
 #include <MailCore/MCIMAPProgressCallback.h>
+#include <MailCore/MCIMAPFetchMessagesCallback.h>
 #include <MailCore/MCIMAPSearchExpression.h>
 #include <MailCore/MCIMAPSession.h>
 #include <MailCore/MCIMAPSyncResult.h>
 #include <MailCore/MCIMAPFolderStatus.h>
 #include <MailCore/MCIMAPIdentity.h>
+#include <MailCore/MCIMAPIdleChanges.h>
 
 #endif
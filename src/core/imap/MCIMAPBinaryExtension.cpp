@@ -0,0 +1,168 @@
+#include "MCWin32.h" // should be included first.
+
+#include "MCIMAPBinaryExtension.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+using namespace mailcore;
+
+// Parsers exported by libetpan. They're declared in mailimap_parser.h, which is not installed.
+extern "C" {
+    int mailimap_token_case_insensitive_parse(mailstream * fd, MMAPString * buffer,
+                                              size_t * indx, const char * token);
+    int mailimap_char_parse(mailstream * fd, MMAPString * buffer, size_t * indx, char token);
+    int mailimap_space_parse(mailstream * fd, MMAPString * buffer, size_t * indx);
+    int mailimap_number_parse(mailstream * fd, MMAPString * buffer, size_t * indx, uint32_t * result);
+    int mailimap_nstring_parse_progress(mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+                                        size_t * indx, char ** result, size_t * result_len,
+                                        size_t progr_rate, progress_function * progr_fun);
+}
+
+#define MAX_PART_LENGTH 128
+
+static int binary_parse(int calling_parser, mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+                        size_t * indx, struct mailimap_extension_data ** result,
+                        size_t progr_rate, progress_function * progr_fun);
+static void binary_free(struct mailimap_extension_data * ext_data);
+
+struct mailimap_extension_api mailcore::imap_extension_binary = {
+    /* name */          (char *) "BINARY",
+    /* extension_id */  -1,
+    /* parser */        binary_parse,
+    /* free */          binary_free,
+};
+
+static pthread_once_t registerOnce = PTHREAD_ONCE_INIT;
+
+static void registerExtension(void)
+{
+    mailimap_extension_register(&imap_extension_binary);
+}
+
+void mailcore::imapBinaryExtensionRegister(void)
+{
+    pthread_once(&registerOnce, registerExtension);
+}
+
+static struct mailimap_fetch_att * fetch_att_new(const char * item, const char * partID)
+{
+    char * ext = (char *) malloc(strlen(item) + strlen(partID) + 3);
+    sprintf(ext, "%s[%s]", item, partID);
+    return mailimap_fetch_att_new_extension(ext);
+}
+
+struct mailimap_fetch_att * mailcore::imap_fetch_att_new_binary_peek(const char * partID)
+{
+    return fetch_att_new("BINARY.PEEK", partID);
+}
+
+// section-binary = "[" [section-part] "]"
+static int section_binary_parse(mailstream * fd, MMAPString * buffer, size_t * indx, char * part)
+{
+    size_t cur_token = * indx;
+    size_t part_length = 0;
+    int r;
+    
+    part[0] = '\0';
+    r = mailimap_char_parse(fd, buffer, &cur_token, '[');
+    if (r != MAILIMAP_NO_ERROR)
+        return r;
+    
+    while (mailimap_char_parse(fd, buffer, &cur_token, ']') != MAILIMAP_NO_ERROR) {
+        uint32_t number;
+        
+        if (part_length > 0) {
+            r = mailimap_char_parse(fd, buffer, &cur_token, '.');
+            if (r != MAILIMAP_NO_ERROR)
+                return r;
+        }
+        r = mailimap_number_parse(fd, buffer, &cur_token, &number);
+        if (r != MAILIMAP_NO_ERROR)
+            return r;
+        if (part_length + 12 > MAX_PART_LENGTH)
+            return MAILIMAP_ERROR_PARSE;
+        part_length += sprintf(part + part_length, part_length > 0 ? ".%u" : "%u", number);
+    }
+    
+    * indx = cur_token;
+    return MAILIMAP_NO_ERROR;
+}
+
+// msg-att-static =/ "BINARY" section-binary ["<" number ">"] SP (nstring / literal8)
+static int binary_parse(int calling_parser, mailstream * fd, MMAPString * buffer, struct mailimap_parser_context * parser_ctx,
+                        size_t * indx, struct mailimap_extension_data ** result,
+                        size_t progr_rate, progress_function * progr_fun)
+{
+    size_t cur_token = * indx;
+    char part[MAX_PART_LENGTH];
+    char * body_part = NULL;
+    size_t length = 0;
+    int r;
+    
+    if (calling_parser != MAILIMAP_EXTENDED_PARSER_FETCH_DATA)
+        return MAILIMAP_ERROR_PARSE;
+    
+    r = mailimap_token_case_insensitive_parse(fd, buffer, &cur_token, "BINARY");
+    if (r != MAILIMAP_NO_ERROR)
+        return r;
+    
+    r = section_binary_parse(fd, buffer, &cur_token, part);
+    if (r != MAILIMAP_NO_ERROR)
+        return r;
+    
+    if (mailimap_char_parse(fd, buffer, &cur_token, '<') == MAILIMAP_NO_ERROR) {
+        uint32_t origin;
+        r = mailimap_number_parse(fd, buffer, &cur_token, &origin);
+        if (r != MAILIMAP_NO_ERROR)
+            return r;
+        r = mailimap_char_parse(fd, buffer, &cur_token, '>');
+        if (r != MAILIMAP_NO_ERROR)
+            return r;
+    }
+    
+    r = mailimap_space_parse(fd, buffer, &cur_token);
+    if (r != MAILIMAP_NO_ERROR)
+        return r;
+    
+    // literal8 = "~{" number "}" CRLF *OCTET
+    mailimap_char_parse(fd, buffer, &cur_token, '~');
+    r = mailimap_nstring_parse_progress(fd, buffer, parser_ctx, &cur_token, &body_part, &length,
+                                        progr_rate, progr_fun);
+    if (r != MAILIMAP_NO_ERROR)
+        return r;
+    
+    struct imap_binary_msg_att * att = (struct imap_binary_msg_att *) malloc(sizeof(* att));
+    att->att_part = strdup(part);
+    att->att_body_part = body_part;
+    att->att_length = length;
+    
+    * result = mailimap_extension_data_new(&imap_extension_binary, IMAP_BINARY_TYPE_SECTION, att);
+    if (* result == NULL) {
+        mailimap_nstring_free(body_part);
+        free(att->att_part);
+        free(att);
+        return MAILIMAP_ERROR_MEMORY;
+    }
+    
+    * indx = cur_token;
+    return MAILIMAP_NO_ERROR;
+}
+
+static void binary_free(struct mailimap_extension_data * ext_data)
+{
+    if (ext_data == NULL)
+        return;
+    
+    struct imap_binary_msg_att * att = (struct imap_binary_msg_att *) ext_data->ext_data;
+    if (att != NULL) {
+        if (att->att_body_part != NULL) {
+            mailimap_nstring_free(att->att_body_part);
+        }
+        free(att->att_part);
+        free(att);
+    }
+    free(ext_data);
+}
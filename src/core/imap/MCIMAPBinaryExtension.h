@@ -0,0 +1,42 @@
+#ifndef MAILCORE_MCIMAPBINARYEXTENSION_H
+
+#define MAILCORE_MCIMAPBINARYEXTENSION_H
+
+#include <inttypes.h>
+#include <libetpan/libetpan.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+
+    // BINARY extension of IMAP (RFC 3516): the server decodes the content transfer encoding of
+    // the parts. libetpan doesn't support it, its extension mechanism is used to parse the
+    // BINARY[...] items of the FETCH responses. BINARY.SIZE[...] is not requested: the length of
+    // the literal is already the maximum of the body progress.
+
+    enum {
+        IMAP_BINARY_TYPE_SECTION,
+    };
+
+    // ext_data of the mailimap_extension_data of the items.
+    struct imap_binary_msg_att {
+        // Part, "1.2" for example, empty for the whole message.
+        char * att_part;
+        // Content of the part, decoded. It's freed with mailimap_nstring_free().
+        char * att_body_part;
+        size_t att_length;
+    };
+
+    extern struct mailimap_extension_api imap_extension_binary;
+
+    // Registers the extension in libetpan. It's done once.
+    void imapBinaryExtensionRegister(void);
+
+    // BINARY.PEEK[partID].
+    struct mailimap_fetch_att * imap_fetch_att_new_binary_peek(const char * partID);
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef MAILCORE_MCIMAPFETCHMESSAGESCALLBACK_H
+
+#define MAILCORE_MCIMAPFETCHMESSAGESCALLBACK_H
+
+#ifdef __cplusplus
+
+#include <inttypes.h>
+#include <MailCore/MCUtils.h>
+
+namespace mailcore {
+    
+    class IMAPSession;
+    class Array;
+    class String;
+    class Data;
+    
+    class MAILCORE_EXPORT IMAPFetchMessagesCallback {
+    public:
+        virtual void messagesFetched(IMAPSession * session, Array * /* IMAPMessage */ messages) {};
+        // See IMAPSession::streamMessageBodiesByUID().
+        virtual void bodyFetched(IMAPSession * session, uint32_t uid, String * partID, Data * data) {};
+    };
+    
+}
+
+#endif
+
+#endif
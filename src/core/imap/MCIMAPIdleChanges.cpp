@@ -0,0 +1,97 @@
+#include "MCIMAPIdleChanges.h"
+
+#include "MCUtils.h"
+
+using namespace mailcore;
+
+IMAPIdleChanges::IMAPIdleChanges()
+{
+    mMessagesCount = 0;
+    mHasMessagesCount = false;
+    mExpungedSequenceNumbers = new Array();
+    mVanishedMessages = new IndexSet();
+    mModifiedMessages = new Array();
+}
+
+IMAPIdleChanges::~IMAPIdleChanges()
+{
+    MC_SAFE_RELEASE(mExpungedSequenceNumbers);
+    MC_SAFE_RELEASE(mVanishedMessages);
+    MC_SAFE_RELEASE(mModifiedMessages);
+}
+
+void IMAPIdleChanges::setMessagesCount(uint32_t messagesCount)
+{
+    mMessagesCount = messagesCount;
+}
+
+uint32_t IMAPIdleChanges::messagesCount()
+{
+    return mMessagesCount;
+}
+
+void IMAPIdleChanges::setHasMessagesCount(bool hasMessagesCount)
+{
+    mHasMessagesCount = hasMessagesCount;
+}
+
+bool IMAPIdleChanges::hasMessagesCount()
+{
+    return mHasMessagesCount;
+}
+
+void IMAPIdleChanges::setExpungedSequenceNumbers(Array * sequenceNumbers)
+{
+    MC_SAFE_REPLACE_RETAIN(Array, mExpungedSequenceNumbers, sequenceNumbers);
+}
+
+Array * IMAPIdleChanges::expungedSequenceNumbers()
+{
+    return mExpungedSequenceNumbers;
+}
+
+void IMAPIdleChanges::setVanishedMessages(IndexSet * vanishedMessages)
+{
+    MC_SAFE_REPLACE_RETAIN(IndexSet, mVanishedMessages, vanishedMessages);
+}
+
+IndexSet * IMAPIdleChanges::vanishedMessages()
+{
+    return mVanishedMessages;
+}
+
+void IMAPIdleChanges::setModifiedMessages(Array * messages)
+{
+    MC_SAFE_REPLACE_RETAIN(Array, mModifiedMessages, messages);
+}
+
+Array * IMAPIdleChanges::modifiedMessages()
+{
+    return mModifiedMessages;
+}
+
+bool IMAPIdleChanges::isEmpty()
+{
+    if (mHasMessagesCount)
+        return false;
+    if ((mExpungedSequenceNumbers != NULL) && (mExpungedSequenceNumbers->count() > 0))
+        return false;
+    if ((mVanishedMessages != NULL) && (mVanishedMessages->count() > 0))
+        return false;
+    if ((mModifiedMessages != NULL) && (mModifiedMessages->count() > 0))
+        return false;
+    return true;
+}
+
+String * IMAPIdleChanges::description()
+{
+    String * result = String::string();
+    result->appendUTF8Format("<%s:%p", className()->UTF8Characters(), this);
+    if (mHasMessagesCount) {
+        result->appendUTF8Format(" messagesCount:%u", (unsigned int) mMessagesCount);
+    }
+    result->appendUTF8Format(" expunged:%s", MCUTF8DESC(mExpungedSequenceNumbers));
+    result->appendUTF8Format(" vanished:%s", MCUTF8DESC(mVanishedMessages));
+    result->appendUTF8Format(" modified:%s>", MCUTF8DESC(mModifiedMessages));
+    return result;
+}
@@ -0,0 +1,54 @@
+#ifndef MAILCORE_MCIMAPIDLECHANGES_H
+
+#define MAILCORE_MCIMAPIDLECHANGES_H
+
+#include <MailCore/MCBaseTypes.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+    
+    // Changes of the selected folder reported by the server while idling.
+    class MAILCORE_EXPORT IMAPIdleChanges : public Object {
+    public:
+        IMAPIdleChanges();
+        virtual ~IMAPIdleChanges();
+        
+        // Number of messages in the folder, when the server sent it (EXISTS).
+        virtual void setMessagesCount(uint32_t messagesCount);
+        virtual uint32_t messagesCount();
+        virtual void setHasMessagesCount(bool hasMessagesCount);
+        virtual bool hasMessagesCount();
+        
+        // Sequence numbers of the expunged messages, in the order they were received.
+        // Each sequence number takes into account the messages expunged before it.
+        virtual void setExpungedSequenceNumbers(Array * /* Value */ sequenceNumbers);
+        virtual Array * /* Value */ expungedSequenceNumbers();
+        
+        // UIDs of the expunged messages when QRESYNC is enabled (VANISHED).
+        virtual void setVanishedMessages(IndexSet * vanishedMessages);
+        virtual IndexSet * vanishedMessages();
+        
+        // Messages whose flags changed. Sequence number, flags and custom flags are set.
+        // UID and modseq value are set when the server sent them.
+        virtual void setModifiedMessages(Array * /* IMAPMessage */ messages);
+        virtual Array * /* IMAPMessage */ modifiedMessages();
+        
+        virtual bool isEmpty();
+        
+    public: // subclass behavior
+        virtual String * description();
+        
+    private:
+        uint32_t mMessagesCount;
+        bool mHasMessagesCount;
+        Array * /* Value */ mExpungedSequenceNumbers;
+        IndexSet * mVanishedMessages;
+        Array * /* IMAPMessage */ mModifiedMessages;
+    };
+    
+}
+
+#endif
+
+#endif
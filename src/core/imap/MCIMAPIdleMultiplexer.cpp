@@ -0,0 +1,331 @@
+#include "MCWin32.h" // should be included first.
+
+#include "MCIMAPIdleMultiplexer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <libetpan/libetpan.h>
+#if defined(__linux__)
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+#include "MCAssert.h"
+
+using namespace mailcore;
+
+#if defined(__linux__)
+
+#define MAX_EVENTS 256
+
+struct mailcore::IMAPIdleWatch {
+    int fd;
+    double deadline;
+    double timeout;
+    IMAPIdleWatchCallback callback;
+    void * context;
+    int result;
+    bool active;
+    // Ordered by deadline while active. Then, list of the watches to call back or to free.
+    IMAPIdleWatch * previous;
+    IMAPIdleWatch * next;
+};
+
+static pthread_once_t multiplexerOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t multiplexerLock = PTHREAD_MUTEX_INITIALIZER;
+static int epollFd = -1;
+static int wakeUpFd = -1;
+static IMAPIdleWatch * firstWatch = NULL;
+static IMAPIdleWatch * lastWatch = NULL;
+static unsigned int watchesCount = 0;
+// The events returned by epoll_wait() might still point to those, they're freed before the next wait.
+static IMAPIdleWatch * freedWatches = NULL;
+
+// The deadlines don't move when the clock of the system is set.
+static double currentTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.;
+}
+
+static void wakeUp(void)
+{
+    uint64_t value = 1;
+    ssize_t r;
+    do {
+        r = write(wakeUpFd, &value, sizeof(value));
+    } while ((r < 0) && (errno == EINTR));
+}
+
+// Should be called with multiplexerLock held.
+static void deactivateWatch(IMAPIdleWatch * watch, int result)
+{
+    if (watch->previous != NULL) {
+        watch->previous->next = watch->next;
+    }
+    else {
+        firstWatch = watch->next;
+    }
+    if (watch->next != NULL) {
+        watch->next->previous = watch->previous;
+    }
+    else {
+        lastWatch = watch->previous;
+    }
+    watch->previous = NULL;
+    watch->next = NULL;
+    watch->active = false;
+    watch->result = result;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, watch->fd, NULL);
+    watchesCount --;
+}
+
+static void * multiplexerThread(void * data)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1) {
+        int timeout = -1;
+
+        pthread_mutex_lock(&multiplexerLock);
+        while (freedWatches != NULL) {
+            IMAPIdleWatch * next = freedWatches->next;
+            free(freedWatches);
+            freedWatches = next;
+        }
+        if (firstWatch != NULL) {
+            double delay = firstWatch->deadline - currentTime();
+            timeout = delay <= 0 ? 0 : (int) (delay * 1000.) + 1;
+        }
+        pthread_mutex_unlock(&multiplexerLock);
+
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, timeout);
+        if ((count < 0) && (errno != EINTR)) {
+            MCAssert(0);
+        }
+
+        IMAPIdleWatch * fired = NULL;
+        IMAPIdleWatch * lastFired = NULL;
+        pthread_mutex_lock(&multiplexerLock);
+        for(int i = 0 ; i < count ; i ++) {
+            IMAPIdleWatch * watch = (IMAPIdleWatch *) events[i].data.ptr;
+            if (watch == NULL) {
+                uint64_t value;
+                read(wakeUpFd, &value, sizeof(value));
+                continue;
+            }
+            // It might have been interrupted meanwhile.
+            if (!watch->active) {
+                continue;
+            }
+            // An error will be reported when reading the response.
+            deactivateWatch(watch, MAILSTREAM_IDLE_HASDATA);
+            if (lastFired != NULL) {
+                lastFired->next = watch;
+            }
+            else {
+                fired = watch;
+            }
+            lastFired = watch;
+        }
+        double now = currentTime();
+        while ((firstWatch != NULL) && (firstWatch->deadline <= now)) {
+            IMAPIdleWatch * watch = firstWatch;
+            deactivateWatch(watch, MAILSTREAM_IDLE_TIMEOUT);
+            if (lastFired != NULL) {
+                lastFired->next = watch;
+            }
+            else {
+                fired = watch;
+            }
+            lastFired = watch;
+        }
+        pthread_mutex_unlock(&multiplexerLock);
+
+        // The owner of the watch can free it as soon as it's called back.
+        while (fired != NULL) {
+            IMAPIdleWatch * next = fired->next;
+            fired->next = NULL;
+            fired->callback(fired->context);
+            fired = next;
+        }
+    }
+
+    return NULL;
+}
+
+static void initMultiplexer(void)
+{
+    struct epoll_event event;
+    pthread_t thread;
+    int r;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    MCAssert(epollFd != -1);
+    wakeUpFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    MCAssert(wakeUpFd != -1);
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    r = epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeUpFd, &event);
+    MCAssert(r == 0);
+
+    r = pthread_create(&thread, NULL, multiplexerThread, NULL);
+    MCAssert(r == 0);
+    pthread_detach(thread);
+}
+
+bool mailcore::idleMultiplexerIsAvailable(void)
+{
+    return true;
+}
+
+unsigned int mailcore::idleMultiplexerWatchesCount(void)
+{
+    pthread_mutex_lock(&multiplexerLock);
+    unsigned int count = watchesCount;
+    pthread_mutex_unlock(&multiplexerLock);
+    return count;
+}
+
+IMAPIdleWatch * mailcore::idleWatchNew(int fd, double timeout, IMAPIdleWatchCallback callback, void * context)
+{
+    IMAPIdleWatch * watch = (IMAPIdleWatch *) calloc(1, sizeof(* watch));
+    watch->fd = fd;
+    watch->timeout = timeout;
+    watch->callback = callback;
+    watch->context = context;
+    watch->result = MAILSTREAM_IDLE_ERROR;
+    return watch;
+}
+
+void mailcore::idleWatchStart(IMAPIdleWatch * watch)
+{
+    struct epoll_event event;
+    bool failed = false;
+
+    pthread_once(&multiplexerOnce, initMultiplexer);
+
+    pthread_mutex_lock(&multiplexerLock);
+    watch->deadline = currentTime() + watch->timeout;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = watch;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, watch->fd, &event) < 0) {
+        watch->result = MAILSTREAM_IDLE_ERROR;
+        failed = true;
+    }
+    else {
+        // The timeouts are usually the same, the watch will most likely go last.
+        IMAPIdleWatch * previous = lastWatch;
+        while ((previous != NULL) && (previous->deadline > watch->deadline)) {
+            previous = previous->previous;
+        }
+        watch->previous = previous;
+        if (previous != NULL) {
+            watch->next = previous->next;
+            previous->next = watch;
+        }
+        else {
+            watch->next = firstWatch;
+            firstWatch = watch;
+        }
+        if (watch->next != NULL) {
+            watch->next->previous = watch;
+        }
+        else {
+            lastWatch = watch;
+        }
+        watch->active = true;
+        watchesCount ++;
+        // The multiplexer needs to wait less.
+        if (firstWatch == watch) {
+            wakeUp();
+        }
+    }
+    pthread_mutex_unlock(&multiplexerLock);
+
+    if (failed) {
+        watch->callback(watch->context);
+    }
+}
+
+void mailcore::idleWatchInterrupt(IMAPIdleWatch * watch)
+{
+    bool interrupted = false;
+
+    pthread_mutex_lock(&multiplexerLock);
+    if (watch->active) {
+        deactivateWatch(watch, MAILSTREAM_IDLE_INTERRUPTED);
+        interrupted = true;
+    }
+    pthread_mutex_unlock(&multiplexerLock);
+
+    if (interrupted) {
+        watch->callback(watch->context);
+    }
+}
+
+int mailcore::idleWatchResult(IMAPIdleWatch * watch)
+{
+    pthread_mutex_lock(&multiplexerLock);
+    int result = watch->result;
+    pthread_mutex_unlock(&multiplexerLock);
+    return result;
+}
+
+void mailcore::idleWatchFree(IMAPIdleWatch * watch)
+{
+    pthread_mutex_lock(&multiplexerLock);
+    MCAssert(!watch->active);
+    watch->next = freedWatches;
+    freedWatches = watch;
+    pthread_mutex_unlock(&multiplexerLock);
+}
+
+#else
+
+bool mailcore::idleMultiplexerIsAvailable(void)
+{
+    return false;
+}
+
+unsigned int mailcore::idleMultiplexerWatchesCount(void)
+{
+    return 0;
+}
+
+IMAPIdleWatch * mailcore::idleWatchNew(int fd, double timeout, IMAPIdleWatchCallback callback, void * context)
+{
+    MCAssert(0);
+    return NULL;
+}
+
+void mailcore::idleWatchStart(IMAPIdleWatch * watch)
+{
+    MCAssert(0);
+}
+
+void mailcore::idleWatchInterrupt(IMAPIdleWatch * watch)
+{
+    MCAssert(0);
+}
+
+int mailcore::idleWatchResult(IMAPIdleWatch * watch)
+{
+    MCAssert(0);
+    return MAILSTREAM_IDLE_ERROR;
+}
+
+void mailcore::idleWatchFree(IMAPIdleWatch * watch)
+{
+    MCAssert(0);
+}
+
+#endif
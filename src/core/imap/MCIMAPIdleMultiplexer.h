@@ -0,0 +1,40 @@
+#ifndef MAILCORE_MCIMAPIDLEMULTIPLEXER_H
+
+#define MAILCORE_MCIMAPIDLEMULTIPLEXER_H
+
+#ifdef __cplusplus
+
+namespace mailcore {
+
+    // Watches the sockets of the idling sessions on a single thread, so that an idling session
+    // doesn't need a thread of its own.
+
+    struct IMAPIdleWatch;
+
+    typedef void (* IMAPIdleWatchCallback)(void * context);
+
+    // Returns false when the platform doesn't support it. The session should then wait in
+    // mailstream_wait_idle().
+    bool idleMultiplexerIsAvailable(void);
+    unsigned int idleMultiplexerWatchesCount(void);
+
+    IMAPIdleWatch * idleWatchNew(int fd, double timeout, IMAPIdleWatchCallback callback, void * context);
+
+    // The callback is called once, when data arrives on the socket, when the timeout expires or
+    // when the watch is interrupted. It's called on the thread of the multiplexer or on the thread
+    // that interrupted the watch.
+    void idleWatchStart(IMAPIdleWatch * watch);
+    void idleWatchInterrupt(IMAPIdleWatch * watch);
+
+    // One of MAILSTREAM_IDLE_HASDATA, MAILSTREAM_IDLE_TIMEOUT, MAILSTREAM_IDLE_INTERRUPTED
+    // or MAILSTREAM_IDLE_ERROR, once the callback has been called.
+    int idleWatchResult(IMAPIdleWatch * watch);
+
+    // Should not be called while the watch is running.
+    void idleWatchFree(IMAPIdleWatch * watch);
+
+}
+
+#endif
+
+#endif
@@ -14,6 +14,7 @@
 #include "MCMessageHeader.h"
 #include "MCAbstractPart.h"
 #include "MCIMAPProgressCallback.h"
+#include "MCIMAPFetchMessagesCallback.h"
 #include "MCIMAPNamespace.h"
 #include "MCIMAPSyncResult.h"
 #include "MCIMAPFolderStatus.h"
@@ -26,10 +27,19 @@
 #include "MCHTMLBodyRendererTemplateCallback.h"
 #include "MCCertificateUtils.h"
 #include "MCIMAPIdentity.h"
+#include "MCIMAPIdleChanges.h"
 #include "MCLibetpan.h"
+#include "MCIMAPBinaryExtension.h"
 
 using namespace mailcore;
 
+// Senders exported by libetpan. They're declared in mailimap_sender.h, which is not installed.
+extern "C" {
+    int mailimap_uid_fetch_send(mailstream * fd, struct mailimap_set * set,
+                                struct mailimap_fetch_type * fetch_type);
+    int mailimap_crlf_send(mailstream * fd);
+}
+
 enum {
     STATE_DISCONNECTED,
     STATE_CONNECTED,
@@ -273,6 +283,61 @@ static clist * splitSet(struct mailimap_set * set, unsigned int splitCount)
     return result;
 }
 
+// Splits the set so that each part covers at most maxCount indexes.
+// An open-ended interval (n:*) can't be bounded and is kept in one part.
+static clist * splitSetByIndexesCount(struct mailimap_set * set, unsigned int maxCount)
+{
+    struct mailimap_set * current_set;
+    clist * result;
+    unsigned int count;
+    
+    result = clist_new();
+    
+    current_set = NULL;
+    count = 0;
+    for(clistiter * iter = clist_begin(set->set_list) ; iter != NULL ; iter = clist_next(iter)) {
+        struct mailimap_set_item * item;
+        
+        item = (struct mailimap_set_item *) clist_content(iter);
+        if (item->set_last == 0) {
+            if (current_set == NULL) {
+                current_set = mailimap_set_new_empty();
+            }
+            mailimap_set_add_interval(current_set, item->set_first, 0);
+            continue;
+        }
+        
+        uint32_t first = item->set_first;
+        while (1) {
+            uint32_t last = item->set_last;
+            
+            if (current_set == NULL) {
+                current_set = mailimap_set_new_empty();
+            }
+            if ((uint64_t) last - first + 1 > maxCount - count) {
+                last = first + (maxCount - count) - 1;
+            }
+            mailimap_set_add_interval(current_set, first, last);
+            count += last - first + 1;
+            
+            if (count >= maxCount) {
+                clist_append(result, current_set);
+                current_set = NULL;
+                count = 0;
+            }
+            if (last == item->set_last) {
+                break;
+            }
+            first = last + 1;
+        }
+    }
+    if (current_set != NULL) {
+        clist_append(result, current_set);
+    }
+    
+    return result;
+}
+
 static struct mailimap_set * setFromIndexSet(IndexSet * indexSet)
 {
     struct mailimap_set * imap_set;
@@ -323,6 +388,7 @@ void IMAPSession::init()
     mXListEnabled = false;
     mQResyncEnabled = false;
     mCondstoreEnabled = false;
+    mBinaryEnabled = false;
     mIdentityEnabled = false;
     mNamespaceEnabled = false;
     mCompressionEnabled = false;
@@ -348,12 +414,18 @@ void IMAPSession::init()
     mImap = NULL;
     mProgressCallback = NULL;
     mProgressItemsCount = 0;
+    mFetchMessagesCallback = NULL;
+    mFetchMessagesBatchSize = 0;
+    mFetchChunkSize = 0;
+    mFetchPipelineDepth = 1;
+    mLastReadFilledBuffer = false;
     mConnectionLogger = NULL;
     mAutomaticConfigurationEnabled = true;
     mAutomaticConfigurationDone = false;
     mShouldDisconnect = false;
     mLoginResponse = NULL;
     mGmailUserDisplayName = NULL;
+    mIdleChanges = NULL;
 }
 
 IMAPSession::IMAPSession()
@@ -363,6 +435,7 @@ IMAPSession::IMAPSession()
 
 IMAPSession::~IMAPSession()
 {
+    MC_SAFE_RELEASE(mIdleChanges);
     MC_SAFE_RELEASE(mGmailUserDisplayName);
     MC_SAFE_RELEASE(mLoginResponse);
     MC_SAFE_RELEASE(mClientIdentity);
@@ -477,6 +550,26 @@ bool IMAPSession::isVoIPEnabled()
     return mVoIPEnabled;
 }
 
+void IMAPSession::setFetchChunkSize(unsigned int chunkSize)
+{
+    mFetchChunkSize = chunkSize;
+}
+
+unsigned int IMAPSession::fetchChunkSize()
+{
+    return mFetchChunkSize;
+}
+
+void IMAPSession::setFetchPipelineDepth(unsigned int depth)
+{
+    mFetchPipelineDepth = depth;
+}
+
+unsigned int IMAPSession::fetchPipelineDepth()
+{
+    return mFetchPipelineDepth;
+}
+
 static bool hasError(int errorCode)
 {
     return ((errorCode != MAILIMAP_NO_ERROR) && (errorCode != MAILIMAP_NO_ERROR_AUTHENTICATED) &&
@@ -510,6 +603,10 @@ static void logger(mailimap * imap, int log_type, const char * buffer, size_t si
 {
     IMAPSession * session = (IMAPSession *) context;
     
+    if (log_type == MAILSTREAM_LOG_TYPE_DATA_RECEIVED) {
+        session->dataReceived(size);
+    }
+    
     if (session->connectionLogger() == NULL)
         return;
     
@@ -532,6 +629,7 @@ void IMAPSession::setup()
 {
     MCAssert(mImap == NULL);
     
+    imapBinaryExtensionRegister();
     mImap = mailimap_new(0, NULL);
     mailimap_set_timeout(mImap, timeout());
     mailimap_set_progress_callback(mImap, body_progress, IMAPSession::items_progress, this);
@@ -558,6 +656,7 @@ void IMAPSession::unsetup()
     }
     
     mState = STATE_DISCONNECTED;
+    MC_SAFE_RELEASE(mCurrentFolder);
 }
 
 void IMAPSession::connect(ErrorCode * pError)
@@ -996,34 +1095,63 @@ static uint64_t get_mod_sequence_value(mailimap * session)
     return mod_sequence_value;
 }
 
-void IMAPSession::select(String * folder, ErrorCode * pError)
+// Message with the flags, the UID and the mod-sequence value of an untagged FETCH response.
+static IMAPMessage * flags_message_from_msg_att(struct mailimap_msg_att * msg_att)
 {
-    int r;
-
-    MCLog("select");
-    MCAssert(mState == STATE_LOGGEDIN || mState == STATE_SELECTED);
+    IMAPMessage * msg = new IMAPMessage();
+    msg->setSequenceNumber(msg_att->att_number);
+    for(clistiter * cur = clist_begin(msg_att->att_list) ; cur != NULL ; cur = clist_next(cur)) {
+        struct mailimap_msg_att_item * att_item = (struct mailimap_msg_att_item *) clist_content(cur);
+        if (att_item->att_type == MAILIMAP_MSG_ATT_ITEM_DYNAMIC) {
+            MessageFlag flags = flags_from_lep_att_dynamic(att_item->att_data.att_dyn);
+            msg->setFlags(flags);
+            msg->setOriginalFlags(flags);
+            msg->setCustomFlags(custom_flags_from_lep_att_dynamic(att_item->att_data.att_dyn));
+        }
+        else if (att_item->att_type == MAILIMAP_MSG_ATT_ITEM_STATIC) {
+            if (att_item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_UID) {
+                msg->setUid(att_item->att_data.att_static->att_data.att_uid);
+            }
+        }
+        else if (att_item->att_type == MAILIMAP_MSG_ATT_ITEM_EXTENSION) {
+            struct mailimap_extension_data * ext_data = att_item->att_data.att_extension_data;
+            if (ext_data->ext_extension == &mailimap_extension_condstore) {
+                struct mailimap_condstore_fetch_mod_resp * fetch_data;
+                
+                fetch_data = (struct mailimap_condstore_fetch_mod_resp *) ext_data->ext_data;
+                msg->setModSeqValue(fetch_data->cs_modseq_value);
+            }
+        }
+    }
+    return (IMAPMessage *) msg->autorelease();
+}
 
-    r = mailimap_select(mImap, MCUTF8(folder));
-    MCLog("select error : %i", r);
+// Sets the error of a SELECT from the result of libetpan, ErrorNone if it succeeded.
+// After a failed SELECT, no folder is considered selected.
+void IMAPSession::selectErrorFromResult(int r, ErrorCode * pError)
+{
     if (r == MAILIMAP_ERROR_STREAM) {
         mShouldDisconnect = true;
         * pError = ErrorConnection;
         MCLog("select error : %s %i", MCUTF8DESC(this), * pError);
-        return;
     }
     else if (r == MAILIMAP_ERROR_PARSE) {
         * pError = ErrorParse;
-        return;
     }
     else if (hasError(r)) {
         * pError = ErrorNonExistantFolder;
-        mState = STATE_LOGGEDIN;
-        MC_SAFE_RELEASE(mCurrentFolder);
+    }
+    else {
+        * pError = ErrorNone;
         return;
     }
+    
+    mState = STATE_LOGGEDIN;
+    MC_SAFE_RELEASE(mCurrentFolder);
+}
 
-    MC_SAFE_REPLACE_COPY(String, mCurrentFolder, folder);
-
+void IMAPSession::readSelectionInfo()
+{
     if (mImap->imap_selection_info != NULL) {
         mUIDValidity = mImap->imap_selection_info->sel_uidvalidity;
         mUIDNext = mImap->imap_selection_info->sel_uidnext;        
@@ -1055,12 +1183,114 @@ void IMAPSession::select(String * folder, ErrorCode * pError)
       
         mModSequenceValue = get_mod_sequence_value(mImap);
     }
+}
+
+void IMAPSession::select(String * folder, ErrorCode * pError)
+{
+    int r;
+
+    MCLog("select");
+    MCAssert(mState == STATE_LOGGEDIN || mState == STATE_SELECTED);
+
+    r = mailimap_select(mImap, MCUTF8(folder));
+    MCLog("select error : %i", r);
+    selectErrorFromResult(r, pError);
+    if (* pError != ErrorNone)
+        return;
+
+    MC_SAFE_REPLACE_COPY(String, mCurrentFolder, folder);
+    readSelectionInfo();
 
     mState = STATE_SELECTED;
     * pError = ErrorNone;
     MCLog("select ok");
 }
 
+IMAPSyncResult * IMAPSession::selectWithQResync(String * folder, uint32_t uidValidity, uint64_t modSequenceValue,
+                                                IndexSet * knownUIDs, ErrorCode * pError)
+{
+    struct mailimap_set * known_uids;
+    clist * fetch_result;
+    struct mailimap_qresync_vanished * vanished;
+    uint64_t mod_sequence_value;
+    int r;
+
+    loginIfNeeded(pError);
+    if (* pError != ErrorNone)
+        return NULL;
+
+    if (!mQResyncEnabled || (modSequenceValue == 0)) {
+        select(folder, pError);
+        if (* pError != ErrorNone)
+            return NULL;
+        if (mUIDValidity != uidValidity) {
+            IMAPSyncResult * result = new IMAPSyncResult();
+            result->setModifiedOrAddedMessages(Array::array());
+            result->setVanishedMessages(IndexSet::indexSet());
+            result->autorelease();
+            return result;
+        }
+        IndexSet * uids = knownUIDs;
+        if (uids == NULL) {
+            uids = IndexSet::indexSetWithRange(RangeMake(1, UINT64_MAX));
+        }
+        return syncMessagesByUID(folder, (IMAPMessagesRequestKind) (IMAPMessagesRequestKindUid | IMAPMessagesRequestKindFlags),
+                                 uids, modSequenceValue, NULL, pError);
+    }
+
+    MCLog("select qresync");
+    MCAssert(mState == STATE_LOGGEDIN || mState == STATE_SELECTED);
+
+    known_uids = NULL;
+    if (knownUIDs != NULL) {
+        known_uids = setFromIndexSet(knownUIDs);
+    }
+    fetch_result = NULL;
+    vanished = NULL;
+    mod_sequence_value = 0;
+    r = mailimap_select_qresync(mImap, MCUTF8(folder), uidValidity, modSequenceValue, known_uids, NULL, NULL,
+                                &fetch_result, &vanished, &mod_sequence_value);
+    if (known_uids != NULL) {
+        mailimap_set_free(known_uids);
+    }
+    selectErrorFromResult(r, pError);
+    if (* pError != ErrorNone)
+        return NULL;
+
+    MC_SAFE_REPLACE_COPY(String, mCurrentFolder, folder);
+    readSelectionInfo();
+    mState = STATE_SELECTED;
+
+    // The server only returns the changes when the UIDVALIDITY still matches.
+    Array * messages = Array::array();
+    if (fetch_result != NULL) {
+        for(clistiter * cur = clist_begin(fetch_result) ; cur != NULL ; cur = clist_next(cur)) {
+            struct mailimap_msg_att * msg_att = (struct mailimap_msg_att *) clist_content(cur);
+            IMAPMessage * msg = flags_message_from_msg_att(msg_att);
+            if (msg->uid() == 0)
+                continue;
+            messages->addObject(msg);
+        }
+        mailimap_fetch_list_free(fetch_result);
+    }
+    IndexSet * vanishedMessages = NULL;
+    if (vanished != NULL) {
+        vanishedMessages = indexSetFromSet(vanished->qr_known_uids);
+        mailimap_qresync_vanished_free(vanished);
+    }
+    else {
+        vanishedMessages = IndexSet::indexSet();
+    }
+
+    IMAPSyncResult * result = new IMAPSyncResult();
+    result->setModifiedOrAddedMessages(messages);
+    result->setVanishedMessages(vanishedMessages);
+    result->autorelease();
+    * pError = ErrorNone;
+    MCLog("select qresync ok");
+    return result;
+}
+
 
 
 
@@ -1901,6 +2131,13 @@ struct msg_att_handler_data {
     bool needsGmailLabels;
     bool needsGmailMessageID;
     bool needsGmailThreadID;
+    unsigned int messagesCount;
+    IMAPSession * session;
+    IMAPFetchMessagesCallback * fetchCallback;
+    unsigned int batchSize;
+    // INTERNALDATE of the fetched messages, converted in batch by decode_internal_dates().
+    Array * internalDateMessages;
+    Data * internalDates;
 };
 
 static void msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
@@ -1928,6 +2165,7 @@ static void msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
     bool needsGmailThreadID;
     IndexSet * uidsFilter;
     IndexSet * numbersFilter;
+    struct mailimap_date_time * internalDate;
     
     msg_att_context = (struct msg_att_handler_data *) context;
     uidsFilter = msg_att_context->uidsFilter;
@@ -1949,6 +2187,7 @@ static void msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
     hasGmailLabels = false;
     hasGmailMessageID = false;
     hasGmailThreadID = false;
+    internalDate = NULL;
     
     if (numbersFilter != NULL) {
         if (!numbersFilter->containsIndex((uint64_t) msg_att->att_number)) {
@@ -2084,7 +2323,7 @@ static void msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
             
             att_static = att_item->att_data.att_static;
             if (att_static->att_type == MAILIMAP_MSG_ATT_INTERNALDATE) {
-                msg->header()->importIMAPInternalDate(att_static->att_data.att_internal_date);
+                internalDate = att_static->att_data.att_internal_date;
             } else if (att_static->att_type == MAILIMAP_MSG_ATT_RFC822_SIZE) {
                 msg->setSize(att_static->att_data.att_rfc822_size);
             }
@@ -2130,12 +2369,178 @@ static void msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
         }
     }
     
+    if (internalDate != NULL) {
+        msg_att_context->internalDateMessages->addObject(msg);
+        msg_att_context->internalDates->appendBytes((const char *) internalDate, sizeof(* internalDate));
+    }
+    
     result->addObject(msg);
     msg->release();
+    msg_att_context->messagesCount ++;
     
     msg_att_context->mLastFetchedSequenceNumber = mLastFetchedSequenceNumber;
 }
 
+static void decode_internal_dates(struct msg_att_handler_data * msg_att_context)
+{
+    unsigned int count;
+    time_t * timestamps;
+    
+    count = msg_att_context->internalDateMessages->count();
+    if (count == 0)
+        return;
+    
+    timestamps = (time_t *) malloc(count * sizeof(* timestamps));
+    timestampsFromIMAPDates((struct mailimap_date_time *) msg_att_context->internalDates->bytes(), count, timestamps);
+    for(unsigned int i = 0 ; i < count ; i ++) {
+        IMAPMessage * msg = (IMAPMessage *) msg_att_context->internalDateMessages->objectAtIndex(i);
+        msg->header()->setReceivedDate(timestamps[i]);
+    }
+    free(timestamps);
+    
+    msg_att_context->internalDateMessages->removeAllObjects();
+    MC_SAFE_RELEASE(msg_att_context->internalDates);
+    msg_att_context->internalDates = new Data();
+}
+
+static void flush_fetched_messages(struct msg_att_handler_data * msg_att_context)
+{
+    if (msg_att_context->result->count() == 0)
+        return;
+    
+    decode_internal_dates(msg_att_context);
+    msg_att_context->fetchCallback->messagesFetched(msg_att_context->session, msg_att_context->result);
+    msg_att_context->result->removeAllObjects();
+}
+
+// Frees the attributes of a message whose response has been handled. The message record itself
+// belongs to libetpan until the end of the command: its list is emptied in place rather than replaced.
+static void release_msg_att_items(struct mailimap_msg_att * msg_att)
+{
+    if (msg_att->att_list == NULL)
+        return;
+    
+    clistiter * cur = clist_begin(msg_att->att_list);
+    while (cur != NULL) {
+        mailimap_msg_att_item_free((struct mailimap_msg_att_item *) clist_content(cur));
+        cur = clist_delete(msg_att->att_list, cur);
+    }
+}
+
+static void stream_msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
+{
+    struct msg_att_handler_data * msg_att_context;
+    
+    msg_att_context = (struct msg_att_handler_data *) context;
+    
+    AutoreleasePool * pool = new AutoreleasePool();
+    msg_att_handler(msg_att, context);
+    if (msg_att_context->result->count() >= msg_att_context->batchSize) {
+        flush_fetched_messages(msg_att_context);
+    }
+    pool->release();
+    
+    // The attributes have been converted, there's no need to keep them until the end of the command.
+    release_msg_att_items(msg_att);
+}
+
+// Sends the UID FETCH commands of setList, keeping at most depth of them waiting for their tagged
+// response. The untagged FETCH responses of all the commands are returned in a single list.
+static int uid_fetch_pipelined(mailimap * imap, clist * setList, unsigned int depth,
+                               struct mailimap_fetch_type * fetch_type, clist ** result)
+{
+    clistiter * set_iter;
+    unsigned int pending_count;
+    clist * fetch_result;
+    int error;
+    int r;
+    
+    if (imap->imap_state != MAILIMAP_STATE_SELECTED)
+        return MAILIMAP_ERROR_BAD_STATE;
+    
+    fetch_result = clist_new();
+    error = MAILIMAP_NO_ERROR;
+    set_iter = clist_begin(setList);
+    pending_count = 0;
+    while (1) {
+        bool sent = false;
+        
+        // Once a command failed, the next ones are not sent but the pending responses are still read.
+        while ((error == MAILIMAP_NO_ERROR) && (set_iter != NULL) && (pending_count < depth)) {
+            struct mailimap_set * set = (struct mailimap_set *) clist_content(set_iter);
+            
+            r = mailimap_send_current_tag(imap);
+            if (r == MAILIMAP_NO_ERROR) {
+                r = mailimap_uid_fetch_send(imap->imap_stream, set, fetch_type);
+            }
+            if (r == MAILIMAP_NO_ERROR) {
+                r = mailimap_crlf_send(imap->imap_stream);
+            }
+            if (r != MAILIMAP_NO_ERROR) {
+                mailimap_fetch_list_free(fetch_result);
+                return r;
+            }
+            pending_count ++;
+            set_iter = clist_next(set_iter);
+            sent = true;
+        }
+        if (sent && (mailstream_flush(imap->imap_stream) == -1)) {
+            mailimap_fetch_list_free(fetch_result);
+            return MAILIMAP_ERROR_STREAM;
+        }
+        if (pending_count == 0)
+            break;
+        
+        struct mailimap_response * response;
+        if (mailimap_read_line(imap) == NULL) {
+            mailimap_fetch_list_free(fetch_result);
+            return MAILIMAP_ERROR_STREAM;
+        }
+        r = mailimap_parse_response(imap, &response);
+        if (r != MAILIMAP_NO_ERROR) {
+            mailimap_fetch_list_free(fetch_result);
+            // The responses of the other pending commands can't be told apart anymore.
+            if (pending_count > 1)
+                return MAILIMAP_ERROR_STREAM;
+            return r;
+        }
+        pending_count --;
+        
+        if (response->rsp_resp_done->rsp_type != MAILIMAP_RESP_DONE_TYPE_TAGGED) {
+            // BYE
+            mailimap_response_free(response);
+            mailimap_fetch_list_free(fetch_result);
+            return MAILIMAP_ERROR_STREAM;
+        }
+        
+        clist * list = imap->imap_response_info->rsp_fetch_list;
+        imap->imap_response_info->rsp_fetch_list = NULL;
+        int cond_state = MAILIMAP_RESP_COND_STATE_OK;
+        if ((list == NULL) || (clist_count(list) == 0)) {
+            cond_state = response->rsp_resp_done->rsp_data.rsp_tagged->rsp_cond_state.rsp_type;
+        }
+        mailimap_response_free(response);
+        
+        if (list != NULL) {
+            for(clistiter * iter = clist_begin(list) ; iter != NULL ; iter = clist_next(iter)) {
+                clist_append(fetch_result, clist_content(iter));
+            }
+            clist_free(list);
+        }
+        if ((cond_state != MAILIMAP_RESP_COND_STATE_OK) && (error == MAILIMAP_NO_ERROR)) {
+            error = MAILIMAP_ERROR_UID_FETCH;
+        }
+    }
+    
+    if (error != MAILIMAP_NO_ERROR) {
+        mailimap_fetch_list_free(fetch_result);
+        return error;
+    }
+    
+    * result = fetch_result;
+    return MAILIMAP_NO_ERROR;
+}
+
 IMAPSyncResult * IMAPSession::fetchMessages(String * folder, IMAPMessagesRequestKind requestKind, bool fetchByUID,
                                             struct mailimap_set * imapset, IndexSet * uidsFilter, IndexSet * numbersFilter,
                                             uint64_t modseq, HashMap * mapping,
@@ -2312,7 +2717,17 @@ IMAPSyncResult * IMAPSession::fetchMessages(String * folder, IMAPMessagesRequest
     msg_att_data.needsGmailLabels = needsGmailLabels;
     msg_att_data.needsGmailMessageID = needsGmailMessageID;
     msg_att_data.needsGmailThreadID = needsGmailThreadID;
-    mailimap_set_msg_att_handler(mImap, msg_att_handler, &msg_att_data);
+    msg_att_data.session = this;
+    msg_att_data.fetchCallback = mFetchMessagesCallback;
+    msg_att_data.batchSize = mFetchMessagesBatchSize;
+    msg_att_data.internalDateMessages = new Array();
+    msg_att_data.internalDates = new Data();
+    if (mFetchMessagesCallback != NULL) {
+        mailimap_set_msg_att_handler(mImap, stream_msg_att_handler, &msg_att_data);
+    }
+    else {
+        mailimap_set_msg_att_handler(mImap, msg_att_handler, &msg_att_data);
+    }
     
     mBodyProgressEnabled = false;
     vanished = NULL;
@@ -2328,6 +2743,12 @@ IMAPSyncResult * IMAPSession::fetchMessages(String * folder, IMAPMessagesRequest
                                                     &fetch_result);
             }
         }
+        else if ((mFetchChunkSize > 0) && (mFetchPipelineDepth > 1)) {
+            clist * setList = splitSetByIndexesCount(imapset, mFetchChunkSize);
+            r = uid_fetch_pipelined(mImap, setList, mFetchPipelineDepth, fetch_type, &fetch_result);
+            clist_foreach(setList, (clist_func) mailimap_set_free, NULL);
+            clist_free(setList);
+        }
         else {
             r = mailimap_uid_fetch(mImap, imapset, fetch_type, &fetch_result);
         }
@@ -2362,6 +2783,16 @@ IMAPSyncResult * IMAPSession::fetchMessages(String * folder, IMAPMessagesRequest
     
     mailimap_set_msg_att_handler(mImap, NULL, NULL);
     
+    if (mFetchMessagesCallback != NULL) {
+        // Messages received before a possible error are delivered anyway.
+        flush_fetched_messages(&msg_att_data);
+    }
+    else {
+        decode_internal_dates(&msg_att_data);
+    }
+    MC_SAFE_RELEASE(msg_att_data.internalDateMessages);
+    MC_SAFE_RELEASE(msg_att_data.internalDates);
+    
     if (r == MAILIMAP_ERROR_STREAM) {
         MCLog("error stream");
         mShouldDisconnect = true;
@@ -2386,7 +2817,7 @@ IMAPSyncResult * IMAPSession::fetchMessages(String * folder, IMAPMessagesRequest
     result->autorelease();
     
     if ((requestKind & IMAPMessagesRequestKindHeaders) != 0) {
-        if (messages->count() == 0) {
+        if (msg_att_data.messagesCount == 0) {
             unsigned int count;
             
             count = clist_count(fetch_result);
@@ -2414,27 +2845,143 @@ IMAPSyncResult * IMAPSession::fetchMessages(String * folder, IMAPMessagesRequest
     return result;
 }
 
-Array * IMAPSession::fetchMessagesByUID(String * folder, IMAPMessagesRequestKind requestKind,
-                                        IndexSet * uids, IMAPProgressCallback * progressCallback, ErrorCode * pError)
-{
-    return fetchMessagesByUIDWithExtraHeaders(folder, requestKind, uids, progressCallback, NULL, pError);
+namespace mailcore {
+    
+    // Keeps the items progress increasing across the FETCH commands of a chunked fetch.
+    class ChunkedFetchProgressCallback : public IMAPProgressCallback {
+    public:
+        ChunkedFetchProgressCallback(IMAPProgressCallback * callback)
+        {
+            mCallback = callback;
+            mOffset = 0;
+            mCurrent = 0;
+        }
+        
+        virtual void bodyProgress(IMAPSession * session, unsigned int current, unsigned int maximum)
+        {
+            mCallback->bodyProgress(session, current, maximum);
+        }
+        
+        virtual void itemsProgress(IMAPSession * session, unsigned int current, unsigned int maximum)
+        {
+            mCurrent = mOffset + current;
+            mCallback->itemsProgress(session, mCurrent, maximum);
+        }
+        
+        virtual void nextChunk()
+        {
+            mOffset = mCurrent;
+        }
+        
+    private:
+        IMAPProgressCallback * mCallback;
+        unsigned int mOffset;
+        unsigned int mCurrent;
+    };
+    
 }
 
-
-Array * IMAPSession::fetchMessagesByUIDWithExtraHeaders(String * folder, IMAPMessagesRequestKind requestKind,
-                                                        IndexSet * uids, IMAPProgressCallback * progressCallback,
-                                                        Array * extraHeaders, ErrorCode * pError)
+IMAPSyncResult * IMAPSession::fetchMessagesByUIDInChunks(String * folder, IMAPMessagesRequestKind requestKind,
+                                                         IndexSet * uids, uint64_t modseq,
+                                                         IMAPProgressCallback * progressCallback,
+                                                         Array * extraHeaders, ErrorCode * pError)
 {
+    // Capabilities are needed to know whether the chunks can be pipelined.
+    selectIfNeeded(folder, pError);
+    if (* pError != ErrorNone)
+        return NULL;
+    
+    // When pipelined, the chunks are sent by fetchMessages() itself. It's not possible
+    // for CHANGEDSINCE fetches.
+    bool pipelined = (mFetchPipelineDepth > 1) && ((modseq == 0) || (!mCondstoreEnabled && !mQResyncEnabled));
     struct mailimap_set * imapset = setFromIndexSet(uids);
-    IMAPSyncResult * syncResult = fetchMessages(folder, requestKind, true, imapset, uids, NULL, 0, NULL,
+    clist * setList = NULL;
+    if ((mFetchChunkSize > 0) && !pipelined) {
+        setList = splitSetByIndexesCount(imapset, mFetchChunkSize);
+        if (clist_count(setList) <= 1) {
+            if (clist_begin(setList) != NULL) {
+                mailimap_set_free((struct mailimap_set *) clist_content(clist_begin(setList)));
+            }
+            clist_free(setList);
+            setList = NULL;
+        }
+    }
+    
+    if (setList == NULL) {
+        IMAPSyncResult * result = fetchMessages(folder, requestKind, true, imapset, uids, NULL, modseq, NULL,
                                                 progressCallback, extraHeaders, pError);
-    if (syncResult == NULL) {
         mailimap_set_free(imapset);
-        return NULL;
+        return result;
     }
-    Array * result = syncResult->modifiedOrAddedMessages();
-    result->retain()->autorelease();
+    
+    Array * messages = Array::array();
+    IndexSet * vanishedMessages = NULL;
+    ChunkedFetchProgressCallback chunkProgressCallback(progressCallback);
+    
+    * pError = ErrorNone;
+    for(clistiter * iter = clist_begin(setList) ; iter != NULL ; iter = clist_next(iter)) {
+        struct mailimap_set * current_set;
+        
+        current_set = (struct mailimap_set *) clist_content(iter);
+        IMAPSyncResult * chunkResult = fetchMessages(folder, requestKind, true, current_set, uids, NULL, modseq, NULL,
+                                                     progressCallback != NULL ? &chunkProgressCallback : NULL,
+                                                     extraHeaders, pError);
+        if (* pError != ErrorNone) {
+            break;
+        }
+        chunkProgressCallback.nextChunk();
+        
+        if (chunkResult->modifiedOrAddedMessages() != NULL) {
+            messages->addObjectsFromArray(chunkResult->modifiedOrAddedMessages());
+        }
+        if (chunkResult->vanishedMessages() != NULL) {
+            if (vanishedMessages == NULL) {
+                vanishedMessages = IndexSet::indexSet();
+            }
+            vanishedMessages->addIndexSet(chunkResult->vanishedMessages());
+        }
+    }
+    
+    for(clistiter * iter = clist_begin(setList) ; iter != NULL ; iter = clist_next(iter)) {
+        struct mailimap_set * current_set;
+        
+        current_set = (struct mailimap_set *) clist_content(iter);
+        mailimap_set_free(current_set);
+    }
+    clist_free(setList);
     mailimap_set_free(imapset);
+    
+    if (* pError != ErrorNone) {
+        return NULL;
+    }
+    
+    IMAPSyncResult * result;
+    result = new IMAPSyncResult();
+    result->setModifiedOrAddedMessages(messages);
+    result->setVanishedMessages(vanishedMessages);
+    result->autorelease();
+    
+    return result;
+}
+
+Array * IMAPSession::fetchMessagesByUID(String * folder, IMAPMessagesRequestKind requestKind,
+                                        IndexSet * uids, IMAPProgressCallback * progressCallback, ErrorCode * pError)
+{
+    return fetchMessagesByUIDWithExtraHeaders(folder, requestKind, uids, progressCallback, NULL, pError);
+}
+
+
+Array * IMAPSession::fetchMessagesByUIDWithExtraHeaders(String * folder, IMAPMessagesRequestKind requestKind,
+                                                        IndexSet * uids, IMAPProgressCallback * progressCallback,
+                                                        Array * extraHeaders, ErrorCode * pError)
+{
+    IMAPSyncResult * syncResult = fetchMessagesByUIDInChunks(folder, requestKind, uids, 0,
+                                                             progressCallback, extraHeaders, pError);
+    if (syncResult == NULL) {
+        return NULL;
+    }
+    Array * result = syncResult->modifiedOrAddedMessages();
+    result->retain()->autorelease();
     return result;
 }
 
@@ -2462,6 +3009,225 @@ Array * IMAPSession::fetchMessagesByNumberWithExtraHeaders(String * folder, IMAP
     return result;
 }
 
+IndexSet * IMAPSession::streamMessagesByUID(String * folder, IMAPMessagesRequestKind requestKind,
+                                            IndexSet * uids, uint64_t modseq, unsigned int batchSize,
+                                            IMAPFetchMessagesCallback * fetchCallback,
+                                            IMAPProgressCallback * progressCallback,
+                                            Array * extraHeaders, ErrorCode * pError)
+{
+    MCAssert(fetchCallback != NULL);
+    
+    mFetchMessagesCallback = fetchCallback;
+    mFetchMessagesBatchSize = batchSize > 0 ? batchSize : 1;
+    IMAPSyncResult * syncResult = fetchMessagesByUIDInChunks(folder, requestKind, uids, modseq,
+                                                             progressCallback, extraHeaders, pError);
+    mFetchMessagesCallback = NULL;
+    mFetchMessagesBatchSize = 0;
+    if (syncResult == NULL) {
+        return NULL;
+    }
+    return syncResult->vanishedMessages();
+}
+
+void IMAPSession::streamMessagesByNumber(String * folder, IMAPMessagesRequestKind requestKind,
+                                         IndexSet * numbers, unsigned int batchSize,
+                                         IMAPFetchMessagesCallback * fetchCallback,
+                                         IMAPProgressCallback * progressCallback,
+                                         Array * extraHeaders, ErrorCode * pError)
+{
+    MCAssert(fetchCallback != NULL);
+    
+    mFetchMessagesCallback = fetchCallback;
+    mFetchMessagesBatchSize = batchSize > 0 ? batchSize : 1;
+    struct mailimap_set * imapset = setFromIndexSet(numbers);
+    fetchMessages(folder, requestKind, false, imapset, NULL, numbers, 0, NULL,
+                  progressCallback, extraHeaders, pError);
+    mailimap_set_free(imapset);
+    mFetchMessagesCallback = NULL;
+    mFetchMessagesBatchSize = 0;
+}
+
+// The fetched bodies are handed to Data without copying them.
+static void nstring_deallocator(char * bytes)
+{
+    mailimap_nstring_free(bytes);
+}
+
+// Section of the part, "1.2" for example, or of the whole message when partID is NULL.
+static struct mailimap_section * section_from_part_id(String * partID)
+{
+    if (partID == NULL) {
+        return mailimap_section_new(NULL);
+    }
+    
+    Array * partIDArray = partID->componentsSeparatedByString(MCSTR("."));
+    clist * sec_list = clist_new();
+    for(unsigned int i = 0 ; i < partIDArray->count() ; i ++) {
+        uint32_t * value;
+        String * element;
+        
+        element = (String *) partIDArray->objectAtIndex(i);
+        value = (uint32_t *) malloc(sizeof(* value));
+        * value = element->intValue();
+        clist_append(sec_list, value);
+    }
+    struct mailimap_section_part * section_part = mailimap_section_part_new(sec_list);
+    return mailimap_section_new_part(section_part);
+}
+
+struct body_msg_att_handler_data {
+    IMAPSession * session;
+    String * partID;
+    IMAPFetchMessagesCallback * fetchCallback;
+    IMAPProgressCallback * progressCallback;
+    unsigned int itemsCount;
+    unsigned int maximum;
+};
+
+// Passes each body to the callback as soon as its response has been parsed.
+static void body_msg_att_handler(struct mailimap_msg_att * msg_att, void * context)
+{
+    struct body_msg_att_handler_data * body_context;
+    uint32_t uid;
+    char * text;
+    size_t text_length;
+    
+    body_context = (struct body_msg_att_handler_data *) context;
+    uid = 0;
+    text = NULL;
+    text_length = 0;
+    for(clistiter * cur = clist_begin(msg_att->att_list) ; cur != NULL ; cur = clist_next(cur)) {
+        struct mailimap_msg_att_item * att_item = (struct mailimap_msg_att_item *) clist_content(cur);
+        if (att_item->att_type != MAILIMAP_MSG_ATT_ITEM_STATIC) {
+            continue;
+        }
+        if (att_item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_UID) {
+            uid = att_item->att_data.att_static->att_data.att_uid;
+        }
+        else if (att_item->att_data.att_static->att_type == MAILIMAP_MSG_ATT_BODY_SECTION) {
+            struct mailimap_msg_att_body_section * body_section = att_item->att_data.att_static->att_data.att_body_section;
+            if ((text == NULL) && (body_section->sec_body_part != NULL)) {
+                text = body_section->sec_body_part;
+                text_length = body_section->sec_length;
+                body_section->sec_body_part = NULL;
+            }
+        }
+    }
+    
+    if (text != NULL) {
+        if (uid != 0) {
+            AutoreleasePool * pool = new AutoreleasePool();
+            Data * data = Data::data();
+            data->takeBytesOwnership(text, (unsigned int) text_length, nstring_deallocator);
+            body_context->fetchCallback->bodyFetched(body_context->session, uid, body_context->partID, data);
+            if (body_context->progressCallback != NULL) {
+                body_context->itemsCount ++;
+                // Messages might have been added to the folder since it was selected.
+                if (body_context->itemsCount > body_context->maximum) {
+                    body_context->maximum = body_context->itemsCount;
+                }
+                body_context->progressCallback->itemsProgress(body_context->session, body_context->itemsCount, body_context->maximum);
+            }
+            pool->release();
+        }
+        else {
+            mailimap_nstring_free(text);
+        }
+    }
+    
+    // The body has been delivered, it doesn't need to be kept until the end of the command.
+    release_msg_att_items(msg_att);
+}
+
+void IMAPSession::streamMessageBodiesByUID(String * folder, IndexSet * uids, String * partID,
+                                           IMAPFetchMessagesCallback * fetchCallback,
+                                           IMAPProgressCallback * progressCallback, ErrorCode * pError)
+{
+    struct mailimap_fetch_type * fetch_type;
+    struct mailimap_fetch_att * fetch_att;
+    struct mailimap_set * imapset;
+    struct body_msg_att_handler_data body_context;
+    clist * setList;
+    int r;
+    
+    MCAssert(fetchCallback != NULL);
+    
+    selectIfNeeded(folder, pError);
+    if (* pError != ErrorNone)
+        return;
+    
+    fetch_type = mailimap_fetch_type_new_fetch_att_list_empty();
+    fetch_att = mailimap_fetch_att_new_uid();
+    mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
+    fetch_att = mailimap_fetch_att_new_body_peek_section(section_from_part_id(partID));
+    mailimap_fetch_type_new_fetch_att_list_add(fetch_type, fetch_att);
+    
+    body_context.session = this;
+    body_context.partID = partID;
+    body_context.fetchCallback = fetchCallback;
+    // The items progress is reported for each body delivered, against the number of messages requested.
+    // An open range such as 1:* doesn't count its UIDs, it can't match more messages than the folder has.
+    body_context.progressCallback = progressCallback;
+    body_context.itemsCount = 0;
+    body_context.maximum = uids->count();
+    if (mFolderMsgCount != (unsigned int) -1) {
+        if ((body_context.maximum == 0) || (body_context.maximum > mFolderMsgCount)) {
+            body_context.maximum = mFolderMsgCount;
+        }
+    }
+    mailimap_set_msg_att_handler(mImap, body_msg_att_handler, &body_context);
+    
+    mBodyProgressEnabled = false;
+    
+    imapset = setFromIndexSet(uids);
+    setList = NULL;
+    if (mFetchChunkSize > 0) {
+        setList = splitSetByIndexesCount(imapset, mFetchChunkSize);
+    }
+    else {
+        setList = clist_new();
+        clist_append(setList, imapset);
+        imapset = NULL;
+    }
+    
+    r = MAILIMAP_NO_ERROR;
+    for(clistiter * iter = clist_begin(setList) ; iter != NULL ; iter = clist_next(iter)) {
+        struct mailimap_set * current_set = (struct mailimap_set *) clist_content(iter);
+        clist * fetch_result = NULL;
+        
+        if (r == MAILIMAP_NO_ERROR) {
+            r = mailimap_uid_fetch(mImap, current_set, fetch_type, &fetch_result);
+            if (r == MAILIMAP_NO_ERROR) {
+                mailimap_fetch_list_free(fetch_result);
+            }
+        }
+        mailimap_set_free(current_set);
+    }
+    clist_free(setList);
+    if (imapset != NULL) {
+        mailimap_set_free(imapset);
+    }
+    
+    mBodyProgressEnabled = true;
+    mailimap_set_msg_att_handler(mImap, NULL, NULL);
+    mailimap_fetch_type_free(fetch_type);
+    
+    if (r == MAILIMAP_ERROR_STREAM) {
+        mShouldDisconnect = true;
+        * pError = ErrorConnection;
+        return;
+    }
+    else if (r == MAILIMAP_ERROR_PARSE) {
+        * pError = ErrorParse;
+        return;
+    }
+    else if (hasError(r)) {
+        * pError = ErrorFetch;
+        return;
+    }
+    * pError = ErrorNone;
+}
+
 static int fetch_rfc822(mailimap * session, bool identifier_is_uid,
                         uint32_t identifier, char ** result, size_t * result_len)
 {
@@ -2574,13 +3340,8 @@ Data * IMAPSession::fetchMessage(String * folder, bool identifier_is_uid, uint32
     rfc822 = NULL;
     r = fetch_rfc822(mImap, identifier_is_uid, identifier, &rfc822, &rfc822_len);
     if (r == MAILIMAP_NO_ERROR) {
-        size_t len;
-        
-        len = 0;
-        if (rfc822 != NULL) {
-            len = strlen(rfc822);
-        }
-        bodyProgress((unsigned int) len, (unsigned int) len);
+        // Length of the literal sent by the server, the message might contain NUL characters.
+        bodyProgress((unsigned int) rfc822_len, (unsigned int) rfc822_len);
     }
     mProgressCallback = NULL;
     
@@ -2598,29 +3359,143 @@ Data * IMAPSession::fetchMessage(String * folder, bool identifier_is_uid, uint32
         return NULL;
     }
     
-    if (rfc822 == NULL) {
-        data = Data::data();
+    data = Data::data();
+    if (rfc822 != NULL) {
+        data->takeBytesOwnership(rfc822, (unsigned int) rfc822_len, nstring_deallocator);
+    }
+    * pError = ErrorNone;
+    
+    return data;
+}
+
+// Fetches the BINARY[...] item of a single message.
+static int fetch_binary(mailimap * imap, bool identifier_is_uid, uint32_t identifier,
+                        struct mailimap_fetch_type * fetch_type,
+                        char ** result, size_t * result_len)
+{
+    int r;
+    clist * fetch_result;
+    struct mailimap_set * set;
+    bool found;
+    
+    set = mailimap_set_new_single(identifier);
+    if (identifier_is_uid) {
+        r = mailimap_uid_fetch(imap, set, fetch_type, &fetch_result);
     }
     else {
-        data = Data::dataWithBytes(rfc822, (unsigned int) rfc822_len);
+        r = mailimap_fetch(imap, set, fetch_type, &fetch_result);
     }
+    mailimap_set_free(set);
+    if (r != MAILIMAP_NO_ERROR)
+        return r;
+    
+    found = false;
+    for(clistiter * iter = clist_begin(fetch_result) ; iter != NULL ; iter = clist_next(iter)) {
+        struct mailimap_msg_att * msg_att = (struct mailimap_msg_att *) clist_content(iter);
+        for(clistiter * cur = clist_begin(msg_att->att_list) ; cur != NULL ; cur = clist_next(cur)) {
+            struct mailimap_msg_att_item * att_item = (struct mailimap_msg_att_item *) clist_content(cur);
+            if (att_item->att_type != MAILIMAP_MSG_ATT_ITEM_EXTENSION) {
+                continue;
+            }
+            struct mailimap_extension_data * ext_data = att_item->att_data.att_extension_data;
+            if ((ext_data->ext_extension != &imap_extension_binary) || (ext_data->ext_type != IMAP_BINARY_TYPE_SECTION)) {
+                continue;
+            }
+            
+            struct imap_binary_msg_att * binary_att = (struct imap_binary_msg_att *) ext_data->ext_data;
+            if (binary_att->att_body_part == NULL) {
+                continue;
+            }
+            * result = binary_att->att_body_part;
+            * result_len = binary_att->att_length;
+            binary_att->att_body_part = NULL;
+            found = true;
+            break;
+        }
+        if (found)
+            break;
+    }
+    mailimap_fetch_list_free(fetch_result);
     
-    mailimap_nstring_free(rfc822);
-    * pError = ErrorNone;
+    if (!found)
+        return MAILIMAP_ERROR_FETCH;
+    
+    return MAILIMAP_NO_ERROR;
+}
+
+Data * IMAPSession::fetchMessageAttachmentBinaryData(String * folder, bool identifier_is_uid,
+                                                     uint32_t identifier, String * partID,
+                                                     IMAPProgressCallback * progressCallback, ErrorCode * pError)
+{
+    struct mailimap_fetch_type * fetch_type;
+    int r;
+    char * text = NULL;
+    size_t text_length = 0;
+    
+    selectIfNeeded(folder, pError);
+    if (* pError != ErrorNone)
+        return NULL;
     
+    mProgressItemsCount = 0;
+    mProgressCallback = progressCallback;
+    bodyProgress(0, 0);
+    
+    fetch_type = mailimap_fetch_type_new_fetch_att(imap_fetch_att_new_binary_peek(MCUTF8(partID)));
+    r = fetch_binary(mImap, identifier_is_uid, identifier, fetch_type, &text, &text_length);
+    mailimap_fetch_type_free(fetch_type);
+    
+    mProgressCallback = NULL;
+    
+    if (r == MAILIMAP_ERROR_STREAM) {
+        mShouldDisconnect = true;
+        * pError = ErrorConnection;
+        return NULL;
+    }
+    else if (r == MAILIMAP_ERROR_PARSE) {
+        * pError = ErrorParse;
+        return NULL;
+    }
+    else if (hasError(r)) {
+        * pError = ErrorFetch;
+        return NULL;
+    }
+    
+    Data * data = Data::data();
+    data->takeBytesOwnership(text, (unsigned int) text_length, nstring_deallocator);
+    * pError = ErrorNone;
     return data;
 }
 
 Data * IMAPSession::fetchMessageAttachment(String * folder, bool identifier_is_uid,
                                            uint32_t identifier, String * partID,
                                            Encoding encoding, IMAPProgressCallback * progressCallback, ErrorCode * pError)
+{
+    // Only the server can save the bytes of the transfer encoding.
+    if (mBinaryEnabled && ((encoding == EncodingBase64) || (encoding == EncodingQuotedPrintable))) {
+        Data * data = fetchMessageAttachmentBinaryData(folder, identifier_is_uid, identifier, partID,
+                                                       progressCallback, pError);
+        // Otherwise, the server could not decode the part, with an UNKNOWN-CTE response code
+        // for example: it's decoded here.
+        if (* pError != ErrorFetch)
+            return data;
+    }
+    
+    Data * data = fetchMessageAttachmentData(folder, identifier_is_uid, identifier, partID,
+                                             false, 0, 0, progressCallback, pError);
+    if (* pError != ErrorNone)
+        return NULL;
+    
+    return data->decodedDataUsingEncoding(encoding);
+}
+
+Data * IMAPSession::fetchMessageAttachmentData(String * folder, bool identifier_is_uid,
+                                               uint32_t identifier, String * partID,
+                                               bool partial, uint32_t offset, uint32_t length,
+                                               IMAPProgressCallback * progressCallback, ErrorCode * pError)
 {
     struct mailimap_fetch_type * fetch_type;
     struct mailimap_fetch_att * fetch_att;
     struct mailimap_section * section;
-    struct mailimap_section_part * section_part;
-    clist * sec_list;
-    Array * partIDArray;
     int r;
     char * text = NULL;
     size_t text_length = 0;
@@ -2634,20 +3509,13 @@ Data * IMAPSession::fetchMessageAttachment(String * folder, bool identifier_is_u
     mProgressCallback = progressCallback;
     bodyProgress(0, 0);
     
-    partIDArray = partID->componentsSeparatedByString(MCSTR("."));
-    sec_list = clist_new();
-    for(unsigned int i = 0 ; i < partIDArray->count() ; i ++) {
-        uint32_t * value;
-        String * element;
-        
-        element = (String *) partIDArray->objectAtIndex(i);
-        value = (uint32_t *) malloc(sizeof(* value));
-        * value = element->intValue();
-        clist_append(sec_list, value);
+    section = section_from_part_id(partID);
+    if (partial) {
+        fetch_att = mailimap_fetch_att_new_body_peek_section_partial(section, offset, length);
+    }
+    else {
+        fetch_att = mailimap_fetch_att_new_body_peek_section(section);
     }
-    section_part = mailimap_section_part_new(sec_list);
-    section = mailimap_section_new_part(section_part);
-    fetch_att = mailimap_fetch_att_new_body_peek_section(section);
     fetch_type = mailimap_fetch_type_new_fetch_att(fetch_att);
     
     r = fetch_imap(mImap, identifier_is_uid, identifier, fetch_type, &text, &text_length);
@@ -2670,10 +3538,11 @@ Data * IMAPSession::fetchMessageAttachment(String * folder, bool identifier_is_u
         return NULL;
     }
 
-    data = Data::dataWithBytes(text, (unsigned int) text_length);
-    data = data->decodedDataUsingEncoding(encoding);
-    
-    mailimap_nstring_free(text);
+    data = Data::data();
+    // A range starting after the end of the part can be returned as NIL.
+    if (text != NULL) {
+        data->takeBytesOwnership(text, (unsigned int) text_length, nstring_deallocator);
+    }
     * pError = ErrorNone;
     
     return data;
@@ -2691,6 +3560,13 @@ Data * IMAPSession::fetchMessageAttachmentByNumber(String * folder, uint32_t num
     return fetchMessageAttachment(folder, false, number, partID, encoding, progressCallback, pError);
 }
 
+Data * IMAPSession::fetchMessageAttachmentRangeByUID(String * folder, uint32_t uid, String * partID,
+                                                     uint32_t offset, uint32_t length,
+                                                     IMAPProgressCallback * progressCallback, ErrorCode * pError)
+{
+    return fetchMessageAttachmentData(folder, true, uid, partID, true, offset, length, progressCallback, pError);
+}
+
 IndexSet * IMAPSession::search(String * folder, IMAPSearchKind kind, String * searchString, ErrorCode * pError)
 {
     IMAPSearchExpression * expr;
@@ -3078,13 +3954,35 @@ bool IMAPSession::setupIdle()
 }
 
 void IMAPSession::idle(String * folder, uint32_t lastKnownUID, ErrorCode * pError)
+{
+    // connection thread
+    if (!enterIdle(folder, lastKnownUID, pError))
+        return;
+    
+    if (!hasIdleData()) {
+        int r;
+        r = waitIdle();
+        idleWaitFinished(r, pError);
+        if (* pError != ErrorNone)
+            return;
+    }
+    else {
+        MCLog("found info before idling");
+    }
+    
+    leaveIdle(pError);
+}
+
+bool IMAPSession::enterIdle(String * folder, uint32_t lastKnownUID, ErrorCode * pError)
 {
     int r;
     
-    // connection thread
+    MC_SAFE_RELEASE(mIdleChanges);
+    mIdleChanges = new IMAPIdleChanges();
+    
     selectIfNeeded(folder, pError);
     if (* pError != ErrorNone)
-        return;
+        return false;
     
     if (lastKnownUID != 0) {
         Array * msgs;
@@ -3092,61 +3990,103 @@ void IMAPSession::idle(String * folder, uint32_t lastKnownUID, ErrorCode * pErro
         msgs = fetchMessagesByUID(folder, IMAPMessagesRequestKindUid, IndexSet::indexSetWithRange(RangeMake(lastKnownUID, UINT64_MAX)),
                                   NULL, pError);
         if (* pError != ErrorNone)
-            return;
+            return false;
         if (msgs->count() > 0) {
             IMAPMessage * msg;
             
             msg = (IMAPMessage *) msgs->objectAtIndex(0);
             if (msg->uid() > lastKnownUID) {
                 MCLog("found msg UID %u %u", (unsigned int) msg->uid(), (unsigned int) lastKnownUID);
-                return;
+                return false;
             }
         }
     }
     
     r = mailimap_idle(mImap);
+    collectIdleChanges();
     if (r == MAILIMAP_ERROR_STREAM) {
         mShouldDisconnect = true;
         * pError = ErrorConnection;
-        return;
+        return false;
     }
     else if (r == MAILIMAP_ERROR_PARSE) {
         * pError = ErrorParse;
-        return;
+        return false;
     }
     else if (hasError(r)) {
         * pError = ErrorIdle;
-        return;
+        return false;
     }
+    * pError = ErrorNone;
+    return true;
+}
+
+bool IMAPSession::hasIdleData()
+{
+    // Changes might also have been read along with the continuation request.
+    if (mImap->imap_selection_info->sel_has_exists || mImap->imap_selection_info->sel_has_recent ||
+        (mImap->imap_stream->read_buffer_len > 0))
+        return true;
     
-    if (!mImap->imap_selection_info->sel_has_exists && !mImap->imap_selection_info->sel_has_recent) {
-        int r;
-        r = mailstream_wait_idle(mImap->imap_stream, MAX_IDLE_DELAY);
-        switch (r) {
-            case MAILSTREAM_IDLE_ERROR:
-            case MAILSTREAM_IDLE_CANCELLED:
-            {
-                mShouldDisconnect = true;
-                * pError = ErrorConnection;
-                MCLog("error or cancelled");
-                return;
-            }
-            case MAILSTREAM_IDLE_INTERRUPTED:
-                MCLog("interrupted by user");
-                break;
-            case MAILSTREAM_IDLE_HASDATA:
-                MCLog("something on the socket");
-                break;
-            case MAILSTREAM_IDLE_TIMEOUT:
-                MCLog("idle timeout");
-                break;
+    // The TLS and COMPRESS layers decode what they read from the socket in blocks. When the last read
+    // filled the buffer of the stream, they might hold decoded bytes that polling the socket wouldn't notice.
+    mailstream_low * low = mailstream_get_low(mImap->imap_stream);
+    return (low->driver != mailstream_socket_driver) && mLastReadFilledBuffer;
+}
+
+int IMAPSession::idleFileDescriptor()
+{
+    if ((mImap == NULL) || (mImap->imap_stream == NULL))
+        return -1;
+    // The TLS and COMPRESS drivers return the socket they're reading from.
+    return mailstream_low_get_fd(mailstream_get_low(mImap->imap_stream));
+}
+
+int IMAPSession::waitIdle()
+{
+    return mailstream_wait_idle(mImap->imap_stream, MAX_IDLE_DELAY);
+}
+
+void IMAPSession::dataReceived(size_t length)
+{
+    mLastReadFilledBuffer = (mImap->imap_stream != NULL) && (length >= mImap->imap_stream->buffer_max_size);
+}
+
+double IMAPSession::idleTimeout()
+{
+    return MAX_IDLE_DELAY;
+}
+
+void IMAPSession::idleWaitFinished(int result, ErrorCode * pError)
+{
+    switch (result) {
+        case MAILSTREAM_IDLE_ERROR:
+        case MAILSTREAM_IDLE_CANCELLED:
+        {
+            mShouldDisconnect = true;
+            * pError = ErrorConnection;
+            MCLog("error or cancelled");
+            return;
         }
+        case MAILSTREAM_IDLE_INTERRUPTED:
+            MCLog("interrupted by user");
+            break;
+        case MAILSTREAM_IDLE_HASDATA:
+            MCLog("something on the socket");
+            break;
+        case MAILSTREAM_IDLE_TIMEOUT:
+            MCLog("idle timeout");
+            break;
     }
-    else {
-        MCLog("found info before idling");
-    }
+    * pError = ErrorNone;
+}
+
+void IMAPSession::leaveIdle(ErrorCode * pError)
+{
+    int r;
     
     r = mailimap_idle_done(mImap);
+    collectIdleChanges();
     if (r == MAILIMAP_ERROR_STREAM) {
         mShouldDisconnect = true;
         * pError = ErrorConnection;
@@ -3163,6 +4103,65 @@ void IMAPSession::idle(String * folder, uint32_t lastKnownUID, ErrorCode * pErro
     * pError = ErrorNone;
 }
 
+// Gathers the untagged responses received while idling. They're removed from the response info
+// once collected, so that they're not reported twice.
+void IMAPSession::collectIdleChanges()
+{
+    if ((mIdleChanges == NULL) || (mImap == NULL))
+        return;
+    
+    if ((mImap->imap_selection_info != NULL) && mImap->imap_selection_info->sel_has_exists) {
+        mIdleChanges->setMessagesCount(mImap->imap_selection_info->sel_exists);
+        mIdleChanges->setHasMessagesCount(true);
+    }
+    
+    struct mailimap_response_info * response_info = mImap->imap_response_info;
+    if (response_info == NULL)
+        return;
+    
+    if (response_info->rsp_expunged != NULL) {
+        clistiter * cur = clist_begin(response_info->rsp_expunged);
+        while (cur != NULL) {
+            uint32_t * number = (uint32_t *) clist_content(cur);
+            mIdleChanges->expungedSequenceNumbers()->addObject(Value::valueWithUnsignedIntValue(* number));
+            free(number);
+            cur = clist_delete(response_info->rsp_expunged, cur);
+        }
+    }
+    
+    if (response_info->rsp_fetch_list != NULL) {
+        clistiter * cur = clist_begin(response_info->rsp_fetch_list);
+        while (cur != NULL) {
+            struct mailimap_msg_att * msg_att = (struct mailimap_msg_att *) clist_content(cur);
+            mIdleChanges->modifiedMessages()->addObject(flags_message_from_msg_att(msg_att));
+            mailimap_msg_att_free(msg_att);
+            cur = clist_delete(response_info->rsp_fetch_list, cur);
+        }
+    }
+    
+    if (response_info->rsp_extension_list != NULL) {
+        clistiter * cur = clist_begin(response_info->rsp_extension_list);
+        while (cur != NULL) {
+            struct mailimap_extension_data * ext_data = (struct mailimap_extension_data *) clist_content(cur);
+            if ((ext_data->ext_extension->ext_id != MAILIMAP_EXTENSION_QRESYNC) ||
+                (ext_data->ext_type != MAILIMAP_QRESYNC_TYPE_VANISHED)) {
+                cur = clist_next(cur);
+                continue;
+            }
+            
+            struct mailimap_qresync_vanished * vanished = (struct mailimap_qresync_vanished *) ext_data->ext_data;
+            mIdleChanges->vanishedMessages()->addIndexSet(indexSetFromSet(vanished->qr_known_uids));
+            mailimap_extension_data_free(ext_data);
+            cur = clist_delete(response_info->rsp_extension_list, cur);
+        }
+    }
+}
+
+IMAPIdleChanges * IMAPSession::idleChanges()
+{
+    return mIdleChanges;
+}
+
 void IMAPSession::interruptIdle()
 {
     // main thread
@@ -3622,13 +4621,8 @@ IMAPSyncResult * IMAPSession::syncMessagesByUIDWithExtraHeaders(String * folder,
                                                 IMAPProgressCallback * progressCallback, Array * extraHeaders,
                                                 ErrorCode * pError)
 {
-    struct mailimap_set * imapset = setFromIndexSet(uids);
-    IMAPSyncResult * result = fetchMessages(folder, requestKind, true, imapset,
-                                            uids, NULL,
-                                            modseq, NULL,
-                                            progressCallback, extraHeaders, pError);
-    mailimap_set_free(imapset);
-    return result;
+    return fetchMessagesByUIDInChunks(folder, requestKind, uids, modseq,
+                                      progressCallback, extraHeaders, pError);
 
 }
 
@@ -3714,6 +4708,9 @@ void IMAPSession::capabilitySetWithSessionState(IndexSet * capabilities)
     if (mailimap_has_extension(mImap, (char *)"CHILDREN")) {
         capabilities->addIndex(IMAPCapabilityChildren);
     }
+    if (mailimap_has_extension(mImap, (char *)"BINARY")) {
+        capabilities->addIndex(IMAPCapabilityBinary);
+    }
 
     applyCapabilities(capabilities);
 }
@@ -3739,6 +4736,9 @@ void IMAPSession::applyCapabilities(IndexSet * capabilities)
     if (capabilities->containsIndex(IMAPCapabilityQResync)) {
         mQResyncEnabled = true;
     }
+    if (capabilities->containsIndex(IMAPCapabilityBinary)) {
+        mBinaryEnabled = true;
+    }
     if (capabilities->containsIndex(IMAPCapabilityXOAuth2)) {
         mXOauth2Enabled = true;
     }
@@ -3770,6 +4770,11 @@ bool IMAPSession::isQResyncEnabled()
     return mQResyncEnabled;
 }
 
+bool IMAPSession::isBinaryEnabled()
+{
+    return mBinaryEnabled;
+}
+
 bool IMAPSession::isIdentityEnabled()
 {
     return mIdentityEnabled;
@@ -3799,6 +4804,13 @@ bool IMAPSession::isDisconnected()
     return mState == STATE_DISCONNECTED;
 }
 
+String * IMAPSession::selectedFolder()
+{
+    if (mState != STATE_SELECTED)
+        return NULL;
+    return mCurrentFolder;
+}
+
 void IMAPSession::setConnectionLogger(ConnectionLogger * logger)
 {
     mConnectionLogger = logger;
@@ -3877,6 +4889,49 @@ String * IMAPSession::plainTextBodyRendering(IMAPMessage * message, String * fol
     return plainTextBodyString;
 }
 
+String * IMAPSession::plainTextPreview(IMAPMessage * message, String * folder, unsigned int maximumLength, ErrorCode * pError)
+{
+    MCAssert(folder != NULL);
+    AbstractPart * part = HTMLRenderer::previewPartForMessage(message);
+    if ((part == NULL) || !part->className()->isEqual(MCSTR("mailcore::IMAPPart"))) {
+        * pError = ErrorNone;
+        return MCSTR("");
+    }
+    IMAPPart * imapPart = (IMAPPart *) part;
+    
+    // Fetches the beginning of the part, then twice as much, until there's enough text.
+    Data * encodedData = Data::data();
+    uint32_t length = HTMLRenderer::previewInitialLength(maximumLength);
+    while (1) {
+        Data * range = fetchMessageAttachmentRangeByUID(folder, message->uid(), imapPart->partID(),
+                                                        encodedData->length(), length, NULL, pError);
+        if (* pError != ErrorNone) {
+            return NULL;
+        }
+        encodedData->appendData(range);
+        bool truncated = (range->length() == length);
+        
+        Data * encodedPrefix = encodedData;
+        if (truncated && (imapPart->encoding() == EncodingQuotedPrintable)) {
+            // Leaves out an escape sequence cut in the middle.
+            unsigned int prefixLength = encodedData->length();
+            const char * bytes = encodedData->bytes();
+            for(unsigned int i = 1 ; (i <= 2) && (i <= encodedData->length()) ; i ++) {
+                if (bytes[encodedData->length() - i] == '=') {
+                    prefixLength = encodedData->length() - i;
+                }
+            }
+            encodedPrefix = Data::dataWithBytes(bytes, prefixLength);
+        }
+        Data * data = encodedPrefix->decodedDataUsingEncoding(imapPart->encoding());
+        String * preview = HTMLRenderer::previewForPartData(part, data, truncated, maximumLength);
+        if (!truncated || (preview->length() >= maximumLength)) {
+            return preview;
+        }
+        length = encodedData->length();
+    }
+}
+
 void IMAPSession::setAutomaticConfigurationEnabled(bool enabled)
 {
     mAutomaticConfigurationEnabled = enabled;
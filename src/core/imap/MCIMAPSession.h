@@ -18,9 +18,11 @@ namespace mailcore {
     class IMAPSearchExpression;
     class IMAPFolder;
     class IMAPProgressCallback;
+    class IMAPFetchMessagesCallback;
     class IMAPSyncResult;
     class IMAPFolderStatus;
     class IMAPIdentity;
+    class IMAPIdleChanges;
     
     class MAILCORE_EXPORT IMAPSession : public Object {
     public:
@@ -59,6 +61,16 @@ namespace mailcore {
         virtual void setVoIPEnabled(bool enabled);
         virtual bool isVoIPEnabled();
         
+        // When not zero, fetching messages by UID issues several FETCH commands covering
+        // at most chunkSize messages each instead of a single one. Default is 0.
+        virtual void setFetchChunkSize(unsigned int chunkSize);
+        virtual unsigned int fetchChunkSize();
+        
+        // With a chunk size, number of FETCH commands sent before waiting for the response of the
+        // first one. Default is 1: each command waits for the previous one to complete.
+        virtual void setFetchPipelineDepth(unsigned int depth);
+        virtual unsigned int fetchPipelineDepth();
+        
         // Needed for fetchSubscribedFolders() and fetchAllFolders().
         virtual void setDefaultNamespace(IMAPNamespace * ns);
         virtual IMAPNamespace * defaultNamespace();
@@ -67,6 +79,12 @@ namespace mailcore {
         virtual IMAPIdentity * clientIdentity();
         
         virtual void select(String * folder, ErrorCode * pError);
+        // Selects the folder and gets the changes since modSequenceValue in the same round trip
+        // when QRESYNC is enabled. Otherwise, the changes are fetched after selecting the folder.
+        // knownUIDs can be NULL. When uidValidity() doesn't match anymore, no changes are
+        // returned and the folder needs to be fully synchronized again.
+        virtual IMAPSyncResult * selectWithQResync(String * folder, uint32_t uidValidity, uint64_t modSequenceValue,
+                                                   IndexSet * knownUIDs, ErrorCode * pError);
         virtual IMAPFolderStatus * folderStatus(String * folder, ErrorCode * pError);
         
         virtual Array * /* IMAPFolder */ fetchSubscribedFolders(ErrorCode * pError);
@@ -108,6 +126,28 @@ namespace mailcore {
                                                                                 IMAPProgressCallback * progressCallback,
                                                                                 Array * extraHeaders, ErrorCode * pError);
 
+        /* Messages are passed to the callback in batches of at most batchSize messages while they are
+           received instead of being returned all at once. Returns the vanished messages when QRESYNC
+           is available and modseq is not zero. */
+        virtual IndexSet * streamMessagesByUID(String * folder, IMAPMessagesRequestKind requestKind,
+                                               IndexSet * uids, uint64_t modseq, unsigned int batchSize,
+                                               IMAPFetchMessagesCallback * fetchCallback,
+                                               IMAPProgressCallback * progressCallback,
+                                               Array * extraHeaders, ErrorCode * pError);
+        virtual void streamMessagesByNumber(String * folder, IMAPMessagesRequestKind requestKind,
+                                            IndexSet * numbers, unsigned int batchSize,
+                                            IMAPFetchMessagesCallback * fetchCallback,
+                                            IMAPProgressCallback * progressCallback,
+                                            Array * extraHeaders, ErrorCode * pError);
+        
+        /* Fetches the bodies of the messages with a single FETCH command, or one per fetchChunkSize()
+           messages. Each body is passed to IMAPFetchMessagesCallback::bodyFetched() as soon as it has been
+           received and is not kept afterwards. The whole messages are fetched when partID is NULL.
+           The items progress counts the bodies received. */
+        virtual void streamMessageBodiesByUID(String * folder, IndexSet * uids, String * partID,
+                                              IMAPFetchMessagesCallback * fetchCallback,
+                                              IMAPProgressCallback * progressCallback, ErrorCode * pError);
+
         virtual Data * fetchMessageByUID(String * folder, uint32_t uid,
                                          IMAPProgressCallback * progressCallback, ErrorCode * pError);
         virtual Data * fetchMessageByNumber(String * folder, uint32_t number,
@@ -116,6 +156,11 @@ namespace mailcore {
                                                    Encoding encoding, IMAPProgressCallback * progressCallback, ErrorCode * pError);
         virtual Data * fetchMessageAttachmentByNumber(String * folder, uint32_t number, String * partID,
                                                       Encoding encoding, IMAPProgressCallback * progressCallback, ErrorCode * pError);
+        // Fetches length bytes of the part, as sent by the server, starting at offset. The data is not
+        // decoded and is shorter than length at the end of the part.
+        virtual Data * fetchMessageAttachmentRangeByUID(String * folder, uint32_t uid, String * partID,
+                                                        uint32_t offset, uint32_t length,
+                                                        IMAPProgressCallback * progressCallback, ErrorCode * pError);
         virtual HashMap * fetchMessageNumberUIDMapping(String * folder, uint32_t fromUID, uint32_t toUID,
                                                        ErrorCode * pError);
         
@@ -145,6 +190,8 @@ namespace mailcore {
         virtual void idle(String * folder, uint32_t lastKnownUID, ErrorCode * pError);
         virtual void interruptIdle();
         virtual void unsetupIdle();
+        // Changes received from the server during the last idle().
+        virtual IMAPIdleChanges * idleChanges();
         
         virtual void connect(ErrorCode * pError);
         virtual void disconnect();
@@ -171,6 +218,7 @@ namespace mailcore {
         virtual bool isXListEnabled();
         virtual bool isCondstoreEnabled();
         virtual bool isQResyncEnabled();
+        virtual bool isBinaryEnabled();
         virtual bool isIdentityEnabled();
         virtual bool isXOAuthEnabled();
         virtual bool isNamespaceEnabled();
@@ -195,6 +243,11 @@ namespace mailcore {
          This method can be used to generate the summary of the message.*/
         virtual String * plainTextBodyRendering(IMAPMessage * message, String * folder, bool stripWhitespace, ErrorCode * pError);
         
+        /** Beginning of the text of the message, at most maximumLength characters with white spaces cleaned up.
+         Unlike plainTextBodyRendering(), only the beginning of a single text part is fetched, with partial fetches,
+         and the HTML is flattened only until there's enough text.*/
+        virtual String * plainTextPreview(IMAPMessage * message, String * folder, unsigned int maximumLength, ErrorCode * pError);
+        
         /** Enable automatic query of the capabilities of the IMAP server when set to true. */
         virtual void setAutomaticConfigurationEnabled(bool enabled);
         
@@ -206,10 +259,30 @@ namespace mailcore {
         virtual void connectIfNeeded(ErrorCode * pError);
         virtual void selectIfNeeded(String * folder, ErrorCode * pError);
         virtual bool isDisconnected();
+        // Folder of the last successful SELECT, NULL when no folder is selected.
+        virtual String * selectedFolder();
         virtual bool isAutomaticConfigurationDone();
         virtual void resetAutomaticConfigurationDone();
         virtual void applyCapabilities(IndexSet * capabilities);
         
+        // Steps of idle(), to wait for the changes without blocking the thread.
+        // enterIdle() returns false when IDLE was not sent, for example when a new message was found.
+        virtual bool enterIdle(String * folder, uint32_t lastKnownUID, ErrorCode * pError);
+        // Returns true when changes were received along with the IDLE response, or when the TLS
+        // or COMPRESS layer might already hold some.
+        virtual bool hasIdleData();
+        // Socket to watch while idling, below the TLS and COMPRESS layers. -1 if the stream
+        // can't be watched.
+        virtual int idleFileDescriptor();
+        virtual double idleTimeout();
+        // Blocks until data arrives, the timeout expires or interruptIdle() is called.
+        virtual int waitIdle();
+        // result is the outcome of the wait, one of the MAILSTREAM_IDLE_* values.
+        virtual void idleWaitFinished(int result, ErrorCode * pError);
+        virtual void leaveIdle(ErrorCode * pError);
+        // Length of each read from the socket layers, for hasIdleData().
+        virtual void dataReceived(size_t length);
+        
     private:
         String * mHostname;
         unsigned int mPort;
@@ -231,6 +304,7 @@ namespace mailcore {
         bool mXListEnabled;
         bool mCondstoreEnabled;
         bool mQResyncEnabled;
+        bool mBinaryEnabled;
         bool mIdentityEnabled;
         bool mXOauth2Enabled;
         bool mNamespaceEnabled;
@@ -254,13 +328,19 @@ namespace mailcore {
         mailimap * mImap;
         IMAPProgressCallback * mProgressCallback;
         unsigned int mProgressItemsCount;
+        IMAPFetchMessagesCallback * mFetchMessagesCallback;
+        unsigned int mFetchMessagesBatchSize;
+        unsigned int mFetchChunkSize;
+        unsigned int mFetchPipelineDepth;
         ConnectionLogger * mConnectionLogger;
         bool mAutomaticConfigurationEnabled;
         bool mAutomaticConfigurationDone;
         bool mShouldDisconnect;
+        bool mLastReadFilledBuffer;
         
         String * mLoginResponse;
         String * mGmailUserDisplayName;
+        IMAPIdleChanges * mIdleChanges;
         
         void init();
         void bodyProgress(unsigned int current, unsigned int maximum);
@@ -277,6 +357,10 @@ namespace mailcore {
                                        uint64_t modseq,
                                        HashMap * mapping, IMAPProgressCallback * progressCallback,
                                        Array * extraHeaders, ErrorCode * pError);
+        IMAPSyncResult * fetchMessagesByUIDInChunks(String * folder, IMAPMessagesRequestKind requestKind,
+                                                    IndexSet * uids, uint64_t modseq,
+                                                    IMAPProgressCallback * progressCallback,
+                                                    Array * extraHeaders, ErrorCode * pError);
         void capabilitySetWithSessionState(IndexSet * capabilities);
         bool enableFeature(String * feature);
         void enableFeatures();
@@ -287,7 +371,17 @@ namespace mailcore {
         Data * fetchMessageAttachment(String * folder, bool identifier_is_uid,
                                       uint32_t identifier, String * partID,
                                       Encoding encoding, IMAPProgressCallback * progressCallback, ErrorCode * pError);
+        Data * fetchMessageAttachmentData(String * folder, bool identifier_is_uid,
+                                          uint32_t identifier, String * partID,
+                                          bool partial, uint32_t offset, uint32_t length,
+                                          IMAPProgressCallback * progressCallback, ErrorCode * pError);
+        Data * fetchMessageAttachmentBinaryData(String * folder, bool identifier_is_uid,
+                                                uint32_t identifier, String * partID,
+                                                IMAPProgressCallback * progressCallback, ErrorCode * pError);
         void storeLabels(String * folder, bool identifier_is_uid, IndexSet * identifiers, IMAPStoreFlagsRequestKind kind, Array * labels, ErrorCode * pError);
+        void collectIdleChanges();
+        void selectErrorFromResult(int r, ErrorCode * pError);
+        void readSelectionInfo();
     };
     
 }
@@ -11,6 +11,8 @@
 #include "MCIterator.h"
 #include "MCJSON.h"
 
+#include <string.h>
+
 #ifdef _MSC_VER
 #include <unicode/uregex.h>
 #include <unicode/utext.h>
@@ -23,6 +25,119 @@
 
 using namespace mailcore;
 
+namespace mailcore {
+    
+    // Domain pattern compiled once when the provider is loaded.
+    class DomainMatcher : public Object {
+    public:
+        DomainMatcher(String * pattern);
+        virtual ~DomainMatcher();
+        
+        // domain is expected to be lowercase.
+        virtual bool match(String * domain);
+        
+    private:
+        String * mKey;
+        bool mValid;
+#ifdef _MSC_VER
+        URegularExpression * mRegex;
+#else
+        regex_t mRegex;
+#endif
+    };
+    
+}
+
+DomainMatcher::DomainMatcher(String * pattern)
+{
+    mKey = MailProvider::indexKeyForPattern(pattern);
+    MC_SAFE_RETAIN(mKey);
+    mValid = false;
+#ifdef _MSC_VER
+    mRegex = NULL;
+#endif
+    if (mKey != NULL) {
+        return;
+    }
+    
+#ifdef _MSC_VER
+    UParseError error;
+    UErrorCode code = U_ZERO_ERROR;
+    mRegex = uregex_open(pattern->unicodeCharacters(), pattern->length(), UREGEX_CASE_INSENSITIVE, &error, &code);
+    if (code != U_ZERO_ERROR) {
+        uregex_close(mRegex);
+        mRegex = NULL;
+        return;
+    }
+    mValid = true;
+#else
+    String * anchoredPattern = String::stringWithUTF8Format("^%s$", pattern->UTF8Characters());
+    if (regcomp(&mRegex, anchoredPattern->UTF8Characters(), REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0) {
+        return;
+    }
+    mValid = true;
+#endif
+}
+
+DomainMatcher::~DomainMatcher()
+{
+    MC_SAFE_RELEASE(mKey);
+#ifdef _MSC_VER
+    if (mRegex != NULL) {
+        uregex_close(mRegex);
+    }
+#else
+    if (mValid) {
+        regfree(&mRegex);
+    }
+#endif
+}
+
+bool DomainMatcher::match(String * domain)
+{
+    if (mKey != NULL) {
+        if (mKey->hasPrefix(MCSTR("."))) {
+            return domain->hasSuffix(mKey);
+        }
+        else if (mKey->hasSuffix(MCSTR("."))) {
+            return domain->hasPrefix(mKey);
+        }
+        else {
+            return domain->isEqual(mKey);
+        }
+    }
+    
+    if (!mValid) {
+        return false;
+    }
+    
+#ifdef _MSC_VER
+    // A compiled expression holds the text being matched, use a clone to match from any thread.
+    UErrorCode code = U_ZERO_ERROR;
+    URegularExpression * r = uregex_clone(mRegex, &code);
+    if (code != U_ZERO_ERROR) {
+        return false;
+    }
+    uregex_setText(r, domain->unicodeCharacters(), domain->length(), &code);
+    if (code != U_ZERO_ERROR) {
+        uregex_close(r);
+        return false;
+    }
+    
+    bool matched = uregex_matches(r, 0, &code);
+    if (code != U_ZERO_ERROR) {
+        uregex_close(r);
+        return false;
+    }
+    
+    uregex_close(r);
+    
+    return matched;
+#else
+    return regexec(&mRegex, domain->UTF8Characters(), 0, NULL, 0) == 0;
+#endif
+}
+
 void MailProvider::init()
 {
     mIdentifier = NULL;
@@ -33,6 +148,9 @@ void MailProvider::init()
     mDomainExclude = new Array();
     mMxMatch = new Array();
     mMailboxPaths = NULL;
+    mDomainMatchers = new Array();
+    mDomainExcludeMatchers = new Array();
+    mMxMatchers = new Array();
 }
 
 MailProvider::MailProvider()
@@ -51,6 +169,7 @@ MailProvider::MailProvider(MailProvider * other)
     MC_SAFE_REPLACE_COPY(Array, mDomainExclude, other->mDomainExclude);
     MC_SAFE_REPLACE_COPY(Array, mMxMatch, other->mMxMatch);
     MC_SAFE_REPLACE_COPY(HashMap, mMailboxPaths, other->mMailboxPaths);
+    compileMatchers();
 }
 
 MailProvider::~MailProvider()
@@ -63,6 +182,9 @@ MailProvider::~MailProvider()
     MC_SAFE_RELEASE(mDomainExclude);
     MC_SAFE_RELEASE(mMailboxPaths);
     MC_SAFE_RELEASE(mIdentifier);
+    MC_SAFE_RELEASE(mDomainMatchers);
+    MC_SAFE_RELEASE(mDomainExcludeMatchers);
+    MC_SAFE_RELEASE(mMxMatchers);
 }
 
 MailProvider * MailProvider::providerWithInfo(HashMap * info)
@@ -96,6 +218,7 @@ void MailProvider::fillWithInfo(HashMap * info)
     if (info->objectForKey(MCSTR("mx-match")) != NULL) {
         mMxMatch = (Array *) info->objectForKey(MCSTR("mx-match"))->retain();
     }
+    compileMatchers();
     
     serverInfo = (HashMap *) info->objectForKey(MCSTR("servers"));
     if (serverInfo == NULL) {
@@ -150,6 +273,82 @@ Array * MailProvider::popServices()
     return mPopServices;
 }
 
+static void addMatchers(Array * matchers, Array * patterns)
+{
+    mc_foreacharray(String, pattern, patterns) {
+        DomainMatcher * matcher = new DomainMatcher(pattern);
+        matchers->addObject(matcher);
+        matcher->release();
+    }
+}
+
+void MailProvider::compileMatchers()
+{
+    mDomainMatchers->removeAllObjects();
+    mDomainExcludeMatchers->removeAllObjects();
+    mMxMatchers->removeAllObjects();
+    addMatchers(mDomainMatchers, mDomainMatch);
+    addMatchers(mDomainExcludeMatchers, mDomainExclude);
+    addMatchers(mMxMatchers, mMxMatch);
+}
+
+static bool isLiteralDomainCharacter(char ch)
+{
+    return ((ch >= 'a') && (ch <= 'z')) || ((ch >= '0') && (ch <= '9')) || (ch == '-');
+}
+
+String * MailProvider::indexKeyForPattern(String * pattern)
+{
+    const char * p = pattern->lowercaseString()->UTF8Characters();
+    String * result = String::string();
+    bool labelStart = true;
+    
+    if (strncmp(p, ".*\\.", 4) == 0) {
+        // .*\.example\.com matches any subdomain.
+        result->appendUTF8Characters(".");
+        p += 4;
+    }
+    
+    while (* p != '\0') {
+        if (isLiteralDomainCharacter(* p)) {
+            result->appendUTF8Format("%c", * p);
+            labelStart = false;
+            p ++;
+        }
+        else if (labelStart) {
+            return NULL;
+        }
+        else if ((strcmp(p, "\\..*") == 0) && !result->hasPrefix(MCSTR("."))) {
+            // example\..* matches any top-level domain.
+            result->appendUTF8Characters(".");
+            return result;
+        }
+        else if (strncmp(p, "\\.", 2) == 0) {
+            result->appendUTF8Characters(".");
+            labelStart = true;
+            p += 2;
+        }
+        else {
+            return NULL;
+        }
+    }
+    if (labelStart) {
+        // Empty pattern or trailing dot.
+        return NULL;
+    }
+    return result;
+}
+
+Array * MailProvider::domainMatchPatterns()
+{
+    return mDomainMatch;
+}
+
+Array * MailProvider::mxMatchPatterns()
+{
+    return mMxMatch;
+}
+
 bool MailProvider::matchEmail(String * email)
 {
     Array * components;
@@ -160,15 +359,20 @@ bool MailProvider::matchEmail(String * email)
         return false;
     
     domain = (String *) components->lastObject();
+    
+    return matchDomain(domain->lowercaseString());
+}
 
-    mc_foreacharray(String, exclude, mDomainExclude) {
-        if (matchDomain(exclude, domain)){
+bool MailProvider::matchDomain(String * domain)
+{
+    mc_foreacharray(DomainMatcher, exclude, mDomainExcludeMatchers) {
+        if (exclude->match(domain)) {
             return false;
         }
     }
     
-    mc_foreacharray(String, match, mDomainMatch) {
-        if (matchDomain(match, domain)){
+    mc_foreacharray(DomainMatcher, match, mDomainMatchers) {
+        if (match->match(domain)) {
             return true;
         }
     }
@@ -178,8 +382,9 @@ bool MailProvider::matchEmail(String * email)
 
 bool MailProvider::matchMX(String * hostname)
 {
-    mc_foreacharray(String, match, mMxMatch) {
-        if (matchDomain(match, hostname)){
+    hostname = hostname->lowercaseString();
+    mc_foreacharray(DomainMatcher, match, mMxMatchers) {
+        if (match->match(hostname)) {
             return true;
         }
     }
@@ -187,54 +392,6 @@ bool MailProvider::matchMX(String * hostname)
     return false;
 }
 
-bool MailProvider::matchDomain(String * match, String * domain)
-{
-#ifdef _MSC_VER
-    UParseError error;
-    UErrorCode code = U_ZERO_ERROR;
-    URegularExpression * r = uregex_open(match->unicodeCharacters(), match->length(), UREGEX_CASE_INSENSITIVE, &error, &code);
-    if (code != U_ZERO_ERROR) {
-        uregex_close(r);
-        return false;
-    }
-    uregex_setText(r, domain->unicodeCharacters(), domain->length(), &code);
-    if (code != U_ZERO_ERROR) {
-        uregex_close(r);
-        return false;
-    }
-
-	bool matched = uregex_matches(r, 0, &code);
-    if (code != U_ZERO_ERROR) {
-        uregex_close(r);
-        return false;
-    }
-
-    uregex_close(r);
-
-    return matched;
-#else
-    const char * cDomain;
-    regex_t r;
-    bool matched;  
-
-    cDomain = domain->UTF8Characters();
-    match = String::stringWithUTF8Format("^%s$", match->UTF8Characters());
-    matched = false;
-
-    if (regcomp(&r, match->UTF8Characters(), REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0){
-        return matched;
-    }
-
-    if (regexec(&r, cDomain, 0, NULL, 0) == 0) {
-        matched = true;
-    }
-
-    regfree(&r);
-
-    return matched;
-#endif
-}
-
 String * MailProvider::sentMailFolderPath()
 {
     return (String *) mMailboxPaths->objectForKey(MCSTR("sentmail"));
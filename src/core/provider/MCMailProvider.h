@@ -17,6 +17,7 @@
 namespace mailcore {
     
     class NetService;
+    class DomainMatcher;
     
     class MAILCORE_EXPORT MailProvider : public Object {
     public:
@@ -53,6 +54,14 @@ namespace mailcore {
     public: // private
         virtual void setIdentifier(String * identifier);
         virtual void fillWithInfo(HashMap * info);
+        virtual Array * /* String */ domainMatchPatterns();
+        virtual Array * /* String */ mxMatchPatterns();
+        virtual bool matchDomain(String * domain);
+        
+        // Returns a lowercase literal that can be used to look up the pattern without a regular expression:
+        // "example.com" for an exact domain, ".example.com" for a suffix, "example." for a prefix.
+        // Returns NULL when the pattern needs a regular expression.
+        static String * indexKeyForPattern(String * pattern);
         
     private:
         String * mIdentifier;
@@ -63,9 +72,12 @@ namespace mailcore {
         Array * /* NetService */ mSmtpServices;
         Array * /* NetService */ mPopServices;
         HashMap * mMailboxPaths;
+        Array * /* DomainMatcher */ mDomainMatchers;
+        Array * /* DomainMatcher */ mDomainExcludeMatchers;
+        Array * /* DomainMatcher */ mMxMatchers;
         
-        virtual bool matchDomain(String * match, String * domain);
         void init();
+        void compileMatchers();
     };
     
 };
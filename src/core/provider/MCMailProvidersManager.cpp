@@ -15,6 +15,10 @@ using namespace mailcore;
 void MailProvidersManager::init()
 {
     mProviders = new HashMap();
+    mDomainIndex = new HashMap();
+    mMXIndex = new HashMap();
+    mDomainFallbackProviders = new Array();
+    mMXFallbackProviders = new Array();
 }
 
 MailProvidersManager::MailProvidersManager() {
@@ -28,24 +32,96 @@ MailProvidersManager * MailProvidersManager::sharedManager()
 }
 
 
-MailProvider * MailProvidersManager::providerForEmail(String * email)
+static MailProvider * firstMatchingProvider(Array * providers, String * name, bool mx)
 {
-    mc_foreachhashmapValue(MailProvider, provider, mProviders) {
-        if (provider->matchEmail(email))
+    mc_foreacharray(MailProvider, provider, providers) {
+        if (mx ? provider->matchMX(name) : provider->matchDomain(name))
             return provider;
     }
-    
     return NULL;
 }
 
-MailProvider * MailProvidersManager::providerForMX(String * hostname)
+MailProvider * MailProvidersManager::lookupProvider(HashMap * index, Array * fallbackProviders, String * name, bool mx)
 {
-    mc_foreachhashmapValue(MailProvider, provider, mProviders) {
-        if (provider->matchMX(hostname))
+    MailProvider * provider;
+    
+    provider = firstMatchingProvider((Array *) index->objectForKey(name), name, mx);
+    if (provider != NULL)
+        return provider;
+    
+    // Suffixes, longest first, then prefixes.
+    const UChar * chars = name->unicodeCharacters();
+    for(unsigned int i = 0 ; i < name->length() ; i ++) {
+        if (chars[i] != '.')
+            continue;
+        provider = firstMatchingProvider((Array *) index->objectForKey(name->substringFromIndex(i)), name, mx);
+        if (provider != NULL)
+            return provider;
+    }
+    for(unsigned int i = 0 ; i < name->length() ; i ++) {
+        if (chars[i] != '.')
+            continue;
+        provider = firstMatchingProvider((Array *) index->objectForKey(name->substringToIndex(i + 1)), name, mx);
+        if (provider != NULL)
             return provider;
     }
     
-    return NULL;
+    return firstMatchingProvider(fallbackProviders, name, mx);
+}
+
+MailProvider * MailProvidersManager::providerForDomain(String * domain)
+{
+    return lookupProvider(mDomainIndex, mDomainFallbackProviders, domain->lowercaseString(), false);
+}
+
+static String * domainForEmail(String * email)
+{
+    Array * components = email->componentsSeparatedByString(MCSTR("@"));
+    if (components->count() < 2)
+        return NULL;
+    
+    return (String *) components->lastObject();
+}
+
+MailProvider * MailProvidersManager::providerForEmail(String * email)
+{
+    String * domain = domainForEmail(email);
+    if (domain == NULL)
+        return NULL;
+    
+    return providerForDomain(domain);
+}
+
+Array * MailProvidersManager::providersForEmails(Array * emails)
+{
+    Array * result = Array::array();
+    HashMap * providersForDomains = HashMap::hashMap();
+    
+    mc_foreacharray(String, email, emails) {
+        String * domain = domainForEmail(email);
+        if (domain == NULL) {
+            result->addObject(Null::null());
+            continue;
+        }
+        domain = domain->lowercaseString();
+        
+        Object * provider = providersForDomains->objectForKey(domain);
+        if (provider == NULL) {
+            provider = providerForDomain(domain);
+            if (provider == NULL) {
+                provider = Null::null();
+            }
+            providersForDomains->setObjectForKey(domain, provider);
+        }
+        result->addObject(provider);
+    }
+    
+    return result;
+}
+
+MailProvider * MailProvidersManager::providerForMX(String * hostname)
+{
+    return lookupProvider(mMXIndex, mMXFallbackProviders, hostname->lowercaseString(), true);
 }
 
 MailProvider * MailProvidersManager::providerForIdentifier(String * identifier)
@@ -60,6 +136,42 @@ void MailProvidersManager::registerProviders(HashMap * providers)
         provider->setIdentifier(identifier);
         mProviders->setObjectForKey(identifier, provider);
     }
+    rebuildIndex();
+}
+
+static void indexProvider(HashMap * index, Array * fallbackProviders, MailProvider * provider, Array * patterns)
+{
+    bool needsFallback = false;
+    mc_foreacharray(String, pattern, patterns) {
+        String * key = MailProvider::indexKeyForPattern(pattern);
+        if (key == NULL) {
+            needsFallback = true;
+            continue;
+        }
+        Array * providers = (Array *) index->objectForKey(key);
+        if (providers == NULL) {
+            providers = Array::array();
+            index->setObjectForKey(key, providers);
+        }
+        if (!providers->containsObject(provider)) {
+            providers->addObject(provider);
+        }
+    }
+    if (needsFallback) {
+        fallbackProviders->addObject(provider);
+    }
+}
+
+void MailProvidersManager::rebuildIndex()
+{
+    mDomainIndex->removeAllObjects();
+    mMXIndex->removeAllObjects();
+    mDomainFallbackProviders->removeAllObjects();
+    mMXFallbackProviders->removeAllObjects();
+    mc_foreachhashmapValue(MailProvider, provider, mProviders) {
+        indexProvider(mDomainIndex, mDomainFallbackProviders, provider, provider->domainMatchPatterns());
+        indexProvider(mMXIndex, mMXFallbackProviders, provider, provider->mxMatchPatterns());
+    }
 }
 
 void MailProvidersManager::registerProvidersWithFilename(String * filename)
@@ -26,6 +26,9 @@ namespace mailcore {
         virtual MailProvider * providerForMX(String * hostname);
         virtual MailProvider * providerForIdentifier(String * identifier);
         
+        // Returns an array with the provider of each email, or Null when none matches.
+        virtual Array * providersForEmails(Array * /* String */ emails);
+        
         virtual void registerProvidersWithFilename(String * filename);
         
     private:
@@ -33,8 +36,17 @@ namespace mailcore {
         void registerProviders(HashMap * providers);
         
         HashMap * mProviders;
+        // Providers indexed by the literal form of their patterns, see MailProvider::indexKeyForPattern().
+        HashMap * mDomainIndex;
+        HashMap * mMXIndex;
+        // Providers with patterns that need a regular expression.
+        Array * mDomainFallbackProviders;
+        Array * mMXFallbackProviders;
         
         void init();
+        void rebuildIndex();
+        MailProvider * providerForDomain(String * domain);
+        MailProvider * lookupProvider(HashMap * index, Array * fallbackProviders, String * name, bool mx);
     };
 }
 
@@ -8,11 +8,11 @@
 
 #include "MCHTMLRenderer.h"
 
-#include <ctemplate/template.h>
 #include "MCAddressDisplay.h"
 #include "MCDateFormatter.h"
 #include "MCSizeFormatter.h"
 #include "MCHTMLRendererCallback.h"
+#include "MCTemplateCache.h"
 
 using namespace mailcore;
 
@@ -78,8 +78,6 @@ static bool messagePartContainsMimeType(AbstractMessagePart * part, String * mim
 
 static String * htmlForAbstractPart(AbstractPart * part, htmlRendererContext * context);
 
-static String * renderTemplate(String * templateContent, HashMap * values);
-
 static String * htmlForAbstractMessage(String * folder, AbstractMessage * message,
                                        HTMLRendererIMAPCallback * dataCallback,
                                        HTMLRendererTemplateCallback * htmlCallback,
@@ -505,60 +503,6 @@ static String * htmlForAbstractMultipartRelated(AbstractMultipart * part, htmlRe
     return htmlForAbstractPart(subpart, context);
 }
 
-static void fillTemplateDictionaryFromMCHashMap(ctemplate::TemplateDictionary * dict, HashMap * mcHashMap)
-{
-    Array * keys = mcHashMap->allKeys();
-    
-    for(unsigned int i = 0 ; i < keys->count() ; i ++) {
-        String * key = (String *) keys->objectAtIndex(i);
-        Object * value;
-        
-        value = mcHashMap->objectForKey(key);
-        if (value->className()->isEqual(MCSTR("mailcore::String"))) {
-            String * str;
-            
-            str = (String *) value;
-            dict->SetValue(key->UTF8Characters(), str->UTF8Characters());
-        }
-        else if (value->className()->isEqual(MCSTR("mailcore::Array"))) {
-            Array * array;
-            
-            array = (Array *) value;
-            for(unsigned int k = 0 ; k < array->count() ; k ++) {
-                HashMap * item = (HashMap *) array->objectAtIndex(k);
-                ctemplate::TemplateDictionary * subDict = dict->AddSectionDictionary(key->UTF8Characters());
-                fillTemplateDictionaryFromMCHashMap(subDict, item);
-            }
-        }
-        else if (value->className()->isEqual(MCSTR("mailcore::HashMap"))) {
-            ctemplate::TemplateDictionary * subDict;
-            HashMap * item;
-            
-            item = (HashMap *) value;
-            subDict = dict->AddSectionDictionary(key->UTF8Characters());
-            fillTemplateDictionaryFromMCHashMap(subDict, item);
-        }
-    }
-}
-
-static String * renderTemplate(String * templateContent, HashMap * values)
-{
-    ctemplate::TemplateDictionary dict("template dict");
-    std::string output;
-    Data * data;
-    
-    fillTemplateDictionaryFromMCHashMap(&dict, values);
-    data = templateContent->dataUsingEncoding("utf-8");
-    ctemplate::Template * tpl = ctemplate::Template::StringToTemplate(data->bytes(), data->length(), ctemplate::DO_NOT_STRIP);
-    if (tpl == NULL)
-        return NULL;
-    if (!tpl->Expand(&output, &dict))
-        return NULL;
-    delete tpl;
-    
-    return String::stringWithUTF8Characters(output.c_str());
-}
-
 String * HTMLRenderer::htmlForRFC822Message(MessageParser * message,
                                             HTMLRendererTemplateCallback * htmlCallback)
 {
@@ -607,3 +551,103 @@ Array * HTMLRenderer::requiredPartsForRendering(AbstractMessage * message)
     (void) ignoredResult; // remove unused variable warning.
     return requiredParts;
 }
+
+static AbstractPart * previewPartForAbstractPart(AbstractPart * part)
+{
+    switch (part->partType()) {
+        case PartTypeSingle:
+        {
+            if (!part->isInlineAttachment() && part->isAttachment()) {
+                return NULL;
+            }
+            if (part->mimeType() == NULL) {
+                return NULL;
+            }
+            String * mimeType = part->mimeType()->lowercaseString();
+            if (mimeType->isEqual(MCSTR("text/plain")) || mimeType->isEqual(MCSTR("text/html"))) {
+                return part;
+            }
+            return NULL;
+        }
+        case PartTypeMessage:
+            return previewPartForAbstractPart(((AbstractMessagePart *) part)->mainPart());
+        case PartTypeMultipartAlternative:
+        {
+            // The plain text alternative has the same text and is cheaper to flatten.
+            AbstractMultipart * multipart = (AbstractMultipart *) part;
+            for(unsigned int i = 0 ; i < multipart->parts()->count() ; i ++) {
+                AbstractPart * subpart = (AbstractPart *) multipart->parts()->objectAtIndex(i);
+                if (partContainsMimeType(subpart, MCSTR("text/plain"))) {
+                    AbstractPart * result = previewPartForAbstractPart(subpart);
+                    if (result != NULL)
+                        return result;
+                }
+            }
+            AbstractPart * preferredAlternative = preferredPartInMultipartAlternative(multipart);
+            if (preferredAlternative == NULL)
+                return NULL;
+            return previewPartForAbstractPart(preferredAlternative);
+        }
+        case PartTypeMultipartMixed:
+        case PartTypeMultipartRelated:
+        case PartTypeMultipartSigned:
+        {
+            AbstractMultipart * multipart = (AbstractMultipart *) part;
+            for(unsigned int i = 0 ; i < multipart->parts()->count() ; i ++) {
+                AbstractPart * result = previewPartForAbstractPart((AbstractPart *) multipart->parts()->objectAtIndex(i));
+                if (result != NULL)
+                    return result;
+            }
+            return NULL;
+        }
+        default:
+            return NULL;
+    }
+}
+
+AbstractPart * HTMLRenderer::previewPartForMessage(AbstractMessage * message)
+{
+    AbstractPart * mainPart = NULL;
+    
+    if (message->className()->isEqual(MCSTR("mailcore::IMAPMessage"))) {
+        mainPart = ((IMAPMessage *) message)->mainPart();
+    }
+    else if (message->className()->isEqual(MCSTR("mailcore::MessageParser"))) {
+        mainPart = ((MessageParser *) message)->mainPart();
+    }
+    if (mainPart == NULL)
+        return NULL;
+    
+    return previewPartForAbstractPart(mainPart);
+}
+
+// Bytes of the text part tried first, per character of the preview.
+#define PREVIEW_BYTES_PER_CHARACTER 4
+
+unsigned int HTMLRenderer::previewInitialLength(unsigned int maximumLength)
+{
+    unsigned int length = maximumLength * PREVIEW_BYTES_PER_CHARACTER;
+    if (length == 0) {
+        length = 1;
+    }
+    return length;
+}
+
+String * HTMLRenderer::previewForPartData(AbstractPart * part, Data * data, bool truncated, unsigned int maximumLength)
+{
+    bool isHTML = part->mimeType()->lowercaseString()->isEqual(MCSTR("text/html"));
+    String * str = data->stringWithDetectedCharset(part->charset(), isHTML);
+    if (truncated && (str->length() > 0)) {
+        // The last character might have been cut in the middle.
+        str = str->substringToIndex(str->length() - 1);
+    }
+    if (isHTML) {
+        // Whitespace is collapsed afterwards: asks for more text than needed.
+        str = str->flattenHTMLWithMaximumLength(maximumLength * 2);
+    }
+    str = str->stripWhitespace();
+    if (str->length() > maximumLength) {
+        str = str->substringToIndex(maximumLength);
+    }
+    return str;
+}
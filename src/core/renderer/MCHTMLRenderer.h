@@ -35,6 +35,16 @@ namespace mailcore {
         static Array * /* AbstractPart */ attachmentsForMessage(AbstractMessage * message);
         static Array * /* AbstractPart */ htmlInlineAttachmentsForMessage(AbstractMessage * message);
         static Array * /* AbstractPart */ requiredPartsForRendering(AbstractMessage * message);
+        
+        // Text part used for the preview of the message, the plain text alternative if there's one.
+        static AbstractPart * previewPartForMessage(AbstractMessage * message);
+        // First maximumLength characters of the text of the part, whitespace collapsed.
+        // data is the content of the part, transfer encoding decoded. When truncated is true, it's
+        // only the beginning of the part.
+        static String * previewForPartData(AbstractPart * part, Data * data, bool truncated, unsigned int maximumLength);
+        // Length of the beginning of the part to try first for a preview of maximumLength characters.
+        // It's doubled until the text is long enough.
+        static unsigned int previewInitialLength(unsigned int maximumLength);
     };
     
 };
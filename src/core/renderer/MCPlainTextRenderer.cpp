@@ -8,11 +8,11 @@
 
 #include "MCPlainTextRenderer.h"
 
-#include <ctemplate/template.h>
 #include "MCAddressDisplay.h"
 #include "MCDateFormatter.h"
 #include "MCSizeFormatter.h"
 #include "MCHTMLRendererCallback.h"
+#include "MCTemplateCache.h"
 
 using namespace mailcore;
 
@@ -78,8 +78,6 @@ static bool messagePartContainsMimeType(AbstractMessagePart * part, String * mim
 
 static String * htmlForAbstractPart(AbstractPart * part, htmlRendererContext * context);
 
-static String * renderTemplate(String * templateContent, HashMap * values);
-
 static String * htmlForAbstractMessage(String * folder, AbstractMessage * message,
                                        HTMLRendererIMAPCallback * dataCallback,
                                        HTMLRendererTemplateCallback * htmlCallback,
@@ -354,60 +352,6 @@ static String * htmlForAbstractMultipartRelated(AbstractMultipart * part, htmlRe
     return htmlForAbstractPart(subpart, context);
 }
 
-static void fillTemplateDictionaryFromMCHashMap(ctemplate::TemplateDictionary * dict, HashMap * mcHashMap)
-{
-    Array * keys = mcHashMap->allKeys();
-    
-    for(unsigned int i = 0 ; i < keys->count() ; i ++) {
-        String * key = (String *) keys->objectAtIndex(i);
-        Object * value;
-        
-        value = mcHashMap->objectForKey(key);
-        if (value->className()->isEqual(MCSTR("mailcore::String"))) {
-            String * str;
-            
-            str = (String *) value;
-            dict->SetValue(key->UTF8Characters(), str->UTF8Characters());
-        }
-        else if (value->className()->isEqual(MCSTR("mailcore::Array"))) {
-            Array * array;
-            
-            array = (Array *) value;
-            for(unsigned int k = 0 ; k < array->count() ; k ++) {
-                HashMap * item = (HashMap *) array->objectAtIndex(k);
-                ctemplate::TemplateDictionary * subDict = dict->AddSectionDictionary(key->UTF8Characters());
-                fillTemplateDictionaryFromMCHashMap(subDict, item);
-            }
-        }
-        else if (value->className()->isEqual(MCSTR("mailcore::HashMap"))) {
-            ctemplate::TemplateDictionary * subDict;
-            HashMap * item;
-            
-            item = (HashMap *) value;
-            subDict = dict->AddSectionDictionary(key->UTF8Characters());
-            fillTemplateDictionaryFromMCHashMap(subDict, item);
-        }
-    }
-}
-
-static String * renderTemplate(String * templateContent, HashMap * values)
-{
-    ctemplate::TemplateDictionary dict("template dict");
-    std::string output;
-    Data * data;
-    
-    fillTemplateDictionaryFromMCHashMap(&dict, values);
-    data = templateContent->dataUsingEncoding("utf-8");
-    ctemplate::Template * tpl = ctemplate::Template::StringToTemplate(data->bytes(), data->length(), ctemplate::DO_NOT_STRIP);
-    if (tpl == NULL)
-        return NULL;
-    if (!tpl->Expand(&output, &dict))
-        return NULL;
-    delete tpl;
-    
-    return String::stringWithUTF8Characters(output.c_str());
-}
-
 String * PlainTextRenderer::htmlForRFC822Message(MessageParser * message,
                                             HTMLRendererTemplateCallback * htmlCallback)
 {
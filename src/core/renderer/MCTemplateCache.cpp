@@ -0,0 +1,131 @@
+//
+//  MCTemplateCache.cpp
+//  mailcore2
+//
+
+#include "MCTemplateCache.h"
+
+#include <ctemplate/template.h>
+#include "MCLock.h"
+
+using namespace mailcore;
+
+// Number of distinct templates kept compiled. Templates beyond that are compiled for each use.
+#define TEMPLATE_CACHE_MAX_COUNT 64
+
+static MC_LOCK_TYPE s_lock = MC_LOCK_INITIAL_VALUE;
+static HashMap * s_templates = NULL;
+
+static void fillTemplateDictionaryFromMCHashMap(ctemplate::TemplateDictionary * dict, HashMap * mcHashMap)
+{
+    mc_foreachhashmapKeyAndValue(String, key, Object, value, mcHashMap) {
+        if (MCISKINDOFCLASS(value, String)) {
+            String * str;
+            
+            str = (String *) value;
+            dict->SetValue(key->UTF8Characters(), str->UTF8Characters());
+        }
+        else if (MCISKINDOFCLASS(value, Array)) {
+            Array * array;
+            
+            array = (Array *) value;
+            for(unsigned int k = 0 ; k < array->count() ; k ++) {
+                HashMap * item = (HashMap *) array->objectAtIndex(k);
+                ctemplate::TemplateDictionary * subDict = dict->AddSectionDictionary(key->UTF8Characters());
+                fillTemplateDictionaryFromMCHashMap(subDict, item);
+            }
+        }
+        else if (MCISKINDOFCLASS(value, HashMap)) {
+            ctemplate::TemplateDictionary * subDict;
+            HashMap * item;
+            
+            item = (HashMap *) value;
+            subDict = dict->AddSectionDictionary(key->UTF8Characters());
+            fillTemplateDictionaryFromMCHashMap(subDict, item);
+        }
+    }
+}
+
+static ctemplate::Template * compileTemplate(String * templateContent)
+{
+    Data * data = templateContent->dataUsingEncoding("utf-8");
+    return ctemplate::Template::StringToTemplate(data->bytes(), data->length(), ctemplate::DO_NOT_STRIP);
+}
+
+// Returns the cached compiled template, compiling it if needed.
+// Returns NULL if the template is invalid or if the cache is full.
+static ctemplate::Template * cachedTemplate(String * templateContent)
+{
+    ctemplate::Template * cached = NULL;
+    
+    MC_LOCK(&s_lock);
+    if (s_templates == NULL) {
+        s_templates = new HashMap();
+    }
+    Value * value = (Value *) s_templates->objectForKey(templateContent);
+    if (value != NULL) {
+        cached = (ctemplate::Template *) value->pointerValue();
+    }
+    bool full = s_templates->count() >= TEMPLATE_CACHE_MAX_COUNT;
+    MC_UNLOCK(&s_lock);
+    
+    if ((cached != NULL) || full)
+        return cached;
+    
+    // Compile outside of the lock: it's the expensive part.
+    ctemplate::Template * tpl = compileTemplate(templateContent);
+    if (tpl == NULL)
+        return NULL;
+    
+    MC_LOCK(&s_lock);
+    value = (Value *) s_templates->objectForKey(templateContent);
+    if (value != NULL) {
+        // Another thread compiled it meanwhile.
+        cached = (ctemplate::Template *) value->pointerValue();
+    }
+    else if (s_templates->count() < TEMPLATE_CACHE_MAX_COUNT) {
+        cached = tpl;
+        tpl = NULL;
+        String * key = (String *) templateContent->copy();
+        s_templates->setObjectForKey(key, Value::valueWithPointerValue(cached));
+        key->release();
+    }
+    MC_UNLOCK(&s_lock);
+    
+    if (tpl != NULL) {
+        delete tpl;
+    }
+    
+    return cached;
+}
+
+String * mailcore::renderTemplate(String * templateContent, HashMap * values)
+{
+    ctemplate::Template * cached = cachedTemplate(templateContent);
+    
+    if (cached == NULL) {
+        // Not cacheable, use a compiled template once.
+        ctemplate::TemplateDictionary dict("template dict");
+        std::string output;
+        
+        ctemplate::Template * tpl = compileTemplate(templateContent);
+        if (tpl == NULL)
+            return NULL;
+        fillTemplateDictionaryFromMCHashMap(&dict, values);
+        bool expanded = tpl->Expand(&output, &dict);
+        delete tpl;
+        if (!expanded)
+            return NULL;
+        
+        return String::stringWithUTF8Characters(output.c_str());
+    }
+    
+    // A compiled template can be expanded concurrently from several threads.
+    ctemplate::TemplateDictionary dict("template dict");
+    std::string output;
+    fillTemplateDictionaryFromMCHashMap(&dict, values);
+    if (!cached->Expand(&output, &dict))
+        return NULL;
+    
+    return String::stringWithUTF8Characters(output.c_str());
+}
@@ -0,0 +1,27 @@
+//
+//  MCTemplateCache.h
+//  mailcore2
+//
+
+#ifndef MAILCORE_MCTEMPLATECACHE_H
+
+#define MAILCORE_MCTEMPLATECACHE_H
+
+#include <MailCore/MCBaseTypes.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+    
+    class String;
+    class HashMap;
+    
+    // Expands the given template with the given values.
+    // Compiled templates are cached by content and shared between threads.
+    String * renderTemplate(String * templateContent, HashMap * values);
+    
+}
+
+#endif
+
+#endif
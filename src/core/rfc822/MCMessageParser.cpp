@@ -202,6 +202,34 @@ String * MessageParser::plainTextBodyRendering(bool stripWhitespace)
     return plainTextBodyString;
 }
 
+String * MessageParser::plainTextPreview(unsigned int maximumLength)
+{
+    AbstractPart * part = HTMLRenderer::previewPartForMessage(this);
+    if ((part == NULL) || !part->className()->isEqual(MCSTR("mailcore::Attachment"))) {
+        return MCSTR("");
+    }
+    Data * data = ((Attachment *) part)->data();
+    if (data == NULL) {
+        return MCSTR("");
+    }
+    
+    // The text is extracted from the beginning of the part, which is extended until it has enough
+    // text, so that a long part isn't converted entirely.
+    unsigned int length = HTMLRenderer::previewInitialLength(maximumLength);
+    while (1) {
+        if (length >= data->length()) {
+            return HTMLRenderer::previewForPartData(part, data, false, maximumLength);
+        }
+        
+        Data * prefix = Data::dataWithBytes(data->bytes(), length);
+        String * preview = HTMLRenderer::previewForPartData(part, prefix, true, maximumLength);
+        if (preview->length() >= maximumLength) {
+            return preview;
+        }
+        length *= 2;
+    }
+}
+
 static void * createObject()
 {
     return new MessageParser();
@@ -32,6 +32,9 @@ namespace mailcore {
         
         virtual String * plainTextRendering();
         virtual String * plainTextBodyRendering(bool stripWhitespace);
+        // Beginning of the text of the message for a list of messages, at most maximumLength
+        // characters. Only the text needed is decoded, without rendering the whole message.
+        virtual String * plainTextPreview(unsigned int maximumLength);
         
     public: // subclass behavior
         MessageParser(MessageParser * other);
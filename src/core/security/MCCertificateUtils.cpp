@@ -23,9 +23,181 @@
 #include <dirent.h>
 #endif
 
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
 #include "MCLog.h"
+#include "MCData.h"
+#include "MCHashMap.h"
+#include "MCValue.h"
+#include "MCUtils.h"
 
-bool mailcore::checkCertificate(mailstream * stream, String * hostname)
+using namespace mailcore;
+
+#if !__APPLE__
+// The system CA certificates are loaded once and shared by all the connections.
+// The store is not modified once built: a reload replaces it with a new one.
+static pthread_mutex_t s_trustStoreLock = PTHREAD_MUTEX_INITIALIZER;
+static X509_STORE * s_trustStore = NULL;
+static time_t s_trustStoreCAFileModificationDate = 0;
+static bool s_trustStoreNeedsReload = false;
+
+static time_t caFileModificationDate()
+{
+    const char * filename = getenv(X509_get_default_cert_file_env());
+    if (filename == NULL) {
+        filename = X509_get_default_cert_file();
+    }
+    struct stat statInfo;
+    if (stat(filename, &statInfo) < 0) {
+        return 0;
+    }
+    return statInfo.st_mtime;
+}
+
+static X509_STORE * createTrustStore()
+{
+    X509_STORE * store = NULL;
+#if defined(ANDROID) || defined(__ANDROID__)
+    DIR * dir = NULL;
+    struct dirent * ent = NULL;
+    FILE * f = NULL;
+#endif
+    int status;
+    
+    store = X509_STORE_new();
+    if (store == NULL) {
+        return NULL;
+    }
+    
+#ifdef _MSC_VER
+	HCERTSTORE systemStore = CertOpenSystemStore(NULL, L"ROOT");
+
+	PCCERT_CONTEXT previousCert = NULL;
+	while (1) {
+		PCCERT_CONTEXT nextCert = CertEnumCertificatesInStore(systemStore, previousCert);
+		if (nextCert == NULL) {
+			break;
+		}
+		X509 * openSSLCert = d2i_X509(NULL, (const unsigned char **)&nextCert->pbCertEncoded, nextCert->cbCertEncoded);
+		if (openSSLCert != NULL) {
+			X509_STORE_add_cert(store, openSSLCert);
+			X509_free(openSSLCert);
+		}
+		previousCert = nextCert;
+	}
+	CertCloseStore(systemStore, 0);
+#elif defined(ANDROID) || defined(__ANDROID__)
+    dir = opendir("/system/etc/security/cacerts");
+    while (ent = readdir(dir)) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "/system/etc/security/cacerts/%s", ent->d_name);
+        f = fopen(filename, "rb");
+        if (f != NULL) {
+            X509 * cert = PEM_read_X509(f, NULL, NULL, NULL);
+            if (cert != NULL) {
+                X509_STORE_add_cert(store, cert);
+                X509_free(cert);
+            }
+            fclose(f);
+        }
+    }
+    closedir(dir);
+#endif
+
+	status = X509_STORE_set_default_paths(store);
+    if (status != 1) {
+        printf("Error loading the system-wide CA certificates");
+    }
+    
+    return store;
+}
+
+static X509_STORE * retainedTrustStore()
+{
+    X509_STORE * store;
+    
+    pthread_mutex_lock(&s_trustStoreLock);
+    time_t modificationDate = caFileModificationDate();
+    if ((s_trustStore == NULL) || s_trustStoreNeedsReload || (modificationDate != s_trustStoreCAFileModificationDate)) {
+        store = createTrustStore();
+        if (store != NULL) {
+            if (s_trustStore != NULL) {
+                X509_STORE_free(s_trustStore);
+            }
+            s_trustStore = store;
+            s_trustStoreCAFileModificationDate = modificationDate;
+            s_trustStoreNeedsReload = false;
+        }
+    }
+    store = s_trustStore;
+    if (store != NULL) {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        X509_STORE_up_ref(store);
+#else
+        CRYPTO_add(&store->references, 1, CRYPTO_LOCK_X509_STORE);
+#endif
+    }
+    pthread_mutex_unlock(&s_trustStoreLock);
+    
+    return store;
+}
+#endif
+
+// Leaf certificates of the chains that have been verified, by hostname.
+#define VERIFIED_CERTIFICATE_TIMEOUT (60 * 60)
+
+static pthread_mutex_t s_verifiedCertificatesLock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_verifiedCertificatesCacheEnabled = false;
+static HashMap * s_verifiedCertificates = NULL;
+static HashMap * s_verifiedCertificatesDates = NULL;
+
+static void clearVerifiedCertificates()
+{
+    pthread_mutex_lock(&s_verifiedCertificatesLock);
+    MC_SAFE_RELEASE(s_verifiedCertificates);
+    MC_SAFE_RELEASE(s_verifiedCertificatesDates);
+    pthread_mutex_unlock(&s_verifiedCertificatesLock);
+}
+
+static bool isCertificateVerified(String * hostname, Data * leafCertificate)
+{
+    bool result = false;
+    
+    pthread_mutex_lock(&s_verifiedCertificatesLock);
+    if (s_verifiedCertificatesCacheEnabled && (s_verifiedCertificates != NULL)) {
+        Data * verifiedCertificate = (Data *) s_verifiedCertificates->objectForKey(hostname);
+        Value * date = (Value *) s_verifiedCertificatesDates->objectForKey(hostname);
+        if ((verifiedCertificate != NULL) && verifiedCertificate->isEqual(leafCertificate) &&
+            (time(NULL) - (time_t) date->longLongValue() < VERIFIED_CERTIFICATE_TIMEOUT)) {
+            result = true;
+        }
+    }
+    pthread_mutex_unlock(&s_verifiedCertificatesLock);
+    
+    return result;
+}
+
+static void setCertificateVerified(String * hostname, Data * leafCertificate)
+{
+    pthread_mutex_lock(&s_verifiedCertificatesLock);
+    if (s_verifiedCertificatesCacheEnabled) {
+        if (s_verifiedCertificates == NULL) {
+            s_verifiedCertificates = new HashMap();
+            s_verifiedCertificatesDates = new HashMap();
+        }
+        s_verifiedCertificates->setObjectForKey(hostname, leafCertificate);
+        s_verifiedCertificatesDates->setObjectForKey(hostname, Value::valueWithLongLongValue((long long) time(NULL)));
+    }
+    pthread_mutex_unlock(&s_verifiedCertificatesLock);
+}
+
+static bool checkCertificateChain(carray * cCerts, String * hostname)
 {
 #if __APPLE__
     bool result = false;
@@ -36,12 +208,6 @@ bool mailcore::checkCertificate(mailstream * stream, String * hostname)
     SecTrustResultType trustResult;
     OSStatus status;
     
-    carray * cCerts = mailstream_get_certificate_chain(stream);
-    if (cCerts == NULL) {
-        fprintf(stderr, "warning: No certificate chain retrieved");
-        goto err;
-    }
-    
     hostnameCFString = CFStringCreateWithCharacters(NULL, (const UniChar *) hostname->unicodeCharacters(),
                                                                 hostname->length());
     policy = SecPolicyCreateSSL(true, hostnameCFString);
@@ -91,77 +257,21 @@ bool mailcore::checkCertificate(mailstream * stream, String * hostname)
     CFRelease(trust);
 free_certs:
     CFRelease(certificates);
-    mailstream_certificate_chain_free(cCerts);
     CFRelease(policy);
     CFRelease(hostnameCFString);
-err:
     return result;
 #else
     bool result = false;
     X509_STORE * store = NULL;
     X509_STORE_CTX * storectx = NULL;
     STACK_OF(X509) * certificates = NULL;
-#if defined(ANDROID) || defined(__ANDROID__)
-    DIR * dir = NULL;
-    struct dirent * ent = NULL;
-    FILE * f = NULL;
-#endif
     int status;
     
-    carray * cCerts = mailstream_get_certificate_chain(stream);
-    if (cCerts == NULL) {
-        fprintf(stderr, "warning: No certificate chain retrieved");
-        goto err;
-    }
-    
-    store = X509_STORE_new();
+    store = retainedTrustStore();
     if (store == NULL) {
         goto free_certs;
     }
     
-#ifdef _MSC_VER
-	HCERTSTORE systemStore = CertOpenSystemStore(NULL, L"ROOT");
-
-	PCCERT_CONTEXT previousCert = NULL;
-	while (1) {
-		PCCERT_CONTEXT nextCert = CertEnumCertificatesInStore(systemStore, previousCert);
-		if (nextCert == NULL) {
-			break;
-		}
-		X509 * openSSLCert = d2i_X509(NULL, (const unsigned char **)&nextCert->pbCertEncoded, nextCert->cbCertEncoded);
-		if (openSSLCert != NULL) {
-			X509_STORE_add_cert(store, openSSLCert);
-			X509_free(openSSLCert);
-		}
-		previousCert = nextCert;
-	}
-	CertCloseStore(systemStore, 0);
-#elif defined(ANDROID) || defined(__ANDROID__)
-    dir = opendir("/system/etc/security/cacerts");
-    while (ent = readdir(dir)) {
-        if (ent->d_name[0] == '.') {
-            continue;
-        }
-        char filename[1024];
-        snprintf(filename, sizeof(filename), "/system/etc/security/cacerts/%s", ent->d_name);
-        f = fopen(filename, "rb");
-        if (f != NULL) {
-            X509 * cert = PEM_read_X509(f, NULL, NULL, NULL);
-            if (cert != NULL) {
-                X509_STORE_add_cert(store, cert);
-                X509_free(cert);
-            }
-            fclose(f);
-        }
-    }
-    closedir(dir);
-#endif
-
-	status = X509_STORE_set_default_paths(store);
-    if (status != 1) {
-        printf("Error loading the system-wide CA certificates");
-    }
-    
     certificates = sk_X509_new_null();
     for(unsigned int i = 0 ; i < carray_count(cCerts) ; i ++) {
         MMAPString * str;
@@ -193,7 +303,6 @@ err:
     }
     
 free_certs:
-    mailstream_certificate_chain_free(cCerts);
     if (certificates != NULL) {
         sk_X509_pop_free((STACK_OF(X509) *) certificates, X509_free);
     }
@@ -203,7 +312,68 @@ free_certs:
     if (store != NULL) {
         X509_STORE_free(store);
     }
-err:
     return result;
 #endif
 }
+
+bool mailcore::checkCertificate(mailstream * stream, String * hostname)
+{
+    carray * cCerts = mailstream_get_certificate_chain(stream);
+    if (cCerts == NULL) {
+        fprintf(stderr, "warning: No certificate chain retrieved");
+        return false;
+    }
+    
+    Data * leafCertificate = NULL;
+    String * key = NULL;
+    if ((hostname != NULL) && (carray_count(cCerts) > 0) && (carray_get(cCerts, 0) != NULL)) {
+        MMAPString * str = (MMAPString *) carray_get(cCerts, 0);
+        leafCertificate = new Data(str->str, (unsigned int) str->len);
+        key = (String *) hostname->lowercaseString()->retain();
+    }
+    
+    bool result;
+    if ((leafCertificate != NULL) && isCertificateVerified(key, leafCertificate)) {
+        result = true;
+    }
+    else {
+        result = checkCertificateChain(cCerts, hostname);
+        if (result && (leafCertificate != NULL)) {
+            setCertificateVerified(key, leafCertificate);
+        }
+    }
+    
+    mailstream_certificate_chain_free(cCerts);
+    MC_SAFE_RELEASE(leafCertificate);
+    MC_SAFE_RELEASE(key);
+    
+    return result;
+}
+
+void mailcore::reloadTrustedCertificates()
+{
+#if !__APPLE__
+    pthread_mutex_lock(&s_trustStoreLock);
+    s_trustStoreNeedsReload = true;
+    pthread_mutex_unlock(&s_trustStoreLock);
+#endif
+    clearVerifiedCertificates();
+}
+
+void mailcore::setVerifiedCertificatesCacheEnabled(bool enabled)
+{
+    pthread_mutex_lock(&s_verifiedCertificatesLock);
+    s_verifiedCertificatesCacheEnabled = enabled;
+    pthread_mutex_unlock(&s_verifiedCertificatesLock);
+    if (!enabled) {
+        clearVerifiedCertificates();
+    }
+}
+
+bool mailcore::isVerifiedCertificatesCacheEnabled()
+{
+    pthread_mutex_lock(&s_verifiedCertificatesLock);
+    bool enabled = s_verifiedCertificatesCacheEnabled;
+    pthread_mutex_unlock(&s_verifiedCertificatesLock);
+    return enabled;
+}
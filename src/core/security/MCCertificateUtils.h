@@ -17,6 +17,15 @@ namespace mailcore {
     
     bool checkCertificate(mailstream * stream, String * hostname);
     
+    // The system CA certificates are loaded once and reloaded when the CA bundle file changes.
+    // Forces them to be loaded again on the next check and forgets the verified certificates.
+    void reloadTrustedCertificates();
+    
+    // When enabled, a hostname that presents the same leaf certificate as in a chain verified
+    // during the last hour is trusted without verifying the chain again. Disabled by default.
+    void setVerifiedCertificatesCacheEnabled(bool enabled);
+    bool isVerifiedCertificatesCacheEnabled();
+    
 }
 
 #endif
@@ -4,5 +4,6 @@
 
 #include <MailCore/MCSMTPProgressCallback.h>
 #include <MailCore/MCSMTPSession.h>
+#include <MailCore/MCSMTPBatchMessage.h>
 
 #endif
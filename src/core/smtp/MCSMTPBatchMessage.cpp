@@ -0,0 +1,63 @@
+//
+//  MCSMTPBatchMessage.cpp
+//  mailcore2
+//
+
+#include "MCSMTPBatchMessage.h"
+
+#include "MCAddress.h"
+
+using namespace mailcore;
+
+SMTPBatchMessage::SMTPBatchMessage()
+{
+    mFrom = NULL;
+    mRecipients = NULL;
+    mMessageData = NULL;
+}
+
+SMTPBatchMessage::~SMTPBatchMessage()
+{
+    MC_SAFE_RELEASE(mFrom);
+    MC_SAFE_RELEASE(mRecipients);
+    MC_SAFE_RELEASE(mMessageData);
+}
+
+SMTPBatchMessage * SMTPBatchMessage::messageWithData(Address * from, Array * recipients, Data * messageData)
+{
+    SMTPBatchMessage * message = new SMTPBatchMessage();
+    message->setFrom(from);
+    message->setRecipients(recipients);
+    message->setMessageData(messageData);
+    return (SMTPBatchMessage *) message->autorelease();
+}
+
+void SMTPBatchMessage::setFrom(Address * from)
+{
+    MC_SAFE_REPLACE_COPY(Address, mFrom, from);
+}
+
+Address * SMTPBatchMessage::from()
+{
+    return mFrom;
+}
+
+void SMTPBatchMessage::setRecipients(Array * recipients)
+{
+    MC_SAFE_REPLACE_COPY(Array, mRecipients, recipients);
+}
+
+Array * SMTPBatchMessage::recipients()
+{
+    return mRecipients;
+}
+
+void SMTPBatchMessage::setMessageData(Data * messageData)
+{
+    MC_SAFE_REPLACE_RETAIN(Data, mMessageData, messageData);
+}
+
+Data * SMTPBatchMessage::messageData()
+{
+    return mMessageData;
+}
@@ -0,0 +1,45 @@
+//
+//  MCSMTPBatchMessage.h
+//  mailcore2
+//
+
+#ifndef MAILCORE_MCSMTPBATCHMESSAGE_H
+
+#define MAILCORE_MCSMTPBATCHMESSAGE_H
+
+#include <MailCore/MCBaseTypes.h>
+
+#ifdef __cplusplus
+
+namespace mailcore {
+    
+    class Address;
+    
+    // A message to send with SMTPSession::sendMessages().
+    class MAILCORE_EXPORT SMTPBatchMessage : public Object {
+    public:
+        SMTPBatchMessage();
+        virtual ~SMTPBatchMessage();
+        
+        static SMTPBatchMessage * messageWithData(Address * from, Array * /* Address */ recipients, Data * messageData);
+        
+        virtual void setFrom(Address * from);
+        virtual Address * from();
+        
+        virtual void setRecipients(Array * /* Address */ recipients);
+        virtual Array * /* Address */ recipients();
+        
+        virtual void setMessageData(Data * messageData);
+        virtual Data * messageData();
+        
+    private:
+        Address * mFrom;
+        Array * mRecipients;
+        Data * mMessageData;
+    };
+    
+}
+
+#endif
+
+#endif
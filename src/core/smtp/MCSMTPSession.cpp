@@ -10,6 +10,7 @@
 #include "MCMessageParser.h"
 #include "MCMessageHeader.h"
 #include "MCSMTPProgressCallback.h"
+#include "MCSMTPBatchMessage.h"
 #include "MCConnectionLoggerUtils.h"
 #include "MCCertificateUtils.h"
 
@@ -33,7 +34,9 @@ void SMTPSession::init()
     mTimeout = 30;
     mCheckCertificateEnabled = true;
     mUseHeloIPEnabled = false;
+    mKeepAliveEnabled = false;
     mShouldDisconnect = false;
+    mNeedsReset = false;
     
     mSmtp = NULL;
     mProgressCallback = NULL;
@@ -165,6 +168,16 @@ bool SMTPSession::useHeloIPEnabled()
     return mUseHeloIPEnabled;
 }
 
+void SMTPSession::setKeepAliveEnabled(bool enabled)
+{
+    mKeepAliveEnabled = enabled;
+}
+
+bool SMTPSession::isKeepAliveEnabled()
+{
+    return mKeepAliveEnabled;
+}
+
 void SMTPSession::body_progress(size_t current, size_t maximum, void * context)
 {
     SMTPSession * session;
@@ -211,6 +224,7 @@ void SMTPSession::setup()
     mailsmtp_set_timeout(mSmtp, timeout());
     mailsmtp_set_progress_callback(mSmtp, body_progress, this);
     mailsmtp_set_logger(mSmtp, logger, this);
+    mNeedsReset = false;
 }
 
 void SMTPSession::unsetup()
@@ -564,6 +578,11 @@ void SMTPSession::checkAccount(Address * from, ErrorCode * pError)
     if (* pError != ErrorNone) {
         return;
     }
+    resetIfNeeded(pError);
+    if (* pError != ErrorNone) {
+        return;
+    }
+    mNeedsReset = true;
     r = mailsmtp_mail(mSmtp, MCUTF8(from->mailbox()));
     if (r == MAILSMTP_ERROR_STREAM) {
         * pError = ErrorConnection;
@@ -589,8 +608,63 @@ void SMTPSession::checkAccount(Address * from, ErrorCode * pError)
     * pError = ErrorNone;
 }
 
+void SMTPSession::resetIfNeeded(ErrorCode * pError)
+{
+    int r;
+    
+    if (!mNeedsReset) {
+        * pError = ErrorNone;
+        return;
+    }
+    
+    mNeedsReset = false;
+    r = mailsmtp_reset(mSmtp);
+    if (r == MAILSMTP_NO_ERROR) {
+        * pError = ErrorNone;
+        return;
+    }
+    
+    // The server might have closed the connection while it was idle.
+    mShouldDisconnect = true;
+    loginIfNeeded(pError);
+}
+
 void SMTPSession::sendMessage(Address * from, Array * recipients, Data * messageData,
     SMTPProgressCallback * callback, ErrorCode * pError)
+{
+    internalSendMessage(from, recipients, messageData, callback, mKeepAliveEnabled, pError);
+}
+
+Array * SMTPSession::sendMessages(Array * messages, SMTPProgressCallback * callback, ErrorCode * pError)
+{
+    Array * result = Array::array();
+    
+    * pError = ErrorNone;
+    mc_foreacharray(SMTPBatchMessage, message, messages) {
+        ErrorCode error = * pError;
+        if (error == ErrorNone) {
+            AutoreleasePool * pool = new AutoreleasePool();
+            internalSendMessage(message->from(), message->recipients(), message->messageData(),
+                                callback, true, &error);
+            pool->release();
+            // Connection or authentication failure. After a connection error, the state is still
+            // STATE_LOGGEDIN but the connection can't be used anymore.
+            if ((error != ErrorNone) && ((mState != STATE_LOGGEDIN) || mShouldDisconnect)) {
+                * pError = error;
+            }
+        }
+        result->addObject(Value::valueWithIntValue(error));
+    }
+    
+    if (!mKeepAliveEnabled) {
+        disconnect();
+    }
+    
+    return result;
+}
+
+void SMTPSession::internalSendMessage(Address * from, Array * recipients, Data * messageData,
+    SMTPProgressCallback * callback, bool keepAlive, ErrorCode * pError)
 {
     clist * address_list;
     int r;
@@ -616,6 +690,13 @@ void SMTPSession::sendMessage(Address * from, Array * recipients, Data * message
     if (* pError != ErrorNone) {
         goto err;
     }
+    
+    if (keepAlive) {
+        resetIfNeeded(pError);
+        if (* pError != ErrorNone) {
+            goto err;
+        }
+    }
 
     // disable DSN feature for more compatibility
     mSmtp->esmtp &= ~MAILSMTP_ESMTP_DSN;
@@ -626,7 +707,13 @@ void SMTPSession::sendMessage(Address * from, Array * recipients, Data * message
         esmtp_address_list_add(address_list, (char *) MCUTF8(addr->mailbox()), 0, NULL);
     }
     MCLog("send");
-    if ((mSmtp->esmtp & MAILSMTP_ESMTP_PIPELINING) != 0) {
+    if (keepAlive) {
+        r = mailesmtp_send(mSmtp, MCUTF8(from->mailbox()), 0, NULL,
+            address_list,
+            messageData->bytes(), messageData->length());
+        mNeedsReset = true;
+    }
+    else if ((mSmtp->esmtp & MAILSMTP_ESMTP_PIPELINING) != 0) {
         r = mailesmtp_send_quit(mSmtp, MCUTF8(from->mailbox()), 0, NULL,
             address_list,
             messageData->bytes(), messageData->length());
@@ -50,6 +50,11 @@ namespace mailcore {
         virtual void setUseHeloIPEnabled(bool enabled);
         virtual bool useHeloIPEnabled();
         
+        // When enabled, the connection stays open after a message is sent and is reused
+        // for the next one, with a RSET between transactions. Default is false.
+        virtual void setKeepAliveEnabled(bool enabled);
+        virtual bool isKeepAliveEnabled();
+        
         virtual void connect(ErrorCode * pError);
         virtual void disconnect();
         
@@ -61,6 +66,12 @@ namespace mailcore {
         virtual void sendMessage(Address * from, Array * /* Address */ recipients, Data * messageData,
                                  SMTPProgressCallback * callback, ErrorCode * pError);
         
+        // Sends all the messages over the same connection. Returns the error code of each message
+        // as a Value. pError is set when the connection or the authentication fails: the remaining
+        // messages are then not sent and get the same error code.
+        virtual Array * /* Value */ sendMessages(Array * /* SMTPBatchMessage */ messages,
+                                                 SMTPProgressCallback * callback, ErrorCode * pError);
+        
         virtual void setConnectionLogger(ConnectionLogger * logger);
         virtual ConnectionLogger * connectionLogger();
         
@@ -77,7 +88,9 @@ namespace mailcore {
         time_t mTimeout;
         bool mCheckCertificateEnabled;
         bool mUseHeloIPEnabled;
+        bool mKeepAliveEnabled;
         bool mShouldDisconnect;
+        bool mNeedsReset;
         
         mailsmtp * mSmtp;
         SMTPProgressCallback * mProgressCallback;
@@ -98,6 +111,9 @@ namespace mailcore {
         bool checkCertificate();
         
         void sendMessage(MessageBuilder * msg, SMTPProgressCallback * callback, ErrorCode * pError);
+        void internalSendMessage(Address * from, Array * recipients, Data * messageData,
+                                 SMTPProgressCallback * callback, bool keepAlive, ErrorCode * pError);
+        void resetIfNeeded(ErrorCode * pError);
         
     public: // private
         virtual bool isDisconnected();
@@ -110,6 +110,24 @@
 */
 @property (nonatomic, assign) unsigned int maximumConnections;
 
+/**
+ When not zero, fetching messages by UID will use several FETCH commands
+ covering at most fetchChunkSize messages each. Default is 0.
+*/
+@property (nonatomic, assign) unsigned int fetchChunkSize;
+
+/**
+ When fetchChunkSize is set, number of FETCH commands sent before waiting
+ for the response of the first one. Default is 1.
+*/
+@property (nonatomic, assign) unsigned int fetchPipelineDepth;
+
+/**
+ When set to YES, an idle connection takes the next operation waiting on a busy connection
+ if it has the same folder selected. It requires allowsFolderConcurrentAccessEnabled.
+*/
+@property (nonatomic, assign, getter=isWorkStealingEnabled) BOOL workStealingEnabled;
+
 /**
  Sets logger callback. The network traffic will be sent to this block.
 
@@ -154,6 +172,13 @@
  */
 - (void) cancelAllOperations;
 
+/**
+ Returns one dictionary per connection with the queue depth and wait time metrics:
+ queueDepth, maxQueueDepth, startedOperationsCount, stolenOperationsCount, totalWaitTime,
+ maxWaitTime (in seconds) and lastFolder.
+ */
+- (NSArray *) connectionsMetrics;
+
 /** @name Folder Operations */
 
 /**
@@ -105,6 +105,9 @@ MCO_OBJC_SYNTHESIZE_BOOL(setCheckCertificateEnabled, isCheckCertificateEnabled)
 MCO_OBJC_SYNTHESIZE_BOOL(setVoIPEnabled, isVoIPEnabled)
 MCO_OBJC_SYNTHESIZE_SCALAR(BOOL, BOOL, setAllowsFolderConcurrentAccessEnabled, allowsFolderConcurrentAccessEnabled)
 MCO_OBJC_SYNTHESIZE_SCALAR(unsigned int, unsigned int, setMaximumConnections, maximumConnections)
+MCO_OBJC_SYNTHESIZE_SCALAR(unsigned int, unsigned int, setFetchChunkSize, fetchChunkSize)
+MCO_OBJC_SYNTHESIZE_SCALAR(unsigned int, unsigned int, setFetchPipelineDepth, fetchPipelineDepth)
+MCO_OBJC_SYNTHESIZE_BOOL(setWorkStealingEnabled, isWorkStealingEnabled)
 MCO_OBJC_SYNTHESIZE_SCALAR(dispatch_queue_t, dispatch_queue_t, setDispatchQueue, dispatchQueue);
 
 - (void) setDefaultNamespace:(MCOIMAPNamespace *)defaultNamespace
@@ -173,6 +176,11 @@ MCO_OBJC_SYNTHESIZE_SCALAR(dispatch_queue_t, dispatch_queue_t, setDispatchQueue,
     MCO_NATIVE_INSTANCE->cancelAllOperations();
 }
 
+- (NSArray *) connectionsMetrics
+{
+    return MCO_TO_OBJC(MCO_NATIVE_INSTANCE->connectionsMetrics());
+}
+
 #pragma mark - Operations
 
 #define MCO_TO_OBJC_OP(op) [self _objcOperationFromNativeOp:op];
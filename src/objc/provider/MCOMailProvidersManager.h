@@ -29,6 +29,13 @@
 */
 - (MCOMailProvider *) providerForEmail:(NSString *)email;
 
+/**
+    Given a list of email addresses will try to determine the provider of each of them.
+    Addresses of the same domain are looked up once.
+    @return An array with the email provider info of each address, or NSNull if it can't be determined.
+*/
+- (NSArray * /* MCOMailProvider or NSNull */) providersForEmails:(NSArray * /* NSString */)emails;
+
 /** 
     Given the DNS MX record will try to determine the provider
     @return The email provider info or nil if it can't be determined.
@@ -8,6 +8,7 @@
 
 #import "MCOMailProvidersManager.h"
 #include "MCMailProvidersManager.h"
+#include "MCMailProvider.h"
 #import "MCOMailProvider.h"
 
 #import "NSString+MCO.h"
@@ -46,6 +47,21 @@
     return MCO_TO_OBJC(provider);
 }
 
+- (NSArray *) providersForEmails:(NSArray *)emails
+{
+    mailcore::Array * providers = mailcore::MailProvidersManager::sharedManager()->providersForEmails(MCO_FROM_OBJC(mailcore::Array, emails));
+    NSMutableArray * result = [NSMutableArray array];
+    mc_foreacharray(mailcore::Object, provider, providers) {
+        if (MCISKINDOFCLASS(provider, mailcore::MailProvider)) {
+            [result addObject:MCO_TO_OBJC(provider)];
+        }
+        else {
+            [result addObject:[NSNull null]];
+        }
+    }
+    return result;
+}
+
 - (MCOMailProvider *) providerForMX:(NSString *)hostname
 {
     mailcore::MailProvider *provider = mailcore::MailProvidersManager::sharedManager()->providerForMX(hostname.mco_mcString);
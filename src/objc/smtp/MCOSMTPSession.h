@@ -67,6 +67,12 @@
 */
 @property (nonatomic, assign, getter=isUseHeloIPEnabled) BOOL useHeloIPEnabled;
 
+/**
+ If set to YES, the connection is kept open after a message is sent and reused for the next one.
+ Default is NO.
+*/
+@property (nonatomic, assign, getter=isKeepAliveEnabled) BOOL keepAliveEnabled;
+
 /**
  Sets logger callback. The network traffic will be sent to this block.
  
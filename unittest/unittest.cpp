@@ -2,9 +2,17 @@
 #include <dirent.h>
 #include <math.h>
 #include <time.h>
+#include <libetpan/libetpan.h>
 
 using namespace mailcore;
 
+// Declared in MCLibetpan.h, which is not a public header.
+namespace mailcore {
+    time_t mkgmtime(struct tm * tmp);
+    time_t timestampFromIMAPDate(struct mailimap_date_time * date_time);
+    void timestampsFromIMAPDates(struct mailimap_date_time * dates, unsigned int count, time_t * timestamps);
+}
+
 static int global_failure = 0;
 static int global_success = 0;
 
@@ -333,6 +341,283 @@ static void testMUTF7(void)
     global_success ++;
 }
 
+static int tmcomp(struct tm * atmp, struct tm * btmp)
+{
+    int result;
+    
+    if ((result = (atmp->tm_year - btmp->tm_year)) == 0 &&
+        (result = (atmp->tm_mon - btmp->tm_mon)) == 0 &&
+        (result = (atmp->tm_mday - btmp->tm_mday)) == 0 &&
+        (result = (atmp->tm_hour - btmp->tm_hour)) == 0 &&
+        (result = (atmp->tm_min - btmp->tm_min)) == 0)
+        result = atmp->tm_sec - btmp->tm_sec;
+    return result;
+}
+
+// Former implementation of mkgmtime(), bisecting over time_t.
+static time_t referenceMkgmtime(struct tm * tmp)
+{
+    int dir;
+    int bits;
+    int saved_seconds;
+    time_t t;
+    struct tm yourtm, mytm;
+    
+    yourtm = *tmp;
+    saved_seconds = yourtm.tm_sec;
+    yourtm.tm_sec = 0;
+    for (bits = 0, t = 1; t > 0; ++bits, t <<= 1)
+        ;
+    if(bits > 40) bits = 40;
+    t = (t < 0) ? 0 : ((time_t) 1 << bits);
+    for ( ; ; ) {
+        gmtime_r(&t, &mytm);
+        dir = tmcomp(&mytm, &yourtm);
+        if (dir != 0) {
+            if (bits-- < 0) {
+                return -1;
+            }
+            if (bits < 0)
+                --t;
+            else if (dir > 0)
+                t -= (time_t) 1 << bits;
+            else    t += (time_t) 1 << bits;
+            continue;
+        }
+        break;
+    }
+    t += saved_seconds;
+    return t;
+}
+
+static bool checkMkgmtime(struct tm * aTm)
+{
+    time_t expected = referenceMkgmtime(aTm);
+    time_t value = mkgmtime(aTm);
+    if (value != expected) {
+        fprintf(stderr, "mkgmtime(%i-%i-%i %i:%i:%i): %lld, expected %lld\n",
+                aTm->tm_year + 1900, aTm->tm_mon + 1, aTm->tm_mday, aTm->tm_hour, aTm->tm_min, aTm->tm_sec,
+                (long long) value, (long long) expected);
+        return false;
+    }
+    return true;
+}
+
+static void testMkgmtime(void)
+{
+    int failure = 0;
+    int success = 0;
+    
+    // Every day from 1800 to 2200, at a time that changes from day to day.
+    for(int year = 1800 ; year <= 2200 ; year ++) {
+        for(int month = 0 ; month < 12 ; month ++) {
+            for(int day = 1 ; day <= 31 ; day ++) {
+                struct tm aTm;
+                memset(&aTm, 0, sizeof(aTm));
+                aTm.tm_year = year - 1900;
+                aTm.tm_mon = month;
+                aTm.tm_mday = day;
+                aTm.tm_hour = (year + day) % 24;
+                aTm.tm_min = (year * 7 + day) % 60;
+                aTm.tm_sec = (month * 13 + day) % 61;
+                if (checkMkgmtime(&aTm)) {
+                    success ++;
+                }
+                else {
+                    failure ++;
+                }
+            }
+        }
+    }
+    
+    // Invalid fields and out of range dates.
+    const int invalidFields[][6] = {
+        { 2015, 1, 29, 12, 0, 0 },
+        { 2016, 1, 30, 12, 0, 0 },
+        { 1900, 1, 29, 12, 0, 0 },
+        { 2015, 3, 31, 12, 0, 0 },
+        { 2015, 12, 1, 12, 0, 0 },
+        { 2015, -1, 1, 12, 0, 0 },
+        { 2015, 0, 0, 12, 0, 0 },
+        { 2015, 0, 1, 24, 0, 0 },
+        { 2015, 0, 1, -1, 0, 0 },
+        { 2015, 0, 1, 12, 60, 0 },
+        { 2015, 0, 1, 12, 0, 75 },
+        { 2015, 0, 1, 12, 0, -10 },
+        { -50000, 0, 1, 0, 0, 0 },
+        { 50000, 0, 1, 0, 0, 0 },
+    };
+    for(unsigned int i = 0 ; i < sizeof(invalidFields) / sizeof(invalidFields[0]) ; i ++) {
+        struct tm aTm;
+        memset(&aTm, 0, sizeof(aTm));
+        aTm.tm_year = invalidFields[i][0] - 1900;
+        aTm.tm_mon = invalidFields[i][1];
+        aTm.tm_mday = invalidFields[i][2];
+        aTm.tm_hour = invalidFields[i][3];
+        aTm.tm_min = invalidFields[i][4];
+        aTm.tm_sec = invalidFields[i][5];
+        if (checkMkgmtime(&aTm)) {
+            success ++;
+        }
+        else {
+            failure ++;
+        }
+    }
+    
+    // Sparse dates over the whole range, including its limits.
+    for(time_t t = -((time_t) 1 << 40) - 86400 * 400 ; t < ((time_t) 1 << 40) + 86400 * 400 ; t += 86400 * 397 + 3607) {
+        struct tm aTm;
+        gmtime_r(&t, &aTm);
+        if (checkMkgmtime(&aTm)) {
+            success ++;
+        }
+        else {
+            failure ++;
+        }
+    }
+    
+    // The batch conversion gives the same results as the conversion of a single date.
+    struct mailimap_date_time dates[1000];
+    time_t timestamps[1000];
+    for(int i = 0 ; i < 1000 ; i ++) {
+        dates[i].dt_year = (i % 7 == 0) ? 15 : 1990 + i / 40;
+        dates[i].dt_month = 1 + (i / 3) % 12;
+        dates[i].dt_day = 1 + (i * 11) % 31;
+        dates[i].dt_hour = (i * 5) % 24;
+        dates[i].dt_min = (i * 7) % 60;
+        dates[i].dt_sec = (i * 3) % 60;
+        dates[i].dt_zone = (i % 2 == 0) ? -(i % 12) * 100 - 30 : (i % 14) * 100;
+    }
+    timestampsFromIMAPDates(dates, 1000, timestamps);
+    for(int i = 0 ; i < 1000 ; i ++) {
+        if (timestamps[i] != timestampFromIMAPDate(&dates[i])) {
+            failure ++;
+        }
+        else {
+            success ++;
+        }
+    }
+    
+    if (failure > 0) {
+        printf("testMkgmtime ok: %i succeeded, %i failed\n", success, failure);
+        global_failure ++;
+        return;
+    }
+    printf("testMkgmtime ok: %i succeeded\n", success);
+    global_success ++;
+}
+
+static int deallocatedBytesCount = 0;
+
+static void countingDeallocator(char * bytes)
+{
+    deallocatedBytesCount ++;
+    free(bytes);
+}
+
+// Encodes with line breaks, as in a MIME part.
+static Data * base64Content(Data * data)
+{
+    const char * encoded = data->base64String()->UTF8Characters();
+    Data * result = Data::data();
+    size_t length = strlen(encoded);
+    for(size_t i = 0 ; i < length ; i += 76) {
+        result->appendBytes(encoded + i, (unsigned int) (length - i < 76 ? length - i : 76));
+        result->appendBytes("\r\n", 2);
+    }
+    return result;
+}
+
+static Data * quotedPrintableContent(Data * data)
+{
+    Data * result = Data::data();
+    unsigned int lineLength = 0;
+    for(unsigned int i = 0 ; i < data->length() ; i ++) {
+        unsigned char ch = (unsigned char) data->bytes()[i];
+        char buffer[4];
+        if ((ch == '=') || (ch < 32) || (ch > 126)) {
+            snprintf(buffer, sizeof(buffer), "=%02X", ch);
+        }
+        else {
+            snprintf(buffer, sizeof(buffer), "%c", ch);
+        }
+        if (lineLength + strlen(buffer) > 75) {
+            // Soft line break, alternating between CRLF and LF.
+            result->appendBytes(i % 2 == 0 ? "=\r\n" : "=\n", i % 2 == 0 ? 3 : 2);
+            lineLength = 0;
+        }
+        result->appendBytes(buffer, (unsigned int) strlen(buffer));
+        lineLength += (unsigned int) strlen(buffer);
+    }
+    return result;
+}
+
+static void testDecodedData(void)
+{
+    int failure = 0;
+    int success = 0;
+    
+    for(unsigned int length = 0 ; length < 300 ; length += 7) {
+        Data * original = Data::data();
+        for(unsigned int i = 0 ; i < length ; i ++) {
+            char ch = (char) ((i * 131 + length) % 256);
+            original->appendBytes(&ch, 1);
+        }
+        
+        if (base64Content(original)->decodedDataUsingEncoding(EncodingBase64)->isEqual(original)) {
+            success ++;
+        }
+        else {
+            failure ++;
+        }
+        if (quotedPrintableContent(original)->decodedDataUsingEncoding(EncodingQuotedPrintable)->isEqual(original)) {
+            success ++;
+        }
+        else {
+            failure ++;
+        }
+    }
+    
+    // Invalid escapes are kept as is.
+    const char * invalid = "a=ZZb=4";
+    Data * decoded = Data::dataWithBytes(invalid, (unsigned int) strlen(invalid))->decodedDataUsingEncoding(EncodingQuotedPrintable);
+    if ((decoded->length() == strlen(invalid)) && (memcmp(decoded->bytes(), invalid, strlen(invalid)) == 0)) {
+        success ++;
+    }
+    else {
+        failure ++;
+    }
+    
+    // Bytes owned by a deallocator are copied before being modified, and freed once.
+    deallocatedBytesCount = 0;
+    char * bytes = (char *) malloc(5);
+    memcpy(bytes, "hello", 5);
+    Data * data = new Data();
+    data->takeBytesOwnership(bytes, 5, countingDeallocator);
+    data->appendBytes(" world", 6);
+    if ((deallocatedBytesCount == 1) && (data->length() == 11) && (memcmp(data->bytes(), "hello world", 11) == 0)) {
+        success ++;
+    }
+    else {
+        failure ++;
+    }
+    data->release();
+    if (deallocatedBytesCount == 1) {
+        success ++;
+    }
+    else {
+        failure ++;
+    }
+    
+    if (failure > 0) {
+        printf("testDecodedData ok: %i succeeded, %i failed\n", success, failure);
+        global_failure ++;
+        return;
+    }
+    printf("testDecodedData ok: %i succeeded\n", success);
+    global_success ++;
+}
+
 int main(int argc, char ** argv)
 {
     tzset();
@@ -355,6 +640,8 @@ int main(int argc, char ** argv)
     testCharsetDetection(path->stringByAppendingPathComponent(MCSTR("charset-detection")));
     testSummary(path->stringByAppendingPathComponent(MCSTR("summary")));
     testMUTF7();
+    testMkgmtime();
+    testDecodedData();
 
     printf("%i tests succeeded, %i tests failed\n", global_success, global_failure);
 